@@ -1,11 +1,3 @@
-struct DecalTile {
-	uint indices[ 50 ]; // TODO: 50 should be a define/const
-};
-
-layout( std430 ) readonly buffer b_DecalTiles {
-	DecalTile decal_tiles[];
-};
-
 struct Decal {
 	vec3 origin_normal;
 	float radius_angle;
@@ -32,7 +24,7 @@ void OrthonormalBasis( vec3 v, out vec3 tangent, out vec3 bitangent ) {
 	bitangent = vec3( b, s + v.y * v.y * a, -v.y );
 }
 
-void applyDecals( uint count, int tile_index, inout vec4 diffuse, inout vec3 normal ) {
+void applyDecals( uint first_index, uint count, inout vec4 diffuse, inout vec3 normal ) {
 	float accumulated_alpha = 1.0;
 	vec3 accumulated_color = vec3( 0.0 );
 	float accumulated_height = 0.0;
@@ -43,7 +35,7 @@ void applyDecals( uint count, int tile_index, inout vec4 diffuse, inout vec3 nor
 			break;
 		}
 
-		Decal decal = decals[ decal_tiles[ tile_index ].indices[ i ] ];
+		Decal decal = decals[ dynamic_indices[ first_index + i ] ];
 
 		vec3 origin = floor( decal.origin_normal );
 		float radius = floor( decal.radius_angle );
@@ -1,11 +1,3 @@
-struct DynamicLightTile {
-	uint indices[ 50 ]; // NOTE(msc): 50 = MAX_DLIGHTS_PER_TILE
-};
-
-layout( std430 ) readonly buffer b_DynamicLightTiles {
-	DynamicLightTile dlight_tiles[];
-};
-
 struct DynamicLight {
 	vec3 origin_color;
 	float radius;
@@ -15,9 +7,9 @@ layout( std430 ) readonly buffer b_DynamicLights {
 	DynamicLight dlights[];
 };
 
-void applyDynamicLights( uint count, int tile_index, vec3 position, vec3 normal, vec3 viewDir, inout vec3 lambertlight, inout vec3 specularlight ) {
+void applyDynamicLights( uint first_index, uint count, vec3 position, vec3 normal, vec3 viewDir, inout vec3 lambertlight, inout vec3 specularlight ) {
 	for( uint i = 0; i < count; i++ ) {
-		DynamicLight dlight = dlights[ dlight_tiles[ tile_index ].indices[ i ] ];
+		DynamicLight dlight = dlights[ dynamic_indices[ first_index + i ] ];
 
 		vec3 origin = floor( dlight.origin_color.xyz );
 		vec3 dlight_color = fract( dlight.origin_color.xyz ) / 0.9;
@@ -93,13 +93,18 @@ uniform sampler2D u_DepthTexture;
 #endif
 
 #if APPLY_DECALS || APPLY_DLIGHTS
-struct DynamicTile {
-	uint num_decals;
-	uint num_dlights;
+struct DynamicCluster {
+	uint first_index;
+	uint counts; // num_decals | ( num_dlights << 16 )
 };
 
-layout( std430 ) readonly buffer b_DynamicTiles {
-	DynamicTile dynamic_tiles[];
+layout( std430 ) readonly buffer b_DynamicClusters {
+	DynamicCluster dynamic_clusters[];
+};
+
+// each cluster's decals followed by its dlights
+layout( std430 ) readonly buffer b_DynamicIndices {
+	uint dynamic_indices[];
 };
 #endif
 
@@ -153,11 +158,19 @@ void main() {
 	int tile_col = int( gl_FragCoord.x / tile_size );
 	int cols = int( u_ViewportSize.x + tile_size - 1 ) / int( tile_size );
 	int tile_index = tile_row * cols + tile_col;
-	DynamicTile dynamic_tile = dynamic_tiles[ tile_index ];
+
+	// gl_FragCoord.w is 1 / view space depth. must match DepthSlice in cg_dynamics.cpp
+	float view_depth = 1.0 / gl_FragCoord.w;
+	float slice_scale = float( CLUSTER_DEPTH_SLICES ) / log2( float( CLUSTER_FAR_PLANE ) / u_NearClip );
+	int slice = clamp( int( log2( view_depth / u_NearClip ) * slice_scale ), 0, CLUSTER_DEPTH_SLICES - 1 );
+
+	DynamicCluster cluster = dynamic_clusters[ tile_index * CLUSTER_DEPTH_SLICES + slice ];
+	uint num_decals = cluster.counts & 0xFFFFu;
+	uint num_dlights = cluster.counts >> 16;
 #endif
 
 #if APPLY_DECALS
-	applyDecals( dynamic_tile.num_decals, tile_index, diffuse, normal );
+	applyDecals( cluster.first_index, num_decals, diffuse, normal );
 #endif
 
 #if SHADED
@@ -176,7 +189,7 @@ void main() {
 	shadowlight = shadowlight * 0.5 + 0.5;
 
 #if APPLY_DLIGHTS
-	applyDynamicLights( dynamic_tile.num_dlights, tile_index, v_Position, normal, viewDir, lambertlight, specularlight );
+	applyDynamicLights( cluster.first_index + num_decals, num_dlights, v_Position, normal, viewDir, lambertlight, specularlight );
 #endif
 	lambertlight = lambertlight * 0.5 + 0.5;
 
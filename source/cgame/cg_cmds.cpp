@@ -200,7 +200,7 @@ static void CG_SC_DownloadDemo() {
 		return;
 	}
 
-	CL_DownloadFile( filename, []( const char * filename, Span< const u8 > data ) {
+	CL_DownloadFile( filename, []( const char * filename, Span< const u8 > data, u32 checksum ) {
 		if( data.ptr == NULL )
 			return;
 
@@ -392,6 +392,8 @@ static const cgcmd_t cgcmds[] = {
 	{ "weapprev", CG_Cmd_PrevWeapon_f, false },
 	{ "weapon", CG_Cmd_Weapon_f, false },
 	{ "viewpos", CG_Viewpos_f, true },
+	{ "animbench", CG_AnimationBenchmark_f, true },
+	{ "particlebench", CG_ParticleBenchmark_f, true },
 };
 
 void CG_RegisterCGameCommands() {
@@ -1,15 +1,14 @@
 #include "qcommon/base.h"
 #include "qcommon/qcommon.h"
-#include "qcommon/span2d.h"
 #include "cgame/cg_local.h"
 #include "client/renderer/renderer.h"
 #include "qcommon/array.h"
+#include "client/threadpool.h"
 
-static GPUBuffer decal_tiles_buffer;
 static GPUBuffer decals_buffer;
-static GPUBuffer dlight_tiles_buffer;
 static GPUBuffer dlights_buffer;
-static GPUBuffer dynamic_count;
+static GPUBuffer clusters_buffer;
+static GPUBuffer cluster_indices_buffer;
 
 static u32 last_viewport_width, last_viewport_height;
 
@@ -48,12 +47,10 @@ STATIC_ASSERT( sizeof( DynamicLight ) == 1 * 4 * sizeof( float ) );
 STATIC_ASSERT( sizeof( DynamicLight ) % alignof( DynamicLight ) == 0 );
 
 static constexpr u32 MAX_DECALS = 100000;
-static constexpr u32 MAX_DECALS_PER_TILE = 50;
-
 static constexpr u32 MAX_DLIGHTS = 100000;
-static constexpr u32 MAX_DLIGHTS_PER_TILE = 50;
 
-static constexpr u32 MAX_DYNAMICS_PER_SET = 500;
+// shared between all the clusters, each tile row gets an equal share
+static constexpr u32 MAX_CLUSTER_INDICES = 1 << 18;
 
 static Decal decals[ MAX_DECALS ];
 static u32 num_decals;
@@ -67,23 +64,16 @@ static u32 num_persistent_decals;
 static PersistentDynamicLight persistent_dlights[ MAX_DLIGHTS ];
 static u32 num_persistent_dlights;
 
-struct DecalTile {
-	u32 decals[ MAX_DECALS_PER_TILE ];
+// gets copied directly to GPU so packing order is important
+struct DynamicCluster {
+	u32 first_index; // into the cluster indices, decals come first then dlights
+	u16 num_decals;
+	u16 num_dlights;
 };
 
-struct DynamicLightTile {
-	u32 dlights[ MAX_DLIGHTS_PER_TILE ];
-};
+STATIC_ASSERT( sizeof( DynamicCluster ) == 2 * sizeof( u32 ) );
 
-static Span2D< DecalTile > gpu_decal_tiles;
-static Span2D< DynamicLightTile > gpu_dlight_tiles;
-
-struct DynamicCount {
-	u32 decal_count;
-	u32 dlight_count;
-};
-
-static Span2D< DynamicCount > gpu_dynamic_counts;
+static s64 last_cluster_overflow_warning;
 
 void InitDecals() {
 	num_persistent_decals = 0;
@@ -94,22 +84,15 @@ void InitDecals() {
 
 	decals_buffer = NewGPUBuffer( sizeof( decals ), "Decals" );
 	dlights_buffer = NewGPUBuffer( sizeof( dlights ), "Dynamic lights" );
+	cluster_indices_buffer = NewGPUBuffer( MAX_CLUSTER_INDICES * sizeof( u32 ), "Dynamic cluster indices" );
 }
 
 void ShutdownDecals() {
-	FREE( sys_allocator, gpu_decal_tiles.ptr );
-	gpu_decal_tiles.ptr = NULL;
-	DeferDeleteGPUBuffer( decal_tiles_buffer );
 	DeferDeleteGPUBuffer( decals_buffer );
-
-	FREE( sys_allocator, gpu_dlight_tiles.ptr );
-	gpu_dlight_tiles.ptr = NULL;
-	DeferDeleteGPUBuffer( dlight_tiles_buffer );
 	DeferDeleteGPUBuffer( dlights_buffer );
-
-	FREE( sys_allocator, gpu_dynamic_counts.ptr );
-	gpu_dynamic_counts.ptr = NULL;
-	DeferDeleteGPUBuffer( dynamic_count );
+	DeferDeleteGPUBuffer( clusters_buffer );
+	DeferDeleteGPUBuffer( cluster_indices_buffer );
+	clusters_buffer = { };
 }
 
 void DrawDecal( Vec3 origin, Vec3 normal, float radius, float angle, StringHash name, Vec4 color, float height ) {
@@ -300,202 +283,323 @@ void AllocateDecalBuffers() {
 	u32 cols = ( frame_static.viewport_width + TILE_SIZE - 1 ) / TILE_SIZE;
 
 	if( frame_static.viewport_width != last_viewport_width || frame_static.viewport_height != last_viewport_height ) {
-		TracyZoneScopedN( "Reallocate TBOs" );
-
-		FREE( sys_allocator, gpu_decal_tiles.ptr );
-		gpu_decal_tiles = ALLOC_SPAN2D( sys_allocator, DecalTile, cols, rows );
-		decal_tiles_buffer = NewGPUBuffer( gpu_decal_tiles.num_bytes(), "Decal tile indices" );
-
-		FREE( sys_allocator, gpu_dlight_tiles.ptr );
-		gpu_dlight_tiles = ALLOC_SPAN2D( sys_allocator, DynamicLightTile, cols, rows );
-		dlight_tiles_buffer = NewGPUBuffer( gpu_dlight_tiles.num_bytes(), "Dynamic light tile indices" );
+		TracyZoneScopedN( "Reallocate cluster buffer" );
 
-		FREE( sys_allocator, gpu_dynamic_counts.ptr );
-		gpu_dynamic_counts = ALLOC_SPAN2D( sys_allocator, DynamicCount, cols, rows );
-		dynamic_count = NewGPUBuffer( gpu_dynamic_counts.num_bytes(), "Dynamics tile counts" );
+		DeferDeleteGPUBuffer( clusters_buffer );
+		clusters_buffer = NewGPUBuffer( rows * cols * CLUSTER_DEPTH_SLICES * sizeof( DynamicCluster ), "Dynamic clusters" );
 
 		last_viewport_width = frame_static.viewport_width;
 		last_viewport_height = frame_static.viewport_height;
 	}
 }
 
-enum DynamicType {
-	DynamicType_Decal,
-	DynamicType_Light,
+struct CulledSpheres {
+	Span< float > x, y, z, radius;
+	Span< u32 > visible;
+	u32 num_visible;
 };
 
+static CulledSpheres AllocCulledSpheres( Allocator * a, u32 n ) {
+	CulledSpheres spheres;
+	spheres.x = ALLOC_SPAN( a, float, n );
+	spheres.y = ALLOC_SPAN( a, float, n );
+	spheres.z = ALLOC_SPAN( a, float, n );
+	spheres.radius = ALLOC_SPAN( a, float, n );
+	spheres.visible = ALLOC_SPAN( a, u32, n );
+	spheres.num_visible = 0;
+	return spheres;
+}
+
+static void SetSphere( CulledSpheres * spheres, u32 i, Vec3 origin, float radius ) {
+	spheres->x[ i ] = origin.x;
+	spheres->y[ i ] = origin.y;
+	spheres->z[ i ] = origin.z;
+	spheres->radius[ i ] = radius;
+}
+
+static void CullSpheresToView( CulledSpheres * spheres ) {
+	spheres->num_visible = CullSpheres( frame_static.frustum, spheres->x.ptr, spheres->y.ptr, spheres->z.ptr, spheres->radius.ptr, spheres->x.n, spheres->visible.ptr );
+}
+
 struct DynamicRect {
-	DynamicType type;
-	u32 minx, miny, maxx, maxy;
+	u32 min_x, max_x;
+	u32 min_y, max_y;
+	u32 min_slice, max_slice;
 	u32 idx;
 };
 
-struct DynamicSet {
-	u32 indices[ MAX_DYNAMICS_PER_SET ];
-	DynamicType types[ MAX_DYNAMICS_PER_SET ];
-	u32 num;
-};
+static float DepthSliceScale() {
+	return CLUSTER_DEPTH_SLICES / log2f( CLUSTER_FAR_PLANE / frame_static.near_plane );
+}
 
-void UploadDecalBuffers() {
-	TracyZoneScoped;
+// must match the slice calculation in standard.glsl
+static u32 DepthSlice( float view_depth, float slice_scale ) {
+	float slice = log2f( Max2( view_depth, frame_static.near_plane ) / frame_static.near_plane ) * slice_scale;
+	return Min2( u32( slice ), CLUSTER_DEPTH_SLICES - 1 );
+}
 
-	u32 rows = ( frame_static.viewport_height + TILE_SIZE - 1 ) / TILE_SIZE;
-	u32 cols = ( frame_static.viewport_width + TILE_SIZE - 1 ) / TILE_SIZE;
+static bool SphereClusterBounds( Vec3 origin, float radius, float slice_scale, u32 idx, DynamicRect * rect ) {
+	MinMax2 bounds = SphereScreenSpaceBounds( origin, radius );
+	bounds.mins.y = -bounds.mins.y;
+	bounds.maxs.y = -bounds.maxs.y;
+	Swap2( &bounds.mins.y, &bounds.maxs.y );
 
-	DynamicArray< DynamicRect > rects( sys_allocator );
+	if( bounds.maxs.x <= -1.0f || bounds.maxs.y <= -1.0f || bounds.mins.x >= 1.0f || bounds.mins.y >= 1.0f ) {
+		return false;
+	}
 
-	for( u32 i = 0; i < num_dlights; i++ ) {
-		u32 index = num_dlights - i - 1;
-		MinMax2 bounds = SphereScreenSpaceBounds( Floor( dlights[ index ].origin_color ), dlights[ index ].radius );
-		bounds.mins.y = -bounds.mins.y;
-		bounds.maxs.y = -bounds.maxs.y;
-		Swap2( &bounds.mins.y, &bounds.maxs.y );
+	Vec2 mins = ( bounds.mins + 1.0f ) * 0.5f * frame_static.viewport;
+	mins = Clamp( Vec2( 0.0f ), mins, frame_static.viewport - 1.0f ) / float( TILE_SIZE );
 
-		if( bounds.maxs.x <= -1.0f || bounds.maxs.y <= -1.0f || bounds.mins.x >= 1.0f || bounds.mins.y >= 1.0f ) {
-			continue;
-		}
+	Vec2 maxs = ( bounds.maxs + 1.0f ) * 0.5f * frame_static.viewport;
+	maxs = Clamp( Vec2( 0.0f ), maxs, frame_static.viewport - 1.0f ) / float( TILE_SIZE );
 
-		Vec2 mins = ( bounds.mins + 1.0f ) * 0.5f * frame_static.viewport;
-		mins = Clamp( Vec2( 0.0f ), mins, frame_static.viewport - 1.0f ) / float( TILE_SIZE );
+	float view_depth = -( frame_static.V * Vec4( origin, 1.0f ) ).z;
 
-		Vec2 maxs = ( bounds.maxs + 1.0f ) * 0.5f * frame_static.viewport;
-		maxs = Clamp( Vec2( 0.0f ), maxs, frame_static.viewport - 1.0f ) / float( TILE_SIZE );
+	rect->min_x = mins.x;
+	rect->max_x = maxs.x;
+	rect->min_y = mins.y;
+	rect->max_y = maxs.y;
+	rect->min_slice = DepthSlice( view_depth - radius, slice_scale );
+	rect->max_slice = DepthSlice( view_depth + radius, slice_scale );
+	rect->idx = idx;
 
-		DynamicRect rect;
-		rect.type = DynamicType_Light;
-		rect.minx = mins.x;
-		rect.miny = mins.y;
-		rect.maxx = maxs.x;
-		rect.maxy = maxs.y;
-		rect.idx = num_decals + index;
-		rects.add( rect );
+	return true;
+}
+
+/*
+ * binning is two passes over the rows. the first counts how many indices
+ * each cluster wants, then we prefix sum the row totals so every row knows
+ * where its indices go, then the second pass lays out and fills the clusters
+ */
+struct BinRowJob {
+	u32 row;
+	Span< const DynamicRect > decal_rects;
+	Span< const DynamicRect > dlight_rects;
+
+	Span< u32 > decal_counts;
+	Span< u32 > dlight_counts;
+	u32 num_wanted;
+
+	Span< DynamicCluster > clusters;
+	Span< u32 > indices;
+	u32 first_index;
+
+	u32 num_dropped;
+};
+
+static void CountRect( Span< u32 > counts, const DynamicRect & rect ) {
+	for( u32 x = rect.min_x; x <= rect.max_x; x++ ) {
+		for( u32 slice = rect.min_slice; slice <= rect.max_slice; slice++ ) {
+			counts[ x * CLUSTER_DEPTH_SLICES + slice ]++;
+		}
 	}
+}
 
-	for( u32 i = 0; i < num_decals; i++ ) {
-		u32 index = num_decals - i - 1;
-		MinMax2 bounds = SphereScreenSpaceBounds( Floor( decals[ index ].origin_normal ), floorf( decals[ index ].radius_angle ) );
-		bounds.mins.y = -bounds.mins.y;
-		bounds.maxs.y = -bounds.maxs.y;
-		Swap2( &bounds.mins.y, &bounds.maxs.y );
+static void CountRow( TempAllocator * temp, void * data ) {
+	TracyZoneScoped;
 
-		if( bounds.maxs.x <= -1.0f || bounds.maxs.y <= -1.0f || bounds.mins.x >= 1.0f || bounds.mins.y >= 1.0f ) {
-			continue;
+	BinRowJob * job = ( BinRowJob * ) data;
+
+	memset( job->decal_counts.ptr, 0, job->decal_counts.num_bytes() );
+	memset( job->dlight_counts.ptr, 0, job->dlight_counts.num_bytes() );
+
+	for( const DynamicRect & rect : job->decal_rects ) {
+		if( job->row >= rect.min_y && job->row <= rect.max_y ) {
+			CountRect( job->decal_counts, rect );
 		}
+	}
 
-		Vec2 mins = ( bounds.mins + 1.0f ) * 0.5f * frame_static.viewport;
-		mins = Clamp( Vec2( 0.0f ), mins, frame_static.viewport - 1.0f ) / float( TILE_SIZE );
+	for( const DynamicRect & rect : job->dlight_rects ) {
+		if( job->row >= rect.min_y && job->row <= rect.max_y ) {
+			CountRect( job->dlight_counts, rect );
+		}
+	}
 
-		Vec2 maxs = ( bounds.maxs + 1.0f ) * 0.5f * frame_static.viewport;
-		maxs = Clamp( Vec2( 0.0f ), maxs, frame_static.viewport - 1.0f ) / float( TILE_SIZE );
+	job->num_wanted = 0;
+	for( size_t i = 0; i < job->decal_counts.n; i++ ) {
+		job->num_wanted += Min2( job->decal_counts[ i ], u32( U16_MAX ) ) + Min2( job->dlight_counts[ i ], u32( U16_MAX ) );
+	}
+}
 
-		DynamicRect rect;
-		rect.type = DynamicType_Decal;
-		rect.minx = mins.x;
-		rect.miny = mins.y;
-		rect.maxx = maxs.x;
-		rect.maxy = maxs.y;
-		rect.idx = index;
-		rects.add( rect );
+static void BinRow( TempAllocator * temp, void * data ) {
+	TracyZoneScoped;
+
+	BinRowJob * job = ( BinRowJob * ) data;
+	size_t num_clusters = job->clusters.n;
+	Span< u32 > decal_counts = job->decal_counts;
+	Span< u32 > dlight_counts = job->dlight_counts;
+
+	// lay the clusters out back to back. if the row gets less room than it
+	// wanted, keep the decals, which are ordered newest first, over the dlights
+	u32 cursor = 0;
+	for( size_t i = 0; i < num_clusters; i++ ) {
+		u32 space = job->indices.n - cursor;
+		u32 num_decals = Min2( Min2( decal_counts[ i ], space ), u32( U16_MAX ) );
+		u32 num_dlights = Min2( Min2( dlight_counts[ i ], space - num_decals ), u32( U16_MAX ) );
+		job->num_dropped += decal_counts[ i ] - num_decals + dlight_counts[ i ] - num_dlights;
+
+		job->clusters[ i ].first_index = cursor;
+		job->clusters[ i ].num_decals = num_decals;
+		job->clusters[ i ].num_dlights = num_dlights;
+		cursor += num_decals + num_dlights;
+
+		// reuse the counts as write cursors
+		decal_counts[ i ] = 0;
+		dlight_counts[ i ] = 0;
 	}
 
-	{
-		TracyZoneScopedN( "Fill buffers" );
-
-		Span< DynamicSet > rows_coverage = ALLOC_SPAN( sys_allocator, DynamicSet, rows );
-		Span< DynamicSet > cols_coverage = ALLOC_SPAN( sys_allocator, DynamicSet, cols );
-
-		memset( rows_coverage.ptr, 0, rows_coverage.num_bytes() );
-		memset( cols_coverage.ptr, 0, cols_coverage.num_bytes() );
-
-		for( u32 i = 0; i < rects.size(); i++ ) {
-			DynamicRect & rect = rects[ i ];
-			for( u32 x = rect.minx; x <= rect.maxx; x++ ) {
-				DynamicSet & set = cols_coverage[ x ];
-				if( set.num < MAX_DYNAMICS_PER_SET ) {
-					set.indices[ set.num ] = rect.idx;
-					set.types[ set.num ] = rect.type;
-					set.num++;
-				}
-			}
-			for( u32 y = rect.miny; y <= rect.maxy; y++ ) {
-				DynamicSet & set = rows_coverage[ y ];
-				if( set.num < MAX_DYNAMICS_PER_SET ) {
-					set.indices[ set.num ] = rect.idx;
-					set.types[ set.num ] = rect.type;
-					set.num++;
+	for( const DynamicRect & rect : job->decal_rects ) {
+		if( job->row < rect.min_y || job->row > rect.max_y )
+			continue;
+
+		for( u32 x = rect.min_x; x <= rect.max_x; x++ ) {
+			for( u32 slice = rect.min_slice; slice <= rect.max_slice; slice++ ) {
+				u32 i = x * CLUSTER_DEPTH_SLICES + slice;
+				const DynamicCluster & cluster = job->clusters[ i ];
+				if( decal_counts[ i ] < cluster.num_decals ) {
+					job->indices[ cluster.first_index + decal_counts[ i ] ] = rect.idx;
+					decal_counts[ i ]++;
 				}
 			}
 		}
+	}
 
-		memset( gpu_dynamic_counts.ptr, 0, gpu_dynamic_counts.num_bytes() );
-
-		for( u32 y = 0; y < rows; y++ ) {
-			DynamicSet & y_set = rows_coverage[ y ];
-			for( u32 x = 0; x < cols; x++ ) {
-				DynamicSet & x_set = cols_coverage[ x ];
-				u32 x_idx = 0;
-				u32 y_idx = 0;
-				DecalTile & decal_tile = gpu_decal_tiles( x, y );
-				DynamicLightTile & dlight_tile = gpu_dlight_tiles( x, y );
-
-				// NOTE(msc): decals guaranteed to sorted front to back / high to low
-				while( x_idx < x_set.num && y_idx < y_set.num ) {
-					u32 x_instance = x_set.indices[ x_idx ];
-					u32 y_instance = y_set.indices[ y_idx ];
-					// NOTE(msc): instance in both column & row, must be active in this cell
-					if( x_instance == y_instance ) {
-						DynamicType type = x_set.types[ x_idx ];
-						DynamicCount &count = gpu_dynamic_counts( x, y );
-						if( type == DynamicType_Decal ) {
-							if( count.decal_count < MAX_DECALS_PER_TILE ) {
-								decal_tile.decals[ count.decal_count ] = x_instance;
-								count.decal_count++;
-							}
-						}
-						else if( type == DynamicType_Light ) {
-							if( count.dlight_count < MAX_DLIGHTS_PER_TILE ) {
-								dlight_tile.dlights[ count.dlight_count ] = x_instance - num_decals;
-								count.dlight_count++;
-							}
-						}
-						if( count.decal_count == MAX_DECALS_PER_TILE && count.dlight_count == MAX_DLIGHTS_PER_TILE ) {
-							break;
-						}
-						x_idx++;
-						y_idx++;
-					} else if( x_instance > y_instance ) {
-						// NOTE(msc): indices ordered high to low
-						x_idx++;
-					} else {
-						y_idx++;
-					}
+	for( const DynamicRect & rect : job->dlight_rects ) {
+		if( job->row < rect.min_y || job->row > rect.max_y )
+			continue;
+
+		for( u32 x = rect.min_x; x <= rect.max_x; x++ ) {
+			for( u32 slice = rect.min_slice; slice <= rect.max_slice; slice++ ) {
+				u32 i = x * CLUSTER_DEPTH_SLICES + slice;
+				const DynamicCluster & cluster = job->clusters[ i ];
+				if( dlight_counts[ i ] < cluster.num_dlights ) {
+					job->indices[ cluster.first_index + cluster.num_decals + dlight_counts[ i ] ] = rect.idx;
+					dlight_counts[ i ]++;
 				}
 			}
 		}
+	}
+
+	for( DynamicCluster & cluster : job->clusters ) {
+		cluster.first_index += job->first_index;
+	}
+}
 
-		FREE( sys_allocator, rows_coverage.ptr );
-		FREE( sys_allocator, cols_coverage.ptr );
+void UploadDecalBuffers() {
+	TracyZoneScoped;
+
+	defer {
+		num_decals = 0;
+		num_dlights = 0;
+	};
+
+	u32 rows = ( frame_static.viewport_height + TILE_SIZE - 1 ) / TILE_SIZE;
+	u32 cols = ( frame_static.viewport_width + TILE_SIZE - 1 ) / TILE_SIZE;
+	if( rows == 0 || cols == 0 )
+		return;
+
+	TempAllocator temp = cls.frame_arena.temp();
+
+	// frustum cull everything in bulk so only the survivors get projected
+	CulledSpheres visible_dlights = AllocCulledSpheres( &temp, num_dlights );
+	for( u32 i = 0; i < num_dlights; i++ ) {
+		SetSphere( &visible_dlights, i, Floor( dlights[ i ].origin_color ), dlights[ i ].radius );
+	}
+	CullSpheresToView( &visible_dlights );
+
+	CulledSpheres visible_decals = AllocCulledSpheres( &temp, num_decals );
+	for( u32 i = 0; i < num_decals; i++ ) {
+		SetSphere( &visible_decals, i, Floor( decals[ i ].origin_normal ), floorf( decals[ i ].radius_angle ) );
+	}
+	CullSpheresToView( &visible_decals );
+
+	TracyCPlot( "Visible dynamic lights", s64( visible_dlights.num_visible ) );
+	TracyCPlot( "Visible decals", s64( visible_decals.num_visible ) );
+
+	// rects get added high to low, the decal shader relies on decals being
+	// sorted newest first
+	float slice_scale = DepthSliceScale();
+
+	DynamicArray< DynamicRect > dlight_rects( &temp, visible_dlights.num_visible );
+	for( u32 i = 0; i < visible_dlights.num_visible; i++ ) {
+		u32 index = visible_dlights.visible[ visible_dlights.num_visible - i - 1 ];
+		DynamicRect rect;
+		if( SphereClusterBounds( Floor( dlights[ index ].origin_color ), dlights[ index ].radius, slice_scale, index, &rect ) ) {
+			dlight_rects.add( rect );
+		}
+	}
+
+	DynamicArray< DynamicRect > decal_rects( &temp, visible_decals.num_visible );
+	for( u32 i = 0; i < visible_decals.num_visible; i++ ) {
+		u32 index = visible_decals.visible[ visible_decals.num_visible - i - 1 ];
+		DynamicRect rect;
+		if( SphereClusterBounds( Floor( decals[ index ].origin_normal ), floorf( decals[ index ].radius_angle ), slice_scale, index, &rect ) ) {
+			decal_rects.add( rect );
+		}
+	}
+
+	u32 clusters_per_row = cols * CLUSTER_DEPTH_SLICES;
+
+	Span< DynamicCluster > clusters = ALLOC_SPAN( &temp, DynamicCluster, rows * clusters_per_row );
+	Span< u32 > decal_counts = ALLOC_SPAN( &temp, u32, rows * clusters_per_row );
+	Span< u32 > dlight_counts = ALLOC_SPAN( &temp, u32, rows * clusters_per_row );
+
+	Span< BinRowJob > jobs = ALLOC_SPAN( &temp, BinRowJob, rows );
+	for( u32 i = 0; i < rows; i++ ) {
+		BinRowJob * job = &jobs[ i ];
+		job->row = i;
+		job->decal_rects = decal_rects.span();
+		job->dlight_rects = dlight_rects.span();
+		job->decal_counts = decal_counts.slice( i * clusters_per_row, ( i + 1 ) * clusters_per_row );
+		job->dlight_counts = dlight_counts.slice( i * clusters_per_row, ( i + 1 ) * clusters_per_row );
+		job->clusters = clusters.slice( i * clusters_per_row, ( i + 1 ) * clusters_per_row );
+		job->num_dropped = 0;
+	}
+
+	ParallelFor( jobs, CountRow );
+
+	// give each row as much of the index buffer as it wants until it runs out
+	u32 num_indices = 0;
+	for( BinRowJob & job : jobs ) {
+		job.first_index = num_indices;
+		num_indices += Min2( job.num_wanted, MAX_CLUSTER_INDICES - num_indices );
+	}
+
+	Span< u32 > indices = ALLOC_SPAN( &temp, u32, num_indices );
+	for( size_t i = 0; i < jobs.n; i++ ) {
+		u32 end = i + 1 < jobs.n ? jobs[ i + 1 ].first_index : num_indices;
+		jobs[ i ].indices = indices.slice( jobs[ i ].first_index, end );
+	}
+
+	ParallelFor( jobs, BinRow );
+
+	u32 num_dropped = 0;
+	for( const BinRowJob & job : jobs ) {
+		num_dropped += job.num_dropped;
+	}
+
+	TracyCPlot( "Dynamic cluster indices", s64( num_indices ) );
+	TracyCPlot( "Dynamics dropped from clusters", s64( num_dropped ) );
+
+	if( num_dropped > 0 && cls.monotonicTime - last_cluster_overflow_warning >= 1000 ) {
+		Com_Printf( S_COLOR_YELLOW "Dropped %u decals/dlights from clusters that ran out of space\n", num_dropped );
+		last_cluster_overflow_warning = cls.monotonicTime;
 	}
 
 	{
 		TracyZoneScopedN( "Upload decals/dlights" );
-		WriteGPUBuffer( decal_tiles_buffer, gpu_decal_tiles.span() );
 		WriteGPUBuffer( decals_buffer, decals, num_decals * sizeof( Decal ) );
-		WriteGPUBuffer( dlight_tiles_buffer, gpu_dlight_tiles.span() );
 		WriteGPUBuffer( dlights_buffer, dlights, num_dlights * sizeof( DynamicLight ) );
-		WriteGPUBuffer( dynamic_count, gpu_dynamic_counts.span() );
+		WriteGPUBuffer( clusters_buffer, clusters.ptr, clusters.num_bytes() );
+		WriteGPUBuffer( cluster_indices_buffer, indices.ptr, num_indices * sizeof( u32 ) );
 	}
-
-	num_decals = 0;
-	num_dlights = 0;
 }
 
 void AddDynamicsToPipeline( PipelineState * pipeline ) {
-	pipeline->set_buffer( "b_DecalTiles", decal_tiles_buffer );
 	pipeline->set_buffer( "b_Decals", decals_buffer );
-
-	pipeline->set_buffer( "b_DynamicLightTiles", dlight_tiles_buffer );
 	pipeline->set_buffer( "b_DynamicLights", dlights_buffer );
 
-	pipeline->set_buffer( "b_DynamicTiles", dynamic_count );
+	pipeline->set_buffer( "b_DynamicClusters", clusters_buffer );
+	pipeline->set_buffer( "b_DynamicIndices", cluster_indices_buffer );
 }
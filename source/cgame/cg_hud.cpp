@@ -22,6 +22,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "qcommon/base.h"
 #include "qcommon/string.h"
 #include "client/assets.h"
+#include "client/decode_cache.h"
 #include "client/renderer/renderer.h"
 #include "client/renderer/text.h"
 #include "cgame/cg_local.h"
@@ -30,10 +31,18 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "luau/lualib.h"
 #include "luau/luacode.h"
 
+#include "tracy/Tracy.hpp"
+
 static const Vec4 light_gray = sRGBToLinear( RGBA8( 96, 96, 96, 255 ) );
 static constexpr Vec4 dark_gray = vec4_dark;
 
 static lua_State * hud_L;
+static size_t hud_allocated_bytes;
+
+static int hud_state_ref;
+static int hud_keys_ref;
+static const char * hud_key_names[ 64 ];
+static int hud_num_keys;
 
 struct constant_numeric_t {
 	const char *name;
@@ -1164,21 +1173,79 @@ static int HUD_DrawPerksUtility( lua_State * L ) {
 	return 0;
 }
 
-void CG_InitHUD() {
-	TracyZoneScopedN( "Luau" );
+// bump this when we change how the HUD gets compiled
+static constexpr u32 HUD_BYTECODE_VERSION = 1;
+
+// luau puts its bytecode version (LBC_VERSION_TARGET) in the first byte of
+// everything it compiles, and the headers we ship don't expose it, so compile
+// nothing and look
+static u8 LuauBytecodeVersion() {
+	size_t compiled_size;
+	char * compiled = luau_compile( "", 0, NULL, &compiled_size );
+	defer { free( compiled ); };
+	if( compiled == NULL || compiled_size == 0 ) {
+		Fatal( "luau_compile" );
+	}
+	return u8( compiled[ 0 ] );
+}
 
-	hud_L = NULL;
+static Span< u8 > CompileHUD( TempAllocator * temp, const char * path ) {
+	TracyZoneScoped;
+
+	// so updating luau doesn't load bytecode the VM can't read
+	u32 version = ( HUD_BYTECODE_VERSION << 8 ) | LuauBytecodeVersion();
+	u64 key = DecodeCacheKey( "luau", version, AssetBinary( path ) );
+
+	Span< u8 > bytecode;
+	if( LoadFromDecodeCache( temp, sys_allocator, key, &bytecode ) )
+		return bytecode;
 
-	size_t bytecode_size;
-	char * bytecode = luau_compile( AssetString( "huds/hud.lua" ).ptr, AssetBinary( "huds/hud.lua" ).n, NULL, &bytecode_size );
-	defer { free( bytecode ); };
-	if( bytecode == NULL ) {
+	Span< const char > source = AssetString( path );
+	size_t compiled_size;
+	char * compiled = luau_compile( source.ptr, source.n, NULL, &compiled_size );
+	defer { free( compiled ); };
+	if( compiled == NULL ) {
 		Fatal( "luau_compile" );
 	}
 
-	hud_L = luaL_newstate();
+	bytecode = ALLOC_SPAN( sys_allocator, u8, compiled_size );
+	memcpy( bytecode.ptr, compiled, compiled_size );
+
+	// compile errors come back as a 0 byte and the message for luau_load to
+	// report, don't cache those
+	if( bytecode.n > 0 && bytecode[ 0 ] != 0 ) {
+		SaveToDecodeCache( temp, key, bytecode );
+	}
+
+	return bytecode;
+}
+
+// counts bytes so we can plot how much garbage the HUD makes each frame
+static void * HUDAlloc( lua_State * L, void * ud, void * ptr, size_t osize, size_t nsize ) {
+	if( nsize == 0 ) {
+		free( ptr );
+		return NULL;
+	}
+
+	if( nsize > osize ) {
+		hud_allocated_bytes += nsize - osize;
+	}
+
+	return realloc( ptr, nsize );
+}
+
+static void LoadHUD() {
+	TracyZoneScopedN( "Luau" );
+
+	hud_L = NULL;
+
+	TempAllocator temp = cls.frame_arena.temp();
+	Span< u8 > bytecode = CompileHUD( &temp, "huds/hud.lua" );
+	defer { FREE( sys_allocator, bytecode.ptr ); };
+
+	hud_L = lua_newstate( HUDAlloc, NULL );
 	if( hud_L == NULL ) {
-		Fatal( "luaL_newstate" );
+		Fatal( "lua_newstate" );
 	}
 
 	constexpr const luaL_Reg cdlib[] = {
@@ -1221,11 +1288,20 @@ void CG_InitHUD() {
 
 	luaL_sandbox( hud_L );
 
+	lua_newtable( hud_L );
+	hud_state_ref = lua_ref( hud_L, -1 );
+	lua_pop( hud_L, 1 );
+
+	lua_newtable( hud_L );
+	hud_keys_ref = lua_ref( hud_L, -1 );
+	lua_pop( hud_L, 1 );
+	hud_num_keys = 0;
+
 	lua_getglobal( hud_L, "debug" );
 	lua_getfield( hud_L, -1, "traceback" );
 	lua_remove( hud_L, -2 );
 
-	int ok = luau_load( hud_L, "hud.lua", bytecode, bytecode_size, 0 );
+	int ok = luau_load( hud_L, "hud.lua", ( const char * ) bytecode.ptr, bytecode.n, 0 );
 	if( ok == 0 ) {
 		if( !CallWithStackTrace( hud_L, 0, 1 ) || lua_type( hud_L, -1 ) != LUA_TFUNCTION ) {
 			Com_Printf( S_COLOR_RED "hud.lua must return a function\n" );
@@ -1240,133 +1316,145 @@ void CG_InitHUD() {
 	}
 }
 
-void CG_ShutdownHUD() {
+static void CloseHUD() {
 	if( hud_L != NULL ) {
 		lua_close( hud_L );
 	}
 }
 
-void CG_DrawHUD() {
-	TracyZoneScoped;
-
-	bool hotload = false;
-	for( const char * path : ModifiedAssetPaths() ) {
-		if( StartsWith( path, "huds/" ) ) {
-			hotload = true;
-			break;
-		}
-	}
-
-	if( hotload ) {
-		CG_ShutdownHUD();
-		CG_InitHUD();
-	}
-
-	if( hud_L != NULL ) {
-		TracyZoneScopedN( "Luau" );
-
-		lua_pushvalue( hud_L, -1 );
-		lua_newtable( hud_L );
-
-		lua_pushboolean( hud_L, cg.predictedPlayerState.ready );
-		lua_setfield( hud_L, -2, "ready" );
-
-		lua_pushnumber( hud_L, cg.predictedPlayerState.health );
-		lua_setfield( hud_L, -2, "health" );
-
-		lua_pushnumber( hud_L, cg.predictedPlayerState.max_health );
-		lua_setfield( hud_L, -2, "max_health" );
-
-		lua_pushnumber( hud_L, cg.predictedPlayerState.perk );
-		lua_setfield( hud_L, -2, "perk" );
-
-		lua_pushnumber( hud_L, cg.predictedPlayerState.pmove.stamina );
-		lua_setfield( hud_L, -2, "stamina" );
-
-		lua_pushnumber( hud_L, cg.predictedPlayerState.pmove.stamina_state );
-		lua_setfield( hud_L, -2, "staminaState" );
-
-		lua_pushnumber( hud_L, cg.predictedPlayerState.team );
-		lua_setfield( hud_L, -2, "team" );
-
-		lua_pushboolean( hud_L, cg.predictedPlayerState.carrying_bomb );
-		lua_setfield( hud_L, -2, "isCarrier" );
-
-		lua_pushboolean( hud_L, cg.predictedPlayerState.can_plant );
-		lua_setfield( hud_L, -2, "canPlant" );
-
-		lua_pushboolean( hud_L, cg.predictedPlayerState.can_change_loadout );
-		lua_setfield( hud_L, -2, "canChangeLoadout" );
-
-		lua_pushnumber( hud_L, cg.predictedPlayerState.progress );
-		lua_setfield( hud_L, -2, "bomb_progress" );
-
-		lua_pushboolean( hud_L, GS_TeamBasedGametype( &client_gs ) );
-		lua_setfield( hud_L, -2, "teambased" );
-
-		lua_pushnumber( hud_L, client_gs.gameState.match_state );
-		lua_setfield( hud_L, -2, "matchState" );
-
-		lua_pushnumber( hud_L, client_gs.gameState.teams[ TEAM_ALPHA ].score );
-		lua_setfield( hud_L, -2, "scoreAlpha" );
-
-		lua_pushnumber( hud_L, client_gs.gameState.bomb.alpha_players_alive );
-		lua_setfield( hud_L, -2, "aliveAlpha" );
-
-		lua_pushnumber( hud_L, client_gs.gameState.bomb.alpha_players_total );
-		lua_setfield( hud_L, -2, "totalAlpha" );
-
-		lua_pushnumber( hud_L, client_gs.gameState.teams[ TEAM_BETA ].score );
-		lua_setfield( hud_L, -2, "scoreBeta" );
-
-		lua_pushnumber( hud_L, client_gs.gameState.bomb.beta_players_alive );
-		lua_setfield( hud_L, -2, "aliveBeta" );
-
-		lua_pushnumber( hud_L, client_gs.gameState.bomb.beta_players_total );
-		lua_setfield( hud_L, -2, "totalBeta" );
+static void HotloadHUD( Span< const char * > paths ) {
+	CloseHUD();
+	LoadHUD();
+}
 
-		lua_pushnumber( hud_L, client_gs.gameState.round_type );
-		lua_setfield( hud_L, -2, "roundType" );
+void CG_InitHUD() {
+	LoadHUD();
+	SubscribeToAssetChanges( "huds/*", HotloadHUD );
+}
 
-		lua_pushnumber( hud_L, CG_GetPOVnum() );
-		lua_setfield( hud_L, -2, "chasing" );
+void CG_ShutdownHUD() {
+	UnsubscribeFromAssetChanges( HotloadHUD );
+	CloseHUD();
+}
 
-		lua_pushstring( hud_L, cl.configstrings[ CS_CALLVOTE ] );
-		lua_setfield( hud_L, -2, "vote" );
+/*
+ * the state table is made once and updated in place, so drawing the HUD
+ * doesn't make a new table and a few dozen fields of garbage every frame. the
+ * field names get interned into an array the first time they're set, so after
+ * that setting a field is a rawgeti and a rawset instead of hashing the name
+ *
+ * fields are identified by the order they get set in, so every field has to
+ * be set every frame
+ */
+struct HUDStateWriter {
+	int state;
+	int keys;
+	int next_key;
+};
 
-		lua_pushnumber( hud_L, client_gs.gameState.callvote_required_votes );
-		lua_setfield( hud_L, -2, "votesRequired" );
+static void PushHUDKey( HUDStateWriter * writer, const char * name ) {
+	writer->next_key++;
+	int key = writer->next_key;
 
-		lua_pushnumber( hud_L, client_gs.gameState.callvote_yes_votes );
-		lua_setfield( hud_L, -2, "votesTotal" );
+	if( key > hud_num_keys ) {
+		assert( key <= int( ARRAY_COUNT( hud_key_names ) ) );
+		lua_pushstring( hud_L, name );
+		lua_rawseti( hud_L, writer->keys, key );
+		hud_key_names[ key - 1 ] = name;
+		hud_num_keys = key;
+	}
 
-		lua_pushboolean( hud_L, cg.predictedPlayerState.voted );
-		lua_setfield( hud_L, -2, "hasVoted" );
+	assert( StrEqual( hud_key_names[ key - 1 ], name ) );
+	lua_rawgeti( hud_L, writer->keys, key );
+}
 
-		lua_pushboolean( hud_L, CG_IsLagging() );
-		lua_setfield( hud_L, -2, "lagging" );
+static void SetHUDBool( HUDStateWriter * writer, const char * name, bool b ) {
+	PushHUDKey( writer, name );
+	lua_pushboolean( hud_L, b );
+	lua_rawset( hud_L, writer->state );
+}
 
-		lua_pushboolean( hud_L, Cvar_Bool( "cg_showFPS" ) );
-		lua_setfield( hud_L, -2, "show_fps" );
+static void SetHUDNumber( HUDStateWriter * writer, const char * name, double x ) {
+	PushHUDKey( writer, name );
+	lua_pushnumber( hud_L, x );
+	lua_rawset( hud_L, writer->state );
+}
 
-		lua_pushboolean( hud_L, Cvar_Bool( "cg_showHotkeys" ) );
-		lua_setfield( hud_L, -2, "show_hotkeys" );
+static void SetHUDString( HUDStateWriter * writer, const char * name, const char * str ) {
+	PushHUDKey( writer, name );
+	lua_pushstring( hud_L, str );
+	lua_rawset( hud_L, writer->state );
+}
 
-		lua_pushnumber( hud_L, CG_GetFPS() );
-		lua_setfield( hud_L, -2, "fps" );
+static void UpdateHUDState() {
+	TracyZoneScoped;
 
-		lua_pushboolean( hud_L, Cvar_Bool( "cg_showSpeed" ) );
-		lua_setfield( hud_L, -2, "show_speed" );
+	lua_getref( hud_L, hud_state_ref );
+	lua_getref( hud_L, hud_keys_ref );
+
+	HUDStateWriter writer = { };
+	writer.state = lua_gettop( hud_L ) - 1;
+	writer.keys = lua_gettop( hud_L );
+
+	SetHUDBool( &writer, "ready", cg.predictedPlayerState.ready );
+	SetHUDNumber( &writer, "health", cg.predictedPlayerState.health );
+	SetHUDNumber( &writer, "max_health", cg.predictedPlayerState.max_health );
+	SetHUDNumber( &writer, "perk", cg.predictedPlayerState.perk );
+	SetHUDNumber( &writer, "stamina", cg.predictedPlayerState.pmove.stamina );
+	SetHUDNumber( &writer, "staminaState", cg.predictedPlayerState.pmove.stamina_state );
+	SetHUDNumber( &writer, "team", cg.predictedPlayerState.team );
+	SetHUDBool( &writer, "isCarrier", cg.predictedPlayerState.carrying_bomb );
+	SetHUDBool( &writer, "canPlant", cg.predictedPlayerState.can_plant );
+	SetHUDBool( &writer, "canChangeLoadout", cg.predictedPlayerState.can_change_loadout );
+	SetHUDNumber( &writer, "bomb_progress", cg.predictedPlayerState.progress );
+
+	SetHUDBool( &writer, "teambased", GS_TeamBasedGametype( &client_gs ) );
+	SetHUDNumber( &writer, "matchState", client_gs.gameState.match_state );
+	SetHUDNumber( &writer, "scoreAlpha", client_gs.gameState.teams[ TEAM_ALPHA ].score );
+	SetHUDNumber( &writer, "aliveAlpha", client_gs.gameState.bomb.alpha_players_alive );
+	SetHUDNumber( &writer, "totalAlpha", client_gs.gameState.bomb.alpha_players_total );
+	SetHUDNumber( &writer, "scoreBeta", client_gs.gameState.teams[ TEAM_BETA ].score );
+	SetHUDNumber( &writer, "aliveBeta", client_gs.gameState.bomb.beta_players_alive );
+	SetHUDNumber( &writer, "totalBeta", client_gs.gameState.bomb.beta_players_total );
+	SetHUDNumber( &writer, "roundType", client_gs.gameState.round_type );
+	SetHUDNumber( &writer, "chasing", CG_GetPOVnum() );
+
+	SetHUDString( &writer, "vote", cl.configstrings[ CS_CALLVOTE ] );
+	SetHUDNumber( &writer, "votesRequired", client_gs.gameState.callvote_required_votes );
+	SetHUDNumber( &writer, "votesTotal", client_gs.gameState.callvote_yes_votes );
+	SetHUDBool( &writer, "hasVoted", cg.predictedPlayerState.voted );
+
+	SetHUDBool( &writer, "lagging", CG_IsLagging() );
+	SetHUDBool( &writer, "show_fps", Cvar_Bool( "cg_showFPS" ) );
+	SetHUDBool( &writer, "show_hotkeys", Cvar_Bool( "cg_showHotkeys" ) );
+	SetHUDNumber( &writer, "fps", CG_GetFPS() );
+	SetHUDBool( &writer, "show_speed", Cvar_Bool( "cg_showSpeed" ) );
+	SetHUDNumber( &writer, "speed", CG_GetSpeed() );
+	SetHUDNumber( &writer, "viewport_width", frame_static.viewport_width );
+	SetHUDNumber( &writer, "viewport_height", frame_static.viewport_height );
+
+	// leave the state table on the stack
+	lua_pop( hud_L, 1 );
+}
 
-		lua_pushnumber( hud_L, CG_GetSpeed() );
-		lua_setfield( hud_L, -2, "speed" );
+void CG_DrawHUD() {
+	TracyZoneScoped;
 
-		lua_pushnumber( hud_L, frame_static.viewport_width );
-		lua_setfield( hud_L, -2, "viewport_width" );
+	if( hud_L != NULL ) {
+		TracyZoneScopedN( "Luau" );
 
-		lua_pushnumber( hud_L, frame_static.viewport_height );
-		lua_setfield( hud_L, -2, "viewport_height" );
+#if TRACY_ENABLE
+		u64 start = Sys_Microseconds();
+		size_t allocated_before = hud_allocated_bytes;
+#endif
 
+		lua_pushvalue( hud_L, -1 );
+		UpdateHUDState();
 		CallWithStackTrace( hud_L, 1, 0 );
+
+#if TRACY_ENABLE
+		TracyPlot( "HUD Luau ms", ( Sys_Microseconds() - start ) / 1000.0 );
+		TracyPlot( "HUD Luau allocated bytes", s64( hud_allocated_bytes - allocated_before ) );
+#endif
 	}
 }
@@ -155,6 +155,7 @@ void CG_Reset() {
 
 	// reset prediction optimization
 	cg.predictFrom = 0;
+	CG_ResetPredictionCache();
 
 	memset( cg_entities, 0, sizeof( cg_entities ) );
 }
@@ -1,11 +1,16 @@
+#include <xmmintrin.h>
+
 #include "qcommon/fs.h"
 #include "qcommon/serialization.h"
 #include "client/assets.h"
+#include "client/threadpool.h"
 #include "client/renderer/renderer.h"
+#include "client/renderer/null_gl.h"
 #include "cgame/cg_local.h"
 
 #include "qcommon/hash.h"
 #include "qcommon/hashtable.h"
+#include "qcommon/cmodel.h"
 #include "gameshared/q_shared.h"
 
 #include "imgui/imgui.h"
@@ -41,6 +46,7 @@ static u32 num_dlightEmitters;
 static Hashtable< MAX_DLIGHT_EMITTERS * 2 > dlightEmitters_hashtable;
 
 constexpr u32 particles_per_emitter = 10000;
+constexpr u32 cpu_particles_per_job = 4096;
 
 bool ParseParticleEvents( Span< const char > * data, ParticleEvents * event ) {
 	while( true ) {
@@ -88,24 +94,75 @@ RandomDistribution ParseRandomDistribution( Span< const char > * data, ParseStop
 	return d;
 }
 
+static void InitCPUParticles( Allocator * a, CPUParticles * particles, size_t max_particles ) {
+	size_t n = AlignPow2( max_particles, size_t( 4 ) );
+
+	Span< float > * floats[] = {
+		&particles->position_x, &particles->position_y, &particles->position_z,
+		&particles->velocity_x, &particles->velocity_y, &particles->velocity_z,
+		&particles->angle, &particles->rotation_speed,
+		&particles->acceleration, &particles->drag,
+		&particles->age, &particles->lifetime,
+	};
+
+	// zero the padding so the SIMD loops don't chew on denormals
+	for( Span< float > * span : floats ) {
+		*span = ALLOC_SPAN( a, float, n );
+		memset( span->ptr, 0, span->num_bytes() );
+	}
+
+	particles->collided = ALLOC_SPAN( a, u32, n );
+	memset( particles->collided.ptr, 0, particles->collided.num_bytes() );
+
+	particles->cold = ALLOC_SPAN( a, GPUParticle, max_particles );
+}
+
+static void DeleteCPUParticles( Allocator * a, CPUParticles * particles ) {
+	Span< float > floats[] = {
+		particles->position_x, particles->position_y, particles->position_z,
+		particles->velocity_x, particles->velocity_y, particles->velocity_z,
+		particles->angle, particles->rotation_speed,
+		particles->acceleration, particles->drag,
+		particles->age, particles->lifetime,
+	};
+
+	for( Span< float > span : floats ) {
+		FREE( a, span.ptr );
+	}
+
+	FREE( a, particles->collided.ptr );
+	FREE( a, particles->cold.ptr );
+
+	*particles = { };
+}
+
 void DeleteParticleSystem( Allocator * a, ParticleSystem * ps );
 
 void InitParticleSystem( Allocator * a, ParticleSystem * ps ) {
 	DeleteParticleSystem( a, ps );
 
 	ps->particles = ALLOC_SPAN( a, GPUParticle, ps->max_particles );
-	ps->gpu_instances = ALLOC_SPAN( a, u32, ps->max_particles );
 	if( ps->feedback ) {
 		ps->particles_feedback = ALLOC_SPAN( a, GPUParticleFeedback, ps->max_particles );
 		memset( ps->particles_feedback.ptr, 0, ps->particles_feedback.num_bytes() );
-		ps->vb_feedback = NewGPUBuffer( ps->particles_feedback.begin(), ps->max_particles * sizeof( GPUParticleFeedback ) );
+	}
+
+	if( ps->cpu_simulation ) {
+		InitCPUParticles( a, &ps->cpu, ps->max_particles );
+		ps->stream = NewStreamingBuffer( ps->max_particles * sizeof( GPUParticle ), "CPU particles" );
 	}
 	else {
-		ps->gpu_instances_time = ALLOC_SPAN( a, s64, ps->max_particles );
+		ps->gpu_instances = ALLOC_SPAN( a, u32, ps->max_particles );
+		if( ps->feedback ) {
+			ps->vb_feedback = NewGPUBuffer( ps->particles_feedback.begin(), ps->max_particles * sizeof( GPUParticleFeedback ) );
+		}
+		else {
+			ps->gpu_instances_time = ALLOC_SPAN( a, s64, ps->max_particles );
+		}
+		ps->ibo = NewGPUBuffer( ps->max_particles * sizeof( ps->gpu_instances[ 0 ] ) );
+		ps->vb = NewParticleGPUBuffer( ps->max_particles );
+		ps->vb2 = NewParticleGPUBuffer( ps->max_particles );
 	}
-	ps->ibo = NewGPUBuffer( ps->max_particles * sizeof( ps->gpu_instances[ 0 ] ) );
-	ps->vb = NewParticleGPUBuffer( ps->max_particles );
-	ps->vb2 = NewParticleGPUBuffer( ps->max_particles );
 
 	if( !ps->model ) {
 		{
@@ -138,7 +195,7 @@ void InitParticleSystem( Allocator * a, ParticleSystem * ps ) {
 		}
 	}
 
-	{
+	if( !ps->cpu_simulation ) {
 		MeshConfig mesh_config;
 		mesh_config.name = "???";
 		mesh_config.indices = ps->ibo;
@@ -339,6 +396,10 @@ static bool ParseParticleEmitter( ParticleEmitter * emitter, Span< const char >
 				ParseParticleEvents( data, &emitter->on_frame );
 				emitter->feedback = true;
 			}
+			else if( key == "simulation" ) {
+				Span< const char > value = ParseToken( data, Parse_StopOnNewLine );
+				emitter->cpu_simulation = value == "cpu";
+			}
 		}
 	}
 
@@ -602,7 +663,7 @@ void CreateParticleSystems() {
 	for( size_t i = 0; i < num_particleEmitters; i++ ) {
 		ParticleEmitter * emitter = &particleEmitters[ i ];
 		if( emitter->num_materials ) {
-			if( !emitter->feedback ) {
+			if( !emitter->feedback && !emitter->cpu_simulation ) {
 				if( emitter->blend_func == BlendFunc_Add ) {
 					emitter->particle_system = addSystem_hash;
 					addSystem->max_particles += particles_per_emitter;
@@ -616,7 +677,8 @@ void CreateParticleSystems() {
 				ParticleSystem ps = { };
 				ps.max_particles += particles_per_emitter;
 				ps.blend_func = emitter->blend_func;
-				ps.feedback = true;
+				ps.feedback = emitter->feedback;
+				ps.cpu_simulation = emitter->cpu_simulation;
 				ps.on_collision = emitter->on_collision;
 				ps.on_age = emitter->on_age;
 				ps.on_frame = emitter->on_frame;
@@ -637,6 +699,7 @@ void CreateParticleSystems() {
 			ParticleSystem ps = { };
 			ps.model = FindModel( emitter->model );
 			ps.max_particles += particles_per_emitter;
+			ps.cpu_simulation = emitter->cpu_simulation;
 			u64 hash = Random64( &cls.rng );
 			if( emitter->feedback ) {
 				ps.blend_func = emitter->blend_func;
@@ -672,34 +735,31 @@ void ShutdownParticleSystems() {
 	num_particleSystems = 0;
 }
 
-void InitVisualEffects() {
+static void HotloadVisualEffects( Span< const char * > paths ) {
 	TracyZoneScoped;
 
-	ShutdownParticleSystems();
-
-	for( const char * path : AssetPaths() ) {
-		if( FileExtension( path ) == ".cdvfx" ) {
-			LoadVisualEffect( path );
-		}
+	for( const char * path : paths ) {
+		LoadVisualEffect( path );
 	}
 
+	ShutdownParticleSystems();
 	CreateParticleSystems();
 }
 
-void HotloadVisualEffects() {
+void InitVisualEffects() {
 	TracyZoneScoped;
 
-	bool restart_systems = false;
-	for( const char * path : ModifiedAssetPaths() ) {
+	ShutdownParticleSystems();
+
+	for( const char * path : AssetPaths() ) {
 		if( FileExtension( path ) == ".cdvfx" ) {
 			LoadVisualEffect( path );
-			restart_systems = true;
 		}
 	}
-	if( restart_systems ) {
-		ShutdownParticleSystems();
-		CreateParticleSystems();
-	}
+
+	CreateParticleSystems();
+
+	SubscribeToAssetChanges( "*.cdvfx", HotloadVisualEffects );
 }
 
 VisualEffectGroup * FindVisualEffectGroup( StringHash name ) {
@@ -726,6 +786,11 @@ void DeleteParticleSystem( Allocator * a, ParticleSystem * ps ) {
 	DeleteGPUBuffer( ps->vb2 );
 	DeleteGPUBuffer( ps->vb_feedback );
 
+	if( ps->cpu_simulation ) {
+		DeleteCPUParticles( a, &ps->cpu );
+		DeleteStreamingBuffer( ps->stream );
+	}
+
 	DeleteMesh( ps->mesh );
 	DeleteMesh( ps->update_mesh );
 
@@ -733,6 +798,8 @@ void DeleteParticleSystem( Allocator * a, ParticleSystem * ps ) {
 }
 
 void ShutdownVisualEffects() {
+	UnsubscribeFromAssetChanges( HotloadVisualEffects );
+
 	visualEffectGroups_hashtable.clear();
 	num_visualEffectGroups = 0;
 	particleEmitters_hashtable.clear();
@@ -787,9 +854,274 @@ bool ParticleFeedback( ParticleSystem * ps, GPUParticleFeedback * feedback ) {
 	return result;
 };
 
+static void SpawnCPUParticles( ParticleSystem * ps ) {
+	TracyZoneScoped;
+
+	CPUParticles * p = &ps->cpu;
+	for( size_t i = 0; i < ps->new_particles; i++ ) {
+		size_t idx = ps->num_particles + i;
+		const GPUParticle & particle = ps->particles[ i ];
+
+		p->position_x[ idx ] = particle.position.x;
+		p->position_y[ idx ] = particle.position.y;
+		p->position_z[ idx ] = particle.position.z;
+		p->velocity_x[ idx ] = particle.velocity.x;
+		p->velocity_y[ idx ] = particle.velocity.y;
+		p->velocity_z[ idx ] = particle.velocity.z;
+		p->angle[ idx ] = particle.angle;
+		p->rotation_speed[ idx ] = particle.rotation_speed;
+		p->acceleration[ idx ] = particle.acceleration;
+		p->drag[ idx ] = particle.drag;
+		p->age[ idx ] = particle.age;
+		p->lifetime[ idx ] = particle.lifetime;
+		p->cold[ idx ] = particle;
+	}
+
+	ps->num_particles += ps->new_particles;
+	ps->new_particles = 0;
+}
+
+static Vec3 PackPositionNormal( Vec3 position, Vec3 normal ) {
+	return Floor( position ) + ( normal * 0.49f + 0.5f );
+}
+
+// same as collide() in particle_update.glsl, but the trace isn't thread safe
+// so this runs serially before the integration jobs
+static void CollideCPUParticles( ParticleSystem * ps, float dt ) {
+	TracyZoneScoped;
+
+	CPUParticles * p = &ps->cpu;
+	memset( p->collided.ptr, 0, ps->num_particles * sizeof( u32 ) );
+
+	if( cl.map == NULL )
+		return;
+
+	for( size_t i = 0; i < ps->num_particles; i++ ) {
+		const GPUParticle & cold = p->cold[ i ];
+		if( ( cold.flags & ( PARTICLE_COLLISION_POINT | PARTICLE_COLLISION_SPHERE ) ) == 0 )
+			continue;
+
+		float radius = 0.0f;
+		if( cold.flags & PARTICLE_COLLISION_SPHERE ) {
+			radius = Lerp( cold.start_size, p->age[ i ] / p->lifetime[ i ], cold.end_size ) * ps->radius;
+		}
+
+		Vec3 position = Vec3( p->position_x[ i ], p->position_y[ i ], p->position_z[ i ] );
+		Vec3 velocity = Vec3( p->velocity_x[ i ], p->velocity_y[ i ], p->velocity_z[ i ] );
+
+		trace_t trace;
+		CM_TransformedBoxTrace( CM_Client, cl.map->cms, &trace, position, position + velocity * dt, Vec3( -radius ), Vec3( radius ), NULL, MASK_SOLID, Vec3( 0.0f ), Vec3( 0.0f ) );
+		if( trace.fraction == 1.0f )
+			continue;
+
+		Vec3 normal = trace.plane.normal;
+		velocity -= ( 1.0f + cold.restitution ) * Dot( velocity, normal ) * normal;
+		position = trace.endpos + velocity * ( 1.0f - trace.fraction ) * dt;
+
+		p->position_x[ i ] = position.x;
+		p->position_y[ i ] = position.y;
+		p->position_z[ i ] = position.z;
+		p->velocity_x[ i ] = velocity.x;
+		p->velocity_y[ i ] = velocity.y;
+		p->velocity_z[ i ] = velocity.z;
+		p->collided[ i ] = U32_MAX;
+
+		if( ps->feedback ) {
+			ps->particles_feedback[ i ].position_normal = PackPositionNormal( trace.endpos, normal );
+		}
+	}
+}
+
+struct IntegrateParticlesJob {
+	CPUParticles * particles;
+	size_t begin, end;
+	float dt;
+};
+
+static void IntegrateParticles( TempAllocator * temp, void * data ) {
+	TracyZoneScoped;
+
+	const IntegrateParticlesJob * job = ( const IntegrateParticlesJob * ) data;
+	CPUParticles * p = job->particles;
+	__m128 dt = _mm_set1_ps( job->dt );
+	__m128 one = _mm_set1_ps( 1.0f );
+
+	// the arrays are padded so the last group is allowed to run past end
+	for( size_t i = job->begin; i < job->end; i += 4 ) {
+		__m128 px = _mm_loadu_ps( &p->position_x[ i ] );
+		__m128 py = _mm_loadu_ps( &p->position_y[ i ] );
+		__m128 pz = _mm_loadu_ps( &p->position_z[ i ] );
+		__m128 vx = _mm_loadu_ps( &p->velocity_x[ i ] );
+		__m128 vy = _mm_loadu_ps( &p->velocity_y[ i ] );
+		__m128 vz = _mm_loadu_ps( &p->velocity_z[ i ] );
+
+		// collided particles were already moved by CollideCPUParticles
+		__m128 collided = _mm_loadu_ps( ( const float * ) &p->collided[ i ] );
+		px = _mm_add_ps( px, _mm_andnot_ps( collided, _mm_mul_ps( vx, dt ) ) );
+		py = _mm_add_ps( py, _mm_andnot_ps( collided, _mm_mul_ps( vy, dt ) ) );
+		pz = _mm_add_ps( pz, _mm_andnot_ps( collided, _mm_mul_ps( vz, dt ) ) );
+
+		__m128 angle = _mm_loadu_ps( &p->angle[ i ] );
+		angle = _mm_add_ps( angle, _mm_mul_ps( _mm_loadu_ps( &p->rotation_speed[ i ] ), dt ) );
+
+		__m128 age = _mm_add_ps( _mm_loadu_ps( &p->age[ i ] ), dt );
+
+		vz = _mm_add_ps( vz, _mm_mul_ps( _mm_loadu_ps( &p->acceleration[ i ] ), dt ) );
+
+		__m128 drag = _mm_sub_ps( one, _mm_mul_ps( _mm_loadu_ps( &p->drag[ i ] ), dt ) );
+		vx = _mm_mul_ps( vx, drag );
+		vy = _mm_mul_ps( vy, drag );
+		vz = _mm_mul_ps( vz, drag );
+
+		_mm_storeu_ps( &p->position_x[ i ], px );
+		_mm_storeu_ps( &p->position_y[ i ], py );
+		_mm_storeu_ps( &p->position_z[ i ], pz );
+		_mm_storeu_ps( &p->velocity_x[ i ], vx );
+		_mm_storeu_ps( &p->velocity_y[ i ], vy );
+		_mm_storeu_ps( &p->velocity_z[ i ], vz );
+		_mm_storeu_ps( &p->angle[ i ], angle );
+		_mm_storeu_ps( &p->age[ i ], age );
+	}
+}
+
+static void IntegrateCPUParticles( CPUParticles * particles, size_t num_particles, float dt, bool parallel ) {
+	TracyZoneScoped;
+
+	TempAllocator temp = cls.frame_arena.temp();
+
+	size_t num_jobs = ( num_particles + cpu_particles_per_job - 1 ) / cpu_particles_per_job;
+	Span< IntegrateParticlesJob > jobs = ALLOC_SPAN( &temp, IntegrateParticlesJob, num_jobs );
+	for( size_t i = 0; i < num_jobs; i++ ) {
+		jobs[ i ].particles = particles;
+		jobs[ i ].begin = i * cpu_particles_per_job;
+		jobs[ i ].end = Min2( num_particles, ( i + 1 ) * cpu_particles_per_job );
+		jobs[ i ].dt = dt;
+	}
+
+	if( parallel && num_jobs > 1 ) {
+		ParallelFor( jobs, IntegrateParticles );
+	}
+	else {
+		for( IntegrateParticlesJob & job : jobs ) {
+			IntegrateParticles( &temp, &job );
+		}
+	}
+}
+
+static void MoveCPUParticle( CPUParticles * p, size_t dst, size_t src ) {
+	p->position_x[ dst ] = p->position_x[ src ];
+	p->position_y[ dst ] = p->position_y[ src ];
+	p->position_z[ dst ] = p->position_z[ src ];
+	p->velocity_x[ dst ] = p->velocity_x[ src ];
+	p->velocity_y[ dst ] = p->velocity_y[ src ];
+	p->velocity_z[ dst ] = p->velocity_z[ src ];
+	p->angle[ dst ] = p->angle[ src ];
+	p->rotation_speed[ dst ] = p->rotation_speed[ src ];
+	p->acceleration[ dst ] = p->acceleration[ src ];
+	p->drag[ dst ] = p->drag[ src ];
+	p->age[ dst ] = p->age[ src ];
+	p->lifetime[ dst ] = p->lifetime[ src ];
+	p->cold[ dst ] = p->cold[ src ];
+}
+
+static GPUParticleFeedback CPUParticleFeedback( const ParticleSystem * ps, size_t i ) {
+	const CPUParticles * p = &ps->cpu;
+	const GPUParticle & cold = p->cold[ i ];
+
+	GPUParticleFeedback feedback;
+	feedback.parm = FEEDBACK_NONE;
+
+	if( p->collided[ i ] != 0 ) {
+		feedback.position_normal = ps->particles_feedback[ i ].position_normal;
+		feedback.parm |= FEEDBACK_COLLISION;
+	}
+	else {
+		Vec3 position = Vec3( p->position_x[ i ], p->position_y[ i ], p->position_z[ i ] );
+		Vec3 velocity = Vec3( p->velocity_x[ i ], p->velocity_y[ i ], p->velocity_z[ i ] );
+		float speed = Length( velocity );
+		feedback.position_normal = PackPositionNormal( position, speed == 0.0f ? Vec3( 0.0f, 0.0f, 1.0f ) : velocity / speed );
+	}
+
+	if( p->age[ i ] >= p->lifetime[ i ] ) {
+		feedback.parm |= FEEDBACK_AGE;
+	}
+
+	float fage = Min2( p->age[ i ] / p->lifetime[ i ], 1.0f );
+	feedback.color = RGB8(
+		Lerp( float( cold.start_color.r ), fage, float( cold.end_color.r ) ),
+		Lerp( float( cold.start_color.g ), fage, float( cold.end_color.g ) ),
+		Lerp( float( cold.start_color.b ), fage, float( cold.end_color.b ) )
+	);
+
+	return feedback;
+}
+
+// despawns dead particles, fires their events and writes the survivors to out
+static size_t CompactCPUParticles( ParticleSystem * ps, GPUParticle * out ) {
+	TracyZoneScoped;
+
+	CPUParticles * p = &ps->cpu;
+	size_t num_alive = 0;
+
+	for( size_t i = 0; i < ps->num_particles; i++ ) {
+		bool alive;
+		if( ps->feedback ) {
+			GPUParticleFeedback feedback = CPUParticleFeedback( ps, i );
+			alive = ParticleFeedback( ps, &feedback );
+		}
+		else {
+			alive = p->age[ i ] < p->lifetime[ i ];
+		}
+
+		if( !alive )
+			continue;
+
+		if( num_alive != i ) {
+			MoveCPUParticle( p, num_alive, i );
+		}
+
+		GPUParticle particle = p->cold[ num_alive ];
+		particle.position = Vec3( p->position_x[ num_alive ], p->position_y[ num_alive ], p->position_z[ num_alive ] );
+		particle.velocity = Vec3( p->velocity_x[ num_alive ], p->velocity_y[ num_alive ], p->velocity_z[ num_alive ] );
+		particle.angle = p->angle[ num_alive ];
+		particle.age = p->age[ num_alive ];
+
+		// out is write combined, don't read from it
+		memcpy( &out[ num_alive ], &particle, sizeof( particle ) );
+
+		num_alive++;
+	}
+
+	return num_alive;
+}
+
+static void SimulateCPUParticles( ParticleSystem * ps, float dt, GPUParticle * out, bool parallel ) {
+	SpawnCPUParticles( ps );
+	CollideCPUParticles( ps, dt );
+	IntegrateCPUParticles( &ps->cpu, ps->num_particles, dt, parallel );
+	ps->num_particles = CompactCPUParticles( ps, out );
+}
+
+static void UpdateCPUParticleSystem( ParticleSystem * ps, float dt ) {
+	TracyZoneScopedN( "Update CPU particles" );
+
+	if( ps->num_particles == 0 && ps->new_particles == 0 )
+		return;
+
+	StreamingBufferFrame( &ps->stream );
+	SimulateCPUParticles( ps, dt, ( GPUParticle * ) GetStreamingBufferMapping( ps->stream ), true );
+
+	RecordNullGLMappedWrite( ps->num_particles * sizeof( GPUParticle ) );
+}
+
 void UpdateParticleSystem( ParticleSystem * ps, float dt ) {
 	TracyZoneScopedN( "Update particles" );
 
+	if( ps->cpu_simulation ) {
+		UpdateCPUParticleSystem( ps, dt );
+		return;
+	}
+
 	size_t previous_num_particles = ps->num_particles;
 
 	{
@@ -854,6 +1186,17 @@ void DrawParticleSystem( ParticleSystem * ps, float dt ) {
 
 	TracyZoneScoped;
 
+	if( ps->cpu_simulation ) {
+		GPUBuffer vb = GetStreamingBufferBuffer( ps->stream );
+		if( ps->model ) {
+			DrawInstancedParticles( vb, ps->model, ps->num_particles );
+		}
+		else {
+			DrawInstancedParticles( ps->mesh, vb, ps->blend_func, ps->num_particles );
+		}
+		return;
+	}
+
 	if( ps->feedback ) {
 		UpdateParticlesFeedback( ps->update_mesh, ps->vb, ps->vb2, ps->vb_feedback, ps->radius, ps->num_particles, dt );
 	}
@@ -1172,6 +1515,46 @@ void ClearParticles() {
 	}
 }
 
+// simulates synthetic emitters that keep the system full, no GL required
+void CG_ParticleBenchmark_f() {
+	size_t num_particles = Cmd_Argc() >= 2 ? Max2( 1, atoi( Cmd_Argv( 1 ) ) ) : 100000;
+	int frames = Cmd_Argc() >= 3 ? Max2( 1, atoi( Cmd_Argv( 2 ) ) ) : 100;
+	float dt = 1.0f / 60.0f;
+
+	ParticleSystem ps = { };
+	ps.max_particles = num_particles;
+	ps.cpu_simulation = true;
+	ps.particles = ALLOC_SPAN( sys_allocator, GPUParticle, num_particles );
+	defer { FREE( sys_allocator, ps.particles.ptr ); };
+	InitCPUParticles( sys_allocator, &ps.cpu, num_particles );
+	defer { DeleteCPUParticles( sys_allocator, &ps.cpu ); };
+
+	Span< GPUParticle > out = ALLOC_SPAN( sys_allocator, GPUParticle, num_particles );
+	defer { FREE( sys_allocator, out.ptr ); };
+
+	constexpr const char * modes[] = { "serial", "jobs" };
+	for( size_t mode = 0; mode < ARRAY_COUNT( modes ); mode++ ) {
+		RNG rng = NewRNG( 0, 0 );
+		ps.num_particles = 0;
+		ps.new_particles = 0;
+
+		u64 start = Sys_Microseconds();
+
+		for( int frame = 0; frame < frames; frame++ ) {
+			while( ps.num_particles + ps.new_particles < ps.max_particles ) {
+				Vec3 velocity = UniformSampleOnSphere( &rng ) * RandomUniformFloat( &rng, 100.0f, 400.0f );
+				float lifetime = RandomUniformFloat( &rng, 0.25f, 2.0f );
+				EmitParticle( &ps, lifetime, Vec3( 0.0f ), velocity, 0.0f, 1.0f, -GRAVITY, 0.5f, 0.8f, Vec4( 0.0f ), Vec4( 1.0f ), Vec4( 0.0f ), 4.0f, 1.0f, 0 );
+			}
+
+			SimulateCPUParticles( &ps, dt, out.ptr, mode == 1 );
+		}
+
+		u64 elapsed = Sys_Microseconds() - start;
+		Com_Printf( "%s: %.2fus per frame, %zu particles, %d frames\n", modes[ mode ], double( elapsed ) / frames, num_particles, frames );
+	}
+}
+
 void DrawParticleMenuEffect() {
 	ImVec2 mouse_pos = ImGui::GetMousePos();
 	Vec2 pos = Clamp( Vec2( 0.0f ), Vec2( mouse_pos.x, mouse_pos.y ), frame_static.viewport ) - frame_static.viewport * 0.5f;
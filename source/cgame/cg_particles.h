@@ -1,7 +1,7 @@
 #pragma once
 
 #include "qcommon/types.h"
-#include "client/renderer/types.h"
+#include "client/renderer/backend.h"
 
 constexpr u32 MAX_PARTICLE_SYSTEMS = 512;
 constexpr u32 MAX_PARTICLE_EMITTERS = 512;
@@ -81,6 +81,19 @@ struct ParticleEvents {
 	StringHash events[ MAX_PARTICLE_EMITTER_EVENTS ];
 };
 
+// hot state of CPU simulated particles, laid out SoA so it can be integrated
+// 4 at a time. the arrays are padded to a multiple of 4. everything else
+// lives in cold, whose hot fields are stale until the particle is streamed
+struct CPUParticles {
+	Span< float > position_x, position_y, position_z;
+	Span< float > velocity_x, velocity_y, velocity_z;
+	Span< float > angle, rotation_speed;
+	Span< float > acceleration, drag;
+	Span< float > age, lifetime;
+	Span< u32 > collided;
+	Span< GPUParticle > cold;
+};
+
 struct ParticleSystem {
 	size_t max_particles;
 
@@ -109,6 +122,12 @@ struct ParticleSystem {
 	GPUBuffer vb2;
 	GPUBuffer vb_feedback;
 
+	// simulated on the CPU and streamed to the GPU each frame instead of
+	// being updated with transform feedback, so there's no readback
+	bool cpu_simulation;
+	CPUParticles cpu;
+	StreamingBuffer stream;
+
 	Mesh mesh;
 	Mesh update_mesh;
 };
@@ -191,6 +210,8 @@ struct ParticleEmitter {
 	ParticleEvents on_collision;
 	ParticleEvents on_age;
 	ParticleEvents on_frame;
+
+	bool cpu_simulation;
 };
 
 struct DecalEmitter {
@@ -223,7 +244,6 @@ struct DynamicLightEmitter {
 };
 
 void InitVisualEffects();
-void HotloadVisualEffects();
 void ShutdownVisualEffects();
 
 ParticleEmitterPosition ParticleEmitterSphere( Vec3 origin, Vec3 normal, float theta = 180.0f, float radius = 0.0f );
@@ -240,6 +260,8 @@ void DoVisualEffect( StringHash name, Vec3 origin, Vec3 normal = Vec3( 0.0f, 0.0
 void DrawParticles();
 void ClearParticles();
 
+void CG_ParticleBenchmark_f();
+
 // void InitParticleMenuEffect();
 // void ShutdownParticleEditor();
 
@@ -19,9 +19,11 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "cgame/cg_local.h"
+#include "qcommon/array.h"
 #include "qcommon/hash.h"
 #include "qcommon/hashtable.h"
 #include "client/assets.h"
+#include "client/threadpool.h"
 #include "client/renderer/renderer.h"
 #include "client/renderer/model.h"
 
@@ -33,6 +35,9 @@ static PlayerModelMetadata player_model_metadatas[ MAX_PLAYER_MODELS ];
 static u32 num_player_models;
 static Hashtable< MAX_PLAYER_MODELS * 2 > player_models_hashtable;
 
+// Model::num_nodes is a u8
+static AnimationCursor player_animation_cursors[ MAX_CLIENTS ][ 2 ][ U8_MAX + 1 ];
+
 static Mat4 EulerAnglesToMat4( float pitch, float yaw, float roll ) {
 	mat3_t axis;
 	AnglesToAxis( Vec3( pitch, yaw, roll ), axis );
@@ -208,6 +213,7 @@ void CG_ResetPModels() {
 	for( int i = 0; i < MAX_EDICTS; i++ ) {
 		memset( &cg_entPModels[i].animState, 0, sizeof( pmodel_animationstate_t ) );
 	}
+	memset( player_animation_cursors, 0, sizeof( player_animation_cursors ) );
 	memset( &cg.weapon, 0, sizeof( cg.weapon ) );
 }
 
@@ -698,6 +704,117 @@ static Mat4 TransformTag( const Model * model, const Mat4 & transform, const Mat
 	return transform * model->transform * pose.node_transforms[ tag.node_idx ] * tag.transform;
 }
 
+struct PlayerPoseJob {
+	int ent_num;
+	const PlayerModelMetadata * meta;
+
+	float lower_time;
+	float upper_time;
+	Span< AnimationCursor > lower_cursors;
+	Span< AnimationCursor > upper_cursors;
+
+	bool apply_rotators;
+	Quaternion upper_rotation;
+	Quaternion head_rotation;
+
+	MatrixPalettes pose;
+};
+
+static PlayerPoseJob PreparePlayerPose( Allocator * a, centity_t * cent, const PlayerModelMetadata * meta ) {
+	pmodel_t * pmodel = &cg_entPModels[ cent->current.number ];
+
+	PlayerPoseJob job = { };
+	job.ent_num = cent->current.number;
+	job.meta = meta;
+
+	CG_GetAnimationTimes( meta, pmodel, cl.serverTime, &job.lower_time, &job.upper_time );
+
+	// corpses get sampled too rarely for the cursors to be worth it
+	if( cent->current.type == ET_PLAYER && cent->current.number >= 1 && cent->current.number <= MAX_CLIENTS ) {
+		AnimationCursor ( *cursors )[ U8_MAX + 1 ] = player_animation_cursors[ cent->current.number - 1 ];
+		job.lower_cursors = Span< AnimationCursor >( cursors[ 0 ], meta->model->num_nodes );
+		job.upper_cursors = Span< AnimationCursor >( cursors[ 1 ], meta->model->num_nodes );
+	}
+
+	// apply UPPER and HEAD angles to rotator nodes
+	// also add rotations from velocity leaning
+	job.apply_rotators = cent->current.type != ET_CORPSE;
+	if( job.apply_rotators ) {
+		EulerDegrees3 upper_angles = EulerDegrees3( LerpAngles( pmodel->oldangles[ UPPER ], cg.lerpfrac, pmodel->angles[ UPPER ] ) * 0.5f );
+		Swap2( &upper_angles.pitch, &upper_angles.yaw ); // hack for rigg model
+		job.upper_rotation = EulerAnglesToQuaternion( upper_angles );
+
+		EulerDegrees3 head_angles = EulerDegrees3( LerpAngles( pmodel->oldangles[ HEAD ], cg.lerpfrac, pmodel->angles[ HEAD ] ) );
+		job.head_rotation = EulerAnglesToQuaternion( head_angles );
+	}
+
+	job.pose.node_transforms = ALLOC_SPAN( a, Mat4, meta->model->num_nodes );
+	if( meta->model->num_joints != 0 ) {
+		job.pose.skinning_matrices = ALLOC_SPAN( a, Mat4, meta->model->num_joints );
+	}
+
+	return job;
+}
+
+static void ComputePlayerPose( TempAllocator * temp, void * data ) {
+	PlayerPoseJob * job = ( PlayerPoseJob * ) data;
+	const PlayerModelMetadata * meta = job->meta;
+
+	Span< TRS > lower = SampleAnimation( temp, meta->model, job->lower_time, 0, job->lower_cursors );
+	Span< TRS > upper = SampleAnimation( temp, meta->model, job->upper_time, 0, job->upper_cursors );
+	MergeLowerUpperPoses( lower, upper, meta->model, meta->upper_root_node );
+
+	// add skeleton effects (pose is unmounted yet)
+	if( job->apply_rotators ) {
+		lower[ meta->upper_rotator_nodes[ 0 ] ].rotation *= job->upper_rotation;
+		lower[ meta->upper_rotator_nodes[ 1 ] ].rotation *= job->upper_rotation;
+		lower[ meta->head_rotator_node ].rotation *= job->head_rotation;
+	}
+
+	ComputeMatrixPalettes( &job->pose, meta->model, lower );
+}
+
+static bool ShouldDrawPlayer( const centity_t * cent ) {
+	if( cent->type != ET_PLAYER && cent->type != ET_CORPSE )
+		return false;
+	if( cent->current.linearMovement && !cent->linearProjectileCanDraw )
+		return false;
+	return cent->current.team != TEAM_SPECTATOR;
+}
+
+void CG_AnimatePlayers( Allocator * a ) {
+	TracyZoneScoped;
+
+	DynamicArray< PlayerPoseJob > jobs( a );
+
+	for( int pnum = 0; pnum < cg.frame.numEntities; pnum++ ) {
+		const SyncEntityState * state = &cg.frame.parsedEntities[ pnum & ( MAX_PARSE_ENTITIES - 1 ) ];
+		centity_t * cent = &cg_entities[ state->number ];
+		if( !ShouldDrawPlayer( cent ) )
+			continue;
+
+		const PlayerModelMetadata * meta = GetPlayerModelMetadata( cent->current.number );
+		if( meta == NULL )
+			continue;
+
+		jobs.add( PreparePlayerPose( a, cent, meta ) );
+	}
+
+	// not worth waking the workers for one player
+	if( jobs.size() > 1 ) {
+		ParallelFor( jobs.span(), ComputePlayerPose );
+	}
+	else if( jobs.size() == 1 ) {
+		TempAllocator temp = cls.frame_arena.temp();
+		ComputePlayerPose( &temp, &jobs[ 0 ] );
+	}
+
+	for( const PlayerPoseJob & job : jobs ) {
+		cg_entPModels[ job.ent_num ].pose = job.pose;
+		cg_entPModels[ job.ent_num ].pose_framecount = cls.framecount;
+	}
+}
+
 void CG_DrawPlayer( centity_t * cent ) {
 	pmodel_t * pmodel = &cg_entPModels[ cent->current.number ];
 	const PlayerModelMetadata * meta = GetPlayerModelMetadata( cent->current.number );
@@ -727,13 +844,14 @@ void CG_DrawPlayer( centity_t * cent ) {
 
 	TempAllocator temp = cls.frame_arena.temp();
 
-	float lower_time, upper_time;
-	CG_GetAnimationTimes( meta, pmodel, cl.serverTime, &lower_time, &upper_time );
-	Span< TRS > lower = SampleAnimation( &temp, meta->model, lower_time );
-	Span< TRS > upper = SampleAnimation( &temp, meta->model, upper_time );
-	MergeLowerUpperPoses( lower, upper, meta->model, meta->upper_root_node );
+	// normally CG_AnimatePlayers has done this already
+	MatrixPalettes pose = pmodel->pose;
+	if( pmodel->pose_framecount != cls.framecount ) {
+		PlayerPoseJob job = PreparePlayerPose( &temp, cent, meta );
+		ComputePlayerPose( &temp, &job );
+		pose = job.pose;
+	}
 
-	// add skeleton effects (pose is unmounted yet)
 	bool corpse = cent->current.type == ET_CORPSE;
 	if( !corpse ) {
 		Vec3 tmpangles;
@@ -749,26 +867,8 @@ void CG_DrawPlayer( centity_t * cent ) {
 		}
 
 		AnglesToAxis( tmpangles, cent->interpolated.axis );
-
-		// apply UPPER and HEAD angles to rotator nodes
-		// also add rotations from velocity leaning
-		{
-			EulerDegrees3 angles = EulerDegrees3( LerpAngles( pmodel->oldangles[ UPPER ], cg.lerpfrac, pmodel->angles[ UPPER ] ) * 0.5f );
-			Swap2( &angles.pitch, &angles.yaw ); // hack for rigg model
-
-			Quaternion q = EulerAnglesToQuaternion( angles );
-			lower[ meta->upper_rotator_nodes[ 0 ] ].rotation *= q;
-			lower[ meta->upper_rotator_nodes[ 1 ] ].rotation *= q;
-		}
-
-		{
-			EulerDegrees3 angles = EulerDegrees3( LerpAngles( pmodel->oldangles[ HEAD ], cg.lerpfrac, pmodel->angles[ HEAD ] ) );
-			lower[ meta->head_rotator_node ].rotation *= EulerAnglesToQuaternion( angles );
-		}
 	}
 
-	MatrixPalettes pose = ComputeMatrixPalettes( &temp, meta->model, lower );
-
 	Mat4 transform = FromAxisAndOrigin( cent->interpolated.axis, cent->interpolated.origin ) * Mat4Scale( cent->interpolated.scale );
 
 	Vec4 color = CG_TeamColorVec4( cent->current.team );
@@ -852,3 +952,63 @@ void CG_DrawPlayer( centity_t * cent ) {
 		}
 	}
 }
+
+// animates MAX_CLIENTS players across the player model's timeline without
+// drawing anything, so it also works with -headless
+void CG_AnimationBenchmark_f() {
+	const PlayerModelMetadata * meta = GetPlayerModelMetadata( 0 );
+	if( meta == NULL ) {
+		Com_Printf( "No player model to benchmark\n" );
+		return;
+	}
+
+	const Model * model = meta->model;
+	int frames = Cmd_Argc() >= 2 ? Max2( 1, atoi( Cmd_Argv( 1 ) ) ) : 1000;
+	float duration = model->num_animations > 0 ? model->animations[ 0 ].duration : 1.0f;
+
+	TempAllocator temp = cls.frame_arena.temp();
+
+	Span< AnimationCursor > cursors = ALLOC_SPAN( &temp, AnimationCursor, MAX_CLIENTS * 2 * model->num_nodes );
+	memset( cursors.ptr, 0, cursors.num_bytes() );
+
+	PlayerPoseJob jobs[ MAX_CLIENTS ];
+	for( int i = 0; i < MAX_CLIENTS; i++ ) {
+		jobs[ i ] = { };
+		jobs[ i ].meta = meta;
+		jobs[ i ].pose.node_transforms = ALLOC_SPAN( &temp, Mat4, model->num_nodes );
+		if( model->num_joints != 0 ) {
+			jobs[ i ].pose.skinning_matrices = ALLOC_SPAN( &temp, Mat4, model->num_joints );
+		}
+	}
+
+	constexpr const char * modes[] = { "search", "cursors", "cursors + jobs" };
+	for( size_t mode = 0; mode < ARRAY_COUNT( modes ); mode++ ) {
+		u64 start = Sys_Microseconds();
+
+		for( int frame = 0; frame < frames; frame++ ) {
+			for( int i = 0; i < MAX_CLIENTS; i++ ) {
+				// spread the players out so they don't all sample the same keyframes
+				float t = fmodf( frame / 60.0f + duration * i / MAX_CLIENTS, duration );
+				jobs[ i ].lower_time = t;
+				jobs[ i ].upper_time = t;
+				if( mode != 0 ) {
+					jobs[ i ].lower_cursors = cursors.slice( ( i * 2 + 0 ) * model->num_nodes, ( i * 2 + 1 ) * model->num_nodes );
+					jobs[ i ].upper_cursors = cursors.slice( ( i * 2 + 1 ) * model->num_nodes, ( i * 2 + 2 ) * model->num_nodes );
+				}
+			}
+
+			if( mode == 2 ) {
+				ParallelFor( Span< PlayerPoseJob >( jobs, MAX_CLIENTS ), ComputePlayerPose );
+			}
+			else {
+				for( int i = 0; i < MAX_CLIENTS; i++ ) {
+					TempAllocator job_temp = cls.frame_arena.temp();
+					ComputePlayerPose( &job_temp, &jobs[ i ] );
+				}
+			}
+		}
+
+		u64 elapsed = Sys_Microseconds() - start;
+		Com_Printf( "%s: %.2fus per frame, %d players, %d frames\n", modes[ mode ], double( elapsed ) / frames, MAX_CLIENTS, frames );
+	}
+}
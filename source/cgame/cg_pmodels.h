@@ -192,6 +192,10 @@ struct pmodel_t {
 	Vec3 oldangles[PMODEL_PARTS];             // for rotations
 
 	Mat4 muzzle_transform;
+
+	// filled in by CG_AnimatePlayers, only valid for the frame it was computed on
+	MatrixPalettes pose;
+	s64 pose_framecount = -1;
 };
 
 extern pmodel_t cg_entPModels[MAX_EDICTS];      //a pmodel handle for each cg_entity
@@ -213,7 +217,9 @@ const PlayerModelMetadata * GetPlayerModelMetadata( int ent_num );
 
 void CG_ResetPModels();
 
+void CG_AnimatePlayers( Allocator * a );
 void CG_DrawPlayer( centity_t * cent );
+void CG_AnimationBenchmark_f();
 void CG_UpdatePlayerModelEnt( centity_t *cent );
 void CG_PModel_AddAnimation( int entNum, int loweranim, int upperanim, int headanim, int channel );
 void CG_PModel_ClearEventAnimations( int entNum );
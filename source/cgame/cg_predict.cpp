@@ -30,6 +30,21 @@ static bool cg_triggersListTriggered[MAX_PARSE_ENTITIES];
 
 static bool ucmdReady = false;
 
+// the predicted state after every closed ucmd. when a new snapshot agrees with
+// what we predicted for the last ucmd it executed, everything we predicted
+// after that is still good and we can pick up from the newest one instead of
+// replaying every unacknowledged ucmd
+struct PredictionCacheEntry {
+	s64 ucmd;
+	SyncPlayerState player_state;
+};
+
+static constexpr float PREDICTION_CACHE_TOLERANCE = 0.1f;
+
+static PredictionCacheEntry prediction_cache[ CMD_BACKUP ];
+static u64 prediction_cache_lookups;
+static u64 prediction_cache_hits;
+
 /*
 * CG_PredictedEvent - shared code can fire events during prediction
 */
@@ -273,6 +288,108 @@ int CG_PointContents( Vec3 point ) {
 }
 
 
+void CG_ResetPredictionCache() {
+	for( PredictionCacheEntry & entry : prediction_cache ) {
+		entry.ucmd = -1;
+	}
+
+	prediction_cache_lookups = 0;
+	prediction_cache_hits = 0;
+}
+
+// if these fire you added a field, so add it to PredictionMatches too (or
+// say why it's safe to skip) and then update the sizes
+STATIC_ASSERT( sizeof( SyncPlayerState ) == 208 );
+STATIC_ASSERT( sizeof( pmove_state_t ) == 64 );
+
+// events and viewangles are skipped because prediction never reads them back
+static bool PredictionMatches( const SyncPlayerState & predicted, const SyncPlayerState & server ) {
+	const pmove_state_t & a = predicted.pmove;
+	const pmove_state_t & b = server.pmove;
+
+	if( Length( a.origin - b.origin ) > PREDICTION_CACHE_TOLERANCE || Length( a.velocity - b.velocity ) > PREDICTION_CACHE_TOLERANCE )
+		return false;
+	if( Abs( a.stamina - b.stamina ) > 0.001f || Abs( a.stamina_stored - b.stamina_stored ) > 0.001f )
+		return false;
+
+	if( a.pm_type != b.pm_type || a.pm_flags != b.pm_flags || a.pm_time != b.pm_time || a.features != b.features )
+		return false;
+	if( a.delta_angles[ 0 ] != b.delta_angles[ 0 ] || a.delta_angles[ 1 ] != b.delta_angles[ 1 ] || a.delta_angles[ 2 ] != b.delta_angles[ 2 ] )
+		return false;
+	if( a.no_shooting_time != b.no_shooting_time || a.knockback_time != b.knockback_time || a.tbag_time != b.tbag_time )
+		return false;
+	if( a.stamina_state != b.stamina_state || a.max_speed != b.max_speed )
+		return false;
+
+	for( size_t i = 0; i < ARRAY_COUNT( predicted.weapons ); i++ ) {
+		if( predicted.weapons[ i ].weapon != server.weapons[ i ].weapon || predicted.weapons[ i ].ammo != server.weapons[ i ].ammo )
+			return false;
+	}
+
+	if( predicted.weapon != server.weapon || predicted.pending_weapon != server.pending_weapon || predicted.last_weapon != server.last_weapon )
+		return false;
+	if( predicted.weapon_state != server.weapon_state || predicted.weapon_state_time != server.weapon_state_time || predicted.zoom_time != server.zoom_time )
+		return false;
+	if( predicted.gadget != server.gadget || predicted.gadget_ammo != server.gadget_ammo || predicted.using_gadget != server.using_gadget || predicted.pending_gadget != server.pending_gadget )
+		return false;
+
+	// the rest only comes from the server, but resuming would bring back the
+	// old values so they have to match too
+	if( predicted.viewheight != server.viewheight || predicted.perk != server.perk )
+		return false;
+	if( predicted.ready != server.ready || predicted.voted != server.voted || predicted.can_change_loadout != server.can_change_loadout )
+		return false;
+	if( predicted.carrying_bomb != server.carrying_bomb || predicted.can_plant != server.can_plant )
+		return false;
+	if( predicted.health != server.health || predicted.max_health != server.max_health || predicted.flashed != server.flashed )
+		return false;
+	if( predicted.team != server.team || predicted.real_team != server.real_team )
+		return false;
+	if( predicted.progress_type != server.progress_type || predicted.progress != server.progress )
+		return false;
+	if( predicted.pointed_player != server.pointed_player || predicted.pointed_health != server.pointed_health )
+		return false;
+
+	return true;
+}
+
+static bool StandingOnMover() {
+	if( cg.predictedGroundEntity == -1 )
+		return false;
+
+	const SyncEntityState * ent = &cg_entities[ cg.predictedGroundEntity ].current;
+	return ent->linearMovement && CM_TryFindCModel( CM_Client, ent->model ) != NULL;
+}
+
+// sets cg.predictFrom to the newest cached prediction if the snapshot agrees
+// with what we predicted for the ucmd it acknowledges
+static void ResumeFromPredictionCache( s64 ucmdExecuted, s64 ucmdHead ) {
+	prediction_cache_lookups++;
+
+	const PredictionCacheEntry * acked = &prediction_cache[ ucmdExecuted & CMD_MASK ];
+	bool hit = acked->ucmd == ucmdExecuted && PredictionMatches( acked->player_state, cg.frame.playerState );
+
+	// movers are predicted from the snapshot's server time, so everything we
+	// predicted while riding one is stale
+	if( !hit || StandingOnMover() ) {
+		if( cg_showMiss->integer ) {
+			Com_Printf( "prediction cache miss on %" PRIi64 "\n", cg.frame.serverFrame );
+		}
+		return;
+	}
+
+	prediction_cache_hits++;
+
+	s64 resume = ucmdExecuted;
+	while( resume + 1 < ucmdHead && prediction_cache[ ( resume + 1 ) & CMD_MASK ].ucmd == resume + 1 ) {
+		resume++;
+	}
+
+	cg.predictFrom = resume;
+	cg.predictFromPlayerState = prediction_cache[ resume & CMD_MASK ].player_state;
+	cg.predictFromEntityState = cg_entities[ cg.frame.playerState.POVnum ].current;
+}
+
 static float predictedSteps[CMD_BACKUP]; // for step smoothing
 static void CG_PredictAddStep( int virtualtime, int predictiontime, float stepSize ) {
 
@@ -346,6 +463,11 @@ void CG_PredictMovement() {
 		cg.predictFrom = 0;
 	}
 
+	// only worth looking up if there's more than the open ucmd to replay
+	if( cg.predictFrom == 0 && ucmdHead - ucmdExecuted > 1 && ucmdHead - ucmdExecuted < CMD_BACKUP ) {
+		ResumeFromPredictionCache( ucmdExecuted, ucmdHead );
+	}
+
 	if( cg.predictFrom > 0 ) {
 		ucmdExecuted = cg.predictFrom;
 		cg.predictedPlayerState = cg.predictFromPlayerState;
@@ -374,6 +496,8 @@ void CG_PredictMovement() {
 	// clear the triggered toggles for this prediction round
 	memset( &cg_triggersListTriggered, false, sizeof( cg_triggersListTriggered ) );
 
+	u32 pmoves = 0;
+
 	// run frames
 	while( ++ucmdExecuted <= ucmdHead ) {
 		frame = ucmdExecuted & CMD_MASK;
@@ -385,6 +509,7 @@ void CG_PredictMovement() {
 		}
 
 		Pmove( &client_gs, &pm );
+		pmoves++;
 
 		// copy for stair smoothing
 		predictedSteps[frame] = pm.step;
@@ -396,6 +521,11 @@ void CG_PredictMovement() {
 		// save for debug checking
 		cg.predictedOrigins[frame] = cg.predictedPlayerState.pmove.origin; // store for prediction error checks
 
+		if( ucmdExecuted < ucmdHead ) {
+			prediction_cache[ frame ].ucmd = ucmdExecuted;
+			prediction_cache[ frame ].player_state = cg.predictedPlayerState;
+		}
+
 		// backup the last predicted ucmd which has a timestamp (it's closed)
 		if( ucmdExecuted == ucmdHead - 1 ) {
 			if( ucmdExecuted != cg.predictFrom ) {
@@ -406,6 +536,9 @@ void CG_PredictMovement() {
 		}
 	}
 
+	TracyCPlot( "Pmoves per frame", s64( pmoves ) );
+	TracyCPlot( "Prediction cache hit rate", prediction_cache_lookups == 0 ? 0.0 : double( prediction_cache_hits ) / double( prediction_cache_lookups ) );
+
 	cg.predictedGroundEntity = pm.groundentity;
 
 	// compensate for ground entity movement
@@ -21,6 +21,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "cgame/cg_local.h"
 #include "client/renderer/renderer.h"
 #include "client/renderer/text.h"
+#include "client/frame_pacer.h"
 
 Cvar *cg_showPointedPlayer;
 Cvar *cg_draw2D;
@@ -528,6 +529,19 @@ void AddDamageEffect( float x ) {
 	cg.damage_effect = Min2( max, cg.damage_effect + x );
 }
 
+static void CG_DrawFrameTiming() {
+	if( !Cvar_Bool( "cl_showFrameTiming" ) )
+		return;
+
+	TempAllocator temp = cls.frame_arena.temp();
+	FramePacerStats stats = GetFramePacerStats();
+	const char * msg = temp( "frame {.2}ms (stddev {.2}ms), work {.2}ms, input to submit {.2}ms",
+		stats.frame_time_ms, stats.frame_time_stddev_ms, stats.work_time_ms, stats.input_to_submit_ms );
+
+	float margin = frame_static.viewport_height * 0.01f;
+	DrawText( cgs.fontNormal, cgs.textSizeSmall, msg, Alignment_RightTop, frame_static.viewport_width - margin, margin, vec4_white, true );
+}
+
 void CG_Draw2DView() {
 	TracyZoneScoped;
 
@@ -547,6 +561,7 @@ void CG_Draw2DView() {
 
 	CG_DrawHUD();
 	CG_DrawChat();
+	CG_DrawFrameTiming();
 }
 
 void CG_Draw2D() {
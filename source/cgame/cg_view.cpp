@@ -609,6 +609,9 @@ void CG_RenderView( unsigned extrapolationTime ) {
 
 	DrawWorld();
 	DrawSilhouettes();
+
+	TempAllocator temp = cls.frame_arena.temp();
+	CG_AnimatePlayers( &temp );
 	DrawEntities();
 	CG_AddViewWeapon( &cg.weapon );
 	DrawGibs();
@@ -24,6 +24,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "gameshared/q_math.h"
 
 constexpr u32 TILE_SIZE = 32; // forward+ tile size
+constexpr u32 CLUSTER_DEPTH_SLICES = 16; // exponentially spaced slices per tile
+constexpr float CLUSTER_FAR_PLANE = 8192.0f; // anything further away goes in the last slice
 constexpr float DLIGHT_CUTOFF = 0.5f;
 
 struct InterpolatedEntity {
@@ -19,9 +19,16 @@ struct Asset {
 	char * data;
 	size_t len;
 	bool compressed;
+
+	// compressed assets keep their zstd data around and only get
+	// decompressed into data when somebody asks for them
+	Span< u8 > zst;
+	u32 pin_count;
+	u64 last_used;
 };
 
 static constexpr u32 MAX_ASSETS = 4096;
+static constexpr size_t ASSET_CACHE_BUDGET = 64 * 1024 * 1024; // 64MB
 
 static Mutex * assets_mutex;
 
@@ -34,13 +41,91 @@ static FSChangeMonitor * fs_change_monitor;
 static const char * modified_asset_paths[ MAX_ASSETS ];
 static u32 num_modified_assets;
 
+// editors tend to write files several times when saving, so we wait for
+// changes to settle before reloading them
+static constexpr s64 HOTLOAD_DEBOUNCE_MS = 200;
+static constexpr u32 MAX_PENDING_HOTLOADS = 1024;
+
+struct PendingHotload {
+	char * path;
+	s64 last_change;
+	bool loading;
+	bool changed_while_loading;
+
+	// written by the job, guarded by assets_mutex
+	bool done;
+	char * contents;
+	size_t len;
+};
+
+static PendingHotload * pending_hotloads[ MAX_PENDING_HOTLOADS ];
+static u32 num_pending_hotloads;
+
+static constexpr u32 MAX_ASSET_SUBSCRIPTIONS = 64;
+
+struct AssetSubscription {
+	const char * pattern;
+	AssetsChangedCallback callback;
+};
+
+static AssetSubscription asset_subscriptions[ MAX_ASSET_SUBSCRIPTIONS ];
+static u32 num_asset_subscriptions;
+
 static Hashtable< MAX_ASSETS * 2 > assets_hashtable;
 
+static size_t asset_cache_bytes;
+static u64 asset_cache_clock;
+
+// replacing a pinned asset can't free its old memory because somebody is
+// still reading it, so we hang on to it until the last unpin
+struct RetiredAssetMemory {
+	u64 idx;
+	void * ptr;
+};
+
+static NonRAIIDynamicArray< RetiredAssetMemory > retired_asset_memory;
+
 enum IsCompressed {
 	IsCompressed_No,
 	IsCompressed_Yes,
 };
 
+static void EvictAsset( Asset * a ) {
+	asset_cache_bytes -= a->len;
+	FREE( sys_allocator, a->data );
+	a->data = NULL;
+	a->len = 0;
+}
+
+static void FreeOrRetireAssetMemory( u64 idx, void * ptr ) {
+	if( ptr == NULL )
+		return;
+
+	if( assets[ idx ].pin_count == 0 ) {
+		FREE( sys_allocator, ptr );
+		return;
+	}
+
+	retired_asset_memory.add( { idx, ptr } );
+}
+
+// assets_mutex must be held
+static void ReleasePin( u64 idx ) {
+	assert( assets[ idx ].pin_count > 0 );
+	assets[ idx ].pin_count--;
+	if( assets[ idx ].pin_count > 0 )
+		return;
+
+	for( size_t i = 0; i < retired_asset_memory.size(); i++ ) {
+		if( retired_asset_memory[ i ].idx == idx ) {
+			FREE( sys_allocator, retired_asset_memory[ i ].ptr );
+			retired_asset_memory[ i ] = retired_asset_memory.top();
+			retired_asset_memory.resize( retired_asset_memory.size() - 1 );
+			i--;
+		}
+	}
+}
+
 static void AddAsset( const char * path, u64 hash, char * contents, size_t len, IsCompressed compressed ) {
 	Lock( assets_mutex );
 	defer { Unlock( assets_mutex ); };
@@ -56,17 +141,31 @@ static void AddAsset( const char * path, u64 hash, char * contents, size_t len,
 	Asset * a;
 	if( exists ) {
 		a = &assets[ idx ];
-		FREE( sys_allocator, a->data );
+		if( a->compressed ) {
+			asset_cache_bytes -= a->len;
+		}
+		FreeOrRetireAssetMemory( idx, a->data );
+		FreeOrRetireAssetMemory( idx, a->zst.ptr );
 	}
 	else {
 		a = &assets[ num_assets ];
 		a->path = CopyString( sys_allocator, path );
+		a->pin_count = 0;
 		asset_paths[ num_assets ] = a->path;
 	}
 
-	a->data = contents;
-	a->len = len;
 	a->compressed = compressed == IsCompressed_Yes;
+	if( a->compressed ) {
+		a->data = NULL;
+		a->len = 0;
+		a->zst = Span< u8 >( ( u8 * ) contents, len );
+	}
+	else {
+		a->data = contents;
+		a->len = len;
+		a->zst = Span< u8 >();
+	}
+	a->last_used = asset_cache_clock;
 
 	modified_asset_paths[ num_modified_assets ] = a->path;
 	num_modified_assets++;
@@ -77,85 +176,122 @@ static void AddAsset( const char * path, u64 hash, char * contents, size_t len,
 	}
 }
 
-struct DecompressAssetJob {
-	char * path;
-	u64 hash;
-	Span< u8 > compressed;
-};
+static Span< const char > MaterializeAsset( u64 idx ) {
+	Asset * a = &assets[ idx ];
 
-static void DecompressAsset( TempAllocator * temp, void * data ) {
-	TracyZoneScoped;
+	Span< const u8 > zst;
+	{
+		Lock( assets_mutex );
+		defer { Unlock( assets_mutex ); };
+
+		asset_cache_clock++;
+		a->last_used = asset_cache_clock;
 
-	DecompressAssetJob * job = ( DecompressAssetJob * ) data;
+		if( a->data != NULL || a->zst.ptr == NULL )
+			return Span< const char >( a->data, a->len );
+
+		// stop a hotload from freeing zst while we decompress it
+		a->pin_count++;
+		zst = a->zst;
+	}
 
-	TracyZoneText( job->path, strlen( job->path ) );
+	TracyZoneScopedN( "Decompress asset" );
+	TracyZoneText( a->path, strlen( a->path ) );
 
-	char * path_with_zst = ( *temp )( "{}.zst", job->path );
 	Span< u8 > decompressed;
-	if( Decompress( path_with_zst, sys_allocator, job->compressed, &decompressed ) ) {
+	char * decompressed_and_terminated = NULL;
+	if( Decompress( a->path, sys_allocator, zst, &decompressed ) ) {
 		// TODO: we need to add a null terminator too so AssetString etc works
-		char * decompressed_and_terminated = ALLOC_MANY( sys_allocator, char, decompressed.n + 1 );
+		decompressed_and_terminated = ALLOC_MANY( sys_allocator, char, decompressed.n + 1 );
 		memcpy( decompressed_and_terminated, decompressed.ptr, decompressed.n );
 		decompressed_and_terminated[ decompressed.n ] = '\0';
+	}
+	FREE( sys_allocator, decompressed.ptr );
 
-		AddAsset( job->path, job->hash, decompressed_and_terminated, decompressed.n, IsCompressed_Yes );
+	Lock( assets_mutex );
+	defer { Unlock( assets_mutex ); };
+
+	ReleasePin( idx );
+
+	// someone else beat us to it, or it got hotloaded while we were working
+	if( a->data != NULL || a->zst.ptr != zst.ptr ) {
+		FREE( sys_allocator, decompressed_and_terminated );
+		return Span< const char >( a->data, a->len );
 	}
 
-	FREE( sys_allocator, decompressed.ptr );
-	FREE( sys_allocator, job->path );
-	FREE( sys_allocator, job->compressed.ptr );
-	FREE( sys_allocator, job );
-}
+	// don't retry broken assets every time they get used
+	if( decompressed_and_terminated == NULL ) {
+		FreeOrRetireAssetMemory( idx, a->zst.ptr );
+		a->zst = Span< u8 >();
+		return Span< const char >();
+	}
 
-static void LoadAsset( TempAllocator * temp, const char * game_path, const char * full_path ) {
-	TracyZoneScoped;
-	TracyZoneText( game_path, strlen( game_path ) );
+	a->data = decompressed_and_terminated;
+	a->len = decompressed.n;
+	asset_cache_bytes += a->len;
 
-	Span< const char > ext = FileExtension( game_path );
-	bool compressed = ext == ".zst";
+	return Span< const char >( a->data, a->len );
+}
 
-	Span< const char > game_path_no_zst = MakeSpan( game_path );
-	if( compressed ) {
-		game_path_no_zst.n -= ext.n;
+static Span< const char > StripZstExtension( const char * game_path ) {
+	Span< const char > path = MakeSpan( game_path );
+	if( FileExtension( game_path ) == ".zst" ) {
+		path.n -= strlen( ".zst" );
 	}
+	return path;
+}
 
-	u64 hash = Hash64( game_path_no_zst );
+static bool ShouldLoadAsset( const char * game_path ) {
+	bool compressed = FileExtension( game_path ) == ".zst";
+	Span< const char > game_path_no_zst = StripZstExtension( game_path );
 
-	{
-		Lock( assets_mutex );
-		defer { Unlock( assets_mutex ); };
+	Lock( assets_mutex );
+	defer { Unlock( assets_mutex ); };
 
-		u64 idx;
-		bool exists = assets_hashtable.get( hash, &idx );
-		if( exists ) {
-			if( !StrEqual( game_path_no_zst, asset_paths[ idx ] ) ) {
-				Fatal( "Asset hash name collision: %s and %s", game_path, assets[ idx ].path );
-			}
+	u64 idx;
+	if( !assets_hashtable.get( Hash64( game_path_no_zst ), &idx ) )
+		return true;
 
-			if( compressed && !assets[ idx ].compressed ) {
-				return;
-			}
-		}
+	if( !StrEqual( game_path_no_zst, asset_paths[ idx ] ) ) {
+		Fatal( "Asset hash name collision: %s and %s", game_path, assets[ idx ].path );
 	}
 
-	size_t len;
-	char * contents = ReadFileString( sys_allocator, full_path, &len );
-	if( contents == NULL )
+	// uncompressed assets take priority
+	return !compressed || assets[ idx ].compressed;
+}
+
+static void InstallAsset( TempAllocator * temp, const char * game_path, char * contents, size_t len ) {
+	if( !ShouldLoadAsset( game_path ) ) {
+		FREE( sys_allocator, contents );
 		return;
+	}
 
-	if( compressed ) {
-		DecompressAssetJob * job = ALLOC( sys_allocator, DecompressAssetJob );
-		job->path = ( *sys_allocator )( "{}", game_path_no_zst );
-		job->hash = hash;
-		job->compressed = Span< u8 >( ( u8 * ) contents, len );
+	Span< const char > game_path_no_zst = StripZstExtension( game_path );
+	u64 hash = Hash64( game_path_no_zst );
 
-		ThreadPoolDo( DecompressAsset, job );
+	if( FileExtension( game_path ) == ".zst" ) {
+		AddAsset( ( *temp )( "{}", game_path_no_zst ), hash, contents, len, IsCompressed_Yes );
 	}
 	else {
 		AddAsset( game_path, hash, contents, len, IsCompressed_No );
 	}
 }
 
+static void LoadAsset( TempAllocator * temp, const char * game_path, const char * full_path ) {
+	TracyZoneScoped;
+	TracyZoneText( game_path, strlen( game_path ) );
+
+	if( !ShouldLoadAsset( game_path ) )
+		return;
+
+	size_t len;
+	char * contents = ReadFileString( sys_allocator, full_path, &len );
+	if( contents == NULL )
+		return;
+
+	InstallAsset( temp, game_path, contents, len );
+}
+
 static void LoadAssetsRecursive( TempAllocator * temp, DynamicString * path, size_t skip ) {
 	ListDirHandle scan = BeginListDir( temp, path->c_str() );
 
@@ -185,8 +321,14 @@ void InitAssets( TempAllocator * temp ) {
 
 	num_assets = 0;
 	num_modified_assets = 0;
+	num_pending_hotloads = 0;
+	num_asset_subscriptions = 0;
 	assets_hashtable.clear();
 
+	asset_cache_bytes = 0;
+	asset_cache_clock = 0;
+	retired_asset_memory.init( sys_allocator );
+
 	DynamicString base( temp, "{}/base", RootDirPath() );
 	fs_change_monitor = NewFSChangeMonitor( sys_allocator, base.c_str() );
 	LoadAssetsRecursive( temp, &base, base.length() + 1 );
@@ -194,32 +336,181 @@ void InitAssets( TempAllocator * temp ) {
 	num_modified_assets = 0;
 }
 
+static void HotloadAssetJob( TempAllocator * temp, void * data ) {
+	PendingHotload * hotload = ( PendingHotload * ) data;
+
+	TracyZoneScopedN( "Hotload asset" );
+	TracyZoneText( hotload->path, strlen( hotload->path ) );
+
+	const char * full_path = ( *temp )( "{}/base/{}", RootDirPath(), hotload->path );
+
+	size_t len;
+	char * contents = ReadFileString( sys_allocator, full_path, &len );
+
+	Lock( assets_mutex );
+	hotload->contents = contents;
+	hotload->len = len;
+	hotload->done = true;
+	Unlock( assets_mutex );
+}
+
+static void QueueHotload( const char * path, s64 now ) {
+	for( u32 i = 0; i < num_pending_hotloads; i++ ) {
+		PendingHotload * hotload = pending_hotloads[ i ];
+		if( StrEqual( hotload->path, path ) ) {
+			hotload->last_change = now;
+			if( hotload->loading ) {
+				hotload->changed_while_loading = true;
+			}
+			return;
+		}
+	}
+
+	if( num_pending_hotloads == ARRAY_COUNT( pending_hotloads ) ) {
+		Com_Printf( S_COLOR_YELLOW "Too many pending hotloads, dropping %s\n", path );
+		return;
+	}
+
+	PendingHotload * hotload = ALLOC( sys_allocator, PendingHotload );
+	*hotload = { };
+	hotload->path = CopyString( sys_allocator, path );
+	hotload->last_change = now;
+
+	pending_hotloads[ num_pending_hotloads ] = hotload;
+	num_pending_hotloads++;
+}
+
+static void DeletePendingHotload( PendingHotload * hotload ) {
+	FREE( sys_allocator, hotload->contents );
+	FREE( sys_allocator, hotload->path );
+	FREE( sys_allocator, hotload );
+}
+
+static bool MatchesAssetPattern( const char * pattern, const char * path ) {
+	if( *pattern == '\0' )
+		return *path == '\0';
+
+	if( *pattern == '*' ) {
+		do {
+			if( MatchesAssetPattern( pattern + 1, path ) )
+				return true;
+		} while( *path++ != '\0' );
+		return false;
+	}
+
+	return *pattern == *path && MatchesAssetPattern( pattern + 1, path + 1 );
+}
+
+static void NotifyAssetSubscribers( TempAllocator * temp ) {
+	TracyZoneScoped;
+
+	for( u32 i = 0; i < num_asset_subscriptions; i++ ) {
+		AssetsChangedCallback callback = asset_subscriptions[ i ].callback;
+
+		// callbacks with several patterns get called once with everything they match
+		bool seen = false;
+		for( u32 j = 0; j < i; j++ ) {
+			seen = seen || asset_subscriptions[ j ].callback == callback;
+		}
+		if( seen )
+			continue;
+
+		NonRAIIDynamicArray< const char * > paths( temp );
+		for( u32 j = 0; j < num_modified_assets; j++ ) {
+			for( u32 k = i; k < num_asset_subscriptions; k++ ) {
+				if( asset_subscriptions[ k ].callback == callback && MatchesAssetPattern( asset_subscriptions[ k ].pattern, modified_asset_paths[ j ] ) ) {
+					paths.add( modified_asset_paths[ j ] );
+					break;
+				}
+			}
+		}
+
+		if( paths.size() > 0 ) {
+			callback( paths.span() );
+		}
+	}
+}
+
 void HotloadAssets( TempAllocator * temp ) {
 	TracyZoneScoped;
 
+	s64 now = Sys_Milliseconds();
+
 	const char * buf[ 1024 ];
 	Span< const char * > changes = PollFSChangeMonitor( temp, fs_change_monitor, buf, ARRAY_COUNT( buf ) );
-	std::sort( changes.begin(), changes.end(), SortCStringsComparator );
+	for( const char * path : changes ) {
+		QueueHotload( path, now );
+	}
+
+	for( u32 i = 0; i < num_pending_hotloads; i++ ) {
+		PendingHotload * hotload = pending_hotloads[ i ];
+
+		if( !hotload->loading ) {
+			if( now - hotload->last_change >= HOTLOAD_DEBOUNCE_MS ) {
+				hotload->loading = true;
+				ThreadPoolDo( HotloadAssetJob, hotload );
+			}
+			continue;
+		}
 
-	for( size_t i = 0; i < changes.n; i++ ) {
-		if( i > 0 && StrEqual( changes[ i ], changes[ i - 1 ] ) )
+		bool done;
+		{
+			Lock( assets_mutex );
+			defer { Unlock( assets_mutex ); };
+			done = hotload->done;
+		}
+
+		if( !done )
 			continue;
-		char * full_path = ( *temp )( "{}/base/{}", RootDirPath(), changes[ i ] );
-		LoadAsset( temp, changes[ i ], full_path );
-	}
 
-	ThreadPoolFinish();
+		if( hotload->contents != NULL ) {
+			InstallAsset( temp, hotload->path, hotload->contents, hotload->len );
+			hotload->contents = NULL;
+		}
+
+		// it got saved again while we were reading it, so go round again
+		if( hotload->changed_while_loading ) {
+			hotload->loading = false;
+			hotload->changed_while_loading = false;
+			hotload->done = false;
+			continue;
+		}
+
+		DeletePendingHotload( hotload );
+		num_pending_hotloads--;
+		pending_hotloads[ i ] = pending_hotloads[ num_pending_hotloads ];
+		i--;
+	}
 
 	if( num_modified_assets > 0 ) {
 		Com_Printf( "Hotloading:\n" );
-		for( const char * path : ModifiedAssetPaths() ) {
-			Com_Printf( "    %s\n", path );
+		for( u32 i = 0; i < num_modified_assets; i++ ) {
+			Com_Printf( "    %s\n", modified_asset_paths[ i ] );
 		}
+
+		NotifyAssetSubscribers( temp );
+		num_modified_assets = 0;
 	}
 }
 
-void DoneHotloadingAssets() {
-	num_modified_assets = 0;
+void SubscribeToAssetChanges( const char * pattern, AssetsChangedCallback callback ) {
+	if( num_asset_subscriptions == ARRAY_COUNT( asset_subscriptions ) ) {
+		Fatal( "Too many asset subscriptions" );
+	}
+
+	asset_subscriptions[ num_asset_subscriptions ] = { pattern, callback };
+	num_asset_subscriptions++;
+}
+
+void UnsubscribeFromAssetChanges( AssetsChangedCallback callback ) {
+	u32 n = 0;
+	for( u32 i = 0; i < num_asset_subscriptions; i++ ) {
+		if( asset_subscriptions[ i ].callback != callback ) {
+			asset_subscriptions[ n ] = asset_subscriptions[ i ];
+			n++;
+		}
+	}
+	num_asset_subscriptions = n;
 }
 
 void ShutdownAssets() {
@@ -228,6 +519,17 @@ void ShutdownAssets() {
 	for( u32 i = 0; i < num_assets; i++ ) {
 		FREE( sys_allocator, assets[ i ].path );
 		FREE( sys_allocator, assets[ i ].data );
+		FREE( sys_allocator, assets[ i ].zst.ptr );
+	}
+
+	for( RetiredAssetMemory retired : retired_asset_memory ) {
+		FREE( sys_allocator, retired.ptr );
+	}
+	retired_asset_memory.shutdown();
+
+	// the thread pool is already gone so nothing can still be writing to these
+	for( u32 i = 0; i < num_pending_hotloads; i++ ) {
+		DeletePendingHotload( pending_hotloads[ i ] );
 	}
 
 	DeleteFSChangeMonitor( sys_allocator, fs_change_monitor );
@@ -235,11 +537,103 @@ void ShutdownAssets() {
 	DeleteMutex( assets_mutex );
 }
 
+void TrimAssetCache() {
+	TracyZoneScoped;
+
+	Lock( assets_mutex );
+	defer { Unlock( assets_mutex ); };
+
+	TracyCPlot( "Asset cache size", asset_cache_bytes );
+
+	if( asset_cache_bytes <= ASSET_CACHE_BUDGET )
+		return;
+
+	u32 candidates[ MAX_ASSETS ];
+	u32 num_candidates = 0;
+
+	for( u32 i = 0; i < num_assets; i++ ) {
+		const Asset * a = &assets[ i ];
+		if( a->compressed && a->data != NULL && a->pin_count == 0 ) {
+			candidates[ num_candidates ] = i;
+			num_candidates++;
+		}
+	}
+
+	std::sort( candidates, candidates + num_candidates, []( u32 a, u32 b ) {
+		return assets[ a ].last_used < assets[ b ].last_used;
+	} );
+
+	for( u32 i = 0; i < num_candidates; i++ ) {
+		if( asset_cache_bytes <= ASSET_CACHE_BUDGET )
+			break;
+		EvictAsset( &assets[ candidates[ i ] ] );
+	}
+}
+
+void PrefetchAssets( Span< const char * > paths ) {
+	TracyZoneScoped;
+
+	DynamicArray< u64 > jobs( sys_allocator );
+
+	{
+		Lock( assets_mutex );
+		defer { Unlock( assets_mutex ); };
+
+		for( const char * path : paths ) {
+			u64 idx;
+			if( !assets_hashtable.get( StringHash( path ).hash, &idx ) )
+				continue;
+			if( assets[ idx ].compressed && assets[ idx ].data == NULL ) {
+				jobs.add( idx );
+			}
+		}
+	}
+
+	// ParallelFor waits for every job in the pool, which might include
+	// startup work that has nothing to do with us
+	if( jobs.size() == 0 )
+		return;
+
+	ParallelFor( jobs.span(), []( TempAllocator * temp, void * data ) {
+		MaterializeAsset( *( const u64 * ) data );
+	} );
+}
+
+void PinAsset( StringHash path ) {
+	u64 i;
+	if( !assets_hashtable.get( path.hash, &i ) )
+		return;
+
+	Lock( assets_mutex );
+	defer { Unlock( assets_mutex ); };
+
+	assets[ i ].pin_count++;
+}
+
+void PinAsset( const char * path ) {
+	PinAsset( StringHash( path ) );
+}
+
+void UnpinAsset( StringHash path ) {
+	u64 i;
+	if( !assets_hashtable.get( path.hash, &i ) )
+		return;
+
+	Lock( assets_mutex );
+	defer { Unlock( assets_mutex ); };
+
+	ReleasePin( i );
+}
+
+void UnpinAsset( const char * path ) {
+	UnpinAsset( StringHash( path ) );
+}
+
 Span< const char > AssetString( StringHash path ) {
 	u64 i;
 	if( !assets_hashtable.get( path.hash, &i ) )
 		return Span< const char >();
-	return Span< const char >( assets[ i ].data, assets[ i ].len );
+	return MaterializeAsset( i );
 }
 
 Span< const char > AssetString( const char * path ) {
@@ -257,7 +651,3 @@ Span< const u8 > AssetBinary( const char * path ) {
 Span< const char * > AssetPaths() {
 	return Span< const char * >( asset_paths, num_assets );
 }
-
-Span< const char * > ModifiedAssetPaths() {
-	return Span< const char * >( modified_asset_paths, num_modified_assets );
-}
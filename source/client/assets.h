@@ -7,7 +7,24 @@ void InitAssets( TempAllocator * temp );
 void ShutdownAssets();
 
 void HotloadAssets( TempAllocator * temp );
-void DoneHotloadingAssets();
+
+// subscribers get called from HotloadAssets with the changed assets that
+// match any of their patterns, where * matches anything. patterns need to
+// outlive the subscription
+using AssetsChangedCallback = void ( * )( Span< const char * > paths );
+void SubscribeToAssetChanges( const char * pattern, AssetsChangedCallback callback );
+void UnsubscribeFromAssetChanges( AssetsChangedCallback callback );
+
+// compressed assets are decompressed the first time they're used and kept in
+// an LRU cache. the spans returned by AssetString/AssetBinary are only valid
+// until the next TrimAssetCache, so pin anything you need to keep around
+void TrimAssetCache();
+void PrefetchAssets( Span< const char * > paths );
+
+void PinAsset( StringHash path );
+void PinAsset( const char * path );
+void UnpinAsset( StringHash path );
+void UnpinAsset( const char * path );
 
 Span< const char > AssetString( StringHash path );
 Span< const char > AssetString( const char * path );
@@ -16,4 +33,3 @@ Span< const u8 > AssetBinary( StringHash path );
 Span< const u8 > AssetBinary( const char * path );
 
 Span< const char * > AssetPaths();
-Span< const char * > ModifiedAssetPaths();
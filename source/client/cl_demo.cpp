@@ -18,8 +18,13 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 */
 
+#include <algorithm>
+
 #include "client/client.h"
+#include "client/renderer/null_gl.h"
+#include "qcommon/array.h"
 #include "qcommon/fs.h"
+#include "qcommon/string.h"
 #include "qcommon/version.h"
 
 static void CL_PauseDemo( bool paused );
@@ -143,12 +148,88 @@ void CL_Record_f() {
 static int demofilehandle;
 static int demofilelen, demofilelentotal;
 
+// headless benchmarking
+struct BenchmarkFrame {
+	u64 cpu_us;
+	NullGLFrameStats gl;
+};
+
+static NonRAIIDynamicArray< BenchmarkFrame > benchmark_frames;
+static u64 benchmark_last_frame;
+
+void CL_BenchmarkFrame() {
+	u64 now = Sys_Microseconds();
+	u64 cpu_us = now - benchmark_last_frame;
+	benchmark_last_frame = now;
+
+	NullGLFrameStats gl = NullGLEndFrame();
+
+	if( !cls.demo.playing || cls.demo.paused || cls.state != CA_ACTIVE )
+		return;
+
+	BenchmarkFrame frame;
+	frame.cpu_us = cpu_us;
+	frame.gl = gl;
+	benchmark_frames.add( frame );
+}
+
+static void ReportBenchmark() {
+	if( benchmark_frames.size() == 0 ) {
+		Com_Printf( "No frames were benchmarked\n" );
+		return;
+	}
+
+	TempAllocator temp = cls.frame_arena.temp();
+	DynamicArray< u64 > cpu_us( &temp );
+	DynamicString csv( &temp, "frame,cpu_us,draw_calls,dispatches,state_changes,clears_and_blits,uploaded_bytes\n" );
+
+	u64 total_us = 0;
+	u64 total_draw_calls = 0;
+	u64 total_state_changes = 0;
+	u64 total_uploaded_bytes = 0;
+
+	for( size_t i = 0; i < benchmark_frames.size(); i++ ) {
+		const BenchmarkFrame & frame = benchmark_frames[ i ];
+		cpu_us.add( frame.cpu_us );
+
+		total_us += frame.cpu_us;
+		total_draw_calls += frame.gl.draw_calls;
+		total_state_changes += frame.gl.state_changes;
+		total_uploaded_bytes += frame.gl.uploaded_bytes;
+
+		csv.append( "{},{},{},{},{},{},{}\n", i, frame.cpu_us, frame.gl.draw_calls, frame.gl.dispatches, frame.gl.state_changes, frame.gl.clears_and_blits, frame.gl.uploaded_bytes );
+	}
+
+	std::sort( cpu_us.begin(), cpu_us.end() );
+
+	size_t n = benchmark_frames.size();
+	auto ms = []( u64 us ) { return us / 1000.0; };
+
+	Com_GGPrint( "Benchmarked {} frames of {}", n, cls.demo.name );
+	Com_GGPrint( "CPU frame time: avg {.3}ms, median {.3}ms, p99 {.3}ms, max {.3}ms", ms( total_us / n ), ms( cpu_us[ n / 2 ] ), ms( cpu_us[ n * 99 / 100 ] ), ms( cpu_us[ n - 1 ] ) );
+	Com_GGPrint( "Per frame: {} draw calls, {} state changes, {} KB uploaded", total_draw_calls / n, total_state_changes / n, total_uploaded_bytes / n / 1024 );
+
+	const char * path = temp( "{}/benchmarks/{}.csv", HomeDirPath(), StripExtension( cls.demo.name ) );
+	if( WriteFile( &temp, path, csv.c_str(), csv.length() ) ) {
+		Com_GGPrint( "Wrote per-frame stats to {}", path );
+	}
+	else {
+		Com_GGPrint( S_COLOR_YELLOW "Couldn't write {}", path );
+	}
+}
+
 /*
 * CL_DemoCompleted
 *
 * Close the demo file and disable demo state. Called from disconnection process
 */
 void CL_DemoCompleted() {
+	if( IsHeadless() && cls.demo.name != NULL ) {
+		ReportBenchmark();
+		benchmark_frames.shutdown();
+		Com_DeferQuit();
+	}
+
 	if( demofilehandle ) {
 		FS_FCloseFile( demofilehandle );
 		demofilehandle = 0;
@@ -275,6 +356,10 @@ static void CL_StartDemo( const char * demoname, bool yolo ) {
 	cls.demo.yolo = yolo;
 
 	CL_PauseDemo( false );
+
+	if( IsHeadless() ) {
+		benchmark_frames.init( sys_allocator );
+	}
 }
 
 void CL_PlayDemo_f() {
@@ -1,6 +1,7 @@
 #include "client/client.h"
 #include "client/icon.h"
 #include "client/renderer/renderer.h"
+#include "client/renderer/null_gl.h"
 
 #include "glad/glad.h"
 
@@ -13,8 +14,11 @@
 #include "stb/stb_image.h"
 
 GLFWwindow * window = NULL;
+static GLFWwindow * loader_context = NULL;
+static GLFWwindow * context_before_loader = NULL;
 
 static bool running_in_debugger = false;
+static bool headless = false;
 const bool is_dedicated_server = false;
 
 static int framebuffer_width, framebuffer_height;
@@ -23,6 +27,9 @@ static int framebuffer_width, framebuffer_height;
 extern Cvar * vid_mode;
 
 static void UpdateVidModeCvar() {
+	if( headless )
+		return;
+
 	TempAllocator temp = cls.frame_arena.temp();
 	Cvar_Set( "vid_mode", temp( "{}", GetWindowMode() ) );
 	vid_mode->modified = false;
@@ -291,6 +298,13 @@ static WindowMode CompleteWindowMode( WindowMode mode ) {
 void CreateWindow( WindowMode mode ) {
 	TracyZoneScoped;
 
+	if( headless ) {
+		framebuffer_width = mode.video_mode.width > 0 ? mode.video_mode.width : 1920;
+		framebuffer_height = mode.video_mode.height > 0 ? mode.video_mode.height : 1080;
+		InitNullGL();
+		return;
+	}
+
 	glfwWindowHint( GLFW_CLIENT_API, GLFW_OPENGL_API );
 	glfwWindowHint( GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE );
 	glfwWindowHint( GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE );
@@ -325,6 +339,16 @@ void CreateWindow( WindowMode mode ) {
 
 	glfwGetFramebufferSize( window, &framebuffer_width, &framebuffer_height );
 
+	// hidden window whose context shares objects with the main one, so we can
+	// compile shaders off the main thread
+	if( loader_context == NULL ) {
+		TracyZoneScopedN( "Create loader context" );
+
+		glfwWindowHint( GLFW_VISIBLE, GLFW_FALSE );
+		loader_context = glfwCreateWindow( 1, 1, APPLICATION, NULL, window );
+		glfwWindowHint( GLFW_VISIBLE, GLFW_TRUE );
+	}
+
 	{
 		TracyZoneScopedN( "Set window icon" );
 
@@ -358,19 +382,62 @@ void CreateWindow( WindowMode mode ) {
 
 void DestroyWindow() {
 	TracyZoneScoped;
+
+	if( headless ) {
+		ShutdownNullGL();
+		return;
+	}
+
+	DestroyLoaderContext();
 	glfwDestroyWindow( window );
 }
 
+bool MakeLoaderContextCurrent() {
+	if( loader_context == NULL )
+		return false;
+
+	// the thread pool runs jobs on the main thread too, so put back whatever
+	// was current when we're done
+	context_before_loader = glfwGetCurrentContext();
+	glfwMakeContextCurrent( loader_context );
+	return true;
+}
+
+void ReleaseLoaderContext() {
+	// make sure everything we made is done before another context uses it
+	glFinish();
+	glfwMakeContextCurrent( context_before_loader );
+	context_before_loader = NULL;
+}
+
+void DestroyLoaderContext() {
+	if( loader_context == NULL )
+		return;
+
+	glfwDestroyWindow( loader_context );
+	loader_context = NULL;
+}
+
+bool IsHeadless() {
+	return headless;
+}
+
 void GetFramebufferSize( int * width, int * height ) {
 	*width = framebuffer_width;
 	*height = framebuffer_height;
 }
 
 void FlashWindow() {
+	if( headless )
+		return;
 	glfwRequestWindowAttention( window );
 }
 
 VideoMode GetVideoMode( int monitor ) {
+	if( headless ) {
+		return { 1920, 1080, 60 };
+	}
+
 	const GLFWvidmode * glfw_mode = glfwGetVideoMode( GetMonitorByIdx( monitor ) );
 
 	VideoMode mode;
@@ -383,6 +450,12 @@ VideoMode GetVideoMode( int monitor ) {
 WindowMode GetWindowMode() {
 	WindowMode mode = { };
 
+	if( headless ) {
+		mode.video_mode.width = framebuffer_width;
+		mode.video_mode.height = framebuffer_height;
+		return mode;
+	}
+
 	glfwGetWindowPos( window, &mode.x, &mode.y );
 	glfwGetWindowSize( window, &mode.video_mode.width, &mode.video_mode.height );
 
@@ -417,6 +490,14 @@ WindowMode GetWindowMode() {
 }
 
 void SetWindowMode( WindowMode mode ) {
+	if( headless ) {
+		if( mode.video_mode.width > 0 && mode.video_mode.height > 0 ) {
+			framebuffer_width = mode.video_mode.width;
+			framebuffer_height = mode.video_mode.height;
+		}
+		return;
+	}
+
 	mode = CompleteWindowMode( mode );
 
 	if( mode.fullscreen == FullscreenMode_Windowed ) {
@@ -434,16 +515,23 @@ void SetWindowMode( WindowMode mode ) {
 }
 
 void EnableVSync( bool enabled ) {
+	if( headless )
+		return;
 	glfwSwapInterval( enabled ? 1 : 0 );
 }
 
 bool IsWindowFocused() {
+	if( headless )
+		return false;
 	return glfwGetWindowAttrib( window, GLFW_FOCUSED );
 }
 
 static double last_mouse_x, last_mouse_y;
 
 Vec2 GetMouseMovement() {
+	if( headless )
+		return Vec2( 0.0f );
+
 	double x, y;
 	glfwGetCursorPos( window, &x, &y );
 	Vec2 delta = Vec2( x - last_mouse_x, y - last_mouse_y );
@@ -452,7 +540,18 @@ Vec2 GetMouseMovement() {
 	return delta;
 }
 
+void PollWindowEvents() {
+	if( headless )
+		return;
+
+	TracyZoneScoped;
+	glfwPollEvents();
+}
+
 void GlfwInputFrame() {
+	if( headless )
+		return;
+
 	// show cursor if there are any imgui windows accepting inputs
 	bool gui_active = false;
 	const ImGuiContext * ctx = ImGui::GetCurrentContext();
@@ -485,13 +584,30 @@ void GlfwInputFrame() {
 
 void SwapBuffers() {
 	TracyZoneScoped;
+
+	if( headless ) {
+		CL_BenchmarkFrame();
+		return;
+	}
+
 	glfwSwapBuffers( window );
 }
 
 int main( int argc, char ** argv ) {
 	running_in_debugger = !is_public_build && Sys_BeingDebugged();
 
-	{
+	// -headless replaces the window and GL with the recording null GL, e.g.
+	// client -headless +demo mydemo benchmarks the renderer's CPU side
+	for( int i = 1; i < argc; i++ ) {
+		if( StrCaseEqual( argv[ i ], "-headless" ) ) {
+			headless = true;
+			memmove( &argv[ i ], &argv[ i + 1 ], ( argc - i ) * sizeof( argv[ 0 ] ) );
+			argc--;
+			break;
+		}
+	}
+
+	if( !headless ) {
 		TracyZoneScopedN( "Init GLFW" );
 
 		glfwSetErrorCallback( OnGlfwError );
@@ -508,10 +624,15 @@ int main( int argc, char ** argv ) {
 	Qcommon_Init( argc, argv );
 
 	int64_t oldtime = Sys_Milliseconds();
-	while( !glfwWindowShouldClose( window ) ) {
+	while( headless || !glfwWindowShouldClose( window ) ) {
 		int64_t newtime;
 		int dt;
-		{
+		if( headless ) {
+			// advance at a fixed 60Hz so frames are identical run to run and
+			// we go as fast as the CPU allows
+			dt = 16;
+		}
+		else {
 			TracyZoneScopedN( "Interframe" );
 
 			// find time spent rendering last frame
@@ -522,7 +643,7 @@ int main( int argc, char ** argv ) {
 			oldtime = newtime;
 		}
 
-		glfwPollEvents();
+		PollWindowEvents();
 
 		if( !Qcommon_Frame( dt ) ) {
 			break;
@@ -531,7 +652,9 @@ int main( int argc, char ** argv ) {
 
 	Qcommon_Shutdown();
 
-	glfwTerminate();
+	if( !headless ) {
+		glfwTerminate();
+	}
 
 	return 0;
 }
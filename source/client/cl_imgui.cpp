@@ -30,7 +30,9 @@ extern GLFWwindow * window;
 void CL_InitImGui() {
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
-	ImGui_ImplGlfw_InitForOpenGL( window, false );
+	if( !IsHeadless() ) {
+		ImGui_ImplGlfw_InitForOpenGL( window, false );
+	}
 
 	ImGuiIO & io = ImGui::GetIO();
 
@@ -133,7 +135,9 @@ void CL_InitImGui() {
 void CL_ShutdownImGui() {
 	DeleteTexture( atlas_texture );
 
-	ImGui_ImplGlfw_Shutdown();
+	if( !IsHeadless() ) {
+		ImGui_ImplGlfw_Shutdown();
+	}
 	ImGui::DestroyContext();
 }
 
@@ -223,7 +227,14 @@ static void SubmitDrawCalls() {
 void CL_ImGuiBeginFrame() {
 	TracyZoneScoped;
 
-	ImGui_ImplGlfw_NewFrame();
+	if( IsHeadless() ) {
+		ImGuiIO & io = ImGui::GetIO();
+		io.DisplaySize = ImVec2( frame_static.viewport_width, frame_static.viewport_height );
+		io.DeltaTime = Max2( cls.realFrameTime / 1000.0f, 0.001f );
+	}
+	else {
+		ImGui_ImplGlfw_NewFrame();
+	}
 	ImGui::NewFrame();
 }
 
@@ -22,11 +22,14 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "client/client.h"
 #include "client/assets.h"
 #include "client/downloads.h"
+#include "client/frame_pacer.h"
+#include "client/frame_tasks.h"
+#include "client/startup.h"
 #include "client/threadpool.h"
+#include "client/decode_cache.h"
 #include "client/demo_browser.h"
 #include "client/server_browser.h"
 #include "client/renderer/renderer.h"
-#include "qcommon/compression.h"
 #include "qcommon/csprng.h"
 #include "qcommon/hash.h"
 #include "qcommon/fs.h"
@@ -362,7 +365,7 @@ static void CL_Disconnect_SendCommand() {
 * This is also called on Com_Error, so it shouldn't cause any errors
 */
 void CL_Disconnect( const char *message ) {
-	CancelDownload(); // TODO: maybe shouldn't cancel when downloading a demo
+	CL_CancelDownload(); // TODO: maybe shouldn't cancel when downloading a demo
 
 	if( cls.state == CA_UNINITIALIZED ) {
 		return;
@@ -447,7 +450,7 @@ void CL_ServerReconnect_f() {
 		return;
 	}
 
-	CancelDownload();
+	CL_CancelDownload();
 
 	if( cls.demo.recording ) {
 		CL_Stop_f();
@@ -748,6 +751,10 @@ void CL_ReadPackets() {
 
 static int precache_spawncount;
 
+// old servers don't send one
+static bool precache_has_map_checksum;
+static u32 precache_map_checksum;
+
 void CL_FinishConnect() {
 	TempAllocator temp = cls.frame_arena.temp();
 
@@ -755,19 +762,15 @@ void CL_FinishConnect() {
 	CL_AddReliableCommand( temp( "begin {}\n", precache_spawncount ) );
 }
 
-static bool AddDownloadedMap( const char * filename, Span< const u8 > compressed ) {
-	if( compressed.ptr == NULL )
-		return false;
-
-	Span< u8 > data;
-	defer { FREE( sys_allocator, data.ptr ); };
-
-	if( !Decompress( filename, sys_allocator, compressed, &data ) ) {
+static bool AddDownloadedMap( const char * filename, Span< const u8 > data, u32 checksum ) {
+	// decompressed and checksummed while downloading
+	if( data.ptr == NULL || ( precache_has_map_checksum && checksum != precache_map_checksum ) ) {
 		Com_Printf( "Downloaded map is corrupt.\n" );
 		return false;
 	}
 
-	if( !AddMap( data, filename + strlen( "base/" ) ) ) {
+	TempAllocator temp = cls.frame_arena.temp();
+	if( !AddMap( data, temp( "{}", StripExtension( filename + strlen( "base/" ) ) ) ) ) {
 		Com_Printf( "Downloaded map is corrupt.\n" );
 		return false;
 	}
@@ -797,13 +800,17 @@ void CL_Precache_f() {
 
 	precache_spawncount = atoi( Cmd_Argv( 1 ) );
 
+	u64 map_checksum = 0;
+	precache_has_map_checksum = Cmd_Argc() > 3 && TryStringToU64( Cmd_Argv( 3 ), &map_checksum );
+	precache_map_checksum = u32( map_checksum );
+
 	const char * mapname = Cmd_Argv( 2 );
 	u64 hash = Hash64( mapname, strlen( mapname ), Hash64( "maps/" ) );
 
 	if( FindMap( StringHash( hash ) ) == NULL ) {
 		TempAllocator temp = cls.frame_arena.temp();
-		CL_DownloadFile( temp( "base/maps/{}.bsp.zst", Cmd_Argv( 2 ) ), []( const char * filename, Span< const u8 > data ) {
-			if( AddDownloadedMap( filename, data ) ) {
+		CL_DownloadFile( temp( "base/maps/{}.bsp.zst", Cmd_Argv( 2 ) ), []( const char * filename, Span< const u8 > data, u32 checksum ) {
+			if( AddDownloadedMap( filename, data, checksum ) ) {
 				CL_FinishConnect();
 			}
 			else {
@@ -1216,8 +1223,7 @@ void CL_Frame( int realMsec, int gameMsec ) {
 	CSPRNG( entropy, sizeof( entropy ) );
 	cls.rng = NewRNG( entropy[ 0 ], entropy[ 1 ] );
 
-	static int allRealMsec = 0, allGameMsec = 0, extraMsec = 0;
-	static float roundingMsec = 0.0f;
+	static int allRealMsec = 0, allGameMsec = 0;
 
 	cls.monotonicTime += realMsec;
 	cls.realtime += realMsec;
@@ -1242,9 +1248,6 @@ void CL_Frame( int realMsec, int gameMsec ) {
 
 	CL_UpdateSnapshot();
 	CL_AdjustServerTime( gameMsec );
-	CL_UserInputFrame( realMsec );
-	CL_NetFrame( realMsec, gameMsec );
-	PumpDownloads();
 
 	constexpr int absMinFps = 24;
 
@@ -1253,39 +1256,30 @@ void CL_Frame( int realMsec, int gameMsec ) {
 		Cvar_SetInteger( "cl_maxfps", absMinFps );
 	}
 	float maxFps = IFDEF( PLATFORM_LINUX ) || IsWindowFocused() ? cl_maxfps->number : absMinFps;
-	int minMsec = Max2( 1000.0f / maxFps, 1.0f );
-	roundingMsec += Max2( 1000.0f / maxFps, 1.0f ) - minMsec;
 
-	if( roundingMsec >= 1.0f ) {
-		minMsec += (int)roundingMsec;
-		roundingMsec -= (int)roundingMsec;
+	// let CPU sleep while minimized
+	bool idle = cls.state == CA_DISCONNECTED || !IsWindowFocused();
+	bool render = FramePacerReady( u64( 1000000.0f / maxFps ), idle );
+	if( render ) {
+		// we might have been waiting on the pacer for a while so get fresh input
+		PollWindowEvents();
 	}
 
-	if( allRealMsec + extraMsec < minMsec ) {
-		// let CPU sleep while minimized
-		bool sleep = cls.state == CA_DISCONNECTED || !IsWindowFocused();
+	CL_UserInputFrame( realMsec );
+	CL_NetFrame( realMsec, gameMsec );
+	PumpDownloads();
 
-		if( sleep && minMsec - extraMsec > 1 ) {
-			Sys_Sleep( minMsec - extraMsec - 1 );
-		}
+	if( !render )
 		return;
-	}
+
+	FramePacerInputSampled();
 
 	TracyCFrameMark;
 
-	DoneHotloadingAssets();
-	if( cl_hotloadAssets->integer != 0 ) {
-		TempAllocator temp = cls.frame_arena.temp();
-		HotloadAssets( &temp );
-	}
+	RunFrameTasks();
 
 	cls.frametime = cls.demo.paused ? 0 : allGameMsec;
 	cls.realFrameTime = allRealMsec;
-	if( allRealMsec < minMsec ) { // is compensating for a too slow frame
-		extraMsec = Clamp( 0, extraMsec - ( minMsec - allRealMsec ), 100 );
-	} else {   // too slow, or exact frame
-		extraMsec = Clamp( 0, allRealMsec - minMsec, 100 );
-	}
 
 	VID_CheckChanges();
 
@@ -1309,7 +1303,10 @@ void CL_Frame( int realMsec, int gameMsec ) {
 
 	cls.framecount++;
 
+	FrameTasksWorkDone();
+	FramePacerSubmitted();
 	SwapBuffers();
+	FramePacerSwapped();
 }
 
 void CL_Init() {
@@ -1317,7 +1314,7 @@ void CL_Init() {
 
 	InitLivePP();
 
-	constexpr size_t frame_arena_size = 1024 * 1024; // 1MB
+	constexpr size_t frame_arena_size = 16 * 1024 * 1024; // 16MB
 	void * frame_arena_memory = ALLOC_SIZE( sys_allocator, frame_arena_size, 16 );
 	cls.frame_arena = ArenaAllocator( frame_arena_memory, frame_arena_size );
 
@@ -1333,23 +1330,88 @@ void CL_Init() {
 
 	InitThreadPool();
 
-	ThreadPoolDo( []( TempAllocator * temp, void * data ) {
-		InitAssets( temp );
-	} );
-
-	VID_Init();
-
-	ThreadPoolFinish();
+	{
+		StartupTaskConfig assets;
+		assets.name = "Assets";
+		assets.kick = []( StartupTask * task ) {
+			StartupTaskDo( task, []( TempAllocator * temp, void * data ) {
+				InitAssets( temp );
+			} );
+		};
+		AddStartupTask( assets );
+
+		StartupTaskConfig prune_cache;
+		prune_cache.name = "Prune decode cache";
+		prune_cache.kick = []( StartupTask * task ) {
+			StartupTaskDo( task, []( TempAllocator * temp, void * data ) {
+				PruneDecodeCache( temp );
+			} );
+		};
+		AddStartupTask( prune_cache );
+
+		StartupTaskConfig window;
+		window.name = "Window";
+		window.finish = VID_Init;
+		AddStartupTask( window );
+
+		StartupTaskConfig textures;
+		textures.name = "Decode textures";
+		textures.dependencies[ 0 ] = "Assets";
+		textures.asset_extensions[ 0 ] = ".dds";
+		textures.kick = DecodeMaterialTextures;
+		AddStartupTask( textures );
+
+		StartupTaskConfig models;
+		models.name = "Decode models";
+		models.dependencies[ 0 ] = "Assets";
+		models.kick = DecodeModels;
+		AddStartupTask( models );
+
+		StartupTaskConfig shaders;
+		shaders.name = "Compile shaders";
+		shaders.dependencies[ 0 ] = "Assets";
+		shaders.dependencies[ 1 ] = "Window";
+		shaders.kick = CompileShaders;
+		AddStartupTask( shaders );
+
+		StartupTaskConfig renderer;
+		renderer.name = "Renderer";
+		renderer.dependencies[ 0 ] = "Window";
+		renderer.dependencies[ 1 ] = "Decode textures";
+		renderer.dependencies[ 2 ] = "Decode models";
+		renderer.dependencies[ 3 ] = "Compile shaders";
+		renderer.finish = InitRenderer;
+		AddStartupTask( renderer );
+
+		StartupTaskConfig bsps;
+		bsps.name = "Decompress maps";
+		bsps.dependencies[ 0 ] = "Assets";
+		bsps.asset_extensions[ 0 ] = ".bsp";
+		AddStartupTask( bsps );
+
+		StartupTaskConfig maps;
+		maps.name = "Maps";
+		maps.dependencies[ 0 ] = "Renderer";
+		maps.dependencies[ 1 ] = "Decompress maps";
+		maps.finish = InitMaps;
+		AddStartupTask( maps );
+
+		StartupTaskConfig sounds;
+		sounds.name = "Sounds";
+		sounds.dependencies[ 0 ] = "Assets";
+		sounds.kick = DecodeSounds;
+		sounds.finish = []() {
+			if( !S_Init() ) {
+				Com_Printf( S_COLOR_RED "Couldn't initialise audio engine\n" );
+			}
+		};
+		AddStartupTask( sounds );
 
-	InitRenderer();
-	InitMaps();
+		RunStartupTasks();
+	}
 
 	cls.white_material = FindMaterial( "$whiteimage" );
 
-	if( !S_Init() ) {
-		Com_Printf( S_COLOR_RED "Couldn't initialise audio engine\n" );
-	}
-
 	CL_ClearState();
 
 	// loopback
@@ -1379,6 +1441,28 @@ void CL_Init() {
 	InitDownloads();
 	InitServerBrowser();
 	InitDemoBrowser();
+	InitFramePacer();
+
+	{
+		FrameTaskConfig assets;
+		assets.name = "Assets";
+		assets.priority = FrameTaskPriority_EveryFrame;
+		assets.callback = []() {
+			TrimAssetCache();
+			if( cl_hotloadAssets->integer != 0 ) {
+				TempAllocator temp = cls.frame_arena.temp();
+				HotloadAssets( &temp );
+			}
+			return false;
+		};
+		AddFrameTask( assets );
+
+		FrameTaskConfig demo_metadata;
+		demo_metadata.name = "Demo browser metadata";
+		demo_metadata.priority = FrameTaskPriority_Low;
+		demo_metadata.callback = LoadDemoBrowserMetadata;
+		AddFrameTask( demo_metadata );
+	}
 
 	CL_InitImGui();
 	UI_Init();
@@ -1411,6 +1495,8 @@ void CL_Shutdown() {
 	ShutdownRenderer();
 	DestroyWindow();
 
+	ClearFrameTasks();
+	ShutdownFramePacer();
 	ShutdownDemoBrowser();
 	ShutdownServerBrowser();
 	ShutdownDownloads();
@@ -24,20 +24,21 @@ static void DeleteMap( Map * map ) {
 	DeleteBSPRenderData( map );
 }
 
-static void FillMapModelsHashtable() {
-	TracyZoneScoped;
-
-	map_models_hashtable.clear();
+static u64 MapModelHash( const Map * map, u32 model ) {
+	String< 16 > suffix( "*{}", model );
+	return Hash64( suffix.c_str(), suffix.length(), map->base_hash );
+}
 
-	for( u32 i = 0; i < num_maps; i++ ) {
-		const Map * map = &maps[ i ];
-		for( u32 j = 0; j < map->num_models; j++ ) {
-			String< 16 > suffix( "*{}", j );
-			u64 hash = Hash64( suffix.c_str(), suffix.length(), map->base_hash );
+static void AddMapModels( const Map * map ) {
+	for( u32 i = 0; i < map->num_models; i++ ) {
+		assert( map_models_hashtable.size() < MAX_MAP_MODELS );
+		map_models_hashtable.add( MapModelHash( map, i ), uintptr_t( &map->models[ i ] ) );
+	}
+}
 
-			assert( map_models_hashtable.size() < MAX_MAP_MODELS );
-			map_models_hashtable.add( hash, uintptr_t( &map->models[ j ] ) );
-		}
+static void RemoveMapModels( const Map * map ) {
+	for( u32 i = 0; i < map->num_models; i++ ) {
+		map_models_hashtable.remove( MapModelHash( map, i ) );
 	}
 }
 
@@ -59,6 +60,7 @@ bool AddMap( Span< const u8 > data, const char * path ) {
 		num_maps++;
 	}
 	else {
+		RemoveMapModels( &maps[ idx ] );
 		DeleteMap( &maps[ idx ] );
 	}
 
@@ -71,49 +73,59 @@ bool AddMap( Span< const u8 > data, const char * path ) {
 
 	maps[ idx ] = map;
 
-	FillMapModelsHashtable();
+	AddMapModels( &maps[ idx ] );
 
 	return true;
 }
 
-void InitMaps() {
+// the file reads happen on the thread pool before we get called, and the
+// decompression goes wide with PrefetchAssets, but building the render data
+// and collision model touches GL and the map list so that stays on the main
+// thread
+static void HotloadMaps( Span< const char * > paths ) {
 	TracyZoneScoped;
 
-	num_maps = 0;
-
-	for( const char * path : AssetPaths() ) {
-		Span< const char > ext = FileExtension( path );
-		if( ext != ".bsp" )
-			continue;
+	PrefetchAssets( paths );
 
+	for( const char * path : paths ) {
 		AddMap( AssetBinary( path ), path );
 	}
+
+	// if we hotload a map while playing a local game just assume we're
+	// playing on it and always hotload
+	if( Com_ServerState() != ss_dead ) {
+		G_HotloadMap();
+	}
 }
 
-void HotloadMaps() {
+void InitMaps() {
 	TracyZoneScoped;
 
-	bool hotloaded_anything = false;
+	num_maps = 0;
+	maps_hashtable.clear();
+	map_models_hashtable.clear();
+
+	DynamicArray< const char * > paths( sys_allocator );
+	for( const char * path : AssetPaths() ) {
+		if( FileExtension( path ) == ".bsp" ) {
+			paths.add( path );
+		}
+	}
 
-	for( const char * path : ModifiedAssetPaths() ) {
-		Span< const char > ext = FileExtension( path );
-		if( ext != ".bsp" )
-			continue;
+	PrefetchAssets( paths.span() );
 
+	for( const char * path : paths ) {
 		AddMap( AssetBinary( path ), path );
-		hotloaded_anything = true;
 	}
 
-	// if we hotload a map while playing a local game just assume we're
-	// playing on it and always hotload
-	if( hotloaded_anything && Com_ServerState() != ss_dead ) {
-		G_HotloadMap();
-	}
+	SubscribeToAssetChanges( "*.bsp", HotloadMaps );
 }
 
 void ShutdownMaps() {
 	TracyZoneScoped;
 
+	UnsubscribeFromAssetChanges( HotloadMaps );
+
 	for( u32 i = 0; i < num_maps; i++ ) {
 		DeleteMap( &maps[ i ] );
 	}
@@ -646,8 +646,6 @@ static void ServerBrowser() {
 static void DemoBrowser() {
 	TempAllocator temp = cls.frame_arena.temp();
 
-	DemoBrowserFrame();
-
 	ImGui::Checkbox( "Try to force load demos from old versions. Comes with no warranty", &yolodemo );
 
 	ImGui::Columns( 5, "demobrowser", false );
@@ -1225,6 +1223,8 @@ static void DemoMenu() {
 void UI_Refresh() {
 	TracyZoneScoped;
 
+	SetDemoBrowserOpen( uistate == UIState_MainMenu && mainmenu_state == MainMenuState_DemoBrowser );
+
 	if( uistate == UIState_Hidden && !Con_IsVisible() ) {
 		return;
 	}
@@ -1250,7 +1250,15 @@ void UI_Refresh() {
 			DrawParticleMenuEffect();
 		}
 
+		TempAllocator temp = cls.frame_arena.temp();
+
 		const char * connecting = "Connecting...";
+		const char * download_path;
+		float download_frac;
+		if( CL_DownloadProgress( &download_path, &download_frac ) ) {
+			connecting = temp( "Downloading {}... {}%", FileName( download_path ), int( download_frac * 100.0f ) );
+		}
+
 		ImGui::SetNextWindowPos( ImVec2() );
 		ImGui::SetNextWindowSize( ImVec2( frame_static.viewport_width, frame_static.viewport_height ) );
 		ImGui::Begin( "mainmenu", WindowZOrder_Menu, ImGuiWindowFlags_NoBackground | ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoBringToFrontOnFocus );
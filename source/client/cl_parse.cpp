@@ -22,24 +22,76 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "client/client.h"
 #include "client/downloads.h"
+#include "qcommon/array.h"
+#include "qcommon/compression.h"
 #include "qcommon/fs.h"
+#include "qcommon/hash.h"
 #include "qcommon/string.h"
 #include "qcommon/version.h"
 
 struct DownloadInProgress {
 	char * path;
 	DownloadCompleteCallback callback;
+
+	// .zst files get decompressed as they arrive, everything else
+	// gets buffered as is
+	DecompressionStream * decompressor;
+	NonRAIIDynamicArray< u8 > data;
 };
 
 static DownloadInProgress download;
 
-static void OnDownloadDone( int http_status, Span< const u8 > data ) {
-	Com_Printf( "Download %s: %s (%i)\n", data.ptr != NULL ? "successful" : "failed", download.path, http_status );
+static bool OnDownloadData( Span< const u8 > data ) {
+	if( download.decompressor != NULL ) {
+		return DecompressStreamChunk( download.decompressor, data );
+	}
+
+	download.data.add_many( data );
+	return true;
+}
+
+static void OnDownloadDone( int http_status, bool ok ) {
+	Span< const u8 > data;
+	u32 checksum = 0;
+	if( ok ) {
+		if( download.decompressor != NULL ) {
+			ok = FinishDecompressionStream( download.decompressor, &data, &checksum );
+		}
+		else {
+			data = download.data.span();
+			checksum = Hash32( data );
+		}
+	}
+
+	Com_Printf( "Download %s: %s (%i)\n", ok ? "successful" : "failed", download.path, http_status );
 
-	download.callback( download.path, data );
+	download.callback( download.path, ok ? data : Span< const u8 >(), checksum );
 
+	DeleteDecompressionStream( download.decompressor );
+	download.data.shutdown();
 	FREE( sys_allocator, download.path );
-	download.path = NULL;
+	download = { };
+}
+
+bool CL_DownloadProgress( const char ** path, float * frac ) {
+	u64 downloaded, total;
+	if( download.path == NULL || !GetDownloadProgress( &downloaded, &total ) )
+		return false;
+
+	*path = download.path;
+	*frac = total == 0 ? 0.0f : float( downloaded ) / float( total );
+	return true;
+}
+
+void CL_CancelDownload() {
+	CancelDownload();
+
+	if( download.path != NULL ) {
+		DeleteDecompressionStream( download.decompressor );
+		download.data.shutdown();
+		FREE( sys_allocator, download.path );
+		download = { };
+	}
 }
 
 bool CL_DownloadFile( const char * filename, DownloadCompleteCallback callback ) {
@@ -63,6 +115,12 @@ bool CL_DownloadFile( const char * filename, DownloadCompleteCallback callback )
 	download = { };
 	download.path = CopyString( sys_allocator, filename );
 	download.callback = callback;
+	download.data.init( sys_allocator );
+
+	if( FileExtension( filename ) == ".zst" ) {
+		constexpr size_t DECOMPRESSED_MAX_SIZE = 256 * 1000 * 1000; // 256MB
+		download.decompressor = NewDecompressionStream( sys_allocator, filename, DECOMPRESSED_MAX_SIZE );
+	}
 
 	TempAllocator temp = cls.frame_arena.temp();
 
@@ -72,10 +130,10 @@ bool CL_DownloadFile( const char * filename, DownloadCompleteCallback callback )
 			temp( "X-Client: {}", cl.playernum ),
 			temp( "X-Session: {}", cls.session ),
 		};
-		StartDownload( url, OnDownloadDone, headers, ARRAY_COUNT( headers ) );
+		StartDownload( url, OnDownloadData, OnDownloadDone, headers, ARRAY_COUNT( headers ) );
 	}
 	else {
-		StartDownload( url, OnDownloadDone, NULL, 0 );
+		StartDownload( url, OnDownloadData, OnDownloadDone, NULL, 0 );
 	}
 
 	Com_Printf( "Downloading %s\n", url );
@@ -2,12 +2,17 @@
 
 #include "qcommon/base.h"
 #include "qcommon/qcommon.h"
+#include "qcommon/fs.h"
 #include "qcommon/hash.h"
 #include "qcommon/array.h"
 #include "qcommon/hashtable.h"
+#include "qcommon/threads.h"
 #include "client/client.h"
 #include "client/assets.h"
+#include "client/decode_cache.h"
+#include "client/mixer.h"
 #include "client/sound.h"
+#include "client/startup.h"
 #include "client/threadpool.h"
 #include "cgame/cg_local.h"
 #include "gameshared/gs_public.h"
@@ -20,9 +25,15 @@
 #define STB_VORBIS_HEADER_ONLY
 #include "stb/stb_vorbis.h"
 
+#include "tracy/Tracy.hpp"
+
 struct Sound {
-	ALuint buf;
+	MixerSound mixer_sound;
 	bool mono;
+
+	// long sounds keep their Ogg around and the mixer decodes them as they play
+	bool streamed;
+	StringHash pinned_asset;
 };
 
 struct SoundEffect {
@@ -35,6 +46,7 @@ struct SoundEffect {
 		float pitch;
 		float pitch_random;
 		float attenuation;
+		u8 priority;
 	};
 
 	PlaybackConfig sounds[ 8 ];
@@ -67,17 +79,35 @@ struct PlayingSound {
 	Vec3 origin;
 	Vec3 end;
 
-	ALuint sources[ ARRAY_COUNT( &SoundEffect::sounds ) ];
+	MixerVoiceHandle voices[ ARRAY_COUNT( &SoundEffect::sounds ) ];
 	bool started[ ARRAY_COUNT( &SoundEffect::sounds ) ];
 	bool stopped[ ARRAY_COUNT( &SoundEffect::sounds ) ];
 };
 
+/*
+ * everything non-positional gets mixed in software into one stereo stream, and
+ * a background thread feeds that to a single AL source through a small ring of
+ * buffers. the output thread doesn't use CheckALErrors because alGetError is
+ * shared with the main thread and we'd report each other's errors
+ *
+ * the mixer still decides which positional voices are worth hearing, but the
+ * audible ones get played by AL sources so we keep HRTF, doppler and the
+ * distance model. a voice that goes virtual gives its source back, and picks
+ * up from the mixer's cursor when it comes back
+ */
+constexpr u32 OUTPUT_BUFFERS = 4;
+constexpr u32 OUTPUT_BUFFER_FRAMES = 512;
+constexpr float STREAM_SOUNDS_LONGER_THAN = 10.0f; // seconds
+
 static ALCdevice * al_device;
 static ALCcontext * al_context;
 
 // so we don't crash when some other application is running in exclusive playback mode (WASAPI/JACK/etc)
 static bool initialized;
 
+// sounds still get loaded when we can't open a device so mixerbench works headless
+static bool sounds_loaded;
+
 Cvar * s_device;
 static Cvar * s_volume;
 static Cvar * s_musicvolume;
@@ -85,7 +115,7 @@ static Cvar * s_muteinbackground;
 
 constexpr u32 MAX_SOUND_ASSETS = 4096;
 constexpr u32 MAX_SOUND_EFFECTS = 4096;
-constexpr u32 MAX_PLAYING_SOUNDS = 256;
+constexpr u32 MAX_PLAYING_SOUNDS = 512;
 
 static Sound sounds[ MAX_SOUND_ASSETS ];
 static u32 num_sounds;
@@ -95,18 +125,45 @@ static SoundEffect sound_effects[ MAX_SOUND_EFFECTS ];
 static u32 num_sound_effects;
 static Hashtable< MAX_SOUND_EFFECTS * 2 > sound_effects_hashtable;
 
-static ALuint free_sound_sources[ MAX_PLAYING_SOUNDS ];
-static u32 num_free_sound_sources;
-
 static PlayingSound playing_sound_effects[ MAX_PLAYING_SOUNDS ];
 static u32 num_playing_sound_effects;
 
 static Hashtable< MAX_PLAYING_SOUNDS * 2 > immediate_sounds_hashtable;
 static u64 immediate_sounds_autoinc;
 
-static ALuint music_source;
+static Mixer * mixer;
+static Vec3 listener_origin;
+
+static MixerVoiceHandle music_voice;
 static bool music_playing;
 
+static ALuint output_source;
+static ALuint output_buffers[ OUTPUT_BUFFERS ];
+
+struct PositionalSource {
+	ALuint source;
+	MixerVoiceHandle voice;
+
+	// what we last gave AL, so we only push changes
+	float gain;
+	Vec3 position;
+	Vec3 velocity;
+};
+
+struct ALListener {
+	Vec3 position;
+	Vec3 velocity;
+	float forward_and_up[ 6 ];
+	bool valid;
+};
+
+static ALListener al_listener;
+
+static PositionalSource positional_sources[ MAX_AUDIBLE_VOICES ];
+static Mutex * output_mutex;
+static Thread * output_thread;
+static bool output_shutting_down;
+
 constexpr float MusicIsWayTooLoud = 0.25f;
 
 const char * ALErrorMessage( ALenum error ) {
@@ -144,63 +201,108 @@ static void CheckALErrors( const char * fmt, const Rest & ... rest ) {
 	}
 }
 
-static void CheckedALListener( ALenum param, float x ) {
-	alListenerf( param, x );
-	CheckALErrors( "alListenerf( {}, {} )", param, x );
+static void CheckedALSource( ALuint source, ALenum param, ALint x ) {
+	alSourcei( source, param, x );
+	CheckALErrors( "alSourcei( {}, {}, {} )", source, param, x );
 }
 
-static void CheckedALListener( ALenum param, Vec3 v ) {
-	alListenerfv( param, v.ptr() );
-	CheckALErrors( "alListenerfv( {}, {} )", param, v );
+static void CheckedALSourceStop( ALuint source ) {
+	alSourceStop( source );
+	CheckALErrors( "alSourceStop( {} )", source );
 }
 
-static void CheckedALListener( ALenum param, const mat3_t m ) {
-	float forward_and_up[ 6 ];
-	forward_and_up[ 0 ] = m[ AXIS_FORWARD ];
-	forward_and_up[ 1 ] = m[ AXIS_FORWARD + 1 ];
-	forward_and_up[ 2 ] = m[ AXIS_FORWARD + 2 ];
-	forward_and_up[ 3 ] = m[ AXIS_UP ];
-	forward_and_up[ 4 ] = m[ AXIS_UP + 1 ];
-	forward_and_up[ 5 ] = m[ AXIS_UP + 2 ];
-	alListenerfv( param, forward_and_up );
-	CheckALErrors( "alListenerfv( {}, {}/{} )", param, FromQFAxis( m, AXIS_FORWARD ), FromQFAxis( m, AXIS_UP ) );
+static void QueueOutputBuffer( ALuint buffer ) {
+	s16 samples[ OUTPUT_BUFFER_FRAMES * 2 ];
+	MixAudio( mixer, Span< s16 >( samples, ARRAY_COUNT( samples ) ) );
+	alBufferData( buffer, AL_FORMAT_STEREO16, samples, sizeof( samples ), MIXER_SAMPLE_RATE );
+	alSourceQueueBuffers( output_source, 1, &buffer );
 }
 
-static ALint CheckedALGetSource( ALuint source, ALenum param ) {
-	ALint res;
-	alGetSourcei( source, param, &res );
-	CheckALErrors( "alGetSourcei( {}, {} )", source, param );
-	return res;
-}
+static void OutputThread( void * data ) {
+#if TRACY_ENABLE
+	tracy::SetThreadName( "Sound mixing" );
+#endif
 
-static void CheckedALSource( ALuint source, ALenum param, ALint x ) {
-	alSourcei( source, param, x );
-	CheckALErrors( "alSourcei( {}, {}, {} )", source, param, x );
-}
+	while( true ) {
+		Lock( output_mutex );
+		bool shutting_down = output_shutting_down;
+		Unlock( output_mutex );
 
-static void CheckedALSource( ALuint source, ALenum param, ALuint x ) {
-	alSourcei( source, param, x );
-	CheckALErrors( "alSourcei( {}, {}, {} )", source, param, x );
-}
+		if( shutting_down )
+			break;
 
-static void CheckedALSource( ALuint source, ALenum param, float x ) {
-	alSourcef( source, param, x );
-	CheckALErrors( "alSourcef( {}, {}, {} )", source, param, x );
-}
+		ALint processed;
+		alGetSourcei( output_source, AL_BUFFERS_PROCESSED, &processed );
+
+		for( ALint i = 0; i < processed; i++ ) {
+			ALuint buffer;
+			alSourceUnqueueBuffers( output_source, 1, &buffer );
+			QueueOutputBuffer( buffer );
+		}
+
+		// we fell behind and the source ran out of buffers, kick it again
+		ALint state;
+		alGetSourcei( output_source, AL_SOURCE_STATE, &state );
+		if( state != AL_PLAYING ) {
+			alSourcePlay( output_source );
+		}
 
-static void CheckedALSource( ALuint source, ALenum param, Vec3 v ) {
-	alSourcefv( source, param, v.ptr() );
-	CheckALErrors( "alSourcefv( {}, {}, {} )", source, param, v );
+		Sys_Sleep( 2 );
+	}
 }
 
-static void CheckedALSourcePlay( ALuint source ) {
-	alSourcePlay( source );
-	CheckALErrors( "alSourcePlay( {} )", source );
+static bool InitOutput() {
+	alGenSources( 1, &output_source );
+	alGenBuffers( ARRAY_COUNT( output_buffers ), output_buffers );
+	alSourcei( output_source, AL_SOURCE_RELATIVE, AL_TRUE );
+	alSourcei( output_source, AL_DIRECT_CHANNELS_SOFT, AL_TRUE );
+
+	for( PositionalSource & ps : positional_sources ) {
+		alGenSources( 1, &ps.source );
+		alSourcef( ps.source, AL_REFERENCE_DISTANCE, S_DEFAULT_ATTENUATION_REFDISTANCE );
+		alSourcef( ps.source, AL_MAX_DISTANCE, S_DEFAULT_ATTENUATION_MAXDISTANCE );
+		ps.voice = { 0 };
+	}
+
+	al_listener.valid = false;
+
+	if( alGetError() != AL_NO_ERROR )
+		return false;
+
+	for( ALuint buffer : output_buffers ) {
+		QueueOutputBuffer( buffer );
+	}
+	alSourcePlay( output_source );
+
+	if( alGetError() != AL_NO_ERROR )
+		return false;
+
+	output_shutting_down = false;
+	output_mutex = NewMutex();
+	output_thread = NewThread( OutputThread );
+
+	return true;
 }
 
-static void CheckedALSourceStop( ALuint source ) {
-	alSourceStop( source );
-	CheckALErrors( "alSourceStop( {} )", source );
+static void ShutdownOutput() {
+	Lock( output_mutex );
+	output_shutting_down = true;
+	Unlock( output_mutex );
+
+	JoinThread( output_thread );
+	DeleteMutex( output_mutex );
+
+	alSourceStop( output_source );
+	alSourcei( output_source, AL_BUFFER, 0 );
+	alDeleteSources( 1, &output_source );
+	alDeleteBuffers( ARRAY_COUNT( output_buffers ), output_buffers );
+
+	for( PositionalSource & ps : positional_sources ) {
+		alSourceStop( ps.source );
+		alDeleteSources( 1, &ps.source );
+	}
+
+	CheckALErrors( "ShutdownOutput" );
 }
 
 static bool S_InitAL() {
@@ -225,9 +327,10 @@ static bool S_InitAL() {
 	}
 
 	ALCint attrs[] = {
+		ALC_FREQUENCY, MIXER_SAMPLE_RATE,
 		ALC_HRTF_SOFT, ALC_HRTF_ENABLED_SOFT,
-		ALC_MONO_SOURCES, 256,
-		ALC_STEREO_SOURCES, 16,
+		ALC_MONO_SOURCES, MAX_AUDIBLE_VOICES,
+		ALC_STEREO_SOURCES, 1,
 		0
 	};
 	al_context = alcCreateContext( al_device, attrs );
@@ -244,13 +347,10 @@ static bool S_InitAL() {
 
 	alDistanceModel( AL_INVERSE_DISTANCE_CLAMPED );
 
-	alGenSources( ARRAY_COUNT( free_sound_sources ), free_sound_sources );
-	alGenSources( 1, &music_source );
-	num_free_sound_sources = ARRAY_COUNT( free_sound_sources );
-
-	if( alGetError() != AL_NO_ERROR ) {
-		Com_Printf( S_COLOR_RED "Failed to allocate sound sources\n" );
-		S_Shutdown();
+	if( !InitOutput() ) {
+		Com_Printf( S_COLOR_RED "Failed to allocate output source\n" );
+		alcDestroyContext( al_context );
+		alcCloseDevice( al_device );
 		return false;
 	}
 
@@ -268,14 +368,63 @@ struct DecodeSoundJob {
 		int sample_rate;
 		int num_samples;
 		s16 * samples;
+
+		// samples points into this when they come from the decode cache
+		Span< u8 > cached;
+
+		// streamed sounds only fill in channels/sample_rate/num_samples
+		bool streamed;
+		u64 decode_time;
 	} out;
 };
 
-static void AddSound( const char * path, int num_samples, int channels, int sample_rate, s16 * samples ) {
+struct DecodedSoundHeader {
+	s32 channels;
+	s32 sample_rate;
+	s32 num_samples;
+};
+
+// bumped when long sounds stopped going in the cache
+static constexpr u32 SOUND_DECODE_VERSION = 2;
+
+static void UploadSoundToAL( Sound * sound ) {
+	if( !sound->mono || sound->streamed )
+		return;
+
+	MixerSound * ms = &sound->mixer_sound;
+	ALuint buffer;
+	alGenBuffers( 1, &buffer );
+	alBufferData( buffer, AL_FORMAT_MONO16, ms->samples.ptr, ms->samples.num_bytes(), ms->sample_rate );
+	CheckALErrors( "UploadSoundToAL" );
+	ms->al_buffer = buffer;
+}
+
+static void FreeSoundAL( Sound * sound ) {
+	ALuint buffer = sound->mixer_sound.al_buffer;
+	if( buffer != 0 ) {
+		alDeleteBuffers( 1, &buffer );
+		sound->mixer_sound.al_buffer = 0;
+	}
+}
+
+static void FreeSound( Sound * sound ) {
+	FreeSoundAL( sound );
+
+	if( sound->streamed ) {
+		UnpinAsset( sound->pinned_asset );
+	}
+	else {
+		FREE( sys_allocator, const_cast< s16 * >( sound->mixer_sound.samples.ptr ) );
+	}
+}
+
+static void AddSound( const DecodeSoundJob & job ) {
 	TracyZoneScoped;
+
+	const char * path = job.in.path;
 	TracyZoneText( path, strlen( path ) );
 
-	if( num_samples == -1 ) {
+	if( job.out.num_samples < 0 ) {
 		Com_Printf( S_COLOR_RED "Couldn't decode sound %s\n", path );
 		return;
 	}
@@ -309,76 +458,216 @@ static void AddSound( const char * path, int num_samples, int channels, int samp
 	else {
 		restart_music = music_playing;
 		S_StopAllSounds( true );
-		alDeleteBuffers( 1, &sounds[ idx ].buf );
+		FreeSound( &sounds[ idx ] );
 	}
 
-	ALenum format = channels == 1 ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
-	alGenBuffers( 1, &sounds[ idx ].buf );
-	alBufferData( sounds[ idx ].buf, format, samples, num_samples * channels * sizeof( s16 ), sample_rate );
-	CheckALErrors( "AddSound" );
+	Sound * sound = &sounds[ idx ];
+	*sound = { };
+	sound->mono = job.out.channels == 1;
+	sound->streamed = job.out.streamed;
+	sound->mixer_sound.channels = job.out.channels;
+	sound->mixer_sound.sample_rate = job.out.sample_rate;
+	sound->mixer_sound.num_frames = job.out.num_samples;
+
+	if( job.out.streamed ) {
+		// keep the Ogg out of the asset cache while we might be decoding it
+		sound->mixer_sound.ogg = job.in.ogg;
+		sound->pinned_asset = StringHash( path );
+		PinAsset( sound->pinned_asset );
+	}
+	else {
+		// job.out.samples gets freed with the decode job
+		Span< s16 > samples = ALLOC_SPAN( sys_allocator, s16, size_t( job.out.num_samples ) * job.out.channels );
+		memcpy( samples.ptr, job.out.samples, samples.num_bytes() );
+		sound->mixer_sound.samples = samples;
+	}
 
-	sounds[ idx ].mono = channels == 1;
+	if( initialized ) {
+		UploadSoundToAL( sound );
+	}
 
 	if( restart_music ) {
 		S_StartMenuMusic();
 	}
+}
 
-	free( samples );
+// music always streams, everything else streams when it's long enough to be
+// worth it. the mixer can only stream mono and stereo files
+static bool ShouldStreamSound( const char * path, int channels, int sample_rate, u32 num_samples ) {
+	if( channels > 2 )
+		return false;
+	return StartsWith( path, "sounds/music/" ) || num_samples > sample_rate * STREAM_SOUNDS_LONGER_THAN;
 }
 
-static void LoadSounds() {
-	TracyZoneScoped;
+static void DecodeSound( TempAllocator * temp, void * data ) {
+	DecodeSoundJob * job = ( DecodeSoundJob * ) data;
+
+	TracyZoneScopedN( "Decode sound" );
+	TracyZoneText( job->in.path, strlen( job->in.path ) );
+
+	u64 start_time = Sys_Microseconds();
+	defer { job->out.decode_time = Sys_Microseconds() - start_time; };
+
+	u64 key = DecodeCacheKey( "ogg", SOUND_DECODE_VERSION, job->in.ogg );
+
+	job->out.cached = Span< u8 >();
+	job->out.streamed = false;
+	if( LoadFromDecodeCache( temp, sys_allocator, key, &job->out.cached ) ) {
+		DecodedSoundHeader header;
+		if( job->out.cached.n >= sizeof( header ) ) {
+			memcpy( &header, job->out.cached.ptr, sizeof( header ) );
+			if( header.num_samples >= 0 && job->out.cached.n == sizeof( header ) + size_t( header.num_samples ) * header.channels * sizeof( s16 ) ) {
+				job->out.channels = header.channels;
+				job->out.sample_rate = header.sample_rate;
+				job->out.num_samples = header.num_samples;
+				job->out.samples = ( s16 * ) ( job->out.cached.ptr + sizeof( header ) );
+				return;
+			}
+		}
+
+		FREE( sys_allocator, job->out.cached.ptr );
+		job->out.cached = Span< u8 >();
+	}
 
-	DynamicArray< DecodeSoundJob > jobs( sys_allocator );
 	{
-		TracyZoneScopedN( "Build job list" );
+		TracyZoneScopedN( "Probe length" );
 
-		for( const char * path : AssetPaths() ) {
-			if( FileExtension( path ) == ".ogg" ) {
-				DecodeSoundJob job;
-				job.in.path = path;
-				job.in.ogg = AssetBinary( path );
+		int error;
+		stb_vorbis * vorbis = stb_vorbis_open_memory( job->in.ogg.ptr, job->in.ogg.num_bytes(), &error, NULL );
+		if( vorbis == NULL ) {
+			job->out.num_samples = -1;
+			return;
+		}
 
-				jobs.add( job );
-			}
+		stb_vorbis_info info = stb_vorbis_get_info( vorbis );
+		u32 num_samples = stb_vorbis_stream_length_in_samples( vorbis );
+		stb_vorbis_close( vorbis );
+
+		if( ShouldStreamSound( job->in.path, info.channels, info.sample_rate, num_samples ) ) {
+			job->out.channels = info.channels;
+			job->out.sample_rate = info.sample_rate;
+			job->out.num_samples = num_samples;
+			job->out.samples = NULL;
+			job->out.streamed = true;
+			return;
 		}
+	}
 
-		std::sort( jobs.begin(), jobs.end(), []( const DecodeSoundJob & a, const DecodeSoundJob & b ) {
-			return a.in.ogg.n > b.in.ogg.n;
-		} );
+	{
+		TracyZoneScopedN( "stb_vorbis_decode_memory" );
+		job->out.num_samples = stb_vorbis_decode_memory( job->in.ogg.ptr, job->in.ogg.num_bytes(), &job->out.channels, &job->out.sample_rate, &job->out.samples );
 	}
 
-	ParallelFor( jobs.span(), []( TempAllocator * temp, void * data ) {
-		DecodeSoundJob * job = ( DecodeSoundJob * ) data;
+	if( job->out.num_samples < 0 )
+		return;
 
-		TracyZoneScopedN( "stb_vorbis_decode_memory" );
-		TracyZoneText( job->in.path, strlen( job->in.path ) );
+	DecodedSoundHeader header;
+	header.channels = job->out.channels;
+	header.sample_rate = job->out.sample_rate;
+	header.num_samples = job->out.num_samples;
+
+	size_t samples_size = size_t( job->out.num_samples ) * job->out.channels * sizeof( s16 );
+	Span< u8 > blob = ALLOC_SPAN( sys_allocator, u8, sizeof( header ) + samples_size );
+	memcpy( blob.ptr, &header, sizeof( header ) );
+	memcpy( blob.ptr + sizeof( header ), job->out.samples, samples_size );
+	SaveToDecodeCache( temp, key, blob );
+	FREE( sys_allocator, blob.ptr );
+}
 
-		job->out.num_samples = stb_vorbis_decode_memory( job->in.ogg.ptr, job->in.ogg.num_bytes(), &job->out.channels, &job->out.sample_rate, &job->out.samples );
-	} );
+static void FreeDecodedSound( const DecodeSoundJob & job ) {
+	if( job.out.cached.ptr != NULL ) {
+		FREE( sys_allocator, job.out.cached.ptr );
+	}
+	else if( job.out.num_samples >= 0 && !job.out.streamed ) {
+		free( job.out.samples );
+	}
+}
+
+static NonRAIIDynamicArray< DecodeSoundJob > decode_sound_jobs;
+static bool sounds_decoded;
 
-	for( DecodeSoundJob job : jobs ) {
-		AddSound( job.in.path, job.out.num_samples, job.out.channels, job.out.sample_rate, job.out.samples );
+static void BuildDecodeSoundJobs() {
+	TracyZoneScopedN( "Build job list" );
+
+	decode_sound_jobs.init( sys_allocator );
+
+	for( const char * path : AssetPaths() ) {
+		if( FileExtension( path ) == ".ogg" ) {
+			DecodeSoundJob job;
+			job.in.path = path;
+			job.in.ogg = AssetBinary( path );
+
+			decode_sound_jobs.add( job );
+		}
 	}
+
+	std::sort( decode_sound_jobs.begin(), decode_sound_jobs.end(), []( const DecodeSoundJob & a, const DecodeSoundJob & b ) {
+		return a.in.ogg.n > b.in.ogg.n;
+	} );
 }
 
-static void HotloadSounds() {
+void DecodeSounds( StartupTask * task ) {
+	BuildDecodeSoundJobs();
+	StartupTaskParallelFor( task, decode_sound_jobs.span(), DecodeSound );
+	sounds_decoded = true;
+}
+
+static void LoadSounds() {
 	TracyZoneScoped;
 
-	for( const char * path : ModifiedAssetPaths() ) {
-		if( FileExtension( path ) == ".ogg" ) {
-			Span< const u8 > ogg = AssetBinary( path );
-
-			int num_samples, channels, sample_rate;
-			s16 * samples;
-			{
-				TracyZoneScopedN( "stb_vorbis_decode_memory" );
-				TracyZoneText( path, strlen( path ) );
-				num_samples = stb_vorbis_decode_memory( ogg.ptr, ogg.num_bytes(), &channels, &sample_rate, &samples );
-			}
+	if( !sounds_decoded ) {
+		BuildDecodeSoundJobs();
+		ParallelFor( decode_sound_jobs.span(), DecodeSound );
+	}
+
+	u32 num_resident = 0;
+	u32 num_streamed = 0;
+	size_t resident_bytes = 0;
+	size_t streamed_ogg_bytes = 0;
+	size_t streamed_pcm_bytes = 0;
+	u64 decode_time = 0;
+
+	for( const DecodeSoundJob & job : decode_sound_jobs ) {
+		AddSound( job );
+		FreeDecodedSound( job );
+
+		if( job.out.num_samples < 0 )
+			continue;
 
-			AddSound( path, num_samples, channels, sample_rate, samples );
+		size_t pcm_bytes = size_t( job.out.num_samples ) * job.out.channels * sizeof( s16 );
+		if( job.out.streamed ) {
+			num_streamed++;
+			streamed_ogg_bytes += job.in.ogg.num_bytes();
+			streamed_pcm_bytes += pcm_bytes;
 		}
+		else {
+			num_resident++;
+			resident_bytes += pcm_bytes;
+		}
+
+		decode_time += job.out.decode_time;
+	}
+
+	Com_GGPrint( "Loaded {} sounds using {.2}MB of PCM, decoding took {.2}ms of CPU time", num_resident, resident_bytes / 1024.0 / 1024.0, decode_time / 1000.0 );
+	Com_GGPrint( "Streaming {} sounds from {.2}MB of Ogg instead of {.2}MB of PCM", num_streamed, streamed_ogg_bytes / 1024.0 / 1024.0, streamed_pcm_bytes / 1024.0 / 1024.0 );
+
+	decode_sound_jobs.shutdown();
+	sounds_decoded = false;
+}
+
+static void HotloadSounds( Span< const char * > paths ) {
+	TracyZoneScoped;
+
+	for( const char * path : paths ) {
+		DecodeSoundJob job;
+		job.in.path = path;
+		job.in.ogg = AssetBinary( path );
+
+		TempAllocator temp = cls.frame_arena.temp();
+		DecodeSound( &temp, &job );
+
+		AddSound( job );
+		FreeDecodedSound( job );
 	}
 }
 
@@ -456,6 +745,14 @@ static bool ParseSoundEffect( SoundEffect * sfx, Span< const char > * data, u64
 					return false;
 				}
 			}
+			else if( key == "priority" ) {
+				int priority;
+				if( !TrySpanToInt( value, &priority ) || priority < 0 || priority > U8_MAX ) {
+					Com_Printf( S_COLOR_YELLOW "Argument to priority should be a number from 0 to 255\n" );
+					return false;
+				}
+				config->priority = priority;
+			}
 			else if( key == "attenuation" ) {
 				if( value == "none" ) {
 					config->attenuation = ATTN_NONE;
@@ -529,14 +826,131 @@ static void LoadSoundEffects() {
 	}
 }
 
-static void HotloadSoundEffects() {
+static void HotloadSoundEffects( Span< const char * > paths ) {
 	TracyZoneScoped;
 
-	for( const char * path : ModifiedAssetPaths() ) {
-		if( FileExtension( path ) == ".cdsfx" ) {
-			LoadSoundEffect( path );
+	for( const char * path : paths ) {
+		LoadSoundEffect( path );
+	}
+}
+
+struct WAVHeader {
+	char riff[ 4 ];
+	u32 riff_size;
+	char wave[ 4 ];
+
+	char fmt[ 4 ];
+	u32 fmt_size;
+	u16 format;
+	u16 channels;
+	u32 sample_rate;
+	u32 byte_rate;
+	u16 block_align;
+	u16 bits_per_sample;
+
+	char data[ 4 ];
+	u32 data_size;
+};
+
+STATIC_ASSERT( sizeof( WAVHeader ) == 44 );
+
+// mixes a lot of looping voices at random positions through a private mixer
+// and writes the result to a wav. it doesn't need a sound device so it also
+// works headless
+static void MixerBench() {
+	if( !sounds_loaded ) {
+		Com_Printf( "Sounds aren't loaded\n" );
+		return;
+	}
+
+	if( Cmd_Argc() > 3 ) {
+		Com_Printf( "Usage: mixerbench [voices] [seconds]\n" );
+		return;
+	}
+
+	u32 num_voices = Cmd_Argc() > 1 ? Max2( atoi( Cmd_Argv( 1 ) ), 1 ) : 256;
+	float seconds = Cmd_Argc() > 2 ? Max2( float( atof( Cmd_Argv( 2 ) ) ), 0.1f ) : 10.0f;
+
+	NonRAIIDynamicArray< const Sound * > candidates( sys_allocator );
+	defer { candidates.shutdown(); };
+	for( u32 i = 0; i < num_sounds; i++ ) {
+		if( !sounds[ i ].streamed && sounds[ i ].mono && sounds[ i ].mixer_sound.num_frames > 0 ) {
+			candidates.add( &sounds[ i ] );
 		}
 	}
+
+	if( candidates.size() == 0 ) {
+		Com_Printf( "No mono sounds to mix\n" );
+		return;
+	}
+
+	// mix everything, we want to know what it costs
+	Mixer * bench = NewMixer( sys_allocator, false );
+	defer { DeleteMixer( sys_allocator, bench ); };
+
+	// fixed seed so runs are comparable
+	RNG rng = NewRNG( 42, 0 );
+	for( u32 i = 0; i < num_voices; i++ ) {
+		MixerVoiceConfig config;
+		config.sound = &RandomElement( &rng, candidates.ptr(), candidates.size() )->mixer_sound;
+		config.volume = RandomUniformFloat( &rng, 0.25f, 1.0f );
+		config.pitch = RandomUniformFloat( &rng, 0.8f, 1.2f );
+		config.rolloff = ATTN_NORM;
+		config.spatial = true;
+		config.loop = true;
+		config.position = Vec3( RandomFloat11( &rng ), RandomFloat11( &rng ), 0.0f ) * 2000.0f;
+		config.priority = RandomUniform( &rng, 0, 4 );
+		StartMixerVoice( bench, config );
+	}
+
+	SetMixerListener( bench, Vec3( 0.0f ), Vec3( 0.0f, -1.0f, 0.0f ), 1.0f );
+
+	u32 num_frames = AlignPow2( u32( seconds * MIXER_SAMPLE_RATE ), OUTPUT_BUFFER_FRAMES );
+	size_t data_size = size_t( num_frames ) * 2 * sizeof( s16 );
+
+	Span< u8 > wav = ALLOC_SPAN( sys_allocator, u8, sizeof( WAVHeader ) + data_size );
+	defer { FREE( sys_allocator, wav.ptr ); };
+
+	WAVHeader header;
+	memcpy( header.riff, "RIFF", 4 );
+	header.riff_size = wav.n - 8;
+	memcpy( header.wave, "WAVE", 4 );
+	memcpy( header.fmt, "fmt ", 4 );
+	header.fmt_size = 16;
+	header.format = 1; // PCM
+	header.channels = 2;
+	header.sample_rate = MIXER_SAMPLE_RATE;
+	header.byte_rate = MIXER_SAMPLE_RATE * 2 * sizeof( s16 );
+	header.block_align = 2 * sizeof( s16 );
+	header.bits_per_sample = 16;
+	memcpy( header.data, "data", 4 );
+	header.data_size = data_size;
+	memcpy( wav.ptr, &header, sizeof( header ) );
+
+	Span< s16 > pcm( ( s16 * ) ( wav.ptr + sizeof( WAVHeader ) ), num_frames * 2 );
+
+	u32 max_audible = 0;
+	u64 start = Sys_Microseconds();
+	for( u32 i = 0; i < num_frames; i += OUTPUT_BUFFER_FRAMES ) {
+		MixAudio( bench, pcm.slice( i * 2, ( i + OUTPUT_BUFFER_FRAMES ) * 2 ) );
+		max_audible = Max2( max_audible, GetMixerStats( bench ).audible );
+	}
+	u64 elapsed = Sys_Microseconds() - start;
+
+	MixerStats stats = GetMixerStats( bench );
+	double audio_us = double( num_frames ) / MIXER_SAMPLE_RATE * 1000000.0;
+
+	Com_GGPrint( "Mixed {} voices ({} playing, up to {} audible) for {.2}s of audio in {.2}ms, {.3}% of realtime",
+		num_voices, stats.voices, max_audible, num_frames / float( MIXER_SAMPLE_RATE ), elapsed / 1000.0, 100.0 * elapsed / audio_us );
+
+	TempAllocator temp = cls.frame_arena.temp();
+	const char * path = temp( "{}/benchmarks/mixer.wav", HomeDirPath() );
+	if( WriteFile( &temp, path, wav.ptr, wav.num_bytes() ) ) {
+		Com_GGPrint( "Wrote {}", path );
+	}
+	else {
+		Com_GGPrint( S_COLOR_YELLOW "Couldn't write {}", path );
+	}
 }
 
 bool S_Init() {
@@ -558,36 +972,61 @@ bool S_Init() {
 	s_musicvolume = NewCvar( "s_musicvolume", "1", CvarFlag_Archive );
 	s_muteinbackground = NewCvar( "s_muteinbackground", "1", CvarFlag_Archive );
 
-	if( !S_InitAL() )
-		return false;
+	mixer = NewMixer( sys_allocator, true );
 
 	LoadSounds();
 	LoadSoundEffects();
 
+	SubscribeToAssetChanges( "*.ogg", HotloadSounds );
+	SubscribeToAssetChanges( "*.cdsfx", HotloadSoundEffects );
+
+	AddCommand( "mixerbench", MixerBench );
+
+	sounds_loaded = true;
+
+	if( !S_InitAL() )
+		return false;
+
 	initialized = true;
 
+	for( u32 i = 0; i < num_sounds; i++ ) {
+		UploadSoundToAL( &sounds[ i ] );
+	}
+
 	return true;
 }
 
 void S_Shutdown() {
 	TracyZoneScoped;
 
-	if( !initialized )
+	if( !sounds_loaded )
 		return;
 
-	S_StopAllSounds( true );
+	if( initialized ) {
+		S_StopAllSounds( true );
+		ShutdownOutput();
 
-	alDeleteSources( ARRAY_COUNT( free_sound_sources ), free_sound_sources );
-	alDeleteSources( 1, &music_source );
+		for( u32 i = 0; i < num_sounds; i++ ) {
+			FreeSoundAL( &sounds[ i ] );
+		}
 
-	for( u32 i = 0; i < num_sounds; i++ ) {
-		alDeleteBuffers( 1, &sounds[ i ].buf );
+		alcDestroyContext( al_context );
+		alcCloseDevice( al_device );
+		initialized = false;
 	}
 
-	CheckALErrors( "S_Shutdown" );
+	RemoveCommand( "mixerbench" );
+
+	UnsubscribeFromAssetChanges( HotloadSounds );
+	UnsubscribeFromAssetChanges( HotloadSoundEffects );
+
+	DeleteMixer( sys_allocator, mixer );
 
-	alcDestroyContext( al_context );
-	alcCloseDevice( al_device );
+	for( u32 i = 0; i < num_sounds; i++ ) {
+		FreeSound( &sounds[ i ] );
+	}
+
+	sounds_loaded = false;
 }
 
 Span< const char * > GetAudioDevices( Allocator * a ) {
@@ -602,12 +1041,11 @@ Span< const char * > GetAudioDevices( Allocator * a ) {
 	return devices.span();
 }
 
-static bool FindSound( StringHash name, Sound * sound ) {
+static const Sound * FindSound( StringHash name ) {
 	u64 idx;
 	if( !initialized || !sounds_hashtable.get( name.hash, &idx ) )
-		return false;
-	*sound = sounds[ idx ];
-	return true;
+		return NULL;
+	return &sounds[ idx ];
 }
 
 static const SoundEffect * FindSoundEffect( StringHash name ) {
@@ -617,6 +1055,21 @@ static const SoundEffect * FindSoundEffect( StringHash name ) {
 	return &sound_effects[ idx ];
 }
 
+static Vec3 PlayingSoundVelocity( const PlayingSound * ps ) {
+	return ps->type == PlayingSoundType_Entity ? cg_entities[ ps->ent_num ].velocity : Vec3( 0.0f );
+}
+
+static Vec3 PlayingSoundPosition( const PlayingSound * ps, Vec3 listener ) {
+	switch( ps->type ) {
+		case PlayingSoundType_Entity:
+			return cg_entities[ ps->ent_num ].interpolated.origin;
+		case PlayingSoundType_Line:
+			return ClosestPointOnSegment( ps->origin, ps->end, listener );
+		default:
+			return ps->origin;
+	}
+}
+
 static bool StartSound( PlayingSound * ps, u8 i ) {
 	SoundEffect::PlaybackConfig config = ps->sfx->sounds[ i ];
 
@@ -629,69 +1082,178 @@ static bool StartSound( PlayingSound * ps, u8 i ) {
 		idx = RandomUniform( &rng, 0, config.num_random_sounds );
 	}
 
-	Sound sound;
-	if( !FindSound( config.sounds[ idx ], &sound ) )
+	const Sound * sound = FindSound( config.sounds[ idx ] );
+	if( sound == NULL )
 		return false;
 
-	if( num_free_sound_sources == 0 ) {
-		Com_Printf( S_COLOR_YELLOW "Too many playing sounds!\n" );
+	if( !sound->mono && ps->type != PlayingSoundType_Global ) {
+		Com_Printf( S_COLOR_YELLOW "Positioned sounds must be mono!\n" );
 		return false;
 	}
 
-	if( !sound.mono && ps->type != PlayingSoundType_Global ) {
-		Com_Printf( S_COLOR_YELLOW "Positioned sounds must be mono!\n" );
-		return false;
+	MixerVoiceConfig voice;
+	voice.sound = &sound->mixer_sound;
+	voice.volume = ps->volume * config.volume;
+	voice.pitch = ps->pitch * config.pitch + ( RandomFloat11( &cls.rng ) * config.pitch_random * config.pitch * ps->pitch );
+	voice.rolloff = config.attenuation;
+	voice.spatial = ps->type != PlayingSoundType_Global;
+	voice.loop = ps->immediate_handle.x != 0 && ps->loop;
+	voice.position = PlayingSoundPosition( ps, listener_origin );
+	voice.velocity = PlayingSoundVelocity( ps );
+	voice.priority = config.priority;
+
+	ps->voices[ i ] = StartMixerVoice( mixer, voice );
+
+	return ps->voices[ i ].x != 0;
+}
+
+static void ReleasePositionalSource( PositionalSource * ps ) {
+	CheckedALSourceStop( ps->source );
+	CheckedALSource( ps->source, AL_BUFFER, 0 );
+	ps->voice = { 0 };
+}
+
+static void StopSound( PlayingSound * ps, u8 i ) {
+	StopMixerVoice( mixer, ps->voices[ i ] );
+	ps->stopped[ i ] = true;
+
+	// don't wait for the next update to notice it's gone
+	for( PositionalSource & source : positional_sources ) {
+		if( source.voice.x == ps->voices[ i ].x ) {
+			ReleasePositionalSource( &source );
+		}
 	}
+}
 
-	num_free_sound_sources--;
-	ALuint source = free_sound_sources[ num_free_sound_sources ];
-	ps->sources[ i ] = source;
+static PositionalSource * FindPositionalSource( MixerVoiceHandle voice ) {
+	for( PositionalSource & ps : positional_sources ) {
+		if( ps.voice.x == voice.x ) {
+			return &ps;
+		}
+	}
+	return NULL;
+}
 
-	CheckedALSource( source, AL_BUFFER, sound.buf );
-	CheckedALSource( source, AL_GAIN, ps->volume * config.volume * s_volume->number );
-	CheckedALSource( source, AL_PITCH, ps->pitch * config.pitch + ( RandomFloat11( &cls.rng ) * config.pitch_random * config.pitch * ps->pitch ) );
-	CheckedALSource( source, AL_REFERENCE_DISTANCE, S_DEFAULT_ATTENUATION_REFDISTANCE );
-	CheckedALSource( source, AL_MAX_DISTANCE, S_DEFAULT_ATTENUATION_MAXDISTANCE );
-	CheckedALSource( source, AL_ROLLOFF_FACTOR, config.attenuation );
+// hands AL sources to the positional voices the mixer thinks are audible
+static void UpdatePositionalSources( float gain ) {
+	TracyZoneScoped;
 
-	switch( ps->type ) {
-		case PlayingSoundType_Global:
-			CheckedALSource( source, AL_POSITION, Vec3( 0.0f ) );
-			CheckedALSource( source, AL_VELOCITY, Vec3( 0.0f ) );
-			CheckedALSource( source, AL_SOURCE_RELATIVE, AL_TRUE );
-			break;
+	MixerPositionalVoice voices[ MAX_AUDIBLE_VOICES ];
+	u32 num_voices = GetAudiblePositionalVoices( mixer, Span< MixerPositionalVoice >( voices, ARRAY_COUNT( voices ) ) );
 
-		case PlayingSoundType_Position:
-			CheckedALSource( source, AL_POSITION, ps->origin );
-			CheckedALSource( source, AL_VELOCITY, Vec3( 0.0f ) );
-			CheckedALSource( source, AL_SOURCE_RELATIVE, AL_FALSE );
-			break;
+	// give back sources whose voice stopped or went virtual first, so there's
+	// always a source free for every audible voice
+	for( PositionalSource & ps : positional_sources ) {
+		if( ps.voice.x == 0 )
+			continue;
 
-		case PlayingSoundType_Entity:
-			CheckedALSource( source, AL_POSITION, cg_entities[ ps->ent_num ].interpolated.origin );
-			CheckedALSource( source, AL_VELOCITY, cg_entities[ ps->ent_num ].velocity );
-			CheckedALSource( source, AL_SOURCE_RELATIVE, AL_FALSE );
-			break;
+		bool audible = false;
+		for( u32 i = 0; i < num_voices; i++ ) {
+			audible = audible || voices[ i ].handle.x == ps.voice.x;
+		}
 
-		case PlayingSoundType_Line:
-			CheckedALSource( source, AL_POSITION, ps->origin );
-			CheckedALSource( source, AL_VELOCITY, Vec3( 0.0f ) ); // TODO
-			CheckedALSource( source, AL_SOURCE_RELATIVE, AL_FALSE );
-			break;
+		if( !audible ) {
+			ReleasePositionalSource( &ps );
+		}
 	}
 
-	CheckedALSource( source, AL_LOOPING, ps->immediate_handle.x != 0 && ps->loop ? AL_TRUE : AL_FALSE );
-	CheckedALSourcePlay( source );
+	for( u32 i = 0; i < num_voices; i++ ) {
+		const MixerPositionalVoice & voice = voices[ i ];
+
+		float voice_gain = voice.config.volume * gain;
+
+		PositionalSource * ps = FindPositionalSource( voice.handle );
+		if( ps == NULL ) {
+			ps = FindPositionalSource( { 0 } );
+			assert( ps != NULL );
+
+			ps->voice = voice.handle;
+			ps->gain = voice_gain;
+			ps->position = voice.config.position;
+			ps->velocity = voice.config.velocity;
+
+			alSourcei( ps->source, AL_BUFFER, voice.config.sound->al_buffer );
+			alSourcef( ps->source, AL_ROLLOFF_FACTOR, voice.config.rolloff );
+			alSourcei( ps->source, AL_LOOPING, voice.config.loop ? AL_TRUE : AL_FALSE );
+			alSourcei( ps->source, AL_SAMPLE_OFFSET, ALint( voice.frame ) );
+			alSourcef( ps->source, AL_PITCH, voice.config.pitch );
+			alSourcef( ps->source, AL_GAIN, ps->gain );
+			alSourcefv( ps->source, AL_POSITION, ps->position.ptr() );
+			alSourcefv( ps->source, AL_VELOCITY, ps->velocity.ptr() );
+			alSourcePlay( ps->source );
+			continue;
+		}
 
-	return true;
+		if( ps->gain != voice_gain ) {
+			ps->gain = voice_gain;
+			alSourcef( ps->source, AL_GAIN, ps->gain );
+		}
+
+		if( ps->position != voice.config.position ) {
+			ps->position = voice.config.position;
+			alSourcefv( ps->source, AL_POSITION, ps->position.ptr() );
+		}
+
+		if( ps->velocity != voice.config.velocity ) {
+			ps->velocity = voice.config.velocity;
+			alSourcefv( ps->source, AL_VELOCITY, ps->velocity.ptr() );
+		}
+	}
+
+	CheckALErrors( "UpdatePositionalSources" );
 }
 
-static void StopSound( PlayingSound * ps, u8 i ) {
-	CheckedALSourceStop( ps->sources[ i ] );
-	CheckedALSource( ps->sources[ i ], AL_BUFFER, 0 );
-	free_sound_sources[ num_free_sound_sources ] = ps->sources[ i ];
-	num_free_sound_sources++;
-	ps->stopped[ i ] = true;
+static void UpdateALListener( Vec3 origin, Vec3 velocity, const mat3_t axis ) {
+	bool set_all = !al_listener.valid;
+	al_listener.valid = true;
+
+	if( set_all || al_listener.position != origin ) {
+		al_listener.position = origin;
+		alListenerfv( AL_POSITION, al_listener.position.ptr() );
+	}
+
+	if( set_all || al_listener.velocity != velocity ) {
+		al_listener.velocity = velocity;
+		alListenerfv( AL_VELOCITY, al_listener.velocity.ptr() );
+	}
+
+	float forward_and_up[ 6 ];
+	forward_and_up[ 0 ] = axis[ AXIS_FORWARD ];
+	forward_and_up[ 1 ] = axis[ AXIS_FORWARD + 1 ];
+	forward_and_up[ 2 ] = axis[ AXIS_FORWARD + 2 ];
+	forward_and_up[ 3 ] = axis[ AXIS_UP ];
+	forward_and_up[ 4 ] = axis[ AXIS_UP + 1 ];
+	forward_and_up[ 5 ] = axis[ AXIS_UP + 2 ];
+
+	bool orientation_changed = set_all;
+	for( size_t i = 0; i < ARRAY_COUNT( forward_and_up ); i++ ) {
+		orientation_changed = orientation_changed || al_listener.forward_and_up[ i ] != forward_and_up[ i ];
+	}
+
+	if( orientation_changed ) {
+		memcpy( al_listener.forward_and_up, forward_and_up, sizeof( forward_and_up ) );
+		alListenerfv( AL_ORIENTATION, al_listener.forward_and_up );
+	}
+
+	CheckALErrors( "UpdateALListener" );
+}
+
+static void RemovePlayingSound( PlayingSound * ps ) {
+	if( ps->immediate_handle.x != 0 ) {
+		bool ok = immediate_sounds_hashtable.remove( ps->immediate_handle.x );
+		assert( ok );
+	}
+
+	// remove-swap it from playing_sound_effects
+	num_playing_sound_effects--;
+	if( ps != &playing_sound_effects[ num_playing_sound_effects ] ) {
+		Swap2( ps, &playing_sound_effects[ num_playing_sound_effects ] );
+
+		if( ps->immediate_handle.x != 0 ) {
+			bool ok = immediate_sounds_hashtable.update( ps->immediate_handle.x, ps - playing_sound_effects );
+			assert( ok );
+		}
+	}
 }
 
 void S_Update( Vec3 origin, Vec3 velocity, const mat3_t axis ) {
@@ -706,14 +1268,13 @@ void S_Update( Vec3 origin, Vec3 velocity, const mat3_t axis ) {
 		s_device->modified = false;
 	}
 
-	HotloadSounds();
-	HotloadSoundEffects();
+	listener_origin = origin;
 
-	CheckedALListener( AL_GAIN, IsWindowFocused() || s_muteinbackground->integer == 0 ? 1 : 0 );
+	float gain = IsWindowFocused() || s_muteinbackground->integer == 0 ? s_volume->number : 0.0f;
+	// AXIS_RIGHT actually points left
+	SetMixerListener( mixer, origin, -FromQFAxis( axis, AXIS_RIGHT ), gain );
 
-	CheckedALListener( AL_POSITION, origin );
-	CheckedALListener( AL_VELOCITY, velocity );
-	CheckedALListener( AL_ORIENTATION, axis );
+	UpdateALListener( origin, velocity, axis );
 
 	for( size_t i = 0; i < num_playing_sound_effects; i++ ) {
 		PlayingSound * ps = &playing_sound_effects[ i ];
@@ -728,8 +1289,7 @@ void S_Update( Vec3 origin, Vec3 velocity, const mat3_t axis ) {
 				if( ps->stopped[ j ] )
 					continue;
 
-				ALint state = CheckedALGetSource( ps->sources[ j ], AL_SOURCE_STATE );
-				if( not_touched || state == AL_STOPPED ) {
+				if( not_touched || !MixerVoicePlaying( mixer, ps->voices[ j ] ) ) {
 					StopSound( ps, j );
 				}
 				else {
@@ -749,56 +1309,50 @@ void S_Update( Vec3 origin, Vec3 velocity, const mat3_t axis ) {
 		}
 
 		if( all_stopped ) {
-			if( ps->immediate_handle.x != 0 ) {
-				bool ok = immediate_sounds_hashtable.remove( ps->immediate_handle.x );
-				assert( ok );
-			}
-
-			// remove-swap it from playing_sound_effects
-			num_playing_sound_effects--;
-			if( ps != &playing_sound_effects[ num_playing_sound_effects ] ) {
-				Swap2( ps, &playing_sound_effects[ num_playing_sound_effects ] );
-
-				if( ps->immediate_handle.x != 0 ) {
-					bool ok = immediate_sounds_hashtable.update( ps->immediate_handle.x, ps - playing_sound_effects );
-					assert( ok );
-				}
-			}
-
+			RemovePlayingSound( ps );
 			i--;
 			continue;
 		}
 
-		for( u8 j = 0; j < ps->sfx->num_sounds; j++ ) {
-			if( !ps->started[ j ] || ps->stopped[ j ] )
-				continue;
-
-			if( s_volume->modified ) {
-				CheckedALSource( ps->sources[ j ], AL_GAIN, ps->volume * ps->sfx->sounds[ j ].volume * s_volume->number );
-			}
+		if( ps->type == PlayingSoundType_Global )
+			continue;
 
-			if( ps->type == PlayingSoundType_Entity ) {
-				CheckedALSource( ps->sources[ j ], AL_POSITION, cg_entities[ ps->ent_num ].interpolated.origin );
-				CheckedALSource( ps->sources[ j ], AL_VELOCITY, cg_entities[ ps->ent_num ].velocity );
-			}
-			else if( ps->type == PlayingSoundType_Position ) {
-				CheckedALSource( ps->sources[ j ], AL_POSITION, ps->origin );
-			}
-			else if( ps->type == PlayingSoundType_Line ) {
-				Vec3 p = ClosestPointOnSegment( ps->origin, ps->end, origin );
-				CheckedALSource( ps->sources[ j ], AL_POSITION, p );
+		Vec3 position = PlayingSoundPosition( ps, origin );
+		Vec3 sound_velocity = PlayingSoundVelocity( ps );
+		for( u8 j = 0; j < ps->sfx->num_sounds; j++ ) {
+			if( ps->started[ j ] && !ps->stopped[ j ] ) {
+				SetMixerVoicePosition( mixer, ps->voices[ j ], position, sound_velocity );
 			}
 		}
 	}
 
-	if( ( s_volume->modified || s_musicvolume->modified ) && music_playing ) {
-		CheckedALSource( music_source, AL_GAIN, s_volume->number * s_musicvolume->number * MusicIsWayTooLoud );
+	UpdatePositionalSources( gain );
+
+	if( s_musicvolume->modified && music_playing ) {
+		SetMixerVoiceVolume( mixer, music_voice, s_musicvolume->number * MusicIsWayTooLoud );
 	}
 
-	s_volume->modified = false;
 	s_musicvolume->modified = false;
 }
 
+// the least important sound is the one whose loudest voice is quietest
+static float PlayingSoundImportance( const PlayingSound * ps ) {
+	float importance = 0.0f;
+	for( u8 j = 0; j < ps->sfx->num_sounds; j++ ) {
+		if( !ps->started[ j ] ) {
+			// hasn't played yet so we can't tell, assume it matters
+			return FLT_MAX;
+		}
+
+		if( !ps->stopped[ j ] ) {
+			float priority = ps->sfx->sounds[ j ].priority;
+			importance = Max2( importance, priority + MixerVoiceAudibility( mixer, ps->voices[ j ] ) );
+		}
+	}
+
+	return importance;
+}
+
 static PlayingSound * FindEmptyPlayingSound( int ent_num, int channel ) {
 	if( channel != 0 ) {
 		for( u32 i = 0; i < num_playing_sound_effects; i++ ) {
@@ -814,8 +1368,29 @@ static PlayingSound * FindEmptyPlayingSound( int ent_num, int channel ) {
 		}
 	}
 
-	if( num_playing_sound_effects == ARRAY_COUNT( playing_sound_effects ) )
-		return NULL;
+	if( num_playing_sound_effects == ARRAY_COUNT( playing_sound_effects ) ) {
+		// steal the least important sound rather than dropping the new one,
+		// which might be a bomb beep
+		PlayingSound * victim = NULL;
+		float victim_importance = FLT_MAX;
+		for( u32 i = 0; i < num_playing_sound_effects; i++ ) {
+			float importance = PlayingSoundImportance( &playing_sound_effects[ i ] );
+			if( importance < victim_importance ) {
+				victim = &playing_sound_effects[ i ];
+				victim_importance = importance;
+			}
+		}
+
+		if( victim == NULL )
+			return NULL;
+
+		for( u8 j = 0; j < victim->sfx->num_sounds; j++ ) {
+			if( victim->started[ j ] && !victim->stopped[ j ] ) {
+				StopSound( victim, j );
+			}
+		}
+		RemovePlayingSound( victim );
+	}
 
 	num_playing_sound_effects++;
 	return &playing_sound_effects[ num_playing_sound_effects - 1 ];
@@ -987,27 +1562,26 @@ void S_StartMenuMusic() {
 	if( !initialized )
 		return;
 
-	Sound sound;
-	if( !FindSound( "sounds/music/menu_1", &sound ) )
+	const Sound * sound = FindSound( "sounds/music/menu_1" );
+	if( sound == NULL )
 		return;
 
 	if( music_playing )
 		return;
 
-	CheckedALSource( music_source, AL_GAIN, s_volume->number * s_musicvolume->number * MusicIsWayTooLoud );
-	CheckedALSource( music_source, AL_DIRECT_CHANNELS_SOFT, AL_TRUE );
-	CheckedALSource( music_source, AL_LOOPING, AL_TRUE );
-	CheckedALSource( music_source, AL_BUFFER, sound.buf );
-
-	CheckedALSourcePlay( music_source );
+	MixerVoiceConfig config;
+	config.sound = &sound->mixer_sound;
+	config.volume = s_musicvolume->number * MusicIsWayTooLoud;
+	config.loop = true;
+	config.priority = U8_MAX;
 
-	music_playing = true;
+	music_voice = StartMixerVoice( mixer, config );
+	music_playing = music_voice.x != 0;
 }
 
 void S_StopBackgroundTrack() {
 	if( initialized && music_playing ) {
-		CheckedALSourceStop( music_source );
-		CheckedALSource( music_source, AL_BUFFER, 0 );
+		StopMixerVoice( mixer, music_voice );
 	}
 	music_playing = false;
 }
@@ -88,6 +88,11 @@ bool operator!=( WindowMode lhs, WindowMode rhs ) {
 }
 
 static void UpdateVidModeCvar() {
+	// vid_mode is archived, don't overwrite the player's real window with the
+	// fake headless one
+	if( IsHeadless() )
+		return;
+
 	WindowMode mode = GetWindowMode();
 	TempAllocator temp = cls.frame_arena.temp();
 	Cvar_Set( vid_mode->name, temp( "{}", mode ) );
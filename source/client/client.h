@@ -307,6 +307,7 @@ void CL_WriteUcmdsToMessage( msg_t *msg );
 //
 void CL_WriteDemoMessage( msg_t *msg );
 void CL_DemoCompleted();
+void CL_BenchmarkFrame();
 void CL_PlayDemo_f();
 void CL_YoloDemo_f();
 void CL_ReadDemoPackets();
@@ -323,10 +324,12 @@ void CL_DemoJump_f();
 void CL_ParseServerMessage( msg_t *msg );
 #define SHOWNET( msg,s ) _SHOWNET( msg,s,cl_shownet->integer );
 
-using DownloadCompleteCallback = void ( * )( const char * filename, Span< const u8 > data );
+// checksum is the Hash32 of data
+using DownloadCompleteCallback = void ( * )( const char * filename, Span< const u8 > data, u32 checksum );
 
 bool CL_DownloadFile( const char * filename, DownloadCompleteCallback cb );
 bool CL_IsDownloading();
+bool CL_DownloadProgress( const char ** path, float * frac );
 void CL_CancelDownload();
 
 //
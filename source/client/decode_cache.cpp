@@ -0,0 +1,174 @@
+#include <algorithm> // std::sort
+#include <time.h>
+
+#include "qcommon/base.h"
+#include "qcommon/qcommon.h"
+#include "qcommon/array.h"
+#include "qcommon/csprng.h"
+#include "qcommon/fs.h"
+#include "qcommon/hash.h"
+#include "client/decode_cache.h"
+
+static constexpr u32 DECODE_CACHE_MAGIC = U32( 0xCAC4EDEC );
+static constexpr u32 DECODE_CACHE_VERSION = 1;
+
+static constexpr u64 DECODE_CACHE_MAX_SIZE = 512 * 1024 * 1024; // 512MB
+
+// leftovers from saves that never got moved into place, e.g. because we crashed
+static constexpr s64 DECODE_CACHE_STALE_TMP_SECONDS = 60 * 60;
+
+struct DecodeCacheHeader {
+	u32 magic;
+	u32 version;
+	u64 key;
+	u64 size;
+};
+
+static const char * DecodeCachePath( TempAllocator * temp, u64 key ) {
+	return ( *temp )( "{}/cache/{016x}", HomeDirPath(), key );
+}
+
+u64 DecodeCacheKey( const char * transform, u32 version, Span< const u8 > source ) {
+	TracyZoneScoped;
+
+	u64 hash = Hash64( transform );
+	hash = Hash64( &version, sizeof( version ), hash );
+	return Hash64( source.ptr, source.num_bytes(), hash );
+}
+
+bool LoadFromDecodeCache( TempAllocator * temp, Allocator * a, u64 key, Span< u8 > * decoded ) {
+	TracyZoneScoped;
+
+	FILE * file = OpenFile( temp, DecodeCachePath( temp, key ), "rb" );
+	if( file == NULL )
+		return false;
+	defer { fclose( file ); };
+
+	size_t file_size = FileSize( file );
+
+	DecodeCacheHeader header;
+	size_t bytes_read;
+	if( !ReadPartialFile( file, &header, sizeof( header ), &bytes_read ) || bytes_read != sizeof( header ) )
+		return false;
+
+	if( header.magic != DECODE_CACHE_MAGIC || header.version != DECODE_CACHE_VERSION || header.key != key )
+		return false;
+
+	if( file_size != sizeof( header ) + header.size )
+		return false;
+
+	*decoded = ALLOC_SPAN( a, u8, header.size );
+	if( header.size > 0 && ( !ReadPartialFile( file, decoded->ptr, decoded->n, &bytes_read ) || bytes_read != decoded->n ) ) {
+		FREE( a, decoded->ptr );
+		return false;
+	}
+
+	return true;
+}
+
+void SaveToDecodeCache( TempAllocator * temp, u64 key, Span< const u8 > decoded ) {
+	TracyZoneScoped;
+
+	const char * path = DecodeCachePath( temp, key );
+
+	// identical sources can be decoded on multiple threads, or by multiple
+	// clients, at once, so write to a unique file and move it into place
+	u64 unique;
+	CSPRNG( &unique, sizeof( unique ) );
+	const char * tmp_path = ( *temp )( "{}.{016x}.tmp", path, unique );
+
+	if( !CreatePathForFile( temp, tmp_path ) )
+		return;
+
+	FILE * file = OpenFile( temp, tmp_path, "wb" );
+	if( file == NULL )
+		return;
+
+	DecodeCacheHeader header;
+	header.magic = DECODE_CACHE_MAGIC;
+	header.version = DECODE_CACHE_VERSION;
+	header.key = key;
+	header.size = decoded.num_bytes();
+
+	bool ok = WritePartialFile( file, &header, sizeof( header ) );
+	ok = ok && WritePartialFile( file, decoded.ptr, decoded.num_bytes() );
+	fclose( file );
+
+	if( !ok || !MoveFile( temp, tmp_path, path, MoveFile_DoReplace ) ) {
+		RemoveFile( temp, tmp_path );
+	}
+}
+
+struct DecodeCacheEntry {
+	char * path;
+	u64 size;
+	s64 modified_time;
+};
+
+void PruneDecodeCache( TempAllocator * temp ) {
+	TracyZoneScoped;
+
+	const char * dir = ( *temp )( "{}/cache", HomeDirPath() );
+	s64 now = time( NULL );
+
+	// the cache can hold more files than fit in a temp arena
+	DynamicArray< DecodeCacheEntry > entries( sys_allocator );
+	defer {
+		for( DecodeCacheEntry & entry : entries ) {
+			FREE( sys_allocator, entry.path );
+		}
+	};
+
+	u64 total_size = 0;
+
+	ListDirHandle scan = BeginListDir( sys_allocator, dir );
+	const char * name;
+	bool is_dir;
+	while( ListDirNext( &scan, &name, &is_dir ) ) {
+		if( is_dir )
+			continue;
+
+		char * path = ( *sys_allocator )( "{}/{}", dir, name );
+
+		FileMetadata metadata;
+		bool ok = GetFileMetadata( sys_allocator, path, &metadata );
+
+		// don't touch tmp files that another thread might still be writing
+		if( !ok || EndsWith( name, ".tmp" ) ) {
+			if( ok && now - metadata.modified_time >= DECODE_CACHE_STALE_TMP_SECONDS ) {
+				RemoveFile( sys_allocator, path );
+			}
+			FREE( sys_allocator, path );
+			continue;
+		}
+
+		DecodeCacheEntry entry;
+		entry.path = path;
+		entry.size = metadata.size;
+		entry.modified_time = metadata.modified_time;
+		entries.add( entry );
+		total_size += entry.size;
+	}
+
+	if( total_size <= DECODE_CACHE_MAX_SIZE )
+		return;
+
+	std::sort( entries.begin(), entries.end(), []( const DecodeCacheEntry & a, const DecodeCacheEntry & b ) {
+		return a.modified_time < b.modified_time;
+	} );
+
+	u64 evicted_size = 0;
+	size_t num_evicted = 0;
+	for( const DecodeCacheEntry & entry : entries ) {
+		if( total_size - evicted_size <= DECODE_CACHE_MAX_SIZE )
+			break;
+
+		// files that are still open can't be deleted on windows, they go next time
+		if( RemoveFile( sys_allocator, entry.path ) ) {
+			evicted_size += entry.size;
+			num_evicted++;
+		}
+	}
+
+	Com_GGPrint( "Pruned {} entries ({}MB) from the decode cache", num_evicted, evicted_size / 1024 / 1024 );
+}
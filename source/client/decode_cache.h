@@ -0,0 +1,17 @@
+#pragma once
+
+#include "qcommon/types.h"
+
+// caches the output of expensive asset transforms (ogg decoding, BC4
+// encoding, BSP/glTF render geometry, GL program binaries) in the home dir.
+// entries are keyed by a hash of the source data and a per-transform version,
+// so editing an asset or bumping the version makes the old entry unreachable
+u64 DecodeCacheKey( const char * transform, u32 version, Span< const u8 > source );
+
+bool LoadFromDecodeCache( TempAllocator * temp, Allocator * a, u64 key, Span< u8 > * decoded );
+void SaveToDecodeCache( TempAllocator * temp, u64 key, Span< const u8 > decoded );
+
+// deletes the entries that were written longest ago until the cache fits in
+// its size budget. entries are only rewritten when they miss, so this also
+// throws away everything made unreachable by edits and version bumps
+void PruneDecodeCache( TempAllocator * temp );
@@ -7,9 +7,11 @@
 
 static NonRAIIDynamicArray< DemoBrowserEntry > demos;
 static size_t metadata_load_cursor;
+static bool demo_browser_open;
 
 void InitDemoBrowser() {
 	demos.init( sys_allocator );
+	demo_browser_open = false;
 }
 
 static void ClearDemos() {
@@ -83,30 +85,30 @@ static Span< const char > GetDemoKey( Span< const char > metadata, const char *
 	return Span< const char >();
 }
 
-void DemoBrowserFrame() {
-	constexpr int time_to_spend_per_frame = 2000;
-	s64 start_time = Sys_Microseconds();
+bool LoadDemoBrowserMetadata() {
+	if( !demo_browser_open || metadata_load_cursor == demos.size() )
+		return false;
 
-	while( metadata_load_cursor < demos.size() && Sys_Microseconds() - start_time < time_to_spend_per_frame ) {
-		DemoBrowserEntry * demo = &demos[ metadata_load_cursor ];
-		metadata_load_cursor++;
+	DemoBrowserEntry * demo = &demos[ metadata_load_cursor ];
+	metadata_load_cursor++;
 
-		TempAllocator temp = cls.frame_arena.temp();
+	TempAllocator temp = cls.frame_arena.temp();
 
-		const char * path = temp( "{}/demos/{}", HomeDirPath(), demo->path );
-		Span< u8 > first_1k = ReadFirst1kBytes( path );
-		defer { FREE( sys_allocator, first_1k.ptr ); };
+	const char * path = temp( "{}/demos/{}", HomeDirPath(), demo->path );
+	Span< u8 > first_1k = ReadFirst1kBytes( path );
+	defer { FREE( sys_allocator, first_1k.ptr ); };
 
-		Span< const char > metadata = GetDemoMetadata( first_1k );
+	Span< const char > metadata = GetDemoMetadata( first_1k );
 
-		demo->have_details = true;
-		ggformat( demo->server, sizeof( demo->server ), "{}", GetDemoKey( metadata, "hostname" ) );
-		ggformat( demo->map, sizeof( demo->map ), "{}", GetDemoKey( metadata, "mapname" ) );
-		ggformat( demo->version, sizeof( demo->version ), "{}", GetDemoKey( metadata, "version" ) );
+	demo->have_details = true;
+	ggformat( demo->server, sizeof( demo->server ), "{}", GetDemoKey( metadata, "hostname" ) );
+	ggformat( demo->map, sizeof( demo->map ), "{}", GetDemoKey( metadata, "mapname" ) );
+	ggformat( demo->version, sizeof( demo->version ), "{}", GetDemoKey( metadata, "version" ) );
 
-		s64 timestamp = SpanToInt( GetDemoKey( metadata, "localtime" ), 0 );
-		Sys_FormatTimestamp( demo->date, sizeof( demo->date ), "%Y-%m-%d %H:%M", timestamp );
-	}
+	s64 timestamp = SpanToInt( GetDemoKey( metadata, "localtime" ), 0 );
+	Sys_FormatTimestamp( demo->date, sizeof( demo->date ), "%Y-%m-%d %H:%M", timestamp );
+
+	return metadata_load_cursor < demos.size();
 }
 
 static void FindDemosRecursive( TempAllocator * temp, DynamicString * path, size_t skip ) {
@@ -133,6 +135,10 @@ static void FindDemosRecursive( TempAllocator * temp, DynamicString * path, size
 	}
 }
 
+void SetDemoBrowserOpen( bool open ) {
+	demo_browser_open = open;
+}
+
 void RefreshDemoBrowser() {
 	ClearDemos();
 
@@ -16,5 +16,8 @@ void InitDemoBrowser();
 void ShutdownDemoBrowser();
 
 Span< const DemoBrowserEntry > GetDemoBrowserEntries();
-void DemoBrowserFrame();
+// loads one demo's details, returns true if there are more to load. does
+// nothing while the browser is closed
+bool LoadDemoBrowserMetadata();
 void RefreshDemoBrowser();
+void SetDemoBrowserOpen( bool open );
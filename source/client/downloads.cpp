@@ -1,6 +1,5 @@
 #include "qcommon/base.h"
 #include "qcommon/qcommon.h"
-#include "qcommon/array.h"
 
 #include "client/downloads.h"
 
@@ -17,9 +16,11 @@ static CURL * request;
  * https://curl-library.cool.haxx.narkive.com/RJBkHeNm/http-headers-free-and-multi lol
  */
 struct CurlRequestContext {
-	NonRAIIDynamicArray< u8 > data;
+	CurlDataCallback data_callback;
 	CurlDoneCallback done_callback;
 	curl_slist * headers;
+	size_t downloaded;
+	bool aborted;
 };
 
 static void CheckEasyError( const char * func, CURLcode err ) {
@@ -63,31 +64,35 @@ static void CheckedEasyOpt( CURL * request, CURLoption opt, T val ) {
 	CheckEasyError( "curl_easy_setopt", curl_easy_setopt( request, opt, val ) );
 }
 
-static size_t CurlDataCallback( char * data, size_t size, size_t nmemb, void * user_data ) {
+static size_t CurlWriteCallback( char * data, size_t size, size_t nmemb, void * user_data ) {
+	TracyZoneScoped;
+
 	CurlRequestContext * context = ( CurlRequestContext * ) user_data;
 	size_t len = size * nmemb;
 
 	constexpr size_t DOWNLOAD_MAX_SIZE = 50 * 1000 * 1000; // 50MB
-	if( context->data.size() + len > DOWNLOAD_MAX_SIZE ) {
+	if( context->downloaded + len > DOWNLOAD_MAX_SIZE || !context->data_callback( Span< const u8 >( ( const u8 * ) data, len ) ) ) {
+		context->aborted = true;
 		return 0;
 	}
 
-	size_t old_size = context->data.extend( len );
-	memcpy( context->data.ptr() + old_size, data, len );
+	context->downloaded += len;
 
 	return len;
 }
 
-void StartDownload( const char * url, CurlDoneCallback done_callback, const char ** headers, size_t num_headers ) {
+void StartDownload( const char * url, CurlDataCallback data_callback, CurlDoneCallback done_callback, const char ** headers, size_t num_headers ) {
 	request = curl_easy_init();
 	if( request == NULL ) {
 		Fatal( "curl_easy_init" );
 	}
 
 	CurlRequestContext * context = ALLOC( sys_allocator, CurlRequestContext );
-	context->data.init( sys_allocator );
+	context->data_callback = data_callback;
 	context->done_callback = done_callback;
 	context->headers = NULL;
+	context->downloaded = 0;
+	context->aborted = false;
 
 	for( size_t i = 0; i < num_headers; i++ ) {
 		context->headers = curl_slist_append( context->headers, headers[ i ] );
@@ -98,7 +103,7 @@ void StartDownload( const char * url, CurlDoneCallback done_callback, const char
 
 	CheckedEasyOpt( request, CURLOPT_URL, url );
 	CheckedEasyOpt( request, CURLOPT_HTTPHEADER, context->headers );
-	CheckedEasyOpt( request, CURLOPT_WRITEFUNCTION, CurlDataCallback );
+	CheckedEasyOpt( request, CURLOPT_WRITEFUNCTION, CurlWriteCallback );
 	CheckedEasyOpt( request, CURLOPT_FOLLOWLOCATION, 1l );
 	CheckedEasyOpt( request, CURLOPT_NOSIGNAL, 1l );
 	CheckedEasyOpt( request, CURLOPT_CONNECTTIMEOUT, 10l );
@@ -123,7 +128,6 @@ void CancelDownload() {
 	request = NULL;
 
 	curl_slist_free_all( context->headers );
-	context->data.shutdown();
 	FREE( sys_allocator, context );
 }
 
@@ -150,13 +154,25 @@ void PumpDownloads() {
 		long http_status;
 		CheckEasyError( "curl_easy_getinfo", curl_easy_getinfo( msg->easy_handle, CURLINFO_RESPONSE_CODE, &http_status ) );
 
-		if( msg->data.result == CURLE_OK && http_status / 100 == 2 ) {
-			context->done_callback( http_status, context->data.span() );
-		}
-		else {
-			context->done_callback( http_status, Span< const u8 >() );
-		}
+		bool ok = msg->data.result == CURLE_OK && http_status / 100 == 2 && !context->aborted;
+		context->done_callback( http_status, ok );
 
 		CancelDownload();
 	}
 }
+
+bool GetDownloadProgress( u64 * downloaded, u64 * total ) {
+	if( request == NULL )
+		return false;
+
+	CurlRequestContext * context;
+	CheckEasyError( "curl_easy_getinfo", curl_easy_getinfo( request, CURLINFO_PRIVATE, &context ) );
+
+	curl_off_t content_length;
+	CheckEasyError( "curl_easy_getinfo", curl_easy_getinfo( request, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &content_length ) );
+
+	*downloaded = context->downloaded;
+	*total = content_length > 0 ? u64( content_length ) : 0;
+
+	return true;
+}
@@ -2,11 +2,16 @@
 
 #include "qcommon/types.h"
 
-using CurlDoneCallback = void ( * )( int http_status, Span< const u8 > data );
+// called with each chunk as it arrives, return false to abort the download
+using CurlDataCallback = bool ( * )( Span< const u8 > data );
+using CurlDoneCallback = void ( * )( int http_status, bool ok );
 
 void InitDownloads();
 void ShutdownDownloads();
 
-void StartDownload( const char * url, CurlDoneCallback done_callback, const char ** headers, size_t num_headers );
+void StartDownload( const char * url, CurlDataCallback data_callback, CurlDoneCallback done_callback, const char ** headers, size_t num_headers );
 void CancelDownload();
 void PumpDownloads();
+
+// total is 0 if the server didn't send a Content-Length
+bool GetDownloadProgress( u64 * downloaded, u64 * total );
@@ -0,0 +1,211 @@
+#include <emmintrin.h>
+
+#include "qcommon/base.h"
+#include "qcommon/qcommon.h"
+#include "qcommon/fs.h"
+#include "client/client.h"
+#include "client/frame_pacer.h"
+
+// the main loop comes back round at least once a millisecond, plus however
+// long Sys_Sleep oversleeps by, so anything closer than this gets spun out
+static constexpr u64 SPIN_THRESHOLD = 2000;
+
+// how much later than our worst recent frame we aim to submit in low
+// latency mode
+static constexpr u64 LOW_LATENCY_MARGIN = 1000;
+
+static constexpr size_t TIMING_WINDOW = 64;
+
+static Cvar * cl_lowlatency;
+static Cvar * cl_showFrameTiming;
+static Cvar * cl_frameTimingLog;
+
+static FILE * timing_log;
+
+static u64 next_deadline;
+static u64 frame_start_time;
+static u64 input_sampled_time;
+static u64 submit_time;
+static u64 swap_time;
+static u64 swap_interval;
+
+static u64 frame_intervals[ TIMING_WINDOW ];
+static u64 work_times[ TIMING_WINDOW ];
+static u64 input_to_submit_times[ TIMING_WINDOW ];
+static size_t num_frames;
+
+void InitFramePacer() {
+	cl_lowlatency = NewCvar( "cl_lowlatency", "0", CvarFlag_Archive );
+	cl_showFrameTiming = NewCvar( "cl_showFrameTiming", "0", CvarFlag_Archive );
+	cl_frameTimingLog = NewCvar( "cl_frameTimingLog", "", 0 );
+	cl_frameTimingLog->modified = true;
+
+	timing_log = NULL;
+	next_deadline = 0;
+	frame_start_time = 0;
+	swap_time = 0;
+	swap_interval = 0;
+	num_frames = 0;
+}
+
+static void CloseTimingLog() {
+	if( timing_log != NULL ) {
+		fclose( timing_log );
+		timing_log = NULL;
+	}
+}
+
+void ShutdownFramePacer() {
+	CloseTimingLog();
+}
+
+static void SpinUntil( u64 t ) {
+	TracyZoneScoped;
+
+	while( Sys_Microseconds() < t ) {
+		_mm_pause();
+	}
+}
+
+static u64 MaxWorkTime() {
+	u64 worst = 0;
+	for( size_t i = 0; i < Min2( num_frames, TIMING_WINDOW ); i++ ) {
+		worst = Max2( worst, work_times[ i ] );
+	}
+	return worst;
+}
+
+static u64 NextFrameStart() {
+	u64 start = next_deadline;
+
+	if( cl_lowlatency->integer != 0 && swap_interval != 0 ) {
+		u64 next_present = swap_time + swap_interval;
+		u64 lead_time = MaxWorkTime() + LOW_LATENCY_MARGIN;
+		if( next_present > lead_time ) {
+			start = Max2( start, next_present - lead_time );
+		}
+	}
+
+	return start;
+}
+
+bool FramePacerReady( u64 interval, bool idle ) {
+	TracyZoneScoped;
+
+	u64 now = Sys_Microseconds();
+	u64 start = NextFrameStart();
+
+	// headless runs go as fast as they can
+	if( IsHeadless() ) {
+		start = now;
+	}
+
+	if( now + SPIN_THRESHOLD < start ) {
+		u64 sleep = start - now - SPIN_THRESHOLD;
+		if( !idle ) {
+			// keep the network and input ticking
+			sleep = Min2( sleep, u64( 1000 ) );
+		}
+
+		if( sleep >= 1000 ) {
+			TracyZoneScopedN( "Sleep" );
+			Sys_Sleep( sleep / 1000 );
+		}
+
+		return false;
+	}
+
+	SpinUntil( start );
+
+	now = Sys_Microseconds();
+
+	// space frames from when they were due, not when we got to them, unless
+	// we fell so far behind that we'd have to rush the next few to catch up
+	next_deadline = next_deadline + interval < now ? now + interval : next_deadline + interval;
+
+	if( frame_start_time != 0 ) {
+		frame_intervals[ num_frames % TIMING_WINDOW ] = now - frame_start_time;
+	}
+	frame_start_time = now;
+	input_sampled_time = now;
+
+	return true;
+}
+
+void FramePacerInputSampled() {
+	input_sampled_time = Sys_Microseconds();
+}
+
+static float Mean( const u64 * xs, size_t n ) {
+	if( n == 0 )
+		return 0.0f;
+
+	double sum = 0.0;
+	for( size_t i = 0; i < n; i++ ) {
+		sum += xs[ i ];
+	}
+	return sum / n;
+}
+
+void FramePacerSubmitted() {
+	submit_time = Sys_Microseconds();
+
+	size_t i = num_frames % TIMING_WINDOW;
+	work_times[ i ] = submit_time - frame_start_time;
+	input_to_submit_times[ i ] = submit_time - input_sampled_time;
+	num_frames++;
+
+	TracyCPlot( "Frame interval (ms)", frame_intervals[ i ] / 1000.0 );
+	TracyCPlot( "Frame work (ms)", work_times[ i ] / 1000.0 );
+	TracyCPlot( "Input to submit (ms)", input_to_submit_times[ i ] / 1000.0 );
+	TracyCPlot( "Frame time stddev (ms)", GetFramePacerStats().frame_time_stddev_ms );
+
+	if( cl_frameTimingLog->modified ) {
+		cl_frameTimingLog->modified = false;
+
+		CloseTimingLog();
+		if( !StrEqual( cl_frameTimingLog->value, "" ) ) {
+			timing_log = OpenFile( sys_allocator, cl_frameTimingLog->value, "w" );
+			if( timing_log == NULL ) {
+				Com_Printf( S_COLOR_YELLOW "Can't open %s for writing\n", cl_frameTimingLog->value );
+			}
+			else {
+				ggprint_to_file( timing_log, "frame,start_us,interval_us,work_us,input_to_submit_us\n" );
+			}
+		}
+	}
+
+	if( timing_log != NULL ) {
+		ggprint_to_file( timing_log, "{},{},{},{},{}\n", num_frames, frame_start_time, frame_intervals[ i ], work_times[ i ], input_to_submit_times[ i ] );
+	}
+}
+
+void FramePacerSwapped() {
+	u64 now = Sys_Microseconds();
+	if( swap_time != 0 ) {
+		u64 interval = now - swap_time;
+		// smooth it a lot, we only need it to guess when the next present is
+		swap_interval = swap_interval == 0 ? interval : ( swap_interval * 15 + interval ) / 16;
+	}
+	swap_time = now;
+}
+
+FramePacerStats GetFramePacerStats() {
+	size_t n = Min2( num_frames, TIMING_WINDOW );
+
+	FramePacerStats stats = { };
+	stats.frame_time_ms = Mean( frame_intervals, n ) / 1000.0f;
+	stats.work_time_ms = Mean( work_times, n ) / 1000.0f;
+	stats.input_to_submit_ms = Mean( input_to_submit_times, n ) / 1000.0f;
+
+	if( n > 0 ) {
+		double variance = 0.0;
+		for( size_t i = 0; i < n; i++ ) {
+			double d = frame_intervals[ i ] / 1000.0 - stats.frame_time_ms;
+			variance += d * d;
+		}
+		stats.frame_time_stddev_ms = sqrtf( float( variance / n ) );
+	}
+
+	return stats;
+}
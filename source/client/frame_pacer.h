@@ -0,0 +1,34 @@
+#pragma once
+
+#include "qcommon/types.h"
+
+/*
+ * decides when the client starts its next frame. deadlines are kept in
+ * microseconds and the last stretch before one gets spun out instead of
+ * slept, so frames come out evenly spaced
+ *
+ * with cl_lowlatency 1 frames also start as late as we think we can get away
+ * with and still make the next present, so input gets sampled right before
+ * the frame is submitted rather than right after the previous swap. this
+ * only makes a difference when the swap blocks, i.e. with vsync
+ */
+
+struct FramePacerStats {
+	float frame_time_ms;
+	float frame_time_stddev_ms;
+	float work_time_ms;
+	float input_to_submit_ms;
+};
+
+void InitFramePacer();
+void ShutdownFramePacer();
+
+// returns true if it's time to start a frame. otherwise it sleeps for as long
+// as it safely can, and no more than a millisecond unless idle is set
+bool FramePacerReady( u64 interval, bool idle );
+
+void FramePacerInputSampled();
+void FramePacerSubmitted();
+void FramePacerSwapped();
+
+FramePacerStats GetFramePacerStats();
@@ -0,0 +1,76 @@
+#include "qcommon/base.h"
+#include "qcommon/qcommon.h"
+#include "client/frame_tasks.h"
+
+static constexpr u32 MAX_FRAME_TASKS = 32;
+
+static constexpr u64 MIN_FRAME_TASK_BUDGET = 500; // 0.5ms
+static constexpr u64 MAX_FRAME_TASK_BUDGET = 4000; // 4ms
+
+static FrameTaskConfig tasks[ MAX_FRAME_TASKS ];
+static u32 num_tasks;
+
+static u64 work_done_time;
+
+void AddFrameTask( const FrameTaskConfig & config ) {
+	assert( num_tasks < ARRAY_COUNT( tasks ) );
+	assert( config.callback != NULL );
+
+	tasks[ num_tasks ] = config;
+	num_tasks++;
+}
+
+void ClearFrameTasks() {
+	num_tasks = 0;
+	work_done_time = 0;
+}
+
+static bool RunFrameTask( const FrameTaskConfig & task ) {
+	TracyZoneScopedN( "Frame task" );
+	TracyZoneText( task.name, strlen( task.name ) );
+
+	return task.callback();
+}
+
+static u64 FrameTaskBudget( u64 now ) {
+	if( work_done_time == 0 || work_done_time > now )
+		return MIN_FRAME_TASK_BUDGET;
+
+	// we were idle from the end of last frame's work until now, so we can
+	// spend some of that without missing the next swap. keep half of it
+	// spare for frame time variance
+	u64 headroom = now - work_done_time;
+	return Clamp( MIN_FRAME_TASK_BUDGET, headroom / 2, MAX_FRAME_TASK_BUDGET );
+}
+
+void RunFrameTasks() {
+	TracyZoneScoped;
+
+	u64 start_time = Sys_Microseconds();
+	u64 deadline = start_time + FrameTaskBudget( start_time );
+	TracyCPlot( "Frame task budget", s64( deadline - start_time ) );
+
+	for( int priority = 0; priority < FrameTaskPriority_Count; priority++ ) {
+		for( u32 i = 0; i < num_tasks; i++ ) {
+			const FrameTaskConfig & task = tasks[ i ];
+			if( task.priority != priority )
+				continue;
+
+			// everything gets a turn even when we're over budget so low
+			// priority work can't be starved completely
+			bool more = RunFrameTask( task );
+			if( task.priority == FrameTaskPriority_EveryFrame )
+				continue;
+
+			while( more && Sys_Microseconds() < deadline ) {
+				more = RunFrameTask( task );
+			}
+		}
+	}
+
+	TracyCPlot( "Frame task time", s64( Sys_Microseconds() - start_time ) );
+}
+
+void FrameTasksWorkDone() {
+	work_done_time = Sys_Microseconds();
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "qcommon/types.h"
+
+/*
+ * main thread work that happens between frames. every task gets called once
+ * per rendered frame in priority order, then budgeted tasks keep getting
+ * called while they have more to do and the frame has time left. the budget
+ * comes from how long we spent waiting on vsync/cl_maxfps last frame, so slow
+ * frames don't get slower
+ *
+ * this runs at the framerate, which drops to 24fps when unfocused, so network
+ * polls like downloads and the server browser don't belong here
+ */
+
+enum FrameTaskPriority {
+	FrameTaskPriority_EveryFrame, // called exactly once per rendered frame
+	FrameTaskPriority_Low,
+
+	FrameTaskPriority_Count
+};
+
+struct FrameTaskConfig {
+	const char * name = NULL;
+	FrameTaskPriority priority = FrameTaskPriority_Low;
+
+	// return true if there's more work to do
+	bool ( *callback )() = NULL;
+};
+
+void AddFrameTask( const FrameTaskConfig & config );
+void ClearFrameTasks();
+
+void RunFrameTasks();
+
+// call once the frame has been submitted, right before we start waiting on
+// the swap
+void FrameTasksWorkDone();
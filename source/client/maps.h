@@ -26,8 +26,6 @@ struct Map {
 void InitMaps();
 void ShutdownMaps();
 
-void HotloadMaps();
-
 bool AddMap( Span< const u8 > data, const char * path );
 
 const Map * FindMap( StringHash name );
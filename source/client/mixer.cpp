@@ -0,0 +1,578 @@
+#include <algorithm> // std::nth_element
+#include <emmintrin.h>
+
+#include "qcommon/base.h"
+#include "qcommon/threads.h"
+#include "client/mixer.h"
+#include "gameshared/q_shared.h"
+
+#define STB_VORBIS_HEADER_ONLY
+#include "stb/stb_vorbis.h"
+
+constexpr u32 MIX_BLOCK_FRAMES = 256;
+constexpr u32 STREAM_CHUNK_FRAMES = 4096;
+
+// -60dB, nobody will miss it
+constexpr float VIRTUAL_VOICE_THRESHOLD = 0.001f;
+
+struct MixerStream {
+	stb_vorbis * decoder;
+	s16 frames[ STREAM_CHUNK_FRAMES * 2 ];
+	u64 first_frame;
+	u32 num_frames;
+	bool eof;
+};
+
+struct MixerVoice {
+	MixerVoiceConfig config;
+	u16 generation;
+	bool active;
+	s32 stream;
+
+	u64 cursor; // 32.32 fixed point, in source frames
+	float audibility;
+	bool audible;
+
+	// gains from the last block we mixed, so they ramp instead of clicking
+	float gain_l, gain_r;
+	bool mixed_last_block;
+};
+
+struct Mixer {
+	Mutex * mutex;
+
+	MixerVoice voices[ MAX_MIXER_VOICES ];
+	MixerStream streams[ MAX_MIXER_STREAMS ];
+	bool stream_in_use[ MAX_MIXER_STREAMS ];
+
+	Vec3 listener_origin;
+	Vec3 listener_right;
+	float listener_gain;
+
+	bool positional_voices_elsewhere;
+
+	u32 num_voices;
+	u32 num_audible;
+	u32 num_stolen;
+	u32 num_refused;
+};
+
+Mixer * NewMixer( Allocator * a, bool positional_voices_elsewhere ) {
+	Mixer * mixer = ALLOC( a, Mixer );
+
+	mixer->mutex = NewMutex();
+
+	for( MixerVoice & voice : mixer->voices ) {
+		voice = MixerVoice();
+	}
+
+	for( u32 i = 0; i < MAX_MIXER_STREAMS; i++ ) {
+		mixer->streams[ i ].decoder = NULL;
+		mixer->stream_in_use[ i ] = false;
+	}
+
+	mixer->listener_origin = Vec3( 0.0f );
+	mixer->listener_right = Vec3( 0.0f, -1.0f, 0.0f );
+	mixer->listener_gain = 1.0f;
+
+	mixer->positional_voices_elsewhere = positional_voices_elsewhere;
+
+	mixer->num_voices = 0;
+	mixer->num_audible = 0;
+	mixer->num_stolen = 0;
+	mixer->num_refused = 0;
+
+	return mixer;
+}
+
+void DeleteMixer( Allocator * a, Mixer * mixer ) {
+	StopAllMixerVoices( mixer );
+	DeleteMutex( mixer->mutex );
+	FREE( a, mixer );
+}
+
+static float DistanceGain( const Mixer * mixer, const MixerVoiceConfig & config ) {
+	if( !config.spatial || config.rolloff == 0.0f )
+		return 1.0f;
+
+	// same as AL_INVERSE_DISTANCE_CLAMPED
+	float ref = S_DEFAULT_ATTENUATION_REFDISTANCE;
+	float d = Clamp( ref, Length( config.position - mixer->listener_origin ), float( S_DEFAULT_ATTENUATION_MAXDISTANCE ) );
+	return ref / ( ref + config.rolloff * ( d - ref ) );
+}
+
+static float Audibility( const Mixer * mixer, const MixerVoiceConfig & config ) {
+	return config.volume * DistanceGain( mixer, config );
+}
+
+static bool PlayedElsewhere( const Mixer * mixer, const MixerVoice * voice ) {
+	return mixer->positional_voices_elsewhere && voice->config.spatial && voice->config.sound->channels == 1 && voice->stream < 0;
+}
+
+static bool MoreImportant( const MixerVoice & a, const MixerVoice & b ) {
+	if( a.config.priority != b.config.priority )
+		return a.config.priority > b.config.priority;
+	return a.audibility > b.audibility;
+}
+
+static MixerVoice * FindVoice( Mixer * mixer, MixerVoiceHandle handle ) {
+	u32 idx = handle.x & 0xffff;
+	if( idx == 0 || idx > MAX_MIXER_VOICES )
+		return NULL;
+
+	MixerVoice * voice = &mixer->voices[ idx - 1 ];
+	if( !voice->active || voice->generation != handle.x >> 16 )
+		return NULL;
+
+	return voice;
+}
+
+static void StopVoice( Mixer * mixer, MixerVoice * voice ) {
+	if( voice->stream >= 0 ) {
+		stb_vorbis_close( mixer->streams[ voice->stream ].decoder );
+		mixer->stream_in_use[ voice->stream ] = false;
+	}
+
+	voice->active = false;
+	mixer->num_voices--;
+}
+
+MixerVoiceHandle StartMixerVoice( Mixer * mixer, const MixerVoiceConfig & config ) {
+	TracyZoneScoped;
+
+	Lock( mixer->mutex );
+	defer { Unlock( mixer->mutex ); };
+
+	MixerVoice candidate = { };
+	candidate.config = config;
+	candidate.audibility = Audibility( mixer, config );
+
+	s32 stream = -1;
+	if( config.sound->samples.n == 0 ) {
+		for( u32 i = 0; i < MAX_MIXER_STREAMS; i++ ) {
+			if( !mixer->stream_in_use[ i ] ) {
+				stream = i;
+				break;
+			}
+		}
+
+		if( stream == -1 ) {
+			mixer->num_refused++;
+			return { 0 };
+		}
+	}
+
+	MixerVoice * voice = NULL;
+	for( MixerVoice & v : mixer->voices ) {
+		if( !v.active ) {
+			voice = &v;
+			break;
+		}
+	}
+
+	MixerVoice * victim = NULL;
+	if( voice == NULL ) {
+		victim = &mixer->voices[ 0 ];
+		for( MixerVoice & v : mixer->voices ) {
+			v.audibility = Audibility( mixer, v.config );
+			if( MoreImportant( *victim, v ) ) {
+				victim = &v;
+			}
+		}
+
+		if( !MoreImportant( candidate, *victim ) ) {
+			mixer->num_refused++;
+			return { 0 };
+		}
+	}
+
+	// open the decoder before stealing so a bad ogg doesn't cut off another sound
+	if( stream >= 0 ) {
+		int error;
+		MixerStream * s = &mixer->streams[ stream ];
+		s->decoder = stb_vorbis_open_memory( config.sound->ogg.ptr, config.sound->ogg.num_bytes(), &error, NULL );
+		if( s->decoder == NULL )
+			return { 0 };
+
+		s->first_frame = 0;
+		s->num_frames = 0;
+		s->eof = false;
+		mixer->stream_in_use[ stream ] = true;
+	}
+
+	if( victim != NULL ) {
+		StopVoice( mixer, victim );
+		mixer->num_stolen++;
+		voice = victim;
+	}
+
+	u16 generation = voice->generation + 1;
+	*voice = candidate;
+	voice->generation = generation;
+	voice->active = true;
+	voice->stream = stream;
+	voice->cursor = 0;
+	voice->mixed_last_block = false;
+	// so positional voices get handed out before the next block gets mixed.
+	// if it's not important enough the next block will sort it out
+	voice->audible = true;
+
+	mixer->num_voices++;
+
+	return { ( u32( generation ) << 16 ) | u32( voice - mixer->voices + 1 ) };
+}
+
+void StopMixerVoice( Mixer * mixer, MixerVoiceHandle handle ) {
+	Lock( mixer->mutex );
+	defer { Unlock( mixer->mutex ); };
+
+	MixerVoice * voice = FindVoice( mixer, handle );
+	if( voice != NULL ) {
+		StopVoice( mixer, voice );
+	}
+}
+
+void StopAllMixerVoices( Mixer * mixer ) {
+	Lock( mixer->mutex );
+	defer { Unlock( mixer->mutex ); };
+
+	for( MixerVoice & voice : mixer->voices ) {
+		if( voice.active ) {
+			StopVoice( mixer, &voice );
+		}
+	}
+}
+
+bool MixerVoicePlaying( Mixer * mixer, MixerVoiceHandle handle ) {
+	Lock( mixer->mutex );
+	defer { Unlock( mixer->mutex ); };
+	return FindVoice( mixer, handle ) != NULL;
+}
+
+float MixerVoiceAudibility( Mixer * mixer, MixerVoiceHandle handle ) {
+	Lock( mixer->mutex );
+	defer { Unlock( mixer->mutex ); };
+
+	const MixerVoice * voice = FindVoice( mixer, handle );
+	return voice == NULL ? 0.0f : Audibility( mixer, voice->config );
+}
+
+void SetMixerVoicePosition( Mixer * mixer, MixerVoiceHandle handle, Vec3 position, Vec3 velocity ) {
+	Lock( mixer->mutex );
+	defer { Unlock( mixer->mutex ); };
+
+	MixerVoice * voice = FindVoice( mixer, handle );
+	if( voice != NULL ) {
+		voice->config.position = position;
+		voice->config.velocity = velocity;
+	}
+}
+
+void SetMixerVoiceVolume( Mixer * mixer, MixerVoiceHandle handle, float volume ) {
+	Lock( mixer->mutex );
+	defer { Unlock( mixer->mutex ); };
+
+	MixerVoice * voice = FindVoice( mixer, handle );
+	if( voice != NULL ) {
+		voice->config.volume = volume;
+	}
+}
+
+void SetMixerListener( Mixer * mixer, Vec3 origin, Vec3 right, float gain ) {
+	Lock( mixer->mutex );
+	defer { Unlock( mixer->mutex ); };
+
+	mixer->listener_origin = origin;
+	mixer->listener_right = right;
+	mixer->listener_gain = gain;
+}
+
+MixerStats GetMixerStats( Mixer * mixer ) {
+	Lock( mixer->mutex );
+	defer { Unlock( mixer->mutex ); };
+
+	MixerStats stats;
+	stats.voices = mixer->num_voices;
+	stats.audible = mixer->num_audible;
+	stats.stolen = mixer->num_stolen;
+	stats.refused = mixer->num_refused;
+
+	mixer->num_stolen = 0;
+	mixer->num_refused = 0;
+
+	return stats;
+}
+
+static u64 VoiceStep( const MixerVoice * voice ) {
+	double step = double( voice->config.sound->sample_rate ) / MIXER_SAMPLE_RATE * voice->config.pitch;
+	return u64( Max2( step, 0.0 ) * 4294967296.0 );
+}
+
+// returns false when a voice that doesn't loop runs off the end
+static bool WrapCursor( MixerVoice * voice ) {
+	u64 length = u64( voice->config.sound->num_frames ) << 32;
+	if( voice->cursor < length )
+		return true;
+	if( !voice->config.loop || length == 0 )
+		return false;
+	voice->cursor %= length;
+	return true;
+}
+
+static bool AdvanceVoice( MixerVoice * voice, u32 n ) {
+	voice->cursor += VoiceStep( voice ) * n;
+	return WrapCursor( voice );
+}
+
+// makes sure frame and the one after it are decoded, if the file has them.
+// the last frame of each chunk is kept so we can interpolate across chunks
+static const s16 * StreamFrame( MixerStream * stream, u32 channels, u64 frame ) {
+	static const s16 silence[ 2 ] = { };
+
+	if( frame < stream->first_frame ) {
+		stb_vorbis_seek_start( stream->decoder );
+		stream->first_frame = 0;
+		stream->num_frames = 0;
+		stream->eof = false;
+	}
+
+	while( frame + 1 >= stream->first_frame + stream->num_frames && !stream->eof ) {
+		if( stream->num_frames > 0 ) {
+			u32 last = stream->num_frames - 1;
+			memmove( stream->frames, stream->frames + last * channels, channels * sizeof( s16 ) );
+			stream->first_frame += last;
+			stream->num_frames = 1;
+		}
+
+		int decoded = stb_vorbis_get_samples_short_interleaved( stream->decoder, channels,
+			stream->frames + stream->num_frames * channels, ( STREAM_CHUNK_FRAMES - stream->num_frames ) * channels );
+		if( decoded == 0 ) {
+			stream->eof = true;
+		}
+		stream->num_frames += decoded;
+	}
+
+	if( frame >= stream->first_frame + stream->num_frames )
+		return silence;
+
+	return stream->frames + ( frame - stream->first_frame ) * channels;
+}
+
+// resamples n frames into l (and r for stereo sounds), zero filling past the
+// end of the sound. returns false when the voice is done
+static bool RenderVoice( Mixer * mixer, MixerVoice * voice, float * l, float * r, u32 n ) {
+	const MixerSound * sound = voice->config.sound;
+	u32 channels = sound->channels;
+	u32 last_channel = channels - 1;
+	u64 step = VoiceStep( voice );
+	MixerStream * stream = voice->stream >= 0 ? &mixer->streams[ voice->stream ] : NULL;
+
+	for( u32 i = 0; i < n; i++ ) {
+		if( !WrapCursor( voice ) ) {
+			for( u32 j = i; j < n; j++ ) {
+				l[ j ] = 0.0f;
+				r[ j ] = 0.0f;
+			}
+			return false;
+		}
+
+		u64 frame = voice->cursor >> 32;
+		const s16 * f0;
+		const s16 * f1;
+		if( stream != NULL ) {
+			f0 = StreamFrame( stream, channels, frame );
+			f1 = frame + 1 < stream->first_frame + stream->num_frames ? f0 + channels : f0;
+		}
+		else {
+			u64 next = frame + 1;
+			if( next == sound->num_frames ) {
+				next = voice->config.loop ? 0 : frame;
+			}
+			f0 = sound->samples.ptr + frame * channels;
+			f1 = sound->samples.ptr + next * channels;
+		}
+
+		float t = float( voice->cursor & U32_MAX ) * ( 1.0f / 4294967296.0f );
+		l[ i ] = Lerp( float( f0[ 0 ] ), t, float( f1[ 0 ] ) ) * ( 1.0f / 32768.0f );
+		r[ i ] = Lerp( float( f0[ last_channel ] ), t, float( f1[ last_channel ] ) ) * ( 1.0f / 32768.0f );
+
+		voice->cursor += step;
+	}
+
+	return WrapCursor( voice );
+}
+
+// n must be a multiple of 4
+static void Accumulate( float * out, const float * in, u32 n, float gain_from, float gain_to ) {
+	float dgain = ( gain_to - gain_from ) / n;
+	__m128 gain = _mm_setr_ps( gain_from, gain_from + dgain, gain_from + dgain * 2.0f, gain_from + dgain * 3.0f );
+	__m128 gain_step = _mm_set1_ps( dgain * 4.0f );
+
+	for( u32 i = 0; i < n; i += 4 ) {
+		__m128 mixed = _mm_add_ps( _mm_load_ps( out + i ), _mm_mul_ps( _mm_load_ps( in + i ), gain ) );
+		_mm_store_ps( out + i, mixed );
+		gain = _mm_add_ps( gain, gain_step );
+	}
+}
+
+static void VoiceGains( const Mixer * mixer, const MixerVoice * voice, float * l, float * r ) {
+	float gain = voice->audibility;
+
+	if( voice->config.sound->channels == 2 || !voice->config.spatial ) {
+		*l = gain;
+		*r = gain;
+		return;
+	}
+
+	float pan = 0.0f;
+	Vec3 to_voice = voice->config.position - mixer->listener_origin;
+	float d = Length( to_voice );
+	if( d > 0.001f ) {
+		// fade panning in over the reference distance so sounds right on top
+		// of you don't flip between ears
+		pan = Dot( to_voice / d, mixer->listener_right ) * Min2( 1.0f, d / S_DEFAULT_ATTENUATION_REFDISTANCE );
+	}
+
+	// equal power
+	float angle = ( pan + 1.0f ) * PI * 0.25f;
+	*l = gain * cosf( angle ) * sqrtf( 2.0f );
+	*r = gain * sinf( angle ) * sqrtf( 2.0f );
+}
+
+static void WriteOutput( s16 * output, const float * l, const float * r, u32 n, float gain ) {
+	__m128 scale = _mm_set1_ps( gain * 32767.0f );
+	__m128 lo = _mm_set1_ps( -32768.0f );
+	__m128 hi = _mm_set1_ps( 32767.0f );
+
+	for( u32 i = 0; i < n; i += 4 ) {
+		__m128 fl = _mm_min_ps( _mm_max_ps( _mm_mul_ps( _mm_load_ps( l + i ), scale ), lo ), hi );
+		__m128 fr = _mm_min_ps( _mm_max_ps( _mm_mul_ps( _mm_load_ps( r + i ), scale ), lo ), hi );
+		__m128i il = _mm_cvtps_epi32( fl );
+		__m128i ir = _mm_cvtps_epi32( fr );
+		__m128i lr = _mm_packs_epi32( _mm_unpacklo_epi32( il, ir ), _mm_unpackhi_epi32( il, ir ) );
+
+		if( i + 4 <= n ) {
+			_mm_storeu_si128( ( __m128i * ) ( output + i * 2 ), lr );
+		}
+		else {
+			alignas( 16 ) s16 tail[ 8 ];
+			_mm_store_si128( ( __m128i * ) tail, lr );
+			memcpy( output + i * 2, tail, ( n - i ) * 2 * sizeof( s16 ) );
+		}
+	}
+}
+
+static void MixBlock( Mixer * mixer, s16 * output, u32 n ) {
+	alignas( 16 ) float mix_l[ MIX_BLOCK_FRAMES ] = { };
+	alignas( 16 ) float mix_r[ MIX_BLOCK_FRAMES ] = { };
+	alignas( 16 ) float voice_l[ MIX_BLOCK_FRAMES ];
+	alignas( 16 ) float voice_r[ MIX_BLOCK_FRAMES ];
+	u32 n4 = AlignPow2( n, u32( 4 ) );
+
+	// everything loud enough to hear is a candidate for being mixed. streams
+	// always are because we have to decode them anyway
+	u16 candidates[ MAX_MIXER_VOICES ];
+	u32 num_candidates = 0;
+	for( u32 i = 0; i < MAX_MIXER_VOICES; i++ ) {
+		MixerVoice * voice = &mixer->voices[ i ];
+		if( !voice->active )
+			continue;
+
+		voice->audibility = Audibility( mixer, voice->config );
+		if( voice->audibility >= VIRTUAL_VOICE_THRESHOLD || voice->stream >= 0 ) {
+			candidates[ num_candidates ] = i;
+			num_candidates++;
+		}
+	}
+
+	if( num_candidates > MAX_AUDIBLE_VOICES ) {
+		std::nth_element( candidates, candidates + MAX_AUDIBLE_VOICES, candidates + num_candidates, [&]( u16 a, u16 b ) {
+			return MoreImportant( mixer->voices[ a ], mixer->voices[ b ] );
+		} );
+	}
+
+	bool audible[ MAX_MIXER_VOICES ] = { };
+	mixer->num_audible = Min2( num_candidates, MAX_AUDIBLE_VOICES );
+	for( u32 i = 0; i < mixer->num_audible; i++ ) {
+		audible[ candidates[ i ] ] = true;
+	}
+
+	for( u32 i = 0; i < MAX_MIXER_VOICES; i++ ) {
+		MixerVoice * voice = &mixer->voices[ i ];
+		if( !voice->active )
+			continue;
+
+		voice->audible = audible[ i ];
+
+		bool alive;
+		if( audible[ i ] && !PlayedElsewhere( mixer, voice ) ) {
+			alive = RenderVoice( mixer, voice, voice_l, voice_r, n );
+			for( u32 j = n; j < n4; j++ ) {
+				voice_l[ j ] = 0.0f;
+				voice_r[ j ] = 0.0f;
+			}
+
+			float gain_l, gain_r;
+			VoiceGains( mixer, voice, &gain_l, &gain_r );
+			if( !voice->mixed_last_block ) {
+				voice->gain_l = gain_l;
+				voice->gain_r = gain_r;
+			}
+
+			Accumulate( mix_l, voice_l, n4, voice->gain_l, gain_l );
+			Accumulate( mix_r, voice_r, n4, voice->gain_r, gain_r );
+
+			voice->gain_l = gain_l;
+			voice->gain_r = gain_r;
+			voice->mixed_last_block = true;
+		}
+		else if( voice->stream >= 0 ) {
+			// virtual streams still have to keep their decoder in step
+			alive = RenderVoice( mixer, voice, voice_l, voice_r, n );
+			voice->mixed_last_block = false;
+		}
+		else {
+			// virtual, or being played by whoever called GetAudiblePositionalVoices
+			alive = AdvanceVoice( voice, n );
+			voice->mixed_last_block = false;
+		}
+
+		if( !alive ) {
+			StopVoice( mixer, voice );
+		}
+	}
+
+	WriteOutput( output, mix_l, mix_r, n, mixer->listener_gain );
+}
+
+void MixAudio( Mixer * mixer, Span< s16 > output ) {
+	TracyZoneScoped;
+
+	Lock( mixer->mutex );
+	defer { Unlock( mixer->mutex ); };
+
+	u32 num_frames = output.n / 2;
+	for( u32 i = 0; i < num_frames; i += MIX_BLOCK_FRAMES ) {
+		u32 n = Min2( MIX_BLOCK_FRAMES, num_frames - i );
+		MixBlock( mixer, output.ptr + i * 2, n );
+	}
+}
+
+u32 GetAudiblePositionalVoices( Mixer * mixer, Span< MixerPositionalVoice > voices ) {
+	Lock( mixer->mutex );
+	defer { Unlock( mixer->mutex ); };
+
+	u32 n = 0;
+	for( u32 i = 0; i < MAX_MIXER_VOICES && n < voices.n; i++ ) {
+		const MixerVoice * voice = &mixer->voices[ i ];
+		if( !voice->active || !voice->audible || !PlayedElsewhere( mixer, voice ) )
+			continue;
+
+		voices[ n ].handle = { ( u32( voice->generation ) << 16 ) | ( i + 1 ) };
+		voices[ n ].config = voice->config;
+		voices[ n ].frame = u32( voice->cursor >> 32 );
+		n++;
+	}
+
+	return n;
+}
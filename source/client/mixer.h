@@ -0,0 +1,92 @@
+#pragma once
+
+#include "qcommon/types.h"
+
+/*
+ * software mixer. voices get resampled, attenuated and panned into one stereo
+ * stream, which cl_sound feeds to a single AL source, or to a wav file when
+ * benchmarking
+ *
+ * voices are ranked by priority and then audibility every block. only the top
+ * MAX_AUDIBLE_VOICES get played, the rest are virtual and just advance their
+ * cursor so they come back in the right place. starting a voice with no free
+ * slots steals the least important one
+ *
+ * a mixer made with positional_voices_elsewhere leaves audible mono spatial
+ * voices out of the mix and hands them out through GetAudiblePositionalVoices
+ * instead, so cl_sound can play them with AL sources and keep HRTF and doppler
+ */
+
+constexpr u32 MIXER_SAMPLE_RATE = 48000;
+constexpr u32 MAX_MIXER_VOICES = 1024;
+constexpr u32 MAX_AUDIBLE_VOICES = 64;
+constexpr u32 MAX_MIXER_STREAMS = 16;
+
+struct MixerSound {
+	// interleaved, empty for streamed sounds
+	Span< const s16 > samples;
+	// decoded as the voice plays when samples is empty
+	Span< const u8 > ogg;
+	u32 channels;
+	u32 sample_rate;
+	u32 num_frames;
+
+	// not used by the mixer, cl_sound plays positional voices from it
+	u32 al_buffer;
+};
+
+struct MixerVoiceHandle {
+	u32 x;
+};
+
+struct MixerVoiceConfig {
+	const MixerSound * sound = NULL;
+	float volume = 1.0f;
+	float pitch = 1.0f;
+	float rolloff = 1.0f; // 0 means it's the same volume everywhere
+	bool spatial = false;
+	bool loop = false;
+	Vec3 position = Vec3( 0.0f );
+	Vec3 velocity = Vec3( 0.0f );
+	u8 priority = 0;
+};
+
+struct MixerPositionalVoice {
+	MixerVoiceHandle handle;
+	MixerVoiceConfig config;
+	u32 frame; // where the voice is up to in its sound
+};
+
+struct MixerStats {
+	u32 voices;
+	u32 audible;
+	u32 stolen;
+	u32 refused;
+};
+
+struct Mixer;
+
+Mixer * NewMixer( Allocator * a, bool positional_voices_elsewhere );
+void DeleteMixer( Allocator * a, Mixer * mixer );
+
+// returns { 0 } if every voice is more important than this one
+MixerVoiceHandle StartMixerVoice( Mixer * mixer, const MixerVoiceConfig & config );
+void StopMixerVoice( Mixer * mixer, MixerVoiceHandle handle );
+void StopAllMixerVoices( Mixer * mixer );
+bool MixerVoicePlaying( Mixer * mixer, MixerVoiceHandle handle );
+float MixerVoiceAudibility( Mixer * mixer, MixerVoiceHandle handle );
+
+void SetMixerVoicePosition( Mixer * mixer, MixerVoiceHandle handle, Vec3 position, Vec3 velocity );
+void SetMixerVoiceVolume( Mixer * mixer, MixerVoiceHandle handle, float volume );
+void SetMixerListener( Mixer * mixer, Vec3 origin, Vec3 right, float gain );
+
+// output is interleaved stereo at MIXER_SAMPLE_RATE. safe to call from
+// another thread
+void MixAudio( Mixer * mixer, Span< s16 > output );
+
+// returns how many were written to voices, which never needs to be bigger
+// than MAX_AUDIBLE_VOICES
+u32 GetAudiblePositionalVoices( Mixer * mixer, Span< MixerPositionalVoice > voices );
+
+// resets the stolen/refused counters
+MixerStats GetMixerStats( Mixer * mixer );
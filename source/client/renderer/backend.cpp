@@ -1,4 +1,3 @@
-#include <algorithm> // std::stable_sort
 #include <new>
 
 #include "glad/glad.h"
@@ -9,8 +8,11 @@
 #include "qcommon/qcommon.h"
 #include "qcommon/array.h"
 #include "qcommon/hash.h"
+#include "qcommon/hashtable.h"
 #include "qcommon/string.h"
+#include "client/decode_cache.h"
 #include "client/renderer/renderer.h"
+#include "client/renderer/null_gl.h"
 
 #include "cgame/cg_local.h"
 
@@ -49,7 +51,10 @@ enum VertexAttribute : GLuint {
 	VertexAttribute_ParticleFlags,
 };
 
-static const u32 UNIFORM_BUFFER_SIZE = 64 * 1024;
+static constexpr u32 UNIFORM_BLOCK_MAX_SIZE = 64 * 1024;
+static constexpr u32 UNIFORM_RING_REGION_SIZE = 4 * 1024 * 1024; // 4MB per frame
+static constexpr u32 UNIFORM_RING_REGIONS = 3;
+static constexpr u32 UNIFORM_DEDUPE_MAX_SIZE = 1024;
 
 struct DrawCall {
 	PipelineState pipeline;
@@ -59,13 +64,33 @@ struct DrawCall {
 
 	InstanceType instance_type;
 	u32 num_instances;
+	u32 base_instance;
 	GPUBuffer instance_data;
 	GPUBuffer update_data;
 	GPUBuffer feedback_data;
 };
 
+/*
+ * draw calls are submitted in sort key order:
+ *
+ * 63-56 pass
+ * 55-40 shader
+ * 39-32 blend/depth/cull/etc
+ * 31-16 texture set
+ * 15-0  VAO
+ *
+ * unsorted passes and blended draws only get the pass (and shader) bits so
+ * they keep submission order, we don't know their depth at this level
+ */
+struct DrawCallKey {
+	u64 key;
+	u32 index;
+};
+
 static NonRAIIDynamicArray< RenderPass > render_passes;
 static NonRAIIDynamicArray< DrawCall > draw_calls;
+static NonRAIIDynamicArray< DrawCallKey > draw_call_keys;
+static NonRAIIDynamicArray< DrawCallKey > draw_call_keys_scratch;
 
 static NonRAIIDynamicArray< Mesh > deferred_mesh_deletes;
 static NonRAIIDynamicArray< GPUBuffer > deferred_buffer_deletes;
@@ -79,12 +104,28 @@ static u32 num_vertices_this_frame;
 
 static bool in_frame;
 
-struct UBO {
-	StreamingBuffer stream;
+/*
+ * uniforms get bump allocated out of one persistently mapped buffer that's
+ * split into a region per frame in flight. each region is fenced when the
+ * frame ends and waited on before it gets reused
+ *
+ * small blocks are hashed so identical blocks (materials etc) only get
+ * written once per frame. anything that doesn't fit in the region goes in
+ * its own buffer, which is slow but can't fail
+ */
+struct UniformRing {
+	GLuint buffer;
+	u8 * mapping;
+	u64 fences[ UNIFORM_RING_REGIONS ];
+	u32 region;
 	u32 bytes_used;
+
+	Hashtable< 4096 > dedupe;
+	u32 bytes_deduplicated;
+	u32 bytes_overflowed;
 };
 
-static UBO ubos[ 16 ]; // 1MB of uniform space
+static UniformRing uniform_ring;
 static u32 ubo_offset_alignment;
 
 static float max_anisotropic_filtering;
@@ -239,8 +280,12 @@ static void TextureFilterToGL( TextureFilter filter, GLenum * min, GLenum * mag
 
 static u32 GLTypeSize( GLenum type ) {
 	switch( type ) {
-		case GL_UNSIGNED_BYTE: return 1;
-		case GL_UNSIGNED_SHORT: return 2;
+		case GL_BYTE:
+		case GL_UNSIGNED_BYTE:
+			return 1;
+		case GL_HALF_FLOAT:
+		case GL_UNSIGNED_SHORT:
+			return 2;
 		case GL_UNSIGNED_INT:
 		case GL_FLOAT:
 			return 4;
@@ -299,12 +344,24 @@ static void VertexFormatToGL( VertexFormat format, GLenum * type, int * num_comp
 			*normalized = format == VertexFormat_U16x4_Norm;
 			break;
 
+		case VertexFormat_S8x4_Norm:
+			*type = GL_BYTE;
+			*num_components = 4;
+			*integral = true;
+			*normalized = true;
+			break;
+
 		case VertexFormat_U32x1:
 			*type = GL_UNSIGNED_INT;
 			*num_components = 1;
 			*integral = true;
 			break;
 
+		case VertexFormat_Halfx4:
+			*type = GL_HALF_FLOAT;
+			*num_components = 4;
+			break;
+
 		case VertexFormat_Floatx1:
 			*type = GL_FLOAT;
 			*num_components = 1;
@@ -324,6 +381,9 @@ static void VertexFormatToGL( VertexFormat format, GLenum * type, int * num_comp
 
 		default:
 			assert( false );
+			*type = GL_FLOAT;
+			*num_components = 4;
+			break;
 	}
 
 	if( stride != NULL ) {
@@ -331,6 +391,19 @@ static void VertexFormatToGL( VertexFormat format, GLenum * type, int * num_comp
 	}
 }
 
+u32 VertexFormatSize( VertexFormat format ) {
+	if( format > VertexFormat_Floatx4 )
+		return 0;
+
+	GLenum type;
+	int num_components;
+	bool integral;
+	GLboolean normalized;
+	u32 stride;
+	VertexFormatToGL( format, &type, &num_components, &integral, &normalized, &stride );
+	return stride;
+}
+
 static const char * DebugTypeString( GLenum type ) {
 	switch( type ) {
 		case GL_DEBUG_TYPE_ERROR:
@@ -568,6 +641,8 @@ void InitRenderBackend() {
 
 	render_passes.init( sys_allocator );
 	draw_calls.init( sys_allocator );
+	draw_call_keys.init( sys_allocator );
+	draw_call_keys_scratch.init( sys_allocator );
 
 	deferred_mesh_deletes.init( sys_allocator );
 	deferred_buffer_deletes.init( sys_allocator );
@@ -587,17 +662,24 @@ void InitRenderBackend() {
 
 	GLint alignment;
 	glGetIntegerv( GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment );
-	ubo_offset_alignment = checked_cast< u32 >( alignment );
+	ubo_offset_alignment = Max2( checked_cast< u32 >( alignment ), u32( 256 ) );
 
 	glGetFloatv( GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max_anisotropic_filtering );
 
 	GLint max_ubo_size;
 	glGetIntegerv( GL_MAX_UNIFORM_BLOCK_SIZE, &max_ubo_size );
-	assert( max_ubo_size >= s32( UNIFORM_BUFFER_SIZE ) );
+	assert( max_ubo_size >= s32( UNIFORM_BLOCK_MAX_SIZE ) );
+
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		u32 size = UNIFORM_RING_REGION_SIZE * UNIFORM_RING_REGIONS;
 
-	for( size_t i = 0; i < ARRAY_COUNT( ubos ); i++ ) {
-		TempAllocator temp = cls.frame_arena.temp();
-		ubos[ i ].stream = NewStreamingBuffer( UNIFORM_BUFFER_SIZE, temp( "UBO {}", i ), true );
+		uniform_ring = { };
+		uniform_ring.buffer = DSACreateBuffer( true );
+		glNamedBufferStorage( uniform_ring.buffer, size, NULL, flags );
+		DebugLabel( GL_BUFFER, uniform_ring.buffer, "Uniform ring" );
+		uniform_ring.mapping = ( u8 * ) glMapNamedBufferRange( uniform_ring.buffer, 0, size, flags );
+		uniform_ring.region = UNIFORM_RING_REGIONS - 1;
 	}
 
 	in_frame = false;
@@ -609,12 +691,18 @@ void InitRenderBackend() {
 }
 
 void ShutdownRenderBackend() {
-	for( UBO ubo : ubos ) {
-		DeleteStreamingBuffer( ubo.stream );
+	glUnmapNamedBuffer( uniform_ring.buffer );
+	glDeleteBuffers( 1, &uniform_ring.buffer );
+	for( u64 fence : uniform_ring.fences ) {
+		if( fence != 0 ) {
+			glDeleteSync( bit_cast< GLsync >( fence ) );
+		}
 	}
 
 	render_passes.shutdown();
 	draw_calls.shutdown();
+	draw_call_keys.shutdown();
+	draw_call_keys_scratch.shutdown();
 
 	deferred_mesh_deletes.shutdown();
 	deferred_buffer_deletes.shutdown();
@@ -632,9 +720,22 @@ void RenderBackendBeginFrame() {
 
 	num_vertices_this_frame = 0;
 
-	for( UBO & ubo : ubos ) {
-		StreamingBufferFrame( &ubo.stream );
-		ubo.bytes_used = 0;
+	{
+		TracyZoneScopedN( "Wait for uniform ring" );
+
+		uniform_ring.region = ( uniform_ring.region + 1 ) % UNIFORM_RING_REGIONS;
+		u64 * fence = &uniform_ring.fences[ uniform_ring.region ];
+		if( *fence != 0 ) {
+			GLsync sync = bit_cast< GLsync >( *fence );
+			glClientWaitSync( sync, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED );
+			glDeleteSync( sync );
+			*fence = 0;
+		}
+
+		uniform_ring.bytes_used = 0;
+		uniform_ring.bytes_deduplicated = 0;
+		uniform_ring.bytes_overflowed = 0;
+		uniform_ring.dedupe.clear();
 	}
 
 	if( frame_static.viewport_width != prev_viewport_width || frame_static.viewport_height != prev_viewport_height ) {
@@ -868,14 +969,97 @@ static void SetPipelineState( PipelineState pipeline, bool ccw_winding ) {
 	prev_pipeline = pipeline;
 }
 
-static bool SortDrawCall( const DrawCall & a, const DrawCall & b ) {
-	if( a.pipeline.pass != b.pipeline.pass )
-		return a.pipeline.pass < b.pipeline.pass;
-	if( !render_passes[ a.pipeline.pass ].sorted )
-		return false;
-	return a.pipeline.shader < b.pipeline.shader;
+static u64 DrawCallSortKey( const DrawCall & dc ) {
+	const PipelineState & pipeline = dc.pipeline;
+
+	u64 key = u64( pipeline.pass ) << 56;
+	if( !render_passes[ pipeline.pass ].sorted )
+		return key;
+
+	u64 shader = pipeline.shader == NULL ? 0 : pipeline.shader->program;
+	key |= ( shader & 0xffff ) << 40;
+	if( pipeline.blend_func != BlendFunc_Disabled )
+		return key;
+
+	u64 state = 0;
+	state |= u64( pipeline.depth_func ) << 0;
+	state |= u64( pipeline.cull_face ) << 2;
+	state |= u64( pipeline.write_depth ) << 4;
+	state |= u64( pipeline.clamp_depth ) << 5;
+	state |= u64( pipeline.view_weapon_depth_hack ) << 6;
+	state |= u64( pipeline.wireframe ) << 7;
+	key |= state << 32;
+
+	u32 textures[ ARRAY_COUNT( &PipelineState::textures ) + ARRAY_COUNT( &PipelineState::texture_arrays ) ];
+	size_t num_textures = 0;
+	for( size_t i = 0; i < pipeline.num_textures; i++ ) {
+		const Texture * texture = pipeline.textures[ i ].texture;
+		textures[ num_textures++ ] = texture == NULL ? 0 : texture->texture;
+	}
+	for( size_t i = 0; i < pipeline.num_texture_arrays; i++ ) {
+		textures[ num_textures++ ] = pipeline.texture_arrays[ i ].ta.texture;
+	}
+	key |= u64( Hash32( textures, num_textures * sizeof( textures[ 0 ] ) ) & 0xffff ) << 16;
+
+	key |= dc.mesh.vao & 0xffff;
+
+	return key;
+}
+
+// LSD radix sort, stable so equal keys stay in submission order
+static Span< DrawCallKey > RadixSortDrawCallKeys( Span< DrawCallKey > keys, Span< DrawCallKey > scratch ) {
+	TracyZoneScoped;
+
+	for( u32 shift = 0; shift < 64; shift += 8 ) {
+		u32 offsets[ 256 ] = { };
+		for( DrawCallKey k : keys ) {
+			offsets[ ( k.key >> shift ) & 0xff ]++;
+		}
+
+		// skip bytes that are the same for every key
+		if( keys.n == 0 || offsets[ ( keys[ 0 ].key >> shift ) & 0xff ] == keys.n )
+			continue;
+
+		u32 total = 0;
+		for( u32 & offset : offsets ) {
+			u32 count = offset;
+			offset = total;
+			total += count;
+		}
+
+		for( DrawCallKey k : keys ) {
+			scratch[ offsets[ ( k.key >> shift ) & 0xff ]++ ] = k;
+		}
+
+		Swap2( &keys, &scratch );
+	}
+
+	return keys;
 }
 
+#if TRACY_ENABLE
+// counts how often consecutive draws differ in shader/state/textures/VAO
+static u32 CountKeyChanges( Span< const DrawCallKey > keys ) {
+	constexpr u64 fields[] = {
+		U64( 0xffff ) << 40,
+		U64( 0xff ) << 32,
+		U64( 0xffff ) << 16,
+		U64( 0xffff ),
+	};
+
+	u32 changes = 0;
+	for( size_t i = 1; i < keys.n; i++ ) {
+		u64 a = keys[ i - 1 ].key;
+		u64 b = keys[ i ].key;
+		for( u64 field : fields ) {
+			changes += ( a & field ) != ( b & field ) ? 1 : 0;
+		}
+	}
+
+	return changes;
+}
+#endif
+
 static void SetupAttribute( GLuint vao, GLuint buffer, GLuint index, VertexFormat format, u32 stride = 0, u32 offset = 0 ) {
 	if( buffer == 0 )
 		return;
@@ -1043,7 +1227,7 @@ static void SubmitDrawCall( const DrawCall & dc ) {
 		glVertexAttribDivisor( VertexAttribute_ModelTransformRow2, 1 );
 
 		GLenum type = dc.mesh.indices_format == IndexFormat_U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
-		glDrawElementsInstanced( primitive, dc.num_vertices, type, 0, dc.num_instances );
+		glDrawElementsInstancedBaseInstance( primitive, dc.num_vertices, type, ( const void * ) uintptr_t( dc.index_offset ), dc.num_instances, dc.base_instance );
 	}
 	else if( dc.instance_type == InstanceType_ModelShadows ) {
 		SetupAttribute( dc.mesh.vao, dc.instance_data.buffer, VertexAttribute_ModelTransformRow0, VertexFormat_Floatx4, sizeof( GPUModelShadowsInstance ), offsetof( GPUModelShadowsInstance, transform[ 0 ] ) );
@@ -1055,7 +1239,7 @@ static void SubmitDrawCall( const DrawCall & dc ) {
 		glVertexAttribDivisor( VertexAttribute_ModelTransformRow2, 1 );
 
 		GLenum type = dc.mesh.indices_format == IndexFormat_U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
-		glDrawElementsInstanced( primitive, dc.num_vertices, type, 0, dc.num_instances );
+		glDrawElementsInstancedBaseInstance( primitive, dc.num_vertices, type, ( const void * ) uintptr_t( dc.index_offset ), dc.num_instances, dc.base_instance );
 	}
 	else if( dc.instance_type == InstanceType_ModelOutlines ) {
 		SetupAttribute( dc.mesh.vao, dc.instance_data.buffer, VertexAttribute_MaterialColor, VertexFormat_Floatx4, sizeof( GPUModelOutlinesInstance ), offsetof( GPUModelOutlinesInstance, color ) );
@@ -1073,7 +1257,7 @@ static void SubmitDrawCall( const DrawCall & dc ) {
 		glVertexAttribDivisor( VertexAttribute_ModelTransformRow2, 1 );
 
 		GLenum type = dc.mesh.indices_format == IndexFormat_U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
-		glDrawElementsInstanced( primitive, dc.num_vertices, type, 0, dc.num_instances );
+		glDrawElementsInstancedBaseInstance( primitive, dc.num_vertices, type, ( const void * ) uintptr_t( dc.index_offset ), dc.num_instances, dc.base_instance );
 	}
 	else if( dc.instance_type == InstanceType_ModelSilhouette ) {
 		SetupAttribute( dc.mesh.vao, dc.instance_data.buffer, VertexAttribute_MaterialColor, VertexFormat_Floatx4, sizeof( GPUModelSilhouetteInstance ), offsetof( GPUModelSilhouetteInstance, color ) );
@@ -1089,7 +1273,7 @@ static void SubmitDrawCall( const DrawCall & dc ) {
 		glVertexAttribDivisor( VertexAttribute_ModelTransformRow2, 1 );
 
 		GLenum type = dc.mesh.indices_format == IndexFormat_U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
-		glDrawElementsInstanced( primitive, dc.num_vertices, type, 0, dc.num_instances );
+		glDrawElementsInstancedBaseInstance( primitive, dc.num_vertices, type, ( const void * ) uintptr_t( dc.index_offset ), dc.num_instances, dc.base_instance );
 	}
 	else if( dc.mesh.indices.buffer != 0 ) {
 		GLenum type = dc.mesh.indices_format == IndexFormat_U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
@@ -1110,9 +1294,28 @@ void RenderBackendSubmitFrame() {
 	assert( render_passes.size() > 0 );
 	in_frame = false;
 
+	Span< DrawCallKey > sorted_keys;
 	{
 		TracyZoneScopedN( "Sort draw calls" );
-		std::stable_sort( draw_calls.begin(), draw_calls.end(), SortDrawCall );
+
+		draw_call_keys.resize( draw_calls.size() );
+		draw_call_keys_scratch.resize( draw_calls.size() );
+
+		for( size_t i = 0; i < draw_calls.size(); i++ ) {
+			draw_call_keys[ i ].key = DrawCallSortKey( draw_calls[ i ] );
+			draw_call_keys[ i ].index = checked_cast< u32 >( i );
+		}
+
+#if TRACY_ENABLE
+		u32 unsorted_changes = CountKeyChanges( draw_call_keys.span() );
+#endif
+
+		sorted_keys = RadixSortDrawCallKeys( draw_call_keys.span(), draw_call_keys_scratch.span() );
+
+#if TRACY_ENABLE
+		u32 sorted_changes = CountKeyChanges( sorted_keys );
+		TracyCPlot( "State changes avoided by sorting", s64( unsorted_changes ) - s64( sorted_changes ) );
+#endif
 	}
 
 	SetupRenderPass( render_passes[ 0 ] );
@@ -1120,7 +1323,8 @@ void RenderBackendSubmitFrame() {
 
 	{
 		TracyZoneScopedN( "Submit draw calls" );
-		for( const DrawCall & dc : draw_calls ) {
+		for( DrawCallKey k : sorted_keys ) {
+			const DrawCall & dc = draw_calls[ k.index ];
 			while( dc.pipeline.pass > pass_idx ) {
 				FinishRenderPass();
 				pass_idx++;
@@ -1162,11 +1366,12 @@ void RenderBackendSubmitFrame() {
 		deferred_buffer_deletes.clear();
 	}
 
-	u32 ubo_bytes_used = 0;
-	for( const UBO & ubo : ubos ) {
-		ubo_bytes_used += ubo.bytes_used;
-	}
-	TracyCPlot( "UBO utilisation", float( ubo_bytes_used ) / float( UNIFORM_BUFFER_SIZE * ARRAY_COUNT( ubos ) ) );
+	uniform_ring.fences[ uniform_ring.region ] = bit_cast< u64 >( glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 ) );
+
+	TracyCPlot( "UBO utilisation", float( uniform_ring.bytes_used ) / float( UNIFORM_RING_REGION_SIZE ) );
+	TracyCPlot( "UBO bytes deduplicated", s64( uniform_ring.bytes_deduplicated ) );
+	TracyCPlot( "UBO bytes overflowed", s64( uniform_ring.bytes_overflowed ) );
+	RecordNullGLMappedWrite( uniform_ring.bytes_used );
 
 	TracyCPlot( "Draw calls", s64( draw_calls.size() ) );
 	TracyCPlot( "Vertices", s64( num_vertices_this_frame ) );
@@ -1176,31 +1381,52 @@ void RenderBackendSubmitFrame() {
 
 UniformBlock UploadUniforms( const void * data, size_t size ) {
 	assert( in_frame );
+	assert( size <= UNIFORM_BLOCK_MAX_SIZE );
 
-	UBO * ubo = NULL;
-	u32 offset = 0;
+	UniformBlock block;
+	block.size = AlignPow2( checked_cast< u32 >( size ), u32( 16 ) );
 
-	for( size_t i = 0; i < ARRAY_COUNT( ubos ); i++ ) {
-		offset = AlignPow2( ubos[ i ].bytes_used, ubo_offset_alignment );
-		if( UNIFORM_BUFFER_SIZE - offset >= size ) {
-			ubo = &ubos[ i ];
-			break;
+	u64 hash = 0;
+	if( size <= UNIFORM_DEDUPE_MAX_SIZE ) {
+		hash = Hash64( data, size, Hash64( u64( size ) ) );
+
+		u64 offset;
+		if( uniform_ring.dedupe.get( hash, &offset ) ) {
+			block.ubo = uniform_ring.buffer;
+			block.offset = checked_cast< u32 >( offset );
+			uniform_ring.bytes_deduplicated += size;
+			return block;
 		}
 	}
 
-	if( ubo == NULL )
-		Fatal( "Ran out of UBO space" );
+	u32 offset = AlignPow2( uniform_ring.bytes_used, ubo_offset_alignment );
+	if( UNIFORM_RING_REGION_SIZE - offset < block.size ) {
+		GPUBuffer overflow = { DSACreateBuffer( true ) };
+		glNamedBufferStorage( overflow.buffer, block.size, NULL, GL_DYNAMIC_STORAGE_BIT );
+		glNamedBufferSubData( overflow.buffer, 0, size, data );
+		DeferDeleteGPUBuffer( overflow );
 
-	UniformBlock block;
-	block.ubo = GetStreamingBufferBuffer( ubo->stream ).buffer;
-	block.offset = offset;
-	block.size = AlignPow2( checked_cast< u32 >( size ), u32( 16 ) );
+		uniform_ring.bytes_overflowed += size;
+
+		block.ubo = overflow.buffer;
+		block.offset = 0;
+		return block;
+	}
+
+	u32 region_offset = uniform_ring.region * UNIFORM_RING_REGION_SIZE;
 
 	// memset so we don't leave any gaps. good for write combined memory!
-	u8 * mapping = GetStreamingBufferMapping( ubo->stream );
-	memset( mapping + ubo->bytes_used, 0, offset - ubo->bytes_used );
+	u8 * mapping = uniform_ring.mapping + region_offset;
+	memset( mapping + uniform_ring.bytes_used, 0, offset - uniform_ring.bytes_used );
 	memcpy( mapping + offset, data, size );
-	ubo->bytes_used = offset + size;
+	uniform_ring.bytes_used = offset + size;
+
+	block.ubo = uniform_ring.buffer;
+	block.offset = region_offset + offset;
+
+	if( hash != 0 ) {
+		uniform_ring.dedupe.add( hash, block.offset );
+	}
 
 	return block;
 }
@@ -1491,6 +1717,20 @@ void DeleteTextureArray( TextureArray ta ) {
 	glDeleteTextures( 1, &ta.texture );
 }
 
+void WriteTextureArrayRegion( TextureArray ta, TextureFormat format, u32 mipmap, u32 layer, u32 x, u32 y, u32 w, u32 h, const void * data ) {
+	GLenum internal_format, channels, type;
+	TextureFormatToGL( format, &internal_format, &channels, &type );
+
+	if( CompressedTextureFormat( format ) ) {
+		assert( x % 4 == 0 && y % 4 == 0 && w % 4 == 0 && h % 4 == 0 );
+		u32 size = ( BitsPerPixel( format ) * w * h ) / 8;
+		glCompressedTextureSubImage3DEXT( ta.texture, GL_TEXTURE_2D_ARRAY, mipmap, x, y, layer, w, h, 1, internal_format, size, data );
+	}
+	else {
+		glTextureSubImage3DEXT( ta.texture, GL_TEXTURE_2D_ARRAY, mipmap, x, y, layer, w, h, 1, channels, type, data );
+	}
+}
+
 Framebuffer NewFramebuffer( const FramebufferConfig & config ) {
 	Framebuffer fb = { };
 
@@ -1615,11 +1855,12 @@ static constexpr const char * FRAGMENT_SHADER_PRELUDE =
 	"#define FRAGMENT_SHADER 1\n"
 	"#define v2f in\n";
 
-static GLuint CompileShader( GLenum type, Span< Span< const char > > srcs ) {
-	TempAllocator temp = cls.frame_arena.temp();
+static bool program_binaries_supported;
+static u64 driver_hash;
 
-	DynamicArray< const char * > src_ptrs( &temp );
-	DynamicArray< int > src_lens( &temp );
+static GLuint CompileShader( TempAllocator * temp, GLenum type, Span< Span< const char > > srcs ) {
+	DynamicArray< const char * > src_ptrs( temp );
+	DynamicArray< int > src_lens( temp );
 
 	src_ptrs.add( "#version 430 core\n" );
 	src_lens.add( -1 );
@@ -1660,22 +1901,7 @@ static GLuint CompileShader( GLenum type, Span< Span< const char > > srcs ) {
 	return shader;
 }
 
-static bool LinkShader( Shader * shader, GLuint program ) {
-	glLinkProgram( program );
-
-	GLint status;
-	glGetProgramiv( program, GL_LINK_STATUS, &status );
-	if( status == GL_FALSE ) {
-		// GLint len;
-		// glGetProgramiv( program, GL_INFO_LOG_LENGTH, &status );
-		// DynamicString buf( &temp, len )
-		char buf[ 1024 ];
-		glGetProgramInfoLog( program, sizeof( buf ), NULL, buf );
-		Com_Printf( S_COLOR_YELLOW "Shader linking failed: %s\n", buf );
-
-		return false;
-	}
-
+static bool ReflectShader( Shader * shader, GLuint program ) {
 	GLint count;
 	glGetProgramiv( program, GL_ACTIVE_UNIFORMS, &count );
 
@@ -1733,18 +1959,145 @@ static bool LinkShader( Shader * shader, GLuint program ) {
 	return true;
 }
 
-bool NewShader( Shader * shader, Span< Span< const char > > srcs, Span< const char * > feedback_varyings, bool particle_vertex_attribs ) {
+static bool LinkShader( Shader * shader, GLuint program ) {
+	if( program_binaries_supported ) {
+		glProgramParameteri( program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+	}
+
+	glLinkProgram( program );
+
+	GLint status;
+	glGetProgramiv( program, GL_LINK_STATUS, &status );
+	if( status == GL_FALSE ) {
+		// GLint len;
+		// glGetProgramiv( program, GL_INFO_LOG_LENGTH, &status );
+		// DynamicString buf( &temp, len )
+		char buf[ 1024 ];
+		glGetProgramInfoLog( program, sizeof( buf ), NULL, buf );
+		Com_Printf( S_COLOR_YELLOW "Shader linking failed: %s\n", buf );
+
+		return false;
+	}
+
+	return ReflectShader( shader, program );
+}
+
+/*
+ * linked programs get saved to the decode cache with glGetProgramBinary. the
+ * key covers everything that goes into the program and the driver, so
+ * editing a shader or updating drivers just misses. drivers can still reject
+ * binaries they wrote themselves, in which case we compile from source and
+ * overwrite the entry
+ */
+
+static constexpr u32 PROGRAM_BINARY_VERSION = 1;
+
+struct ProgramBinaryHeader {
+	u32 format;
+};
+
+void InitProgramBinaryCache() {
+	TracyZoneScoped;
+
+	GLint num_formats;
+	glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats );
+	program_binaries_supported = num_formats > 0;
+	if( !program_binaries_supported )
+		return;
+
+	const char * vendor = ( const char * ) glGetString( GL_VENDOR );
+	const char * renderer = ( const char * ) glGetString( GL_RENDERER );
+	const char * version = ( const char * ) glGetString( GL_VERSION );
+	driver_hash = Hash64( version, strlen( version ), Hash64( renderer, strlen( renderer ), Hash64( vendor ) ) );
+}
+
+static u64 ProgramBinaryKey( Span< Span< const char > > srcs, Span< const char * > feedback_varyings, bool particle_vertex_attribs ) {
+	u64 hash = Hash64( &particle_vertex_attribs, sizeof( particle_vertex_attribs ), driver_hash );
+	for( Span< const char > src : srcs ) {
+		hash = Hash64( src.ptr, src.n, hash );
+	}
+	for( const char * varying : feedback_varyings ) {
+		hash = Hash64( varying, strlen( varying ), hash );
+	}
+
+	return DecodeCacheKey( "glprogram", PROGRAM_BINARY_VERSION, Span< const u8 >( ( const u8 * ) &hash, sizeof( hash ) ) );
+}
+
+static bool LoadProgramBinary( TempAllocator * temp, Shader * shader, u64 key ) {
+	TracyZoneScoped;
+
+	if( !program_binaries_supported )
+		return false;
+
+	Span< u8 > blob;
+	if( !LoadFromDecodeCache( temp, sys_allocator, key, &blob ) )
+		return false;
+	defer { FREE( sys_allocator, blob.ptr ); };
+
+	if( blob.n <= sizeof( ProgramBinaryHeader ) )
+		return false;
+
+	ProgramBinaryHeader header;
+	memcpy( &header, blob.ptr, sizeof( header ) );
+	Span< const u8 > binary = blob + sizeof( header );
+
+	shader->program = glCreateProgram();
+	glProgramBinary( shader->program, header.format, binary.ptr, checked_cast< GLsizei >( binary.n ) );
+
+	GLint status;
+	glGetProgramiv( shader->program, GL_LINK_STATUS, &status );
+	if( status == GL_FALSE ) {
+		glDeleteProgram( shader->program );
+		shader->program = 0;
+		return false;
+	}
+
+	return ReflectShader( shader, shader->program );
+}
+
+static void SaveProgramBinary( TempAllocator * temp, GLuint program, u64 key ) {
+	TracyZoneScoped;
+
+	if( !program_binaries_supported )
+		return;
+
+	GLint len;
+	glGetProgramiv( program, GL_PROGRAM_BINARY_LENGTH, &len );
+	if( len <= 0 )
+		return;
+
+	Span< u8 > blob = ALLOC_SPAN( sys_allocator, u8, sizeof( ProgramBinaryHeader ) + len );
+	defer { FREE( sys_allocator, blob.ptr ); };
+
+	GLenum format;
+	GLsizei written;
+	glGetProgramBinary( program, len, &written, &format, blob.ptr + sizeof( ProgramBinaryHeader ) );
+	if( written != len )
+		return;
+
+	ProgramBinaryHeader header;
+	header.format = format;
+	memcpy( blob.ptr, &header, sizeof( header ) );
+
+	SaveToDecodeCache( temp, key, blob );
+}
+
+bool NewShader( TempAllocator * temp, Shader * shader, Span< Span< const char > > srcs, Span< const char * > feedback_varyings, bool particle_vertex_attribs ) {
 	*shader = { };
 	bool feedback = feedback_varyings.n > 0;
 
-	GLuint vs = CompileShader( GL_VERTEX_SHADER, srcs );
+	u64 key = ProgramBinaryKey( srcs, feedback_varyings, particle_vertex_attribs );
+	if( LoadProgramBinary( temp, shader, key ) )
+		return true;
+
+	GLuint vs = CompileShader( temp, GL_VERTEX_SHADER, srcs );
 	if( vs == 0 )
 		return false;
 	defer { glDeleteShader( vs ); };
 
 	GLuint fs = 0;
 	if( !feedback ) {
-		fs = CompileShader( GL_FRAGMENT_SHADER, srcs );
+		fs = CompileShader( temp, GL_FRAGMENT_SHADER, srcs );
 		if( fs == 0 )
 			return false;
 	}
@@ -1798,13 +2151,21 @@ bool NewShader( Shader * shader, Span< Span< const char > > srcs, Span< const ch
 		glTransformFeedbackVaryings( shader->program, feedback_varyings.n, feedback_varyings.begin(), GL_INTERLEAVED_ATTRIBS );
 	}
 
-	return LinkShader( shader, shader->program );
+	if( !LinkShader( shader, shader->program ) )
+		return false;
+
+	SaveProgramBinary( temp, shader->program, key );
+	return true;
 }
 
-bool NewComputeShader( Shader * shader, Span< Span< const char > > srcs ) {
+bool NewComputeShader( TempAllocator * temp, Shader * shader, Span< Span< const char > > srcs ) {
 	*shader = { };
 
-	GLuint cs = CompileShader( GL_COMPUTE_SHADER, srcs );
+	u64 key = ProgramBinaryKey( srcs, Span< const char * >(), false );
+	if( LoadProgramBinary( temp, shader, key ) )
+		return true;
+
+	GLuint cs = CompileShader( temp, GL_COMPUTE_SHADER, srcs );
 	if( cs == 0 )
 		return false;
 	defer { glDeleteShader( cs ); };
@@ -1812,7 +2173,11 @@ bool NewComputeShader( Shader * shader, Span< Span< const char > > srcs ) {
 	shader->program = glCreateProgram();
 	glAttachShader( shader->program, cs );
 
-	return LinkShader( shader, shader->program );
+	if( !LinkShader( shader, shader->program ) )
+		return false;
+
+	SaveProgramBinary( temp, shader->program, key );
+	return true;
 }
 
 void DeleteShader( Shader shader ) {
@@ -1924,7 +2289,7 @@ void DrawMesh( const Mesh & mesh, const PipelineState & pipeline, u32 num_vertic
 	num_vertices_this_frame += dc.num_vertices;
 }
 
-void DrawInstancedMesh( const Mesh & mesh, const PipelineState & pipeline, GPUBuffer instance_data, u32 num_instances, InstanceType instance_type, u32 num_vertices_override, u32 index_offset ) {
+void DrawInstancedMesh( const Mesh & mesh, const PipelineState & pipeline, GPUBuffer instance_data, u32 num_instances, InstanceType instance_type, u32 num_vertices_override, u32 index_offset, u32 base_instance ) {
 	assert( in_frame );
 	assert( pipeline.pass != U8_MAX );
 	assert( pipeline.shader != NULL );
@@ -1937,6 +2302,7 @@ void DrawInstancedMesh( const Mesh & mesh, const PipelineState & pipeline, GPUBu
 	dc.instance_type = instance_type;
 	dc.instance_data = instance_data;
 	dc.num_instances = num_instances;
+	dc.base_instance = base_instance;
 	draw_calls.add( dc );
 
 	num_vertices_this_frame += dc.num_vertices * num_instances;
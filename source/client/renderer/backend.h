@@ -73,14 +73,21 @@ enum VertexFormat : u8 {
 	VertexFormat_U16x4,
 	VertexFormat_U16x4_Norm,
 
+	VertexFormat_S8x4_Norm,
+
 	VertexFormat_U32x1,
 
+	VertexFormat_Halfx4,
+
 	VertexFormat_Floatx1,
 	VertexFormat_Floatx2,
 	VertexFormat_Floatx3,
 	VertexFormat_Floatx4,
 };
 
+// bytes per vertex, or 0 for values that aren't a VertexFormat
+u32 VertexFormatSize( VertexFormat format );
+
 struct Texture {
 	u32 texture;
 	u32 width, height;
@@ -364,14 +371,20 @@ void DeleteTexture( Texture texture );
 
 TextureArray NewTextureArray( const TextureArrayConfig & config );
 void DeleteTextureArray( TextureArray ta );
+// compressed formats need block aligned regions and tightly packed blocks
+void WriteTextureArrayRegion( TextureArray ta, TextureFormat format, u32 mipmap, u32 layer, u32 x, u32 y, u32 w, u32 h, const void * data );
 
 Framebuffer NewFramebuffer( const FramebufferConfig & config );
 Framebuffer NewFramebuffer( Texture * albedo_texture, Texture * normal_texture, Texture * depth_texture );
 Framebuffer NewShadowFramebuffer( TextureArray texture_array, u32 layer );
 void DeleteFramebuffer( Framebuffer fb );
 
-bool NewShader( Shader * shader, Span< Span< const char > > srcs, Span< const char * > feedback_varyings = Span< const char * >(), bool particle_vertex_attribs = false );
-bool NewComputeShader( Shader * shader, Span< Span< const char > > srcs );
+// needs a current context. shaders still work if this never gets called,
+// they just don't go in the program binary cache
+void InitProgramBinaryCache();
+
+bool NewShader( TempAllocator * temp, Shader * shader, Span< Span< const char > > srcs, Span< const char * > feedback_varyings = Span< const char * >(), bool particle_vertex_attribs = false );
+bool NewComputeShader( TempAllocator * temp, Shader * shader, Span< Span< const char > > srcs );
 void DeleteShader( Shader shader );
 
 Mesh NewMesh( MeshConfig config );
@@ -379,7 +392,7 @@ void DeleteMesh( const Mesh & mesh );
 void DeferDeleteMesh( const Mesh & mesh );
 
 void DrawMesh( const Mesh & mesh, const PipelineState & pipeline, u32 num_vertices_override = 0, u32 first_index = 0 );
-void DrawInstancedMesh( const Mesh & mesh, const PipelineState & pipeline, GPUBuffer instance_data, u32 num_instances, InstanceType instance_type, u32 num_vertices_override = 0, u32 first_index = 0 );
+void DrawInstancedMesh( const Mesh & mesh, const PipelineState & pipeline, GPUBuffer instance_data, u32 num_instances, InstanceType instance_type, u32 num_vertices_override = 0, u32 first_index = 0, u32 base_instance = 0 );
 void UpdateParticles( const Mesh & mesh, GPUBuffer vb_in, GPUBuffer vb_out, float radius, u32 num_particles, float dt );
 void UpdateParticlesFeedback( const Mesh & mesh, GPUBuffer vb_in, GPUBuffer vb_out, GPUBuffer vb_feedback, float radius, u32 num_particles, float dt );
 void DrawInstancedParticles( const Mesh & mesh, GPUBuffer vb, BlendFunc blend_func, u32 num_particles );
@@ -0,0 +1,283 @@
+#include <emmintrin.h>
+
+#include "qcommon/base.h"
+#include "client/renderer/bc4.h"
+
+/*
+ * endpoints are the block's min and max, which is a lot better than the
+ * fixed 0/255 we used to use and close enough to a proper fit for decals and
+ * single channel masks. each pixel gets the nearest of the 8 interpolated
+ * values, found by counting how many of the 7 midpoints it's above
+ */
+static BC4Block EncodeBC4Block( __m128i pixels ) {
+	__m128i lo = _mm_min_epu8( pixels, _mm_srli_si128( pixels, 8 ) );
+	__m128i hi = _mm_max_epu8( pixels, _mm_srli_si128( pixels, 8 ) );
+	lo = _mm_min_epu8( lo, _mm_srli_si128( lo, 4 ) );
+	hi = _mm_max_epu8( hi, _mm_srli_si128( hi, 4 ) );
+	lo = _mm_min_epu8( lo, _mm_srli_si128( lo, 2 ) );
+	hi = _mm_max_epu8( hi, _mm_srli_si128( hi, 2 ) );
+	lo = _mm_min_epu8( lo, _mm_srli_si128( lo, 1 ) );
+	hi = _mm_max_epu8( hi, _mm_srli_si128( hi, 1 ) );
+
+	u8 min = u8( _mm_cvtsi128_si32( lo ) );
+	u8 max = u8( _mm_cvtsi128_si32( hi ) );
+
+	BC4Block result;
+	result.data[ 0 ] = max;
+	result.data[ 1 ] = min;
+
+	if( min == max ) {
+		memset( &result.data[ 2 ], 0, 6 );
+		return result;
+	}
+
+	// work in 16 bits with everything scaled by 14 so the midpoints are integers
+	__m128i zero = _mm_setzero_si128();
+	__m128i scaled_min = _mm_set1_epi16( min * 14 );
+	__m128i fourteen = _mm_set1_epi16( 14 );
+	__m128i p0 = _mm_sub_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( pixels, zero ), fourteen ), scaled_min );
+	__m128i p1 = _mm_sub_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( pixels, zero ), fourteen ), scaled_min );
+
+	s16 range = max - min;
+	__m128i t0 = zero;
+	__m128i t1 = zero;
+	for( s16 i = 0; i < 7; i++ ) {
+		__m128i midpoint = _mm_set1_epi16( ( 2 * i + 1 ) * range );
+		t0 = _mm_sub_epi16( t0, _mm_cmpgt_epi16( p0, midpoint ) );
+		t1 = _mm_sub_epi16( t1, _mm_cmpgt_epi16( p1, midpoint ) );
+	}
+
+	// t goes 0 = min to 7 = max, but the selectors go max, min, then the
+	// interpolated values from max to min, i.e. 1 7 6 5 4 3 2 0
+	__m128i seven = _mm_set1_epi16( 7 );
+	__m128i one = _mm_set1_epi16( 1 );
+	__m128i two = _mm_set1_epi16( 2 );
+	__m128i s0 = _mm_and_si128( _mm_sub_epi16( _mm_set1_epi16( 8 ), t0 ), seven );
+	__m128i s1 = _mm_and_si128( _mm_sub_epi16( _mm_set1_epi16( 8 ), t1 ), seven );
+	s0 = _mm_xor_si128( s0, _mm_and_si128( _mm_cmplt_epi16( s0, two ), one ) );
+	s1 = _mm_xor_si128( s1, _mm_and_si128( _mm_cmplt_epi16( s1, two ), one ) );
+
+	alignas( 16 ) u8 selectors[ 16 ];
+	_mm_store_si128( ( __m128i * ) selectors, _mm_packus_epi16( s0, s1 ) );
+
+	u64 packed = 0;
+	for( u32 i = 0; i < 16; i++ ) {
+		packed |= u64( selectors[ i ] ) << ( i * 3 );
+	}
+
+	memcpy( &result.data[ 2 ], &packed, 6 );
+
+	return result;
+}
+
+BC4Block EncodeBC4Block( Span2D< const u8 > pixels ) {
+	assert( pixels.w == 4 && pixels.h == 4 );
+
+	u32 rows[ 4 ];
+	for( u32 i = 0; i < 4; i++ ) {
+		memcpy( &rows[ i ], pixels.row( i ).ptr, sizeof( rows[ i ] ) );
+	}
+
+	return EncodeBC4Block( _mm_setr_epi32( rows[ 0 ], rows[ 1 ], rows[ 2 ], rows[ 3 ] ) );
+}
+
+BC4Block EncodeBC4Block( Span2D< const RGBA8 > pixels, u32 channel ) {
+	assert( pixels.w == 4 && pixels.h == 4 );
+	assert( channel < 4 );
+
+	__m128i shift = _mm_cvtsi32_si128( channel * 8 );
+	__m128i mask = _mm_set1_epi32( 0xff );
+
+	__m128i rows[ 4 ];
+	for( u32 i = 0; i < 4; i++ ) {
+		__m128i row = _mm_loadu_si128( ( const __m128i * ) pixels.row( i ).ptr );
+		rows[ i ] = _mm_and_si128( _mm_srl_epi32( row, shift ), mask );
+	}
+
+	__m128i top = _mm_packs_epi32( rows[ 0 ], rows[ 1 ] );
+	__m128i bottom = _mm_packs_epi32( rows[ 2 ], rows[ 3 ] );
+
+	return EncodeBC4Block( _mm_packus_epi16( top, bottom ) );
+}
+
+/*
+ * the high quality encoder brute forces endpoints near the block's min and
+ * max in both BC4 modes and keeps whichever has the least squared error. the
+ * 6 value mode also has exact 0 and 255, so blocks with a few fully on/off
+ * pixels can spend all their interpolated values on the rest
+ */
+static constexpr s32 BC4_HQ_SEARCH_RADIUS = 8;
+
+static void BC4Palette( u8 * palette, u8 e0, u8 e1 ) {
+	palette[ 0 ] = e0;
+	palette[ 1 ] = e1;
+
+	if( e0 > e1 ) {
+		for( u32 i = 2; i < 8; i++ ) {
+			palette[ i ] = u8( ( ( 8 - i ) * e0 + ( i - 1 ) * e1 + 3 ) / 7 );
+		}
+	}
+	else {
+		for( u32 i = 2; i < 6; i++ ) {
+			palette[ i ] = u8( ( ( 6 - i ) * e0 + ( i - 1 ) * e1 + 2 ) / 5 );
+		}
+		palette[ 6 ] = 0;
+		palette[ 7 ] = 255;
+	}
+}
+
+static u32 FitBC4Block( const u8 * pixels, u8 e0, u8 e1, u64 * selectors ) {
+	u8 palette[ 8 ];
+	BC4Palette( palette, e0, e1 );
+
+	u32 total_error = 0;
+	*selectors = 0;
+	for( u32 i = 0; i < 16; i++ ) {
+		u32 best_error = U32_MAX;
+		u64 best = 0;
+		for( u32 j = 0; j < 8; j++ ) {
+			s32 d = s32( pixels[ i ] ) - s32( palette[ j ] );
+			u32 error = u32( d * d );
+			if( error < best_error ) {
+				best_error = error;
+				best = j;
+			}
+		}
+
+		total_error += best_error;
+		*selectors |= best << ( i * 3 );
+	}
+
+	return total_error;
+}
+
+BC4Block EncodeBC4BlockHQ( Span2D< const u8 > pixels ) {
+	assert( pixels.w == 4 && pixels.h == 4 );
+
+	u8 block[ 16 ];
+	CopySpan2D( Span2D< u8 >( block, 4, 4 ), pixels );
+
+	u8 min = 255, max = 0;
+	// ignoring 0 and 255 because the 6 value mode gets those for free
+	u8 min6 = 255, max6 = 0;
+	for( u8 p : block ) {
+		min = Min2( min, p );
+		max = Max2( max, p );
+		if( p != 0 && p != 255 ) {
+			min6 = Min2( min6, p );
+			max6 = Max2( max6, p );
+		}
+	}
+
+	if( min == max )
+		return EncodeBC4Block( pixels );
+
+	u32 best_error = U32_MAX;
+	u8 best_e0 = 0, best_e1 = 0;
+	u64 best_selectors = 0;
+
+	auto try_endpoints = [&]( u8 e0, u8 e1 ) {
+		u64 selectors;
+		u32 error = FitBC4Block( block, e0, e1, &selectors );
+		if( error < best_error ) {
+			best_error = error;
+			best_e0 = e0;
+			best_e1 = e1;
+			best_selectors = selectors;
+		}
+	};
+
+	for( s32 lo = min; lo <= Min2( min + BC4_HQ_SEARCH_RADIUS, max - 1 ); lo++ ) {
+		for( s32 hi = Max2( max - BC4_HQ_SEARCH_RADIUS, lo + 1 ); hi <= max; hi++ ) {
+			try_endpoints( u8( hi ), u8( lo ) );
+		}
+	}
+
+	if( min6 <= max6 ) {
+		for( s32 lo = min6; lo <= Min2( min6 + BC4_HQ_SEARCH_RADIUS, s32( max6 ) ); lo++ ) {
+			for( s32 hi = Max2( max6 - BC4_HQ_SEARCH_RADIUS, lo ); hi <= max6; hi++ ) {
+				try_endpoints( u8( lo ), u8( hi ) );
+			}
+		}
+	}
+
+	BC4Block result;
+	result.data[ 0 ] = best_e0;
+	result.data[ 1 ] = best_e1;
+	memcpy( &result.data[ 2 ], &best_selectors, 6 );
+
+	return result;
+}
+
+BC5Block EncodeBC5Block( Span2D< const RGBA8 > pixels ) {
+	BC5Block result;
+	result.x = EncodeBC4Block( pixels, 0 );
+	result.y = EncodeBC4Block( pixels, 1 );
+	return result;
+}
+
+void EncodeBC4Rows( Span2D< BC4Block > bc4, Span2D< const u8 > pixels, u32 first_row, u32 num_rows ) {
+	assert( first_row + num_rows <= bc4.h );
+
+	for( u32 row = first_row; row < first_row + num_rows; row++ ) {
+		for( u32 col = 0; col < bc4.w; col++ ) {
+			bc4( col, row ) = EncodeBC4Block( pixels.slice( col * 4, row * 4, 4, 4 ) );
+		}
+	}
+}
+
+void EncodeBC4RowsHQ( Span2D< BC4Block > bc4, Span2D< const u8 > pixels, u32 first_row, u32 num_rows ) {
+	assert( first_row + num_rows <= bc4.h );
+
+	for( u32 row = first_row; row < first_row + num_rows; row++ ) {
+		for( u32 col = 0; col < bc4.w; col++ ) {
+			bc4( col, row ) = EncodeBC4BlockHQ( pixels.slice( col * 4, row * 4, 4, 4 ) );
+		}
+	}
+}
+
+void EncodeBC4Rows( Span2D< BC4Block > bc4, Span2D< const RGBA8 > pixels, u32 channel, u32 first_row, u32 num_rows ) {
+	assert( first_row + num_rows <= bc4.h );
+
+	for( u32 row = first_row; row < first_row + num_rows; row++ ) {
+		for( u32 col = 0; col < bc4.w; col++ ) {
+			bc4( col, row ) = EncodeBC4Block( pixels.slice( col * 4, row * 4, 4, 4 ), channel );
+		}
+	}
+}
+
+void EncodeBC5Rows( Span2D< BC5Block > bc5, Span2D< const RGBA8 > pixels, u32 first_row, u32 num_rows ) {
+	assert( first_row + num_rows <= bc5.h );
+
+	for( u32 row = first_row; row < first_row + num_rows; row++ ) {
+		for( u32 col = 0; col < bc5.w; col++ ) {
+			bc5( col, row ) = EncodeBC5Block( pixels.slice( col * 4, row * 4, 4, 4 ) );
+		}
+	}
+}
+
+u32 BC4EncodeJobsNeeded( Span2D< const RGBA8 > pixels ) {
+	u32 block_rows = pixels.h / 4;
+	return ( block_rows + BC4_ROWS_PER_JOB - 1 ) / BC4_ROWS_PER_JOB;
+}
+
+u32 SplitBC4Encode( BC4EncodeJob * jobs, Span2D< BC4Block > bc4, Span2D< const RGBA8 > pixels, u32 channel ) {
+	assert( bc4.w == pixels.w / 4 && bc4.h == pixels.h / 4 );
+
+	u32 num_jobs = 0;
+	for( u32 row = 0; row < bc4.h; row += BC4_ROWS_PER_JOB ) {
+		BC4EncodeJob * job = &jobs[ num_jobs ];
+		job->bc4 = bc4;
+		job->pixels = pixels;
+		job->channel = channel;
+		job->first_row = row;
+		job->num_rows = Min2( BC4_ROWS_PER_JOB, u32( bc4.h ) - row );
+		num_jobs++;
+	}
+
+	return num_jobs;
+}
+
+void RunBC4EncodeJob( const BC4EncodeJob * job ) {
+	EncodeBC4Rows( job->bc4, job->pixels, job->channel, job->first_row, job->num_rows );
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "qcommon/types.h"
+#include "qcommon/span2d.h"
+#include "client/renderer/dds.h"
+
+/*
+ * shared by the renderer and tools/bc4, so this can't depend on anything
+ * client side. the renderer uses the fast encoder at load time and tools/bc4
+ * uses the much slower HQ encoder offline. encoding is split into rows of
+ * blocks so callers can spread big images across however many threads they
+ * have
+ */
+
+// bump this when the output changes so cached encodes get thrown away
+constexpr u32 BC4_ENCODER_VERSION = 2;
+constexpr u32 BC4_HQ_ENCODER_VERSION = 1;
+
+constexpr u32 BC4_ROWS_PER_JOB = 16;
+
+BC4Block EncodeBC4Block( Span2D< const u8 > pixels );
+BC4Block EncodeBC4Block( Span2D< const RGBA8 > pixels, u32 channel );
+BC4Block EncodeBC4BlockHQ( Span2D< const u8 > pixels );
+BC5Block EncodeBC5Block( Span2D< const RGBA8 > pixels );
+
+// first_row and num_rows count rows of blocks, not pixels
+void EncodeBC4Rows( Span2D< BC4Block > bc4, Span2D< const u8 > pixels, u32 first_row, u32 num_rows );
+void EncodeBC4RowsHQ( Span2D< BC4Block > bc4, Span2D< const u8 > pixels, u32 first_row, u32 num_rows );
+void EncodeBC4Rows( Span2D< BC4Block > bc4, Span2D< const RGBA8 > pixels, u32 channel, u32 first_row, u32 num_rows );
+void EncodeBC5Rows( Span2D< BC5Block > bc5, Span2D< const RGBA8 > pixels, u32 first_row, u32 num_rows );
+
+struct BC4EncodeJob {
+	Span2D< BC4Block > bc4;
+	Span2D< const RGBA8 > pixels;
+	u32 channel;
+	u32 first_row;
+	u32 num_rows;
+};
+
+// fills jobs with BC4_ROWS_PER_JOB row slices of the image and returns how
+// many it used, jobs needs room for BC4EncodeJobsNeeded elements
+u32 BC4EncodeJobsNeeded( Span2D< const RGBA8 > pixels );
+u32 SplitBC4Encode( BC4EncodeJob * jobs, Span2D< BC4Block > bc4, Span2D< const RGBA8 > pixels, u32 channel );
+void RunBC4EncodeJob( const BC4EncodeJob * job );
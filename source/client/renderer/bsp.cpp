@@ -6,6 +6,7 @@
 #include "qcommon/span2d.h"
 #include "client/client.h"
 #include "client/assets.h"
+#include "client/decode_cache.h"
 #include "client/renderer/renderer.h"
 #include "client/maps.h"
 
@@ -256,11 +257,13 @@ static float ParseFogStrength( const BSPSpans * bsp ) {
 
 struct BSPDrawCall {
 	u32 base_vertex;
-	u32 index_offset;
 	u32 num_vertices;
-	const Material * material;
+	u32 index_offset;
+	u32 num_indices;
+	u32 material;
 
 	bool patch;
+	u32 face;
 	u32 patch_width;
 	u32 patch_height;
 };
@@ -334,150 +337,242 @@ static int Order2BezierSubdivisions( Vec3 control0, Vec3 control1, Vec3 control2
 	return Order2BezierSubdivisions( control0, control1, control2, max_error, control0, control2, 0.0f, 1.0f );
 }
 
-static Model LoadBSPModel( const char * filename, DynamicArray< BSPModelVertex > & vertices, const BSPSpans & bsp, size_t model_idx ) {
-	TracyZoneScoped;
+struct BSPPatchTessellation {
+	u32 first_vertex;
+	s32 tess_x;
+	s32 tess_y;
+};
 
-	const BSPModel & bsp_model = bsp.models[ model_idx ];
-	if( bsp_model.num_faces == 0 )
-		return { };
+// tessellated vertices for every patch face, laid out patch by patch
+struct BSPPatches {
+	Span< const BSPPatchTessellation > faces;
+	Span< const BSPModelVertex > vertices;
+};
 
-	DynamicArray< BSPDrawCall > draw_calls( sys_allocator );
+static bool GetPatchFace( const BSPSpans & bsp, u32 face_idx, u32 * base_vertex, u32 * patch_width, u32 * patch_height ) {
 	if( bsp.idbsp ) {
-		for( u32 i = 0; i < bsp_model.num_faces; i++ ) {
-			const BSPFace * face = &bsp.faces[ i + bsp_model.first_face ];
-			BSPDrawCall dc;
-
-			dc.base_vertex = face->first_vertex;
-			dc.index_offset = face->first_index;
-			dc.num_vertices = face->num_indices;
-			if( bsp.materials[ face->material ].flags & CONTENTS_WALLBANGABLE ) {
-				dc.material = FindMaterial( bsp.materials[ face->material ].name, &wallbang_material );
-			}
-			else {
-				dc.material = FindMaterial( bsp.materials[ face->material ].name, &world_material );
-			}
+		const BSPFace * face = &bsp.faces[ face_idx ];
+		*base_vertex = face->first_vertex;
+		*patch_width = face->patch_width;
+		*patch_height = face->patch_height;
+		return face->type == FaceType_Patch;
+	}
 
-			dc.patch = face->type == FaceType_Patch;
-			dc.patch_width = face->patch_width;
-			dc.patch_height = face->patch_height;
+	const RavenBSPFace * face = &bsp.raven_faces[ face_idx ];
+	*base_vertex = face->first_vertex;
+	*patch_width = face->patch_width;
+	*patch_height = face->patch_height;
+	return face->type == FaceType_Patch;
+}
 
-			draw_calls.add( dc );
+static void TessellatePatch( Span< const BSPModelVertex > vertices, u32 base_vertex, u32 patch_width, u32 patch_height, BSPPatchTessellation * tessellation, DynamicArray< BSPModelVertex > * tessellated ) {
+	TracyZoneScopedN( "Generate patch" );
+
+	u32 num_patches_x = ( patch_width - 1 ) / 2;
+	u32 num_patches_y = ( patch_height - 1 ) / 2;
+
+	// find best tessellation for rows and columns
+	// minimum of 2 seems reasonable
+	float max_error = 1.0f;
+	s32 tess_x = 2;
+	s32 tess_y = 2;
+
+	for( u32 patch_y = 0; patch_y < num_patches_y; patch_y++ ) {
+		for( u32 patch_x = 0; patch_x < num_patches_x; patch_x++ ) {
+			u32 control_base = ( patch_y * 2 * patch_width + patch_x * 2 ) + base_vertex;
+			Span2D< const BSPModelVertex > control( &vertices[ control_base ], 3, 3, patch_width );
+			for( int j = 0; j < 3; j++ ) {
+				tess_x = Max2( tess_x, Order2BezierSubdivisions( control( 0, j ).position, control( 1, j ).position, control( 2, j ).position, max_error ) );
+				tess_y = Max2( tess_y, Order2BezierSubdivisions( control( j, 0 ).position, control( j, 1 ).position, control( j, 2 ).position, max_error ) );
+			}
 		}
 	}
-	else {
-		for( u32 i = 0; i < bsp_model.num_faces; i++ ) {
-			const RavenBSPFace * face = &bsp.raven_faces[ i + bsp_model.first_face ];
-			BSPDrawCall dc;
-
-			dc.base_vertex = face->first_vertex;
-			dc.index_offset = face->first_index;
-			dc.num_vertices = face->num_indices;
-			if( bsp.materials[ face->material ].flags & CONTENTS_WALLBANGABLE ) {
-				dc.material = FindMaterial( bsp.materials[ face->material ].name, &wallbang_material );
-			}
-			else {
-				dc.material = FindMaterial( bsp.materials[ face->material ].name, &world_material );
+
+	tessellation->first_vertex = tessellated->size();
+	tessellation->tess_x = tess_x;
+	tessellation->tess_y = tess_y;
+
+	for( u32 patch_y = 0; patch_y < num_patches_y; patch_y++ ) {
+		for( u32 patch_x = 0; patch_x < num_patches_x; patch_x++ ) {
+			u32 control_base = ( patch_y * 2 * patch_width + patch_x * 2 ) + base_vertex;
+			Span2D< const BSPModelVertex > control( &vertices[ control_base ], 3, 3, patch_width );
+
+			for( int y = 0; y <= tess_y; y++ ) {
+				for( int x = 0; x <= tess_x; x++ ) {
+					float tx = float( x ) / tess_x;
+					float ty = float( y ) / tess_y;
+					tessellated->add( Order2Bezier2D( tx, ty, control ) );
+				}
 			}
+		}
+	}
+}
 
-			dc.patch = face->type == FaceType_Patch;
-			dc.patch_width = face->patch_width;
-			dc.patch_height = face->patch_height;
+static void TessellatePatches( const BSPSpans & bsp, Span< const BSPModelVertex > vertices, DynamicArray< BSPPatchTessellation > * faces, DynamicArray< BSPModelVertex > * tessellated ) {
+	TracyZoneScoped;
+
+	u32 num_faces = bsp.idbsp ? bsp.faces.n : bsp.raven_faces.n;
+	for( u32 i = 0; i < num_faces; i++ ) {
+		BSPPatchTessellation * tessellation = faces->add();
+		*tessellation = { };
 
-			draw_calls.add( dc );
+		u32 base_vertex, patch_width, patch_height;
+		if( GetPatchFace( bsp, i, &base_vertex, &patch_width, &patch_height ) ) {
+			TessellatePatch( vertices, base_vertex, patch_width, patch_height, tessellation, tessellated );
 		}
 	}
+}
+
+/*
+ * render geometry gets run through meshoptimizer once and the result goes in
+ * the decode cache, so loading a map we've seen before skips tessellation and
+ * optimisation entirely. the cached blob looks like
+ *
+ * BSPGeometryHeader
+ * for each model:
+ *     BSPGeometryModelHeader
+ *     BSPGeometryPrimitive[ num_primitives ]
+ *     meshopt encoded vertices
+ *     meshopt encoded indices
+ */
+
+static constexpr u32 BSP_GEOMETRY_VERSION = 1;
+
+struct BSPGeometryHeader {
+	u32 num_models;
+};
+
+struct BSPGeometryModelHeader {
+	u32 num_primitives;
+	u32 num_vertices;
+	u32 num_indices;
+	u32 encoded_vertices_size;
+	u32 encoded_indices_size;
+};
+
+struct BSPGeometryPrimitive {
+	u32 material; // index into the materials lump
+	u32 first_index;
+	u32 num_indices;
+};
+
+struct BSPGeometryStats {
+	u64 vertices;
+	u64 triangles;
+	u64 transformed;
+	u64 unoptimized_vertices;
+	u64 unoptimized_transformed;
+	u64 gpu_bytes;
+};
+
+// 16 entries is roughly what post-transform caches on desktop GPUs behave like
+static constexpr u32 STATS_VERTEX_CACHE_SIZE = 16;
+
+template< typename T >
+static void AppendBytes( DynamicArray< u8 > * blob, const T * xs, size_t n ) {
+	blob->add_many( Span< const u8 >( ( const u8 * ) xs, n * sizeof( T ) ) );
+}
+
+template< typename Face >
+static BSPDrawCall FaceDrawCall( const Face & face, u32 face_idx ) {
+	BSPDrawCall dc;
+	dc.base_vertex = face.first_vertex;
+	dc.num_vertices = face.num_vertices;
+	dc.index_offset = face.first_index;
+	dc.num_indices = face.num_indices;
+	dc.material = face.material;
+	dc.patch = face.type == FaceType_Patch;
+	dc.face = face_idx;
+	dc.patch_width = face.patch_width;
+	dc.patch_height = face.patch_height;
+	return dc;
+}
+
+static void BuildBSPModelGeometry( DynamicArray< u8 > * blob, const BSPSpans & bsp, Span< const BSPModelVertex > bsp_vertices, const BSPPatches & patches, size_t model_idx, BSPGeometryStats * stats ) {
+	TracyZoneScoped;
+
+	const BSPModel & bsp_model = bsp.models[ model_idx ];
+
+	DynamicArray< BSPDrawCall > draw_calls( sys_allocator );
+	for( u32 i = 0; i < bsp_model.num_faces; i++ ) {
+		u32 face = i + bsp_model.first_face;
+		draw_calls.add( bsp.idbsp ? FaceDrawCall( bsp.faces[ face ], face ) : FaceDrawCall( bsp.raven_faces[ face ], face ) );
+	}
 
 	std::sort( draw_calls.begin(), draw_calls.end(), []( const BSPDrawCall & a, const BSPDrawCall & b ) {
-		return a.material < b.material;
+		if( a.material != b.material )
+			return a.material < b.material;
+		return a.face < b.face;
 	} );
 
-	// generate patch geometry and merge draw calls
-	// TODO: this generates terrible geometry then relies on meshopt to fix it up. maybe it could be done better
-	DynamicArray< u32 > indices( sys_allocator );
+	// a model's faces use a contiguous range of the vertices lump, so only
+	// copy that range instead of the whole map
+	u32 min_vertex = U32_MAX;
+	u32 max_vertex = 0;
+	for( const BSPDrawCall & dc : draw_calls ) {
+		if( !dc.patch && dc.num_vertices > 0 ) {
+			min_vertex = Min2( min_vertex, dc.base_vertex );
+			max_vertex = Max2( max_vertex, dc.base_vertex + dc.num_vertices );
+		}
+	}
+	min_vertex = Min2( min_vertex, max_vertex );
 
-	DynamicArray< Model::Primitive > primitives( sys_allocator );
-	Model::Primitive first;
-	first.first_index = 0;
-	first.num_vertices = 0;
-	first.material = draw_calls[ 0 ].material;
-	primitives.add( first );
+	DynamicArray< BSPModelVertex > vertices( sys_allocator );
+	vertices.add_many( bsp_vertices.slice( min_vertex, max_vertex ) );
+
+	DynamicArray< u32 > indices( sys_allocator );
+	DynamicArray< BSPGeometryPrimitive > primitives( sys_allocator );
 
 	for( const BSPDrawCall & dc : draw_calls ) {
-		if( dc.material != primitives.top().material ) {
-			Model::Primitive prim;
-			prim.first_index = primitives.top().first_index + primitives.top().num_vertices;
-			prim.num_vertices = 0;
+		if( primitives.size() == 0 || dc.material != primitives.top().material ) {
+			BSPGeometryPrimitive prim;
 			prim.material = dc.material;
+			prim.first_index = indices.size();
+			prim.num_indices = 0;
 			primitives.add( prim );
 		}
 
+		u32 first_index = indices.size();
+
 		if( dc.patch ) {
-			TracyZoneScopedN( "Generate patch" );
+			const BSPPatchTessellation & patch = patches.faces[ dc.face ];
 
 			u32 num_patches_x = ( dc.patch_width - 1 ) / 2;
 			u32 num_patches_y = ( dc.patch_height - 1 ) / 2;
+			u32 verts_per_patch = ( patch.tess_x + 1 ) * ( patch.tess_y + 1 );
+			u32 num_patch_verts = num_patches_x * num_patches_y * verts_per_patch;
 
-			// find best tessellation for rows and columns
-			// minimum of 2 seems reasonable
-			float max_error = 1.0f;
-			s32 tess_x = 2;
-			s32 tess_y = 2;
-
-			for( u32 patch_y = 0; patch_y < num_patches_y; patch_y++ ) {
-				for( u32 patch_x = 0; patch_x < num_patches_x; patch_x++ ) {
-					u32 control_base = ( patch_y * 2 * dc.patch_width + patch_x * 2 ) + dc.base_vertex;
-					Span2D< const BSPModelVertex > control( &vertices[ control_base ], 3, 3, dc.patch_width );
-					for( int j = 0; j < 3; j++ ) {
-						tess_x = Max2( tess_x, Order2BezierSubdivisions( control( 0, j ).position, control( 1, j ).position, control( 2, j ).position, max_error ) );
-						tess_y = Max2( tess_y, Order2BezierSubdivisions( control( j, 0 ).position, control( j, 1 ).position, control( j, 2 ).position, max_error ) );
-					}
-				}
-			}
+			u32 first_vert = vertices.size();
+			vertices.add_many( patches.vertices.slice( patch.first_vertex, patch.first_vertex + num_patch_verts ) );
 
-			for( u32 patch_y = 0; patch_y < num_patches_y; patch_y++ ) {
-				for( u32 patch_x = 0; patch_x < num_patches_x; patch_x++ ) {
-					u32 control_base = ( patch_y * 2 * dc.patch_width + patch_x * 2 ) + dc.base_vertex;
-					u32 base_vert = vertices.size();
-
-					for( int y = 0; y <= tess_y; y++ ) {
-						for( int x = 0; x <= tess_x; x++ ) {
-							// add can reallocate vertices so we need to recreate this every iteration
-							Span2D< const BSPModelVertex > control( &vertices[ control_base ], 3, 3, dc.patch_width );
-							float tx = float( x ) / tess_x;
-							float ty = float( y ) / tess_y;
-							vertices.add( Order2Bezier2D( tx, ty, control ) );
-						}
-					}
-
-					for( int y = 0; y < tess_y; y++ ) {
-						for( int x = 0; x < tess_x; x++ ) {
-							u32 bl = ( y + 0 ) * ( tess_x + 1 ) + x + 0 + base_vert;
-							u32 br = ( y + 0 ) * ( tess_x + 1 ) + x + 1 + base_vert;
-							u32 tl = ( y + 1 ) * ( tess_x + 1 ) + x + 0 + base_vert;
-							u32 tr = ( y + 1 ) * ( tess_x + 1 ) + x + 1 + base_vert;
+			for( u32 i = 0; i < num_patches_x * num_patches_y; i++ ) {
+				u32 base_vert = first_vert + i * verts_per_patch;
 
-							indices.add( bl );
-							indices.add( tl );
-							indices.add( br );
+				for( s32 y = 0; y < patch.tess_y; y++ ) {
+					for( s32 x = 0; x < patch.tess_x; x++ ) {
+						u32 bl = ( y + 0 ) * ( patch.tess_x + 1 ) + x + 0 + base_vert;
+						u32 br = ( y + 0 ) * ( patch.tess_x + 1 ) + x + 1 + base_vert;
+						u32 tl = ( y + 1 ) * ( patch.tess_x + 1 ) + x + 0 + base_vert;
+						u32 tr = ( y + 1 ) * ( patch.tess_x + 1 ) + x + 1 + base_vert;
 
-							indices.add( br );
-							indices.add( tl );
-							indices.add( tr );
+						indices.add( bl );
+						indices.add( tl );
+						indices.add( br );
 
-							primitives.top().num_vertices += 6;
-						}
+						indices.add( br );
+						indices.add( tl );
+						indices.add( tr );
 					}
 				}
 			}
 		}
 		else {
-			for( u32 j = 0; j < dc.num_vertices; j++ ) {
-				u32 index = dc.base_vertex + bsp.indices[ j + dc.index_offset ];
-				indices.add( index );
+			for( u32 j = 0; j < dc.num_indices; j++ ) {
+				indices.add( dc.base_vertex - min_vertex + bsp.indices[ j + dc.index_offset ] );
 			}
-
-			primitives.top().num_vertices += dc.num_vertices;
 		}
+
+		primitives.top().num_indices += indices.size() - first_index;
 	}
 
 	for( BSPModelVertex & v : vertices ) {
@@ -486,56 +581,63 @@ static Model LoadBSPModel( const char * filename, DynamicArray< BSPModelVertex >
 		}
 	}
 
-	// TODO: meshopt
-
-	Model model = { };
-	model.transform = Mat4::Identity();
+	BSPGeometryModelHeader header = { };
+	DynamicArray< u8 > encoded_vertices( sys_allocator );
+	DynamicArray< u8 > encoded_indices( sys_allocator );
+
+	if( indices.size() > 0 ) {
+		stats->unoptimized_vertices += vertices.size();
+		stats->unoptimized_transformed += meshopt_analyzeVertexCache( indices.ptr(), indices.size(), vertices.size(), STATS_VERTEX_CACHE_SIZE, 0, 0 ).vertices_transformed;
+
+		// weld duplicate vertices and drop the ones nothing references, like
+		// patch control points
+		DynamicArray< u32 > remap( sys_allocator );
+		remap.resize( vertices.size() );
+		size_t num_vertices = meshopt_generateVertexRemap( remap.ptr(), indices.ptr(), indices.size(), vertices.ptr(), vertices.size(), sizeof( BSPModelVertex ) );
+		meshopt_remapIndexBuffer( indices.ptr(), indices.ptr(), indices.size(), remap.ptr() );
+		meshopt_remapVertexBuffer( vertices.ptr(), vertices.ptr(), vertices.size(), sizeof( BSPModelVertex ), remap.ptr() );
+		vertices.resize( num_vertices );
+
+		// each primitive is its own draw call so optimise them separately,
+		// then order the vertices for the model as a whole
+		for( const BSPGeometryPrimitive & prim : primitives ) {
+			u32 * prim_indices = indices.ptr() + prim.first_index;
+			meshopt_optimizeVertexCache( prim_indices, prim_indices, prim.num_indices, num_vertices );
+			meshopt_optimizeOverdraw( prim_indices, prim_indices, prim.num_indices, &vertices[ 0 ].position.x, num_vertices, sizeof( BSPModelVertex ), 1.05f );
+		}
 
-	model.primitives = ALLOC_MANY( sys_allocator, Model::Primitive, primitives.size() );
-	model.num_primitives = primitives.size();
-	memcpy( model.primitives, primitives.ptr(), primitives.num_bytes() );
+		meshopt_optimizeVertexFetch( vertices.ptr(), indices.ptr(), indices.size(), vertices.ptr(), num_vertices, sizeof( BSPModelVertex ) );
 
-	TempAllocator temp = cls.frame_arena.temp();
+		encoded_vertices.resize( meshopt_encodeVertexBufferBound( num_vertices, sizeof( BSPModelVertex ) ) );
+		encoded_vertices.resize( meshopt_encodeVertexBuffer( encoded_vertices.ptr(), encoded_vertices.size(), vertices.ptr(), num_vertices, sizeof( BSPModelVertex ) ) );
 
-	{
-		TracyZoneScopedN( "Upload to GPU" );
+		encoded_indices.resize( meshopt_encodeIndexBufferBound( indices.size(), num_vertices ) );
+		encoded_indices.resize( meshopt_encodeIndexBuffer( encoded_indices.ptr(), encoded_indices.size(), indices.ptr(), indices.size() ) );
 
-		MeshConfig mesh_config;
-		mesh_config.name = temp( "{} models[{}]", filename, model_idx );
-		mesh_config.ccw_winding = false;
-		mesh_config.unified_buffer = NewGPUBuffer( vertices.ptr(), vertices.num_bytes(), temp( "{} - {} vertices", filename, model_idx ) );
-		mesh_config.stride = sizeof( vertices[ 0 ] );
-		mesh_config.positions_offset = offsetof( BSPModelVertex, position );
-		mesh_config.normals_offset = offsetof( BSPModelVertex, normal );
-		mesh_config.tex_coords_offset = offsetof( BSPModelVertex, uv );
-		mesh_config.num_vertices = indices.size();
-
-		// if( num_verts <= U16_MAX ) {
-		// 	DynamicArray< u16 > indices_u16( sys_allocator, indices.size() );
-		// 	for( u32 i = 0; i < indices.size(); i++ ) {
-		// 		indices_u16.add( indices[ i ] );
-		// 	}
-		// 	mesh_config.indices = NewGPUBuffer( indices.ptr(), indices.num_bytes(), temp( "{} - {} indices", filename, model_idx ) );
-		// }
-		// else {
-			mesh_config.indices = NewGPUBuffer( indices.ptr(), indices.num_bytes(), temp( "{} - {} indices", filename, model_idx ) );
-			mesh_config.indices_format = IndexFormat_U32;
-		// }
-
-		model.mesh = NewMesh( mesh_config );
+		header.num_vertices = num_vertices;
+		header.num_indices = indices.size();
+		header.encoded_vertices_size = encoded_vertices.size();
+		header.encoded_indices_size = encoded_indices.size();
+		for( const BSPGeometryPrimitive & prim : primitives ) {
+			if( prim.num_indices > 0 ) {
+				header.num_primitives++;
+			}
+		}
 	}
 
-	return model;
+	AppendBytes( blob, &header, 1 );
+	for( const BSPGeometryPrimitive & prim : primitives ) {
+		if( prim.num_indices > 0 ) {
+			AppendBytes( blob, &prim, 1 );
+		}
+	}
+	AppendBytes( blob, encoded_vertices.ptr(), encoded_vertices.size() );
+	AppendBytes( blob, encoded_indices.ptr(), encoded_indices.size() );
 }
 
-bool LoadBSPRenderData( const char * filename, Map * map, u64 base_hash, Span< const u8 > data ) {
+static Span< u8 > BuildBSPGeometry( const BSPSpans & bsp, BSPGeometryStats * stats ) {
 	TracyZoneScoped;
 
-	BSPSpans bsp;
-	if( !ParseBSP( &bsp, data ) )
-		return false;
-
-	// create common vertex data
 	u32 num_verts = bsp.idbsp ? bsp.vertices.n : bsp.raven_vertices.n;
 	DynamicArray< BSPModelVertex > vertices( sys_allocator, num_verts );
 
@@ -558,14 +660,231 @@ bool LoadBSPRenderData( const char * filename, Map * map, u64 base_hash, Span< c
 		}
 	}
 
-	map->base_hash = base_hash;
+	DynamicArray< BSPPatchTessellation > patch_faces( sys_allocator );
+	DynamicArray< BSPModelVertex > patch_vertices( sys_allocator );
+	TessellatePatches( bsp, vertices.span(), &patch_faces, &patch_vertices );
+
+	BSPPatches patches;
+	patches.faces = patch_faces.span();
+	patches.vertices = patch_vertices.span();
+
+	DynamicArray< u8 > blob( sys_allocator );
+
+	BSPGeometryHeader header;
+	header.num_models = bsp.models.n;
+	AppendBytes( &blob, &header, 1 );
+
+	for( size_t i = 0; i < bsp.models.n; i++ ) {
+		BuildBSPModelGeometry( &blob, bsp, vertices.span(), patches, i, stats );
+	}
+
+	Span< u8 > geometry = ALLOC_SPAN( sys_allocator, u8, blob.size() );
+	memcpy( geometry.ptr, blob.ptr(), blob.num_bytes() );
+	return geometry;
+}
+
+template< typename T >
+static bool IndicesInRange( Span< const u8 > indices, u32 num_vertices ) {
+	for( T index : indices.cast< const T >() ) {
+		if( index >= num_vertices )
+			return false;
+	}
+	return true;
+}
+
+static bool LoadBSPModel( Model * model, Span< const u8 > * cursor, const char * filename, const BSPSpans & bsp, size_t model_idx, BSPGeometryStats * stats ) {
+	TracyZoneScoped;
+
+	*model = { };
+
+	BSPGeometryModelHeader header;
+	if( cursor->n < sizeof( header ) )
+		return false;
+	memcpy( &header, cursor->ptr, sizeof( header ) );
+	*cursor += sizeof( header );
+
+	size_t primitives_size = header.num_primitives * sizeof( BSPGeometryPrimitive );
+	size_t model_size = primitives_size + header.encoded_vertices_size + header.encoded_indices_size;
+	if( cursor->n < model_size || header.num_indices % 3 != 0 )
+		return false;
+
+	Span< const u8 > primitives = cursor->slice( 0, primitives_size );
+	Span< const u8 > encoded_vertices = cursor->slice( primitives_size, primitives_size + header.encoded_vertices_size );
+	Span< const u8 > encoded_indices = cursor->slice( primitives_size + header.encoded_vertices_size, model_size );
+	*cursor += model_size;
+
+	if( header.num_primitives == 0 )
+		return true;
+
+	for( u32 i = 0; i < header.num_primitives; i++ ) {
+		BSPGeometryPrimitive prim;
+		memcpy( &prim, primitives.ptr + i * sizeof( prim ), sizeof( prim ) );
+		if( prim.material >= bsp.materials.n || prim.num_indices == 0 || prim.first_index + prim.num_indices > header.num_indices )
+			return false;
+	}
+
+	Span< BSPModelVertex > vertices = ALLOC_SPAN( sys_allocator, BSPModelVertex, header.num_vertices );
+	defer { FREE( sys_allocator, vertices.ptr ); };
+	if( meshopt_decodeVertexBuffer( vertices.ptr, vertices.n, sizeof( BSPModelVertex ), encoded_vertices.ptr, encoded_vertices.n ) != 0 )
+		return false;
+
+	// index compression doesn't stop at the encoding, small enough models
+	// get 16 bit indices on the GPU too
+	bool u16_indices = header.num_vertices <= U16_MAX;
+	size_t index_size = u16_indices ? sizeof( u16 ) : sizeof( u32 );
+
+	Span< u8 > indices = ALLOC_SPAN( sys_allocator, u8, header.num_indices * index_size );
+	defer { FREE( sys_allocator, indices.ptr ); };
+	if( meshopt_decodeIndexBuffer( indices.ptr, header.num_indices, index_size, encoded_indices.ptr, encoded_indices.n ) != 0 )
+		return false;
+
+	bool in_range = u16_indices ? IndicesInRange< u16 >( indices, header.num_vertices ) : IndicesInRange< u32 >( indices, header.num_vertices );
+	if( !in_range )
+		return false;
+
+	const BSPModel & bsp_model = bsp.models[ model_idx ];
+
+	model->transform = Mat4::Identity();
+	model->bounds = bsp_model.bounds;
+
+	model->primitives = ALLOC_MANY( sys_allocator, Model::Primitive, header.num_primitives );
+	model->num_primitives = header.num_primitives;
+
+	for( u32 i = 0; i < header.num_primitives; i++ ) {
+		BSPGeometryPrimitive prim;
+		memcpy( &prim, primitives.ptr + i * sizeof( prim ), sizeof( prim ) );
+
+		const BSPMaterial & material = bsp.materials[ prim.material ];
+
+		Model::Primitive * primitive = &model->primitives[ i ];
+		*primitive = { };
+		if( material.flags & CONTENTS_WALLBANGABLE ) {
+			primitive->material = FindMaterial( material.name, &wallbang_material );
+		}
+		else {
+			primitive->material = FindMaterial( material.name, &world_material );
+		}
+		primitive->first_index = prim.first_index;
+		primitive->num_vertices = prim.num_indices;
+	}
+
+	TempAllocator temp = cls.frame_arena.temp();
+
+	{
+		TracyZoneScopedN( "Upload to GPU" );
+
+		MeshConfig mesh_config;
+		mesh_config.name = temp( "{} models[{}]", filename, model_idx );
+		mesh_config.ccw_winding = false;
+		mesh_config.unified_buffer = NewGPUBuffer( vertices.ptr, vertices.num_bytes(), temp( "{} - {} vertices", filename, model_idx ) );
+		mesh_config.stride = sizeof( vertices[ 0 ] );
+		mesh_config.positions_offset = offsetof( BSPModelVertex, position );
+		mesh_config.normals_offset = offsetof( BSPModelVertex, normal );
+		mesh_config.tex_coords_offset = offsetof( BSPModelVertex, uv );
+		mesh_config.num_vertices = header.num_indices;
+		mesh_config.indices = NewGPUBuffer( indices.ptr, indices.num_bytes(), temp( "{} - {} indices", filename, model_idx ) );
+		mesh_config.indices_format = u16_indices ? IndexFormat_U16 : IndexFormat_U32;
+
+		model->mesh = NewMesh( mesh_config );
+	}
+
+	meshopt_VertexCacheStatistics vcache = u16_indices ?
+		meshopt_analyzeVertexCache( ( const u16 * ) indices.ptr, header.num_indices, header.num_vertices, STATS_VERTEX_CACHE_SIZE, 0, 0 ) :
+		meshopt_analyzeVertexCache( ( const u32 * ) indices.ptr, header.num_indices, header.num_vertices, STATS_VERTEX_CACHE_SIZE, 0, 0 );
+
+	stats->vertices += header.num_vertices;
+	stats->triangles += header.num_indices / 3;
+	stats->transformed += vcache.vertices_transformed;
+	stats->gpu_bytes += vertices.num_bytes() + indices.num_bytes();
+
+	return true;
+}
+
+static bool LoadBSPModels( Map * map, const char * filename, const BSPSpans & bsp, Span< const u8 > geometry, BSPGeometryStats * stats ) {
+	TracyZoneScoped;
+
+	BSPGeometryHeader header;
+	if( geometry.n < sizeof( header ) )
+		return false;
+	memcpy( &header, geometry.ptr, sizeof( header ) );
+	if( header.num_models != bsp.models.n )
+		return false;
+
+	Span< const u8 > cursor = geometry + sizeof( header );
+
+	map->models = ALLOC_MANY( sys_allocator, Model, bsp.models.n );
 	map->num_models = bsp.models.n;
+
+	u32 num_loaded = 0;
+	while( num_loaded < map->num_models ) {
+		if( !LoadBSPModel( &map->models[ num_loaded ], &cursor, filename, bsp, num_loaded, stats ) )
+			break;
+		num_loaded++;
+	}
+
+	// leftover bytes mean the geometry wasn't built from this bsp
+	if( num_loaded == map->num_models && cursor.n == 0 )
+		return true;
+
+	for( u32 i = 0; i < num_loaded; i++ ) {
+		DeleteModel( &map->models[ i ] );
+	}
+	FREE( sys_allocator, map->models );
+	map->models = NULL;
+	map->num_models = 0;
+
+	return false;
+}
+
+bool LoadBSPRenderData( const char * filename, Map * map, u64 base_hash, Span< const u8 > data ) {
+	TracyZoneScoped;
+
+	u64 start_time = Sys_Microseconds();
+
+	BSPSpans bsp;
+	if( !ParseBSP( &bsp, data ) )
+		return false;
+
+	map->base_hash = base_hash;
 	map->fog_strength = ParseFogStrength( &bsp );
 
-	map->models = ALLOC_MANY( sys_allocator, Model, bsp.models.n );
+	// the key covers the whole bsp, so recompiling the map rebuilds it
+	u64 key = DecodeCacheKey( "bspgeometry", BSP_GEOMETRY_VERSION, data );
 
-	for( size_t i = 0; i < bsp.models.n; i++ ) {
-		map->models[ i ] = LoadBSPModel( filename, vertices, bsp, i );
+	TempAllocator temp = cls.frame_arena.temp();
+	BSPGeometryStats stats = { };
+
+	Span< u8 > geometry;
+	bool cached = LoadFromDecodeCache( &temp, sys_allocator, key, &geometry );
+	bool loaded = cached && LoadBSPModels( map, filename, bsp, geometry, &stats );
+	if( !loaded ) {
+		if( cached ) {
+			FREE( sys_allocator, geometry.ptr );
+			stats = { };
+		}
+
+		geometry = BuildBSPGeometry( bsp, &stats );
+		loaded = LoadBSPModels( map, filename, bsp, geometry, &stats );
+		if( loaded ) {
+			SaveToDecodeCache( &temp, key, geometry );
+		}
+		cached = false;
+	}
+	FREE( sys_allocator, geometry.ptr );
+
+	if( !loaded )
+		return false;
+
+	float load_time = ( Sys_Microseconds() - start_time ) / 1000.0f;
+	float acmr = float( stats.transformed ) / Max2( stats.triangles, u64( 1 ) );
+	float atvr = float( stats.transformed ) / Max2( stats.vertices, u64( 1 ) );
+
+	Com_GGPrint( "Loaded {} render geometry in {.2}ms{}: {} triangles, {} vertices, {.2}MB on the GPU, ACMR {.3}, ATVR {.3}",
+		filename, load_time, cached ? " from the cache" : "", stats.triangles, stats.vertices, stats.gpu_bytes / 1024.0f / 1024.0f, acmr, atvr );
+	if( !cached ) {
+		float unoptimized_acmr = float( stats.unoptimized_transformed ) / Max2( stats.triangles, u64( 1 ) );
+		Com_GGPrint( "meshoptimizer took it from {} to {} vertices and ACMR {.3} to {.3}",
+			stats.unoptimized_vertices, stats.vertices, unoptimized_acmr, acmr );
 	}
 
 	DynamicArray< GPUBSPNodeLinks > nodes( sys_allocator, bsp.nodes.n );
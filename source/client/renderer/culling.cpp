@@ -0,0 +1,92 @@
+#include <emmintrin.h>
+
+#include "qcommon/base.h"
+#include "client/renderer/culling.h"
+
+static void AddPlane( Frustum * frustum, Vec4 plane ) {
+	float inv_length = 1.0f / Length( plane.xyz() );
+	u32 i = frustum->num_planes;
+	frustum->nx[ i ] = plane.x * inv_length;
+	frustum->ny[ i ] = plane.y * inv_length;
+	frustum->nz[ i ] = plane.z * inv_length;
+	frustum->d[ i ] = plane.w * inv_length;
+	frustum->num_planes++;
+}
+
+// Gribb and Hartmann, "Fast Extraction of Viewing Frustum Planes from the
+// World-View-Projection Matrix"
+Frustum FrustumFromMatrix( const Mat4 & VP, bool near_plane, bool far_plane ) {
+	Frustum frustum = { };
+
+	Vec4 row0 = VP.row0();
+	Vec4 row1 = VP.row1();
+	Vec4 row2 = VP.row2();
+	Vec4 row3 = VP.row3();
+
+	AddPlane( &frustum, row3 + row0 );
+	AddPlane( &frustum, row3 - row0 );
+	AddPlane( &frustum, row3 + row1 );
+	AddPlane( &frustum, row3 - row1 );
+	if( near_plane ) {
+		AddPlane( &frustum, row3 + row2 );
+	}
+	if( far_plane ) {
+		AddPlane( &frustum, row3 - row2 );
+	}
+
+	return frustum;
+}
+
+bool SphereInFrustum( const Frustum & frustum, Vec3 centre, float radius ) {
+	for( u32 i = 0; i < frustum.num_planes; i++ ) {
+		float dist = frustum.nx[ i ] * centre.x + frustum.ny[ i ] * centre.y + frustum.nz[ i ] * centre.z + frustum.d[ i ];
+		if( dist < -radius )
+			return false;
+	}
+
+	return true;
+}
+
+u32 CullSpheres( const Frustum & frustum, const float * x, const float * y, const float * z, const float * radius, u32 n, u32 * visible ) {
+	TracyZoneScoped;
+
+	u32 num_visible = 0;
+	u32 i = 0;
+
+	for( ; i + 4 <= n; i += 4 ) {
+		__m128 sx = _mm_loadu_ps( x + i );
+		__m128 sy = _mm_loadu_ps( y + i );
+		__m128 sz = _mm_loadu_ps( z + i );
+		__m128 neg_radius = _mm_sub_ps( _mm_setzero_ps(), _mm_loadu_ps( radius + i ) );
+
+		__m128 inside = _mm_castsi128_ps( _mm_set1_epi32( -1 ) );
+		for( u32 j = 0; j < frustum.num_planes; j++ ) {
+			__m128 dist = _mm_add_ps(
+				_mm_add_ps( _mm_mul_ps( sx, _mm_set1_ps( frustum.nx[ j ] ) ), _mm_mul_ps( sy, _mm_set1_ps( frustum.ny[ j ] ) ) ),
+				_mm_add_ps( _mm_mul_ps( sz, _mm_set1_ps( frustum.nz[ j ] ) ), _mm_set1_ps( frustum.d[ j ] ) )
+			);
+			inside = _mm_and_ps( inside, _mm_cmpge_ps( dist, neg_radius ) );
+		}
+
+		// write every lane and only advance past the visible ones. this never
+		// writes past i + 3 so it stays inside visible
+		int mask = _mm_movemask_ps( inside );
+		visible[ num_visible ] = i + 0;
+		num_visible += ( mask >> 0 ) & 1;
+		visible[ num_visible ] = i + 1;
+		num_visible += ( mask >> 1 ) & 1;
+		visible[ num_visible ] = i + 2;
+		num_visible += ( mask >> 2 ) & 1;
+		visible[ num_visible ] = i + 3;
+		num_visible += ( mask >> 3 ) & 1;
+	}
+
+	for( ; i < n; i++ ) {
+		if( SphereInFrustum( frustum, Vec3( x[ i ], y[ i ], z[ i ] ), radius[ i ] ) ) {
+			visible[ num_visible ] = i;
+			num_visible++;
+		}
+	}
+
+	return num_visible;
+}
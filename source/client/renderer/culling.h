@@ -0,0 +1,25 @@
+#pragma once
+
+#include "qcommon/types.h"
+
+/*
+ * planes point inwards, so p is inside a plane when dot( n, p ) + d >= 0
+ */
+struct Frustum {
+	float nx[ 6 ];
+	float ny[ 6 ];
+	float nz[ 6 ];
+	float d[ 6 ];
+	u32 num_planes;
+};
+
+// the perspective projection has no far plane and the shadow cascades clamp
+// depth instead of clipping it, so both the near and far planes are optional
+Frustum FrustumFromMatrix( const Mat4 & VP, bool near_plane, bool far_plane );
+
+bool SphereInFrustum( const Frustum & frustum, Vec3 centre, float radius );
+
+// spheres are SoA so they can be tested 4 at a time. writes the indices of
+// the spheres that touch the frustum to visible, which needs room for n
+// elements, and returns how many it wrote
+u32 CullSpheres( const Frustum & frustum, const float * x, const float * y, const float * z, const float * radius, u32 n, u32 * visible );
@@ -21,11 +21,18 @@ struct DDSHeader {
 	u32 height, width;
 	u32 shit1[ 2 ];
 	u32 mipmap_count;
-	u32 shit2[ 13 ];
+	u64 source_hash; // the start of dwReserved1, tools/bc4 uses it to skip unchanged images
+	u32 shit2[ 11 ];
 	DDSTextureFormat format;
 	u32 shit3[ 10 ];
 };
 
+STATIC_ASSERT( sizeof( DDSHeader ) == 128 );
+
 struct BC4Block {
 	u8 data[ 8 ];
 };
+
+struct BC5Block {
+	BC4Block x, y;
+};
@@ -1,12 +1,15 @@
 #include "qcommon/base.h"
 #include "qcommon/qcommon.h"
 #include "qcommon/hash.h"
+#include "qcommon/array.h"
 #include "client/client.h"
+#include "client/decode_cache.h"
 #include "client/renderer/renderer.h"
 #include "client/assets.h"
 #include "cgame/ref.h"
 
 #include "cgltf/cgltf.h"
+#include "meshoptimizer/meshoptimizer.h"
 
 #define JSMN_HEADER
 #include "jsmn/jsmn.h"
@@ -35,106 +38,362 @@ static void SetNodeIdx( cgltf_node * node, u8 idx ) {
 	node->light = ( cgltf_light * ) uintptr_t( idx + 1 );
 }
 
-static Span< const u8 > AccessorToSpan( const cgltf_accessor * accessor ) {
-	cgltf_size offset = accessor->offset + accessor->buffer_view->offset;
-	return Span< const u8 >( ( const u8 * ) accessor->buffer_view->buffer->data + offset, accessor->count * accessor->stride );
+/*
+ * vertex data gets quantized and run through meshoptimizer on the thread
+ * pool, and the result goes in the decode cache so it only happens once per
+ * model. the cached blob is a GLTFPrimitiveHeader followed by its streams for
+ * every primitive, in the order LoadNode visits them
+ */
+
+static constexpr u32 GLTF_GEOMETRY_VERSION = 1;
+
+// half floats keep 11 significant bits, so a position rounds by at most
+// 1/2048th of its largest coordinate. use them when that's under this many
+// world units after the node transform
+static constexpr float MAX_HALF_POSITION_ERROR = 1.0f / 32.0f;
+
+enum GLTFStream {
+	GLTFStream_Positions,
+	GLTFStream_Normals,
+	GLTFStream_TexCoords,
+	GLTFStream_Colors,
+	GLTFStream_Joints,
+	GLTFStream_Weights,
+	GLTFStream_Indices,
+
+	GLTFStream_Count
+};
+
+struct GLTFPrimitiveHeader {
+	u64 material;
+	u32 num_vertices;
+	u32 num_indices;
+	u32 unquantized_size;
+	u32 stream_sizes[ GLTFStream_Count ];
+	VertexFormat formats[ GLTFStream_Indices ];
+	IndexFormat indices_format;
+};
+
+template< typename T >
+static void AppendBytes( DynamicArray< u8 > * blob, const T * xs, size_t n ) {
+	blob->add_many( Span< const u8 >( ( const u8 * ) xs, n * sizeof( T ) ) );
 }
 
-static VertexFormat VertexFormatFromGLTF( cgltf_type dim, cgltf_component_type component, bool normalized ) {
-	if( dim == cgltf_type_vec2 ) {
-		if( component == cgltf_component_type_r_8u )
-			return normalized ? VertexFormat_U8x2_Norm : VertexFormat_U8x2;
-		if( component == cgltf_component_type_r_16u )
-			return normalized ? VertexFormat_U16x2_Norm : VertexFormat_U16x2;
-		if( component == cgltf_component_type_r_32f )
-			return VertexFormat_Floatx2;
+static const cgltf_accessor * FindAttribute( const cgltf_primitive & prim, cgltf_attribute_type type ) {
+	for( size_t i = 0; i < prim.attributes_count; i++ ) {
+		if( prim.attributes[ i ].type == type && prim.attributes[ i ].index == 0 ) {
+			return prim.attributes[ i ].data;
+		}
 	}
 
-	if( dim == cgltf_type_vec3 ) {
-		if( component == cgltf_component_type_r_8u )
-			return normalized ? VertexFormat_U8x3_Norm : VertexFormat_U8x3;
-		if( component == cgltf_component_type_r_16u )
-			return normalized ? VertexFormat_U16x3_Norm : VertexFormat_U16x3;
-		if( component == cgltf_component_type_r_32f )
-			return VertexFormat_Floatx3;
+	return NULL;
+}
+
+static u32 AccessorSize( const cgltf_accessor * accessor ) {
+	return accessor == NULL ? 0 : accessor->count * accessor->stride;
+}
+
+// quantized streams are built in the glTF's vertex order and then reordered
+// and compacted to match the optimised index buffer
+static void AddStream( DynamicArray< u8 > * streams, GLTFPrimitiveHeader * header, GLTFStream stream, VertexFormat format, const void * vertices, size_t vertex_size, size_t num_vertices, const u32 * remap ) {
+	size_t base = streams->size();
+	streams->resize( base + header->num_vertices * vertex_size );
+	meshopt_remapVertexBuffer( streams->ptr() + base, vertices, num_vertices, vertex_size, remap );
+
+	header->formats[ stream ] = format;
+	header->stream_sizes[ stream ] = header->num_vertices * vertex_size;
+}
+
+static void BuildGeometry( DynamicArray< u8 > * geometry, const cgltf_primitive & prim, float scale, bool skinned ) {
+	TracyZoneScoped;
+
+	const cgltf_accessor * positions_accessor = FindAttribute( prim, cgltf_attribute_type_position );
+	const cgltf_accessor * normals_accessor = FindAttribute( prim, cgltf_attribute_type_normal );
+	const cgltf_accessor * tex_coords_accessor = FindAttribute( prim, cgltf_attribute_type_texcoord );
+	const cgltf_accessor * colors_accessor = FindAttribute( prim, cgltf_attribute_type_color );
+	const cgltf_accessor * joints_accessor = FindAttribute( prim, cgltf_attribute_type_joints );
+	const cgltf_accessor * weights_accessor = FindAttribute( prim, cgltf_attribute_type_weights );
+
+	GLTFPrimitiveHeader header = { };
+	header.material = StringHash( prim.material != NULL ? prim.material->name : "" ).hash;
+
+	size_t num_vertices = positions_accessor == NULL ? 0 : positions_accessor->count;
+
+	DynamicArray< u32 > indices( sys_allocator );
+	if( prim.indices != NULL ) {
+		header.unquantized_size += AccessorSize( prim.indices );
+		for( size_t i = 0; i < prim.indices->count; i++ ) {
+			indices.add( cgltf_accessor_read_index( prim.indices, i ) );
+		}
+	}
+	else {
+		for( size_t i = 0; i < num_vertices; i++ ) {
+			indices.add( i );
+		}
 	}
+	indices.resize( indices.size() - indices.size() % 3 );
 
-	if( dim == cgltf_type_vec4 ) {
-		if( component == cgltf_component_type_r_8u )
-			return normalized ? VertexFormat_U8x4_Norm : VertexFormat_U8x4;
-		if( component == cgltf_component_type_r_16u )
-			return normalized ? VertexFormat_U16x4_Norm : VertexFormat_U16x4;
-		if( component == cgltf_component_type_r_32f )
-			return VertexFormat_Floatx4;
+	for( u32 index : indices ) {
+		if( index >= num_vertices ) {
+			indices.clear();
+			break;
+		}
 	}
 
-	return VertexFormat_Floatx4; // TODO: actual error handling
-}
+	if( indices.size() == 0 ) {
+		AppendBytes( geometry, &header, 1 );
+		return;
+	}
 
-static void LoadGeometry( const char * filename, Model * model, const cgltf_node * node, const Mat4 & transform ) {
-	TempAllocator temp = cls.frame_arena.temp();
+	header.unquantized_size += AccessorSize( positions_accessor ) + AccessorSize( normals_accessor ) + AccessorSize( tex_coords_accessor );
+	header.unquantized_size += AccessorSize( colors_accessor ) + AccessorSize( joints_accessor ) + AccessorSize( weights_accessor );
 
-	const cgltf_primitive & prim = node->mesh->primitives[ 0 ];
+	DynamicArray< Vec3 > positions( sys_allocator, num_vertices );
+	float max_coord = 0.0f;
+	for( size_t i = 0; i < num_vertices; i++ ) {
+		Vec3 p = Vec3( 0.0f );
+		cgltf_accessor_read_float( positions_accessor, i, p.ptr(), 3 );
+		positions.add( p );
+		max_coord = Max2( max_coord, Max2( Abs( p.x ), Max2( Abs( p.y ), Abs( p.z ) ) ) );
+	}
 
-	MeshConfig mesh_config;
-	mesh_config.name = temp( "{} nodes[{}]", filename, node->name );
+	meshopt_optimizeVertexCache( indices.ptr(), indices.ptr(), indices.size(), num_vertices );
+	meshopt_optimizeOverdraw( indices.ptr(), indices.ptr(), indices.size(), &positions[ 0 ].x, num_vertices, sizeof( Vec3 ), 1.05f );
+
+	DynamicArray< u32 > remap( sys_allocator );
+	remap.resize( num_vertices );
+	header.num_vertices = meshopt_optimizeVertexFetchRemap( remap.ptr(), indices.ptr(), indices.size(), num_vertices );
+	header.num_indices = indices.size();
+	meshopt_remapIndexBuffer( indices.ptr(), indices.ptr(), indices.size(), remap.ptr() );
+
+	DynamicArray< u8 > streams( sys_allocator );
+
+	// skinned positions get moved around by the joints so we can't bound
+	// their error, leave them alone
+	if( !skinned && max_coord * scale / 2048.0f <= MAX_HALF_POSITION_ERROR ) {
+		DynamicArray< u16 > halves( sys_allocator, num_vertices * 4 );
+		for( Vec3 p : positions ) {
+			halves.add( meshopt_quantizeHalf( p.x ) );
+			halves.add( meshopt_quantizeHalf( p.y ) );
+			halves.add( meshopt_quantizeHalf( p.z ) );
+			halves.add( meshopt_quantizeHalf( 1.0f ) );
+		}
+		AddStream( &streams, &header, GLTFStream_Positions, VertexFormat_Halfx4, halves.ptr(), sizeof( u16 ) * 4, num_vertices, remap.ptr() );
+	}
+	else {
+		AddStream( &streams, &header, GLTFStream_Positions, VertexFormat_Floatx3, positions.ptr(), sizeof( Vec3 ), num_vertices, remap.ptr() );
+	}
 
-	for( size_t i = 0; i < prim.attributes_count; i++ ) {
-		const cgltf_attribute & attr = prim.attributes[ i ];
+	if( normals_accessor != NULL ) {
+		DynamicArray< s8 > normals( sys_allocator, num_vertices * 4 );
+		for( size_t i = 0; i < num_vertices; i++ ) {
+			Vec3 n = Vec3( 0.0f );
+			cgltf_accessor_read_float( normals_accessor, i, n.ptr(), 3 );
+			normals.add( meshopt_quantizeSnorm( n.x, 8 ) );
+			normals.add( meshopt_quantizeSnorm( n.y, 8 ) );
+			normals.add( meshopt_quantizeSnorm( n.z, 8 ) );
+			normals.add( 0 );
+		}
+		AddStream( &streams, &header, GLTFStream_Normals, VertexFormat_S8x4_Norm, normals.ptr(), sizeof( s8 ) * 4, num_vertices, remap.ptr() );
+	}
 
-		if( attr.type == cgltf_attribute_type_position ) {
-			mesh_config.num_vertices = attr.data->count;
-			mesh_config.positions = NewGPUBuffer( AccessorToSpan( attr.data ) );
+	if( tex_coords_accessor != NULL ) {
+		DynamicArray< Vec2 > tex_coords( sys_allocator, num_vertices );
+		bool unorm = true;
+		for( size_t i = 0; i < num_vertices; i++ ) {
+			Vec2 uv = Vec2( 0.0f );
+			cgltf_accessor_read_float( tex_coords_accessor, i, uv.ptr(), 2 );
+			tex_coords.add( uv );
+			unorm = unorm && uv.x >= 0.0f && uv.x <= 1.0f && uv.y >= 0.0f && uv.y <= 1.0f;
+		}
 
-			Vec3 min, max;
-			for( int j = 0; j < 3; j++ ) {
-				min[ j ] = attr.data->min[ j ];
-				max[ j ] = attr.data->max[ j ];
+		// tiling UVs need the range so they stay float
+		if( unorm ) {
+			DynamicArray< u16 > quantized( sys_allocator, num_vertices * 2 );
+			for( Vec2 uv : tex_coords ) {
+				quantized.add( meshopt_quantizeUnorm( uv.x, 16 ) );
+				quantized.add( meshopt_quantizeUnorm( uv.y, 16 ) );
 			}
+			AddStream( &streams, &header, GLTFStream_TexCoords, VertexFormat_U16x2_Norm, quantized.ptr(), sizeof( u16 ) * 2, num_vertices, remap.ptr() );
+		}
+		else {
+			AddStream( &streams, &header, GLTFStream_TexCoords, VertexFormat_Floatx2, tex_coords.ptr(), sizeof( Vec2 ), num_vertices, remap.ptr() );
+		}
+	}
 
-			model->bounds = Union( model->bounds, ( transform * Vec4( min, 1.0f ) ).xyz() );
-			model->bounds = Union( model->bounds, ( transform * Vec4( max, 1.0f ) ).xyz() );
+	if( colors_accessor != NULL ) {
+		DynamicArray< RGBA8 > colors( sys_allocator, num_vertices );
+		for( size_t i = 0; i < num_vertices; i++ ) {
+			Vec4 color = Vec4( 1.0f );
+			cgltf_accessor_read_float( colors_accessor, i, color.ptr(), 4 );
+			colors.add( RGBA8( meshopt_quantizeUnorm( color.x, 8 ), meshopt_quantizeUnorm( color.y, 8 ), meshopt_quantizeUnorm( color.z, 8 ), meshopt_quantizeUnorm( color.w, 8 ) ) );
 		}
+		AddStream( &streams, &header, GLTFStream_Colors, VertexFormat_U8x4_Norm, colors.ptr(), sizeof( RGBA8 ), num_vertices, remap.ptr() );
+	}
 
-		if( attr.type == cgltf_attribute_type_normal ) {
-			mesh_config.normals = NewGPUBuffer( AccessorToSpan( attr.data ) );
+	if( joints_accessor != NULL ) {
+		DynamicArray< u16 > joints( sys_allocator, num_vertices * 4 );
+		bool fits_in_u8 = true;
+		for( size_t i = 0; i < num_vertices; i++ ) {
+			u32 joint[ 4 ] = { };
+			cgltf_accessor_read_uint( joints_accessor, i, joint, 4 );
+			for( u32 j : joint ) {
+				joints.add( j );
+				fits_in_u8 = fits_in_u8 && j <= U8_MAX;
+			}
 		}
 
-		if( attr.type == cgltf_attribute_type_texcoord ) {
-			mesh_config.tex_coords = NewGPUBuffer( AccessorToSpan( attr.data ) );
-			mesh_config.tex_coords_format = VertexFormatFromGLTF( attr.data->type, attr.data->component_type, attr.data->normalized );
+		if( fits_in_u8 ) {
+			DynamicArray< u8 > joints_u8( sys_allocator, joints.size() );
+			for( u16 j : joints ) {
+				joints_u8.add( j );
+			}
+			AddStream( &streams, &header, GLTFStream_Joints, VertexFormat_U8x4, joints_u8.ptr(), sizeof( u8 ) * 4, num_vertices, remap.ptr() );
+		}
+		else {
+			AddStream( &streams, &header, GLTFStream_Joints, VertexFormat_U16x4, joints.ptr(), sizeof( u16 ) * 4, num_vertices, remap.ptr() );
 		}
+	}
 
-		if( attr.type == cgltf_attribute_type_color ) {
-			mesh_config.colors = NewGPUBuffer( AccessorToSpan( attr.data ) );
-			mesh_config.colors_format = VertexFormatFromGLTF( attr.data->type, attr.data->component_type, attr.data->normalized );
+	if( weights_accessor != NULL ) {
+		DynamicArray< u8 > weights( sys_allocator, num_vertices * 4 );
+		for( size_t i = 0; i < num_vertices; i++ ) {
+			float weight[ 4 ] = { };
+			cgltf_accessor_read_float( weights_accessor, i, weight, 4 );
+
+			// rounding can make the weights not add up to 1, which makes
+			// the vertex shrink or grow, so put the difference on the
+			// biggest weight
+			u8 quantized[ 4 ];
+			int sum = 0;
+			int biggest = 0;
+			for( int j = 0; j < 4; j++ ) {
+				quantized[ j ] = meshopt_quantizeUnorm( weight[ j ], 8 );
+				sum += quantized[ j ];
+				biggest = quantized[ j ] > quantized[ biggest ] ? j : biggest;
+			}
+			quantized[ biggest ] = Clamp( 0, quantized[ biggest ] + 255 - sum, 255 );
+
+			for( u8 w : quantized ) {
+				weights.add( w );
+			}
 		}
+		AddStream( &streams, &header, GLTFStream_Weights, VertexFormat_U8x4_Norm, weights.ptr(), sizeof( u8 ) * 4, num_vertices, remap.ptr() );
+	}
 
-		if( attr.type == cgltf_attribute_type_joints ) {
-			mesh_config.joints = NewGPUBuffer( AccessorToSpan( attr.data ) );
-			mesh_config.joints_format = VertexFormatFromGLTF( attr.data->type, attr.data->component_type, attr.data->normalized );
+	if( header.num_vertices <= U16_MAX ) {
+		DynamicArray< u16 > indices_u16( sys_allocator, indices.size() );
+		for( u32 index : indices ) {
+			indices_u16.add( index );
 		}
+		AppendBytes( &streams, indices_u16.ptr(), indices_u16.size() );
+		header.indices_format = IndexFormat_U16;
+		header.stream_sizes[ GLTFStream_Indices ] = indices_u16.num_bytes();
+	}
+	else {
+		AppendBytes( &streams, indices.ptr(), indices.size() );
+		header.indices_format = IndexFormat_U32;
+		header.stream_sizes[ GLTFStream_Indices ] = indices.num_bytes();
+	}
 
-		if( attr.type == cgltf_attribute_type_weights ) {
-			mesh_config.weights = NewGPUBuffer( AccessorToSpan( attr.data ) );
-			mesh_config.weights_format = VertexFormatFromGLTF( attr.data->type, attr.data->component_type, attr.data->normalized );
+	AppendBytes( geometry, &header, 1 );
+	AppendBytes( geometry, streams.ptr(), streams.size() );
+}
+
+template< typename T >
+static bool IndicesInRange( const u8 * indices, u32 num_indices, u32 num_vertices ) {
+	for( u32 i = 0; i < num_indices; i++ ) {
+		T index;
+		memcpy( &index, indices + i * sizeof( T ), sizeof( T ) );
+		if( index >= num_vertices )
+			return false;
+	}
+	return true;
+}
+
+static bool ParsePrimitiveGeometry( Span< const u8 > * cursor, GLTFPrimitiveHeader * header, Span< const u8 > streams[ GLTFStream_Count ] ) {
+	if( cursor->n < sizeof( *header ) )
+		return false;
+	memcpy( header, cursor->ptr, sizeof( *header ) );
+	*cursor += sizeof( *header );
+
+	for( u32 i = 0; i < GLTFStream_Count; i++ ) {
+		if( cursor->n < header->stream_sizes[ i ] )
+			return false;
+		streams[ i ] = cursor->slice( 0, header->stream_sizes[ i ] );
+		*cursor += header->stream_sizes[ i ];
+	}
+
+	return true;
+}
+
+// the cache is only keyed on the glb, so make sure it can't make us read out
+// of bounds on the GPU
+static bool ValidateGeometry( Span< const u8 > geometry, u32 num_primitives ) {
+	for( u32 i = 0; i < num_primitives; i++ ) {
+		GLTFPrimitiveHeader header;
+		Span< const u8 > streams[ GLTFStream_Count ];
+		if( !ParsePrimitiveGeometry( &geometry, &header, streams ) )
+			return false;
+
+		if( header.num_indices == 0 )
+			continue;
+
+		if( header.num_vertices == 0 || streams[ GLTFStream_Positions ].n == 0 )
+			return false;
+
+		for( u32 j = 0; j < GLTFStream_Indices; j++ ) {
+			if( streams[ j ].n == 0 )
+				continue;
+			if( streams[ j ].n != u64( VertexFormatSize( header.formats[ j ] ) ) * header.num_vertices )
+				return false;
+		}
+
+		Span< const u8 > indices = streams[ GLTFStream_Indices ];
+		bool in_range;
+		if( header.indices_format == IndexFormat_U16 ) {
+			in_range = indices.n == u64( header.num_indices ) * sizeof( u16 ) && IndicesInRange< u16 >( indices.ptr, header.num_indices, header.num_vertices );
+		}
+		else if( header.indices_format == IndexFormat_U32 ) {
+			in_range = indices.n == u64( header.num_indices ) * sizeof( u32 ) && IndicesInRange< u32 >( indices.ptr, header.num_indices, header.num_vertices );
+		}
+		else {
+			in_range = false;
 		}
+
+		if( !in_range )
+			return false;
 	}
 
-	mesh_config.indices = NewGPUBuffer( AccessorToSpan( prim.indices ) );
-	mesh_config.indices_format = prim.indices->component_type == cgltf_component_type_r_16u ? IndexFormat_U16 : IndexFormat_U32;
-	mesh_config.num_vertices = prim.indices->count;
-	mesh_config.ccw_winding = true;
+	return geometry.n == 0;
+}
 
-	Model::Primitive * primitive = &model->primitives[ model->num_primitives ];
-	model->num_primitives++;
+static float MaxScale( const Mat4 & transform ) {
+	return Max2( Length( transform.col0.xyz() ), Max2( Length( transform.col1.xyz() ), Length( transform.col2.xyz() ) ) );
+}
 
-	primitive->mesh = NewMesh( mesh_config );
-	primitive->first_index = 0;
-	primitive->num_vertices = 0;
+static void LoadGeometry( Model * model, DynamicArray< const cgltf_node * > * mesh_nodes, const cgltf_node * node, const Mat4 & transform ) {
+	const cgltf_primitive & prim = node->mesh->primitives[ 0 ];
 
-	const char * material_name = prim.material != NULL ? prim.material->name : "";
-	primitive->material = FindMaterial( material_name );
+	const cgltf_accessor * positions = FindAttribute( prim, cgltf_attribute_type_position );
+	if( positions != NULL ) {
+		Vec3 min, max;
+		for( int j = 0; j < 3; j++ ) {
+			min[ j ] = positions->min[ j ];
+			max[ j ] = positions->max[ j ];
+		}
+
+		// transform every corner so rotated nodes still end up inside the bounds
+		for( int j = 0; j < 8; j++ ) {
+			Vec3 corner = Vec3( j & 1 ? max.x : min.x, j & 2 ? max.y : min.y, j & 4 ? max.z : min.z );
+			model->bounds = Union( model->bounds, ( transform * Vec4( corner, 1.0f ) ).xyz() );
+		}
+	}
+
+	// the vertex data gets built after all the nodes are loaded, and only if
+	// it isn't in the cache
+	mesh_nodes->add( node );
+	model->num_primitives++;
 }
 
 constexpr u32 MAX_EXTRAS = 16;
@@ -188,7 +447,7 @@ static Span< const char > GetExtrasKey( const char * key, GltfExtras * extras )
 	return MakeSpan( "" );
 }
 
-static void LoadNode( const char * filename, Model * model, cgltf_data * gltf, cgltf_node * gltf_node, u8 * node_idx ) {
+static void LoadNode( Model * model, DynamicArray< const cgltf_node * > * mesh_nodes, cgltf_data * gltf, cgltf_node * gltf_node, u8 * node_idx ) {
 	u8 idx = *node_idx;
 	*node_idx += 1;
 	SetNodeIdx( gltf_node, idx );
@@ -263,11 +522,11 @@ static void LoadNode( const char * filename, Model * model, cgltf_data * gltf, c
 	// TODO: this will break if multiple nodes share a mesh
 	if( gltf_node->mesh != NULL ) {
 		node->primitive = model->num_primitives;
-		LoadGeometry( filename, model, gltf_node, node->global_transform );
+		LoadGeometry( model, mesh_nodes, gltf_node, node->global_transform );
 	}
 
 	for( size_t i = 0; i < gltf_node->children_count; i++ ) {
-		LoadNode( filename, model, gltf, gltf_node->children[ i ], node_idx );
+		LoadNode( model, mesh_nodes, gltf, gltf_node->children[ i ], node_idx );
 	}
 
 	if( gltf_node->children_count == 0 ) {
@@ -385,17 +644,15 @@ static void LoadSkin( Model * model, const cgltf_skin * skin ) {
 	}
 }
 
-bool LoadGLTFModel( Model * model, const char * path ) {
+bool DecodeGLTFModel( TempAllocator * temp, DecodedGLTFModel * decoded, const char * path, Span< const u8 > glb ) {
 	TracyZoneScoped;
 	TracyZoneText( path, strlen( path ) );
 
-	Span< const u8 > data = AssetBinary( path );
-
 	cgltf_options options = { };
 	options.type = cgltf_file_type_glb;
 
 	cgltf_data * gltf;
-	if( cgltf_parse( &options, data.ptr, data.num_bytes(), &gltf ) != cgltf_result_success ) {
+	if( cgltf_parse( &options, glb.ptr, glb.num_bytes(), &gltf ) != cgltf_result_success ) {
 		Com_Printf( S_COLOR_YELLOW "%s isn't a GLTF file\n", path );
 		return false;
 	}
@@ -429,7 +686,8 @@ bool LoadGLTFModel( Model * model, const char * path ) {
 		}
 	}
 
-	*model = { };
+	*decoded = { };
+	Model * model = &decoded->model;
 	model->bounds = MinMax3::Empty();
 
 	constexpr Mat4 y_up_to_z_up(
@@ -446,12 +704,33 @@ bool LoadGLTFModel( Model * model, const char * path ) {
 	memset( model->nodes, 0, sizeof( Model::Node ) * gltf->nodes_count );
 	model->num_nodes = gltf->nodes_count;
 
+	DynamicArray< const cgltf_node * > mesh_nodes( sys_allocator );
+
 	u8 node_idx = 0;
 	for( size_t i = 0; i < gltf->scene->nodes_count; i++ ) {
-		LoadNode( path, model, gltf, gltf->scene->nodes[ i ], &node_idx );
+		LoadNode( model, &mesh_nodes, gltf, gltf->scene->nodes[ i ], &node_idx );
 		model->nodes[ GetNodeIdx( gltf->scene->nodes[ i ] ) ].sibling = U8_MAX;
 	}
 
+	u64 key = DecodeCacheKey( "gltf", GLTF_GEOMETRY_VERSION, glb );
+	decoded->cached = LoadFromDecodeCache( temp, sys_allocator, key, &decoded->geometry );
+	if( decoded->cached && !ValidateGeometry( decoded->geometry, mesh_nodes.size() ) ) {
+		FREE( sys_allocator, decoded->geometry.ptr );
+		decoded->cached = false;
+	}
+
+	if( !decoded->cached ) {
+		DynamicArray< u8 > geometry( sys_allocator );
+		for( const cgltf_node * node : mesh_nodes ) {
+			const Model::Node & model_node = model->nodes[ GetNodeIdx( node ) ];
+			BuildGeometry( &geometry, node->mesh->primitives[ 0 ], MaxScale( model_node.global_transform ), model_node.skinned );
+		}
+
+		decoded->geometry = ALLOC_SPAN( sys_allocator, u8, geometry.size() );
+		memcpy( decoded->geometry.ptr, geometry.ptr(), geometry.num_bytes() );
+		SaveToDecodeCache( temp, key, decoded->geometry );
+	}
+
 	if( gltf->animations_count > 0 ) {
 		model->num_animations = gltf->animations_count;
 		if( gltf->skins_count > 0 ) {
@@ -477,3 +756,64 @@ bool LoadGLTFModel( Model * model, const char * path ) {
 
 	return true;
 }
+
+static GPUBuffer NewStreamBuffer( Span< const u8 > stream ) {
+	GPUBuffer buffer = { };
+	if( stream.n > 0 ) {
+		buffer = NewGPUBuffer( stream );
+	}
+	return buffer;
+}
+
+void UploadGLTFModel( Model * model, DecodedGLTFModel * decoded, const char * path ) {
+	TracyZoneScoped;
+	TracyZoneText( path, strlen( path ) );
+
+	*model = decoded->model;
+
+	TempAllocator temp = cls.frame_arena.temp();
+	Span< const u8 > cursor = decoded->geometry;
+
+	for( u32 i = 0; i < model->num_primitives; i++ ) {
+		GLTFPrimitiveHeader header;
+		Span< const u8 > streams[ GLTFStream_Count ];
+		Model::Primitive * primitive = &model->primitives[ i ];
+		*primitive = { };
+
+		// DecodeGLTFModel already made sure every primitive parses
+		if( !ParsePrimitiveGeometry( &cursor, &header, streams ) ) {
+			assert( false );
+			continue;
+		}
+		primitive->material = FindMaterial( StringHash( header.material ) );
+
+		MeshConfig mesh_config;
+		mesh_config.name = temp( "{} primitives[{}]", path, i );
+		mesh_config.positions = NewStreamBuffer( streams[ GLTFStream_Positions ] );
+		mesh_config.positions_format = header.formats[ GLTFStream_Positions ];
+		mesh_config.normals = NewStreamBuffer( streams[ GLTFStream_Normals ] );
+		mesh_config.normals_format = header.formats[ GLTFStream_Normals ];
+		mesh_config.tex_coords = NewStreamBuffer( streams[ GLTFStream_TexCoords ] );
+		mesh_config.tex_coords_format = header.formats[ GLTFStream_TexCoords ];
+		mesh_config.colors = NewStreamBuffer( streams[ GLTFStream_Colors ] );
+		mesh_config.colors_format = header.formats[ GLTFStream_Colors ];
+		mesh_config.joints = NewStreamBuffer( streams[ GLTFStream_Joints ] );
+		mesh_config.joints_format = header.formats[ GLTFStream_Joints ];
+		mesh_config.weights = NewStreamBuffer( streams[ GLTFStream_Weights ] );
+		mesh_config.weights_format = header.formats[ GLTFStream_Weights ];
+		mesh_config.indices = NewStreamBuffer( streams[ GLTFStream_Indices ] );
+		mesh_config.indices_format = header.indices_format;
+		mesh_config.num_vertices = header.num_indices;
+		mesh_config.ccw_winding = true;
+
+		primitive->mesh = NewMesh( mesh_config );
+
+		for( Span< const u8 > stream : streams ) {
+			decoded->gpu_bytes += stream.n;
+		}
+		decoded->unquantized_bytes += header.unquantized_size;
+	}
+
+	FREE( sys_allocator, decoded->geometry.ptr );
+	decoded->geometry = { };
+}
@@ -1,6 +1,7 @@
 #include <algorithm> // std::sort
 
 #include "qcommon/base.h"
+#include "qcommon/array.h"
 #include "qcommon/hash.h"
 #include "qcommon/hashtable.h"
 #include "qcommon/string.h"
@@ -8,13 +9,15 @@
 #include "gameshared/q_shared.h"
 #include "client/client.h"
 #include "client/assets.h"
+#include "client/decode_cache.h"
+#include "client/startup.h"
 #include "client/threadpool.h"
 #include "client/renderer/renderer.h"
+#include "client/renderer/bc4.h"
 #include "client/renderer/dds.h"
 #include "cgame/cg_dynamics.h"
 
 #include "stb/stb_image.h"
-#include "stb/stb_rect_pack.h"
 
 struct MaterialSpecKey {
 	const char * keyword;
@@ -31,6 +34,8 @@ constexpr int DECAL_ATLAS_BLOCK_SIZE = DECAL_ATLAS_SIZE / 4;
 static Texture textures[ MAX_TEXTURES ];
 static void * texture_stb_data[ MAX_TEXTURES ];
 static Span< const BC4Block > texture_bc4_data[ MAX_TEXTURES ];
+static u32 texture_generations[ MAX_TEXTURES ];
+static StringHash texture_pinned_assets[ MAX_TEXTURES ];
 static u32 num_textures;
 static Hashtable< MAX_TEXTURES * 2 > textures_hashtable;
 
@@ -44,10 +49,38 @@ static Hashtable< MAX_MATERIALS * 2 > materials_hashtable;
 Material world_material;
 Material wallbang_material;
 
+/*
+ * decals live in cells of a grid laid over each atlas layer. cells are as big
+ * as a 4x4 block in the atlas's smallest mipmap, so every decal stays block
+ * aligned all the way down the mip chain. hotloads only place the decals that
+ * changed and we repack from scratch when that fails or a repack would free up
+ * a whole layer
+ */
+struct DecalAtlasEntry {
+	u64 material_hash;
+	u64 texture_idx;
+	u32 texture_generation;
+	u32 layer;
+	u32 x, y, w, h; // in cells
+};
+
+struct DecalAtlas {
+	TextureArray texture;
+	u32 num_layers;
+	u32 num_mipmaps;
+	u32 cell_size;
+	u32 cells_per_side;
+	NonRAIIDynamicArray< u8 > cells;
+};
+
+// repack when everything would fit in one less layer at this occupancy
+constexpr float DECAL_ATLAS_REPACK_OCCUPANCY = 0.75f;
+
+static DecalAtlasEntry decal_entries[ MAX_DECALS ];
 static Vec4 decal_uvwhs[ MAX_DECALS ];
 static u32 num_decals;
 static Hashtable< MAX_DECALS * 2 > decals_hashtable;
-static TextureArray decals_atlases;
+static DecalAtlas decal_atlas;
 
 static UniformBlock material_static_uniforms[ MAX_MATERIALS ];
 static Hashtable< MAX_MATERIALS * 2 > material_static_uniforms_hashtable;
@@ -375,6 +408,11 @@ static void UnloadTexture( u64 idx ) {
 	texture_stb_data[ idx ] = NULL;
 	texture_bc4_data[ idx ] = Span< const BC4Block >();
 
+	if( texture_pinned_assets[ idx ] != EMPTY_HASH ) {
+		UnpinAsset( texture_pinned_assets[ idx ] );
+		texture_pinned_assets[ idx ] = EMPTY_HASH;
+	}
+
 	DeleteTexture( textures[ idx ] );
 }
 
@@ -405,6 +443,7 @@ static u64 AddTexture( const char * name, u64 hash, const TextureConfig & config
 	}
 
 	textures[ idx ] = NewTexture( config );
+	texture_generations[ idx ]++;
 	return idx;
 }
 
@@ -522,7 +561,16 @@ static void LoadDDSTexture( const char * path ) {
 	}
 
 	size_t idx = AddTexture( path, Hash64( StripExtension( path ) ), config );
-	texture_bc4_data[ idx ] = ( dds + sizeof( DDSHeader ) ).cast< const BC4Block >();
+	if( idx == U64_MAX )
+		return;
+
+	// BC4 textures might be decals, which get copied into the atlas straight
+	// from the DDS data, so keep it out of the asset cache
+	if( config.format == TextureFormat_BC4 ) {
+		texture_bc4_data[ idx ] = ( dds + sizeof( DDSHeader ) ).cast< const BC4Block >();
+		texture_pinned_assets[ idx ] = StringHash( path );
+		PinAsset( texture_pinned_assets[ idx ] );
+	}
 }
 
 static void LoadMaterialFile( const char * path ) {
@@ -569,48 +617,122 @@ struct DecodeSTBTextureJob {
 	} out;
 };
 
-struct DecalAtlasLayer {
-	BC4Block blocks[ DECAL_ATLAS_BLOCK_SIZE * DECAL_ATLAS_BLOCK_SIZE ];
-};
+static NonRAIIDynamicArray< DecodeSTBTextureJob > decode_texture_jobs;
+static bool textures_decoded;
 
-static BC4Block FastBC4( Span2D< const RGBA8 > rgba ) {
-	BC4Block result;
+static void BuildDecodeTextureJobs() {
+	TracyZoneScopedN( "Build job list" );
+
+	decode_texture_jobs.init( sys_allocator );
+
+	for( const char * path : AssetPaths() ) {
+		Span< const char > ext = FileExtension( path );
 
-	result.data[ 0 ] = 255;
-	result.data[ 1 ] = 0;
+		if( StartsWith( path, "textures/editor" ) ) {
+			continue;
+		}
 
-	constexpr u8 selector_lut[] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+		if( ext == ".png" || ext == ".jpg" ) {
+			DecodeSTBTextureJob job;
+			job.in.path = path;
+			job.in.data = AssetBinary( path );
 
-	u64 selectors = 0;
-	for( size_t i = 0; i < 16; i++ ) {
-		u64 selector = selector_lut[ rgba( i % 4, i / 4 ).a >> 5 ];
-		selectors |= selector << ( i * 3 );
+			decode_texture_jobs.add( job );
+		}
 	}
 
-	memcpy( &result.data[ 2 ], &selectors, 6 );
+	std::sort( decode_texture_jobs.begin(), decode_texture_jobs.end(), []( const DecodeSTBTextureJob & a, const DecodeSTBTextureJob & b ) {
+		return a.in.data.n > b.in.data.n;
+	} );
+}
+
+static void DecodeSTBTexture( TempAllocator * temp, void * data ) {
+	DecodeSTBTextureJob * job = ( DecodeSTBTextureJob * ) data;
+
+	TracyZoneScopedN( "stbi_load_from_memory" );
+	TracyZoneText( job->in.path, strlen( job->in.path ) );
 
-	return result;
+	job->out.pixels = stbi_load_from_memory( job->in.data.ptr, job->in.data.num_bytes(), &job->out.width, &job->out.height, &job->out.channels, 0 );
 }
 
-static Span2D< BC4Block > RGBAToBC4( Span2D< const RGBA8 > rgba ) {
+void DecodeMaterialTextures( StartupTask * task ) {
+	BuildDecodeTextureJobs();
+	StartupTaskParallelFor( task, decode_texture_jobs.span(), DecodeSTBTexture );
+	textures_decoded = true;
+}
+
+static void EncodeBC4Job( TempAllocator * temp, void * data ) {
+	RunBC4EncodeJob( ( const BC4EncodeJob * ) data );
+}
+
+// makes temporary bc4s for RGBA decals. everything that misses the decode
+// cache gets split into block rows and encoded in one go on the thread pool
+static void EncodeDecals( Span< const DecalAtlasEntry > entries ) {
 	TracyZoneScoped;
 
-	Span2D< BC4Block > bc4 = ALLOC_SPAN2D( sys_allocator, BC4Block, rgba.w / 4, rgba.h / 4 );
+	DynamicArray< BC4EncodeJob > jobs( sys_allocator );
+	u64 keys[ MAX_DECALS ];
+	u64 encoded[ MAX_DECALS ];
+	u32 num_encoded = 0;
+
+	for( const DecalAtlasEntry & entry : entries ) {
+		u64 texture_idx = entry.texture_idx;
+		const Texture * texture = &textures[ texture_idx ];
+		if( texture->format != TextureFormat_RGBA_U8_sRGB || texture_bc4_data[ texture_idx ].ptr != NULL )
+			continue;
+
+		Span2D< const RGBA8 > rgba = Span2D< const RGBA8 >( ( const RGBA8 * ) texture_stb_data[ texture_idx ], texture->width, texture->height );
+		Span< const u8 > rgba_bytes = Span< const RGBA8 >( rgba.ptr, rgba.w * rgba.h ).cast< const u8 >();
+		size_t num_blocks = ( rgba.w / 4 ) * ( rgba.h / 4 );
 
-	for( u32 row = 0; row < bc4.h; row++ ) {
-		for( u32 col = 0; col < bc4.w; col++ ) {
-			Span2D< const RGBA8 > rgba_block = rgba.slice( col * 4, row * 4, 4, 4 );
-			bc4( col, row ) = FastBC4( rgba_block );
+		TempAllocator temp = cls.frame_arena.temp();
+		u64 key = DecodeCacheKey( "bc4", BC4_ENCODER_VERSION, rgba_bytes );
+
+		Span< u8 > cached;
+		if( LoadFromDecodeCache( &temp, sys_allocator, key, &cached ) ) {
+			if( cached.n == num_blocks * sizeof( BC4Block ) ) {
+				texture_bc4_data[ texture_idx ] = cached.cast< const BC4Block >();
+				continue;
+			}
+			FREE( sys_allocator, cached.ptr );
 		}
+
+		Span2D< BC4Block > bc4 = ALLOC_SPAN2D( sys_allocator, BC4Block, rgba.w / 4, rgba.h / 4 );
+		texture_bc4_data[ texture_idx ] = bc4.span();
+
+		size_t first_job = jobs.extend( BC4EncodeJobsNeeded( rgba ) );
+		SplitBC4Encode( &jobs[ first_job ], bc4, rgba, 3 );
+
+		keys[ num_encoded ] = key;
+		encoded[ num_encoded ] = texture_idx;
+		num_encoded++;
+	}
+
+	// the thread pool's queue is finite so feed it in batches
+	constexpr size_t jobs_per_batch = 1024;
+	for( size_t i = 0; i < jobs.size(); i += jobs_per_batch ) {
+		ParallelFor( jobs.span().slice( i, Min2( i + jobs_per_batch, jobs.size() ) ), EncodeBC4Job );
+	}
+
+	for( u32 i = 0; i < num_encoded; i++ ) {
+		TempAllocator temp = cls.frame_arena.temp();
+		SaveToDecodeCache( &temp, keys[ i ], texture_bc4_data[ encoded[ i ] ].cast< const u8 >() );
 	}
+}
 
-	return bc4;
+static void FreeEncodedDecals( Span< const DecalAtlasEntry > entries ) {
+	for( const DecalAtlasEntry & entry : entries ) {
+		if( textures[ entry.texture_idx ].format != TextureFormat_RGBA_U8_sRGB )
+			continue;
+
+		FREE( sys_allocator, const_cast< BC4Block * >( texture_bc4_data[ entry.texture_idx ].ptr ) );
+		texture_bc4_data[ entry.texture_idx ] = Span< const BC4Block >();
+	}
 }
 
-static Span2D< const BC4Block > GetMipmap( const Material * material, u32 mipmap ) {
-	u64 texture_idx = material->texture - textures;
-	u32 w = material->texture->width / 4;
-	u32 h = material->texture->height / 4;
+static Span2D< const BC4Block > GetMipmap( u64 texture_idx, u32 mipmap ) {
+	u32 w = textures[ texture_idx ].width / 4;
+	u32 h = textures[ texture_idx ].height / 4;
 
 	Span< const BC4Block > cursor = texture_bc4_data[ texture_idx ];
 	for( u32 i = 0; i < mipmap; i++ ) {
@@ -623,15 +745,131 @@ static Span2D< const BC4Block > GetMipmap( const Material * material, u32 mipmap
 	return Span2D< const BC4Block >( cursor.slice( 0, mip_w * mip_h ).ptr, mip_w, mip_h );
 }
 
-static void PackDecalAtlas() {
-	TracyZoneScoped;
+static Span2D< u8 > DecalAtlasLayerCells( u32 layer ) {
+	u32 layer_cells = Square( decal_atlas.cells_per_side );
+	return Span2D< u8 >( decal_atlas.cells.ptr() + layer * layer_cells, decal_atlas.cells_per_side, decal_atlas.cells_per_side );
+}
 
-	decals_hashtable.clear();
+static void FillDecalAtlasCells( const DecalAtlasEntry & entry, u8 value ) {
+	Span2D< u8 > cells = DecalAtlasLayerCells( entry.layer );
+	for( u32 row = 0; row < entry.h; row++ ) {
+		memset( &cells( entry.x, entry.y + row ), value, entry.w );
+	}
+}
+
+// first fit, skipping past whatever blocked the last attempt
+static bool AllocateDecalAtlasCells( DecalAtlasEntry * entry ) {
+	u32 side = decal_atlas.cells_per_side;
+	if( entry->w > side || entry->h > side )
+		return false;
 
-	// make a list of textures to be packed
-	stbrp_rect rects[ MAX_DECALS ];
+	for( u32 layer = 0; layer < decal_atlas.num_layers; layer++ ) {
+		Span2D< const u8 > cells = DecalAtlasLayerCells( layer );
+
+		for( u32 y = 0; y + entry->h <= side; y++ ) {
+			u32 x = 0;
+			while( x + entry->w <= side ) {
+				u32 skip_to = x;
+				for( u32 row = 0; row < entry->h; row++ ) {
+					for( u32 col = entry->w; col > 0; col-- ) {
+						if( cells( x + col - 1, y + row ) != 0 ) {
+							skip_to = Max2( skip_to, x + col );
+							break;
+						}
+					}
+				}
+
+				if( skip_to == x ) {
+					entry->layer = layer;
+					entry->x = x;
+					entry->y = y;
+					FillDecalAtlasCells( *entry, 1 );
+					return true;
+				}
+
+				x = skip_to;
+			}
+		}
+	}
+
+	return false;
+}
+
+static void ResetDecalAtlas( u32 num_mipmaps ) {
 	num_decals = 0;
+	decal_atlas.num_layers = 0;
+	decal_atlas.num_mipmaps = num_mipmaps;
+	decal_atlas.cell_size = Min2( u32( 4 ) << ( num_mipmaps - 1 ), u32( DECAL_ATLAS_SIZE ) );
+	decal_atlas.cells_per_side = DECAL_ATLAS_SIZE / decal_atlas.cell_size;
+	decal_atlas.cells.clear();
+}
+
+static void AddDecalAtlasLayer() {
+	size_t first_cell = decal_atlas.cells.extend( Square( decal_atlas.cells_per_side ) );
+	memset( decal_atlas.cells.ptr() + first_cell, 0, Square( decal_atlas.cells_per_side ) );
+	decal_atlas.num_layers++;
+}
+
+static DecalAtlasEntry NewDecalAtlasEntry( const Material * material ) {
+	DecalAtlasEntry entry = { };
+	entry.material_hash = material->hash;
+	entry.texture_idx = material->texture - textures;
+	entry.texture_generation = texture_generations[ entry.texture_idx ];
+	entry.w = ( material->texture->width + decal_atlas.cell_size - 1 ) / decal_atlas.cell_size;
+	entry.h = ( material->texture->height + decal_atlas.cell_size - 1 ) / decal_atlas.cell_size;
+	return entry;
+}
+
+// returns false when we run out of room and can't add layers
+static bool PlaceDecals( Span< const u32 > material_indices, bool add_layers ) {
+	assert( num_decals + material_indices.n <= ARRAY_COUNT( decal_entries ) );
+
+	DecalAtlasEntry * to_place = decal_entries + num_decals;
+	for( u32 i = 0; i < material_indices.n; i++ ) {
+		to_place[ i ] = NewDecalAtlasEntry( &materials[ material_indices[ i ] ] );
+	}
+
+	// biggest first packs a lot tighter
+	std::sort( to_place, to_place + material_indices.n, []( const DecalAtlasEntry & a, const DecalAtlasEntry & b ) {
+		return a.h == b.h ? a.w > b.w : a.h > b.h;
+	} );
+
+	for( u32 i = 0; i < material_indices.n; i++ ) {
+		if( !AllocateDecalAtlasCells( &to_place[ i ] ) ) {
+			if( !add_layers )
+				return false;
+
+			AddDecalAtlasLayer();
+			if( !AllocateDecalAtlasCells( &to_place[ i ] ) ) {
+				Fatal( "Can't pack decals" );
+			}
+		}
+
+		num_decals++;
+	}
+
+	return true;
+}
+
+static void UploadDecals( Span< const DecalAtlasEntry > entries ) {
+	TracyZoneScoped;
+
+	for( const DecalAtlasEntry & entry : entries ) {
+		for( u32 i = 0; i < decal_atlas.num_mipmaps; i++ ) {
+			Span2D< const BC4Block > bc4 = GetMipmap( entry.texture_idx, i );
+			u32 x = ( entry.x * decal_atlas.cell_size ) >> i;
+			u32 y = ( entry.y * decal_atlas.cell_size ) >> i;
+			WriteTextureArrayRegion( decal_atlas.texture, TextureFormat_BC4, i, entry.layer, x, y, bc4.w * 4, bc4.h * 4, bc4.ptr );
+		}
+	}
+}
 
+static void UpdateDecalAtlas() {
+	TracyZoneScoped;
+
+	u32 decal_materials[ MAX_DECALS ];
+	u32 num_decal_materials = 0;
+	bool is_decal[ MAX_MATERIALS ] = { };
 	u32 num_mipmaps = U32_MAX;
 
 	for( u32 i = 0; i < num_materials; i++ ) {
@@ -653,143 +891,175 @@ static void PackDecalAtlas() {
 			Com_GGPrint( S_COLOR_YELLOW "{} has a small number of mipmaps ({}) and will mess up the decal atlas", materials[ i ].name, texture->num_mipmaps );
 		}
 
-		assert( num_decals < ARRAY_COUNT( rects ) );
-
-		stbrp_rect * rect = &rects[ num_decals ];
-		num_decals++;
+		assert( num_decal_materials < ARRAY_COUNT( decal_materials ) );
 
-		rect->id = i;
-		rect->w = texture->width;
-		rect->h = texture->height;
+		decal_materials[ num_decal_materials ] = i;
+		num_decal_materials++;
+		is_decal[ i ] = true;
 
 		num_mipmaps = Min2( texture->num_mipmaps, num_mipmaps );
 	}
 
-	// rect packing
-	u32 num_unpacked = num_decals;
-	u32 num_layers = 0;
-	while( true ) {
-		TracyZoneScopedN( "stb_rect_pack iteration" );
+	if( num_decal_materials == 0 ) {
+		num_mipmaps = 1;
+	}
 
-		stbrp_node nodes[ MAX_TEXTURES ];
-		stbrp_context packer;
-		stbrp_init_target( &packer, DECAL_ATLAS_SIZE, DECAL_ATLAS_SIZE, nodes, ARRAY_COUNT( nodes ) );
-		stbrp_setup_allow_out_of_mem( &packer, 1 );
+	// the cell size depends on the mip count so changing it means starting over
+	bool repack = decal_atlas.texture.texture == 0 || num_mipmaps != decal_atlas.num_mipmaps;
+	u32 first_new_decal = 0;
 
-		bool all_packed = stbrp_pack_rects( &packer, rects, num_unpacked ) != 0;
-		bool none_packed = true;
+	if( !repack ) {
+		// free decals that went away or changed
+		bool placed[ MAX_MATERIALS ] = { };
+		u32 used_cells = 0;
 
-		static RGBA8 pixels[ DECAL_ATLAS_SIZE * DECAL_ATLAS_SIZE ];
-		Span2D< RGBA8 > image( pixels, DECAL_ATLAS_SIZE, DECAL_ATLAS_SIZE );
-		for( u32 i = 0; i < num_unpacked; i++ ) {
-			if( !rects[ i ].was_packed )
-				continue;
-			none_packed = false;
+		for( u32 i = 0; i < num_decals; i++ ) {
+			const DecalAtlasEntry & entry = decal_entries[ i ];
 
-			const Material * material = &materials[ rects[ i ].id ];
+			u64 material_idx;
+			bool keep = false;
+			if( materials_hashtable.get( entry.material_hash, &material_idx ) && is_decal[ material_idx ] ) {
+				const Material * material = &materials[ material_idx ];
+				keep = material->texture - textures == s64( entry.texture_idx ) && texture_generations[ entry.texture_idx ] == entry.texture_generation;
+			}
 
-			size_t decal_idx = decals_hashtable.size();
-			decals_hashtable.add( material->hash, decal_idx );
-			decal_uvwhs[ decal_idx ].x = rects[ i ].x / float( DECAL_ATLAS_SIZE ) + num_layers;
-			decal_uvwhs[ decal_idx ].y = rects[ i ].y / float( DECAL_ATLAS_SIZE );
-			decal_uvwhs[ decal_idx ].z = material->texture->width / float( DECAL_ATLAS_SIZE );
-			decal_uvwhs[ decal_idx ].w = material->texture->height / float( DECAL_ATLAS_SIZE );
+			if( keep ) {
+				placed[ material_idx ] = true;
+				used_cells += entry.w * entry.h;
+				continue;
+			}
+
+			FillDecalAtlasCells( entry, 0 );
+			num_decals--;
+			Swap2( &decal_entries[ i ], &decal_entries[ num_decals ] );
+			i--;
 		}
 
-		num_layers++;
-		if( all_packed )
-			break;
+		u32 num_unplaced = 0;
+		for( u32 i = 0; i < num_decal_materials; i++ ) {
+			if( !placed[ decal_materials[ i ] ] ) {
+				decal_materials[ num_unplaced ] = decal_materials[ i ];
+				num_unplaced++;
+			}
+		}
 
-		if( none_packed ) {
-			Fatal( "Can't pack decals" );
+		u32 layer_cells = Square( decal_atlas.cells_per_side );
+		u32 needed_cells = used_cells;
+		for( u32 i = 0; i < num_unplaced; i++ ) {
+			DecalAtlasEntry entry = NewDecalAtlasEntry( &materials[ decal_materials[ i ] ] );
+			needed_cells += entry.w * entry.h;
 		}
 
-		// repack rects array
-		for( u32 i = 0; i < num_unpacked; i++ ) {
-			if( !rects[ i ].was_packed )
-				continue;
+		first_new_decal = num_decals;
 
-			num_unpacked--;
-			Swap2( &rects[ num_unpacked ], &rects[ i ] );
-			i--;
+		if( needed_cells <= ( decal_atlas.num_layers - 1 ) * layer_cells * DECAL_ATLAS_REPACK_OCCUPANCY ) {
+			// so much got freed that a repack would drop a layer
+			repack = true;
+		}
+		else if( !PlaceDecals( Span< const u32 >( decal_materials, num_unplaced ), false ) ) {
+			repack = true;
+		}
+
+		if( repack ) {
+			// gather them all again
+			num_decal_materials = 0;
+			for( u32 i = 0; i < num_materials; i++ ) {
+				if( is_decal[ i ] ) {
+					decal_materials[ num_decal_materials ] = i;
+					num_decal_materials++;
+				}
+			}
 		}
 	}
 
-	// convert pngs to temporary bc4s
-	for( u32 i = 0; i < num_decals; i++ ) {
-		const Material * material = &materials[ rects[ i ].id ];
-		if( material->texture->format != TextureFormat_RGBA_U8_sRGB )
-			continue;
+	if( repack ) {
+		TracyZoneScopedN( "Repack decal atlas" );
+
+		ResetDecalAtlas( num_mipmaps );
+		AddDecalAtlasLayer();
+		PlaceDecals( Span< const u32 >( decal_materials, num_decal_materials ), true );
+		first_new_decal = 0;
+
+		// make a fresh atlas with everything zeroed
+		u32 num_blocks = 0;
+		for( u32 i = 0; i < num_mipmaps; i++ ) {
+			num_blocks += Square( DECAL_ATLAS_BLOCK_SIZE >> i );
+		}
+		num_blocks *= decal_atlas.num_layers;
+
+		Span< BC4Block > blocks = ALLOC_SPAN( sys_allocator, BC4Block, num_blocks );
+		memset( blocks.ptr, 0, blocks.num_bytes() );
+		defer { FREE( sys_allocator, blocks.ptr ); };
+
+		DeleteTextureArray( decal_atlas.texture );
+
+		TextureArrayConfig config;
+		config.width = DECAL_ATLAS_SIZE;
+		config.height = DECAL_ATLAS_SIZE;
+		config.num_mipmaps = num_mipmaps;
+		config.layers = decal_atlas.num_layers;
+		config.data = blocks.ptr;
+		config.format = TextureFormat_BC4;
 
-		u64 texture_idx = material->texture - textures;
-		Span2D< const RGBA8 > rgba = Span2D< const RGBA8 >( ( const RGBA8 * ) texture_stb_data[ texture_idx ], material->texture->width, material->texture->height );
-		Span2D< const BC4Block > bc4 = RGBAToBC4( rgba );
-		texture_bc4_data[ texture_idx ] = Span< const BC4Block >( bc4.ptr, bc4.w * bc4.h );
+		decal_atlas.texture = NewTextureArray( config );
 	}
 
-	// copy texture data into atlases, convert RGBA to BC4 as needed
-	u32 num_blocks = 0;
-	for( u32 i = 0; i < num_mipmaps; i++ ) {
-		num_blocks += Square( DECAL_ATLAS_BLOCK_SIZE >> i );
+	Span< const DecalAtlasEntry > new_decals = Span< const DecalAtlasEntry >( decal_entries + first_new_decal, num_decals - first_new_decal );
+	EncodeDecals( new_decals );
+	UploadDecals( new_decals );
+	FreeEncodedDecals( new_decals );
+
+	decals_hashtable.clear();
+	for( u32 i = 0; i < num_decals; i++ ) {
+		const DecalAtlasEntry & entry = decal_entries[ i ];
+		const Texture * texture = &textures[ entry.texture_idx ];
+		decals_hashtable.add( entry.material_hash, i );
+		decal_uvwhs[ i ].x = entry.x * decal_atlas.cell_size / float( DECAL_ATLAS_SIZE ) + entry.layer;
+		decal_uvwhs[ i ].y = entry.y * decal_atlas.cell_size / float( DECAL_ATLAS_SIZE );
+		decal_uvwhs[ i ].z = texture->width / float( DECAL_ATLAS_SIZE );
+		decal_uvwhs[ i ].w = texture->height / float( DECAL_ATLAS_SIZE );
 	}
-	num_blocks *= num_layers;
+}
 
-	Span< BC4Block > blocks = ALLOC_SPAN( sys_allocator, BC4Block, num_blocks );
-	memset( blocks.ptr, 0, blocks.num_bytes() );
-	defer { FREE( sys_allocator, blocks.ptr ); };
+static void HotloadMaterials( Span< const char * > paths ) {
+	TracyZoneScoped;
 
-	Span< BC4Block > cursor = blocks;
+	bool changes = false;
 
-	for( u32 mipmap_idx = 0; mipmap_idx < num_mipmaps; mipmap_idx++ ) {
-		u32 mipmap_dim = DECAL_ATLAS_BLOCK_SIZE >> mipmap_idx;
-		u32 mipmap_blocks = mipmap_dim * mipmap_dim * num_layers;
-		Span< BC4Block > layer_mipmap = cursor.slice( 0, mipmap_blocks );
-		cursor += mipmap_blocks;
+	for( const char * path : paths ) {
+		Span< const char > ext = FileExtension( path );
 
-		for( u32 i = 0; i < num_decals; i++ ) {
-			const Material * material = &materials[ rects[ i ].id ];
-			u64 decal_idx;
-			bool ok = decals_hashtable.get( material->hash, &decal_idx );
-			assert( ok );
+		if( ext == ".png" || ext == ".jpg" ) {
+			Span< const u8 > data = AssetBinary( path );
+
+			int w, h, channels;
+			u8 * pixels;
+			{
+				TracyZoneScopedN( "stbi_load_from_memory" );
+				TracyZoneText( path, strlen( path ) );
+				pixels = stbi_load_from_memory( data.ptr, data.num_bytes(), &w, &h, &channels, 0 );
+			}
 
-			u32 layer_idx = u32( decal_uvwhs[ decal_idx ].x );
-			Span2D< BC4Block > layer( layer_mipmap + mipmap_dim * mipmap_dim * layer_idx, mipmap_dim, mipmap_dim );
+			LoadSTBTexture( path, pixels, w, h, channels, stbi_failure_reason() );
 
-			Span2D< const BC4Block > bc4 = GetMipmap( material, mipmap_idx );
+			changes = true;
+		}
 
-			u32 mipped_x = rects[ i ].x >> mipmap_idx;
-			u32 mipped_y = rects[ i ].y >> mipmap_idx;
-			assert( mipped_x % 4 == 0 && mipped_y % 4 == 0 );
-			CopySpan2D( layer.slice( mipped_x / 4, mipped_y / 4, bc4.w, bc4.h ), bc4 );
+		if( ext == ".dds" ) {
+			LoadDDSTexture( path );
+			changes = true;
 		}
 	}
 
-	// free temporary bc4s
-	for( u32 i = 0; i < num_decals; i++ ) {
-		const Material * material = &materials[ rects[ i ].id ];
-		if( material->texture->format != TextureFormat_RGBA_U8_sRGB )
-			continue;
-
-		u64 texture_idx = material->texture - textures;
-		FREE( sys_allocator, const_cast< BC4Block * >( texture_bc4_data[ texture_idx ].ptr ) );
-		texture_bc4_data[ texture_idx ] = Span< const BC4Block >();
+	for( const char * path : paths ) {
+		if( FileExtension( path ) == ".shader" && FileName( path ) != "editor.shader" ) {
+			LoadMaterialFile( path );
+			changes = true;
+		}
 	}
 
-	// upload atlases
-	{
-		TracyZoneScopedN( "Upload atlas" );
-
-		DeleteTextureArray( decals_atlases );
-
-		TextureArrayConfig config;
-		config.width = DECAL_ATLAS_SIZE;
-		config.height = DECAL_ATLAS_SIZE;
-		config.num_mipmaps = num_mipmaps;
-		config.layers = num_layers;
-		config.data = blocks.ptr;
-		config.format = TextureFormat_BC4;
-
-		decals_atlases = NewTextureArray( config );
+	if( changes ) {
+		UpdateDecalAtlas();
 	}
 }
 
@@ -821,47 +1091,30 @@ void InitMaterials() {
 	{
 		TracyZoneScopedN( "Load disk textures" );
 
-		DynamicArray< DecodeSTBTextureJob > jobs( sys_allocator );
-		{
-			TracyZoneScopedN( "Build job list" );
-
-			for( const char * path : AssetPaths() ) {
-				Span< const char > ext = FileExtension( path );
-
-				if( StartsWith( path, "textures/editor" ) ) {
-					continue;
-				}
-
-				if( ext == ".png" || ext == ".jpg" ) {
-					DecodeSTBTextureJob job;
-					job.in.path = path;
-					job.in.data = AssetBinary( path );
-
-					jobs.add( job );
-				}
+		if( !textures_decoded ) {
+			BuildDecodeTextureJobs();
+			ParallelFor( decode_texture_jobs.span(), DecodeSTBTexture );
+		}
 
-				if( ext == ".dds" ) {
-					LoadDDSTexture( path );
-				}
+		DynamicArray< const char * > dds_paths( sys_allocator );
+		for( const char * path : AssetPaths() ) {
+			if( FileExtension( path ) == ".dds" && !StartsWith( path, "textures/editor" ) ) {
+				dds_paths.add( path );
 			}
-
-			std::sort( jobs.begin(), jobs.end(), []( const DecodeSTBTextureJob & a, const DecodeSTBTextureJob & b ) {
-				return a.in.data.n > b.in.data.n;
-			} );
 		}
 
-		ParallelFor( jobs.span(), []( TempAllocator * temp, void * data ) {
-			DecodeSTBTextureJob * job = ( DecodeSTBTextureJob * ) data;
+		PrefetchAssets( dds_paths.span() );
 
-			TracyZoneScopedN( "stbi_load_from_memory" );
-			TracyZoneText( job->in.path, strlen( job->in.path ) );
-
-			job->out.pixels = stbi_load_from_memory( job->in.data.ptr, job->in.data.num_bytes(), &job->out.width, &job->out.height, &job->out.channels, 0 );
-		} );
+		for( const char * path : dds_paths ) {
+			LoadDDSTexture( path );
+		}
 
-		for( DecodeSTBTextureJob job : jobs ) {
+		for( DecodeSTBTextureJob job : decode_texture_jobs ) {
 			LoadSTBTexture( job.in.path, job.out.pixels, job.out.width, job.out.height, job.out.channels, stbi_failure_reason() );
 		}
+
+		decode_texture_jobs.shutdown();
+		textures_decoded = false;
 	}
 
 	{
@@ -880,52 +1133,18 @@ void InitMaterials() {
 	missing_material = Material();
 	missing_material.texture = &missing_texture;
 
-	PackDecalAtlas();
-}
-
-void HotloadMaterials() {
-	TracyZoneScoped;
-
-	bool changes = false;
-
-	for( const char * path : ModifiedAssetPaths() ) {
-		Span< const char > ext = FileExtension( path );
-
-		if( ext == ".png" || ext == ".jpg" ) {
-			Span< const u8 > data = AssetBinary( path );
-
-			int w, h, channels;
-			u8 * pixels;
-			{
-				TracyZoneScopedN( "stbi_load_from_memory" );
-				TracyZoneText( path, strlen( path ) );
-				pixels = stbi_load_from_memory( data.ptr, data.num_bytes(), &w, &h, &channels, 0 );
-			}
-
-			LoadSTBTexture( path, pixels, w, h, channels, stbi_failure_reason() );
-
-			changes = true;
-		}
+	decal_atlas.cells.init( sys_allocator );
+	UpdateDecalAtlas();
 
-		if( ext == ".dds" ) {
-			LoadDDSTexture( path );
-			changes = true;
-		}
-	}
-
-	for( const char * path : ModifiedAssetPaths() ) {
-		if( FileExtension( path ) == ".shader" && FileName( path ) != "editor.shader" ) {
-			LoadMaterialFile( path );
-			changes = true;
-		}
-	}
-
-	if( changes ) {
-		PackDecalAtlas();
-	}
+	SubscribeToAssetChanges( "*.png", HotloadMaterials );
+	SubscribeToAssetChanges( "*.jpg", HotloadMaterials );
+	SubscribeToAssetChanges( "*.dds", HotloadMaterials );
+	SubscribeToAssetChanges( "*.shader", HotloadMaterials );
 }
 
 void ShutdownMaterials() {
+	UnsubscribeFromAssetChanges( HotloadMaterials );
+
 	for( u32 i = 0; i < num_textures; i++ ) {
 		UnloadTexture( i );
 	}
@@ -935,7 +1154,10 @@ void ShutdownMaterials() {
 	}
 
 	DeleteTexture( missing_texture );
-	DeleteTextureArray( decals_atlases );
+	DeleteTextureArray( decal_atlas.texture );
+	decal_atlas.texture = { };
+	decal_atlas.cells.shutdown();
+	num_decals = 0;
 }
 
 bool TryFindMaterial( StringHash name, const Material ** material ) {
@@ -966,7 +1188,7 @@ bool TryFindDecal( StringHash name, Vec4 * uvwh ) {
 }
 
 TextureArray DecalAtlasTextureArray() {
-	return decals_atlases;
+	return decal_atlas.texture;
 }
 
 Vec2 HalfPixelSize( const Material * material ) {
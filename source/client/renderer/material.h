@@ -67,8 +67,10 @@ extern Material wallbang_material;
 bool CompressedTextureFormat( TextureFormat format );
 u32 BitsPerPixel( TextureFormat format );
 
+struct StartupTask;
+void DecodeMaterialTextures( StartupTask * task );
+
 void InitMaterials();
-void HotloadMaterials();
 void ShutdownMaterials();
 
 const Material * FindMaterial( StringHash name, const Material * def = NULL );
@@ -1,9 +1,17 @@
+#include <algorithm> // std::sort
+#include <xmmintrin.h>
+
 #include "qcommon/base.h"
 #include "qcommon/qcommon.h"
+#include "qcommon/array.h"
 #include "qcommon/hashtable.h"
 #include "client/assets.h"
+#include "client/client.h"
+#include "client/startup.h"
+#include "client/threadpool.h"
 #include "client/renderer/renderer.h"
 #include "client/renderer/model.h"
+#include "client/renderer/null_gl.h"
 
 #include "cgame/cg_particles.h"
 #include "cgame/cg_dynamics.h"
@@ -14,15 +22,13 @@ static Model gltf_models[ MAX_MODELS ];
 static u32 num_gltf_models;
 static Hashtable< MAX_MODELS * 2 > gltf_models_hashtable;
 
-constexpr u32 MAX_INSTANCES = 1024;
 constexpr u32 MAX_INSTANCE_GROUPS = 128;
+constexpr u32 INSTANCE_BUFFER_SIZE = 4 * 1024 * 1024; // 4MB
 
 template< typename T >
 struct ModelInstanceGroup {
-	T instances[ MAX_INSTANCES ];
-	u32 num_instances;
+	NonRAIIDynamicArray< T > instances;
 	PipelineState pipeline;
-	GPUBuffer instance_data;
 	const Model * model;
 	const Model::Primitive * primitive;
 };
@@ -39,16 +45,42 @@ static ModelInstanceCollection< GPUModelShadowsInstance > model_shadows_instance
 static ModelInstanceCollection< GPUModelOutlinesInstance > model_outlines_instance_collection;
 static ModelInstanceCollection< GPUModelSilhouetteInstance > model_silhouette_instance_collection;
 
-static void LoadGLTF( const char * path ) {
-	Span< const char > ext = FileExtension( path );
-	if( ext != ".glb" )
+// every group from every collection gets packed into this each frame
+static StreamingBuffer instance_stream;
+static s64 last_instance_overflow_warning;
+
+struct DecodeModelJob {
+	struct {
+		const char * path;
+		Span< const u8 > glb;
+	} in;
+
+	struct {
+		bool ok;
+		DecodedGLTFModel decoded;
+		u64 decode_time;
+	} out;
+};
+
+static void DecodeModel( TempAllocator * temp, void * data ) {
+	DecodeModelJob * job = ( DecodeModelJob * ) data;
+
+	TracyZoneScopedN( "Decode model" );
+	TracyZoneText( job->in.path, strlen( job->in.path ) );
+
+	u64 start_time = Sys_Microseconds();
+	job->out.ok = DecodeGLTFModel( temp, &job->out.decoded, job->in.path, job->in.glb );
+	job->out.decode_time = Sys_Microseconds() - start_time;
+}
+
+static void AddModel( DecodeModelJob * job ) {
+	if( !job->out.ok )
 		return;
 
 	Model model;
-	if( !LoadGLTFModel( &model, path ) )
-		return;
+	UploadGLTFModel( &model, &job->out.decoded, job->in.path );
 
-	u64 hash = Hash64( StripExtension( path ) );
+	u64 hash = Hash64( StripExtension( job->in.path ) );
 
 	u64 idx = num_gltf_models;
 	if( !gltf_models_hashtable.get( hash, &idx ) ) {
@@ -63,19 +95,89 @@ static void LoadGLTF( const char * path ) {
 	gltf_models[ idx ] = model;
 }
 
+static NonRAIIDynamicArray< DecodeModelJob > decode_model_jobs;
+static bool models_decoded;
+
+static void BuildDecodeModelJobs() {
+	TracyZoneScopedN( "Build job list" );
+
+	decode_model_jobs.init( sys_allocator );
+
+	for( const char * path : AssetPaths() ) {
+		if( FileExtension( path ) == ".glb" ) {
+			DecodeModelJob job;
+			job.in.path = path;
+			job.in.glb = AssetBinary( path );
+
+			decode_model_jobs.add( job );
+		}
+	}
+
+	std::sort( decode_model_jobs.begin(), decode_model_jobs.end(), []( const DecodeModelJob & a, const DecodeModelJob & b ) {
+		return a.in.glb.n > b.in.glb.n;
+	} );
+}
+
+void DecodeModels( StartupTask * task ) {
+	BuildDecodeModelJobs();
+	StartupTaskParallelFor( task, decode_model_jobs.span(), DecodeModel );
+	models_decoded = true;
+}
+
 void InitModelInstances();
 void ShutdownModelInstances();
 
+static void HotloadModels( Span< const char * > paths ) {
+	TracyZoneScoped;
+
+	for( const char * path : paths ) {
+		DecodeModelJob job;
+		job.in.path = path;
+		job.in.glb = AssetBinary( path );
+
+		TempAllocator temp = cls.frame_arena.temp();
+		DecodeModel( &temp, &job );
+
+		AddModel( &job );
+	}
+}
+
 void InitModels() {
 	TracyZoneScoped;
 
 	num_gltf_models = 0;
 
-	for( const char * path : AssetPaths() ) {
-		LoadGLTF( path );
+	if( !models_decoded ) {
+		BuildDecodeModelJobs();
+		ParallelFor( decode_model_jobs.span(), DecodeModel );
 	}
 
+	u32 num_cached = 0;
+	size_t gpu_bytes = 0;
+	size_t unquantized_bytes = 0;
+	u64 decode_time = 0;
+
+	for( DecodeModelJob & job : decode_model_jobs ) {
+		AddModel( &job );
+
+		if( !job.out.ok )
+			continue;
+
+		num_cached += job.out.decoded.cached ? 1 : 0;
+		gpu_bytes += job.out.decoded.gpu_bytes;
+		unquantized_bytes += job.out.decoded.unquantized_bytes;
+		decode_time += job.out.decode_time;
+	}
+
+	Com_GGPrint( "Loaded {} models ({} from the decode cache) using {.2}MB of vertex data instead of {.2}MB, decoding took {.2}ms of CPU time",
+		num_gltf_models, num_cached, gpu_bytes / 1024.0 / 1024.0, unquantized_bytes / 1024.0 / 1024.0, decode_time / 1000.0 );
+
+	decode_model_jobs.shutdown();
+	models_decoded = false;
+
 	InitModelInstances();
+
+	SubscribeToAssetChanges( "*.glb", HotloadModels );
 }
 
 void DeleteModel( Model * model ) {
@@ -102,15 +204,9 @@ void DeleteModel( Model * model ) {
 	FREE( sys_allocator, model->animations );
 }
 
-void HotloadModels() {
-	TracyZoneScoped;
-
-	for( const char * path : ModifiedAssetPaths() ) {
-		LoadGLTF( path );
-	}
-}
-
 void ShutdownModels() {
+	UnsubscribeFromAssetChanges( HotloadModels );
+
 	for( u32 i = 0; i < num_gltf_models; i++ ) {
 		DeleteModel( &gltf_models[ i ] );
 	}
@@ -140,13 +236,13 @@ void DrawModelPrimitive( const Model * model, const Model::Primitive * primitive
 	}
 }
 
-static void DrawModelPrimitiveInstanced( const Model * model, const Model::Primitive * primitive, const PipelineState & pipeline, GPUBuffer instance_data, u32 num_instances, InstanceType instance_type ) {
+static void DrawModelPrimitiveInstanced( const Model * model, const Model::Primitive * primitive, const PipelineState & pipeline, GPUBuffer instance_data, u32 num_instances, u32 base_instance, InstanceType instance_type ) {
 	if( primitive->num_vertices != 0 ) {
 		u32 index_size = model->mesh.indices_format == IndexFormat_U16 ? sizeof( u16 ) : sizeof( u32 );
-		DrawInstancedMesh( model->mesh, pipeline, instance_data, num_instances, instance_type, primitive->num_vertices, primitive->first_index * index_size );
+		DrawInstancedMesh( model->mesh, pipeline, instance_data, num_instances, instance_type, primitive->num_vertices, primitive->first_index * index_size, base_instance );
 	}
 	else {
-		DrawInstancedMesh( primitive->mesh, pipeline, instance_data, num_instances, instance_type );
+		DrawInstancedMesh( primitive->mesh, pipeline, instance_data, num_instances, instance_type, 0, 0, base_instance );
 	}
 }
 
@@ -162,8 +258,7 @@ static void AddInstanceToCollection( ModelInstanceCollection< T > & collection,
 		collection.num_groups++;
 	}
 
-	assert( collection.groups[ idx ].num_instances < ARRAY_COUNT( collection.groups[ idx ].instances ) );
-	collection.groups[ idx ].instances[ collection.groups[ idx ].num_instances++ ] = instance;
+	collection.groups[ idx ].instances.add( instance );
 }
 
 static void DrawModelNode( DrawModelConfig::DrawModel config, const Model * model, const Model::Primitive * primitive, bool skinned, PipelineState pipeline, u64 hash, Mat4 & transform, GPUMaterial gpu_material ) {
@@ -190,7 +285,7 @@ static void DrawModelNode( DrawModelConfig::DrawModel config, const Model * mode
 	AddInstanceToCollection( model_instance_collection, model, primitive, pipeline, instance, hash );
 }
 
-static void DrawShadowsNode( DrawModelConfig::DrawShadows config, const Model * model, const Model::Primitive * primitive, bool skinned, PipelineState pipeline, u64 hash, Mat4 & transform ) {
+static void DrawShadowsNode( DrawModelConfig::DrawShadows config, u32 cascades, const Model * model, const Model::Primitive * primitive, bool skinned, PipelineState pipeline, u64 hash, Mat4 & transform ) {
 	if( !config.enabled )
 		return;
 
@@ -200,6 +295,9 @@ static void DrawShadowsNode( DrawModelConfig::DrawShadows config, const Model *
 	pipeline.write_depth = true;
 
 	for( u32 i = 0; i < frame_static.shadow_parameters.entity_cascades; i++ ) {
+		if( ( cascades & ( 1u << i ) ) == 0 )
+			continue;
+
 		pipeline.pass = frame_static.shadowmap_pass[ i ];
 		pipeline.set_uniform( "u_View", frame_static.shadowmap_view_uniforms[ i ] );
 
@@ -292,10 +390,64 @@ static void DrawVfxNode( DrawModelConfig::DrawModel config, const Model::Node *
 	}
 }
 
+static bool ModelBoundingSphere( const Model * model, const Mat4 & transform, Vec3 * centre, float * radius ) {
+	if( model->bounds.mins.x > model->bounds.maxs.x )
+		return false;
+
+	Mat4 M = transform * model->transform;
+	Vec3 local_centre = ( model->bounds.mins + model->bounds.maxs ) * 0.5f;
+	float scale = Max2( Max2( Length( M.col0.xyz() ), Length( M.col1.xyz() ) ), Length( M.col2.xyz() ) );
+
+	*centre = ( M * Vec4( local_centre, 1.0f ) ).xyz();
+	*radius = Length( model->bounds.maxs - model->bounds.mins ) * 0.5f * scale;
+
+	return true;
+}
+
+// returns a bitmask of the entity shadow cascades the model touches, and
+// turns off the passes that only draw to the main view if it's offscreen
+static u32 CullModel( DrawModelConfig * config, const Model * model, const Mat4 & transform ) {
+	u32 all_cascades = ( 1u << frame_static.shadow_parameters.entity_cascades ) - 1;
+
+	// animated models are tested with their bind pose bounds. the sphere
+	// around the box is loose enough that the animations stay inside it
+	Vec3 centre;
+	float radius;
+	if( !ModelBoundingSphere( model, transform, &centre, &radius ) )
+		return all_cascades;
+
+	if( !SphereInFrustum( frame_static.frustum, centre, radius ) ) {
+		config->draw_model.enabled = false;
+		config->draw_outlines.enabled = false;
+		config->draw_silhouette.enabled = false;
+	}
+
+	u32 cascades = 0;
+	if( config->draw_shadows.enabled ) {
+		for( u32 i = 0; i < frame_static.shadow_parameters.entity_cascades; i++ ) {
+			if( SphereInFrustum( frame_static.shadow_frusta[ i ], centre, radius ) ) {
+				cascades |= 1u << i;
+			}
+		}
+	}
+
+	if( cascades == 0 ) {
+		config->draw_shadows.enabled = false;
+	}
+
+	return cascades;
+}
+
 void DrawModel( DrawModelConfig config, const Model * model, const Mat4 & transform, const Vec4 & color, MatrixPalettes palettes ) {
 	if( model == NULL )
 		return;
 
+	// vfx nodes spawn lights and decals that can reach into the view even
+	// when the model itself is offscreen, so they don't get culled
+	DrawModelConfig::DrawModel vfx_config = config.draw_model;
+	u32 shadow_cascades = CullModel( &config, model, transform );
+	bool visible = config.draw_model.enabled || config.draw_shadows.enabled || config.draw_outlines.enabled || config.draw_silhouette.enabled;
+
 	bool animated = palettes.node_transforms.ptr != NULL;
 
 	// TODO: this should be figured out during model loading
@@ -308,7 +460,7 @@ void DrawModel( DrawModelConfig config, const Model * model, const Mat4 & transf
 	}
 
 	UniformBlock pose_uniforms = { };
-	if( any_skinned && animated ) {
+	if( any_skinned && animated && visible ) {
 		pose_uniforms = UploadUniforms( palettes.skinning_matrices.ptr, palettes.skinning_matrices.num_bytes() );
 	}
 
@@ -324,7 +476,7 @@ void DrawModel( DrawModelConfig config, const Model * model, const Mat4 & transf
 
 	for( u8 i = 0; i < model->num_nodes; i++ ) {
 		const Model::Node * node = &model->nodes[ i ];
-		if( node->primitive == U8_MAX && node->vfx_type == ModelVfxType_Generic )
+		if( ( node->primitive == U8_MAX || !visible ) && node->vfx_type == ModelVfxType_Generic )
 			continue;
 
 		bool skinned = animated && node->skinned;
@@ -341,9 +493,9 @@ void DrawModel( DrawModelConfig config, const Model * model, const Mat4 & transf
 		}
 		node_transform = transform * model->transform * node_transform;
 
-		DrawVfxNode( config.draw_model, node, node_transform );
+		DrawVfxNode( vfx_config, node, node_transform );
 
-		if( node->primitive == U8_MAX )
+		if( node->primitive == U8_MAX || !visible )
 			continue;
 
 		const Model::Primitive * primitive = &model->primitives[ node->primitive ];
@@ -361,45 +513,81 @@ void DrawModel( DrawModelConfig config, const Model * model, const Mat4 & transf
 		hash = Hash64( &primitive, sizeof( primitive ), hash );
 
 		DrawModelNode( config.draw_model, model, primitive, skinned, pipeline, hash, node_transform, gpu_material );
-		DrawShadowsNode( config.draw_shadows, model, primitive, skinned, pipeline, hash, node_transform );
+		DrawShadowsNode( config.draw_shadows, shadow_cascades, model, primitive, skinned, pipeline, hash, node_transform );
 		DrawOutlinesNode( config.draw_outlines, model, primitive, skinned, pipeline, outline_uniforms, hash, node_transform );
 		DrawSilhouetteNode( config.draw_silhouette, model, primitive, skinned, pipeline, silhouette_uniforms, hash, node_transform );
 	}
 }
 
+template< typename T >
+static void InitModelInstanceCollection( ModelInstanceCollection< T > & collection ) {
+	for( ModelInstanceGroup< T > & group : collection.groups ) {
+		group.instances.init( sys_allocator );
+	}
+	collection.num_groups = 0;
+}
+
+template< typename T >
+static void ShutdownModelInstanceCollection( ModelInstanceCollection< T > & collection ) {
+	for( ModelInstanceGroup< T > & group : collection.groups ) {
+		group.instances.shutdown();
+	}
+}
+
 void InitModelInstances() {
 	TracyZoneScoped;
-	for( u32 i = 0; i < MAX_INSTANCE_GROUPS; i++ ) {
-		model_instance_collection.groups[ i ].instance_data = NewGPUBuffer( sizeof( GPUModelInstance ) * MAX_INSTANCES );
-		model_instance_collection.num_groups = 0;
 
-		model_shadows_instance_collection.groups[ i ].instance_data = NewGPUBuffer( sizeof( GPUModelShadowsInstance ) * MAX_INSTANCES );
-		model_shadows_instance_collection.num_groups = 0;
+	InitModelInstanceCollection( model_instance_collection );
+	InitModelInstanceCollection( model_shadows_instance_collection );
+	InitModelInstanceCollection( model_outlines_instance_collection );
+	InitModelInstanceCollection( model_silhouette_instance_collection );
 
-		model_outlines_instance_collection.groups[ i ].instance_data = NewGPUBuffer( sizeof( GPUModelOutlinesInstance ) * MAX_INSTANCES );
-		model_outlines_instance_collection.num_groups = 0;
-
-		model_silhouette_instance_collection.groups[ i ].instance_data = NewGPUBuffer( sizeof( GPUModelSilhouetteInstance ) * MAX_INSTANCES );
-		model_silhouette_instance_collection.num_groups = 0;
-	}
+	instance_stream = NewStreamingBuffer( INSTANCE_BUFFER_SIZE, "Model instances" );
 }
 
 void ShutdownModelInstances() {
-	for( u32 i = 0; i < MAX_INSTANCE_GROUPS; i++ ) {
-		DeleteGPUBuffer( model_instance_collection.groups[ i ].instance_data );
-		DeleteGPUBuffer( model_shadows_instance_collection.groups[ i ].instance_data );
-		DeleteGPUBuffer( model_outlines_instance_collection.groups[ i ].instance_data );
-		DeleteGPUBuffer( model_silhouette_instance_collection.groups[ i ].instance_data );
-	}
+	ShutdownModelInstanceCollection( model_instance_collection );
+	ShutdownModelInstanceCollection( model_shadows_instance_collection );
+	ShutdownModelInstanceCollection( model_outlines_instance_collection );
+	ShutdownModelInstanceCollection( model_silhouette_instance_collection );
+
+	DeleteStreamingBuffer( instance_stream );
 }
 
+struct InstanceUpload {
+	u8 * mapping;
+	GPUBuffer buffer;
+	u32 cursor;
+
+	u32 num_draws;
+	u32 num_batches;
+	u32 num_dropped;
+};
+
 template< typename T >
-static void DrawModelInstanceCollection( ModelInstanceCollection< T > & collection, InstanceType instance_type ) {
+static void DrawModelInstanceCollection( ModelInstanceCollection< T > & collection, InstanceType instance_type, InstanceUpload * upload ) {
 	for( u32 i = 0; i < collection.num_groups; i++ ) {
 		ModelInstanceGroup< T > & group = collection.groups[ i ];
-		WriteGPUBuffer( group.instance_data, group.instances, sizeof( T ) * group.num_instances );
-		DrawModelPrimitiveInstanced( group.model, group.primitive, group.pipeline, group.instance_data, group.num_instances, instance_type );
-		group.num_instances = 0;
+		u32 num_instances = group.instances.size();
+
+		// instances are addressed with base instance, so round up to a whole T
+		u32 base_instance = ( upload->cursor + sizeof( T ) - 1 ) / sizeof( T );
+		u32 offset = base_instance * sizeof( T );
+		u32 bytes = num_instances * sizeof( T );
+
+		if( offset + bytes <= INSTANCE_BUFFER_SIZE ) {
+			memcpy( upload->mapping + offset, group.instances.ptr(), bytes );
+			DrawModelPrimitiveInstanced( group.model, group.primitive, group.pipeline, upload->buffer, num_instances, base_instance, instance_type );
+
+			upload->cursor = offset + bytes;
+			upload->num_draws += num_instances;
+			upload->num_batches++;
+		}
+		else {
+			upload->num_dropped += num_instances;
+		}
+
+		group.instances.clear();
 	}
 	collection.num_groups = 0;
 	collection.groups_hashtable.clear();
@@ -408,52 +596,224 @@ static void DrawModelInstanceCollection( ModelInstanceCollection< T > & collecti
 void DrawModelInstances() {
 	TracyZoneScoped;
 
-	DrawModelInstanceCollection( model_instance_collection, InstanceType_Model );
-	DrawModelInstanceCollection( model_shadows_instance_collection, InstanceType_ModelShadows );
-	DrawModelInstanceCollection( model_outlines_instance_collection, InstanceType_ModelOutlines );
-	DrawModelInstanceCollection( model_silhouette_instance_collection, InstanceType_ModelSilhouette );
+	StreamingBufferFrame( &instance_stream );
+
+	InstanceUpload upload = { };
+	upload.mapping = GetStreamingBufferMapping( instance_stream );
+	upload.buffer = GetStreamingBufferBuffer( instance_stream );
+
+	DrawModelInstanceCollection( model_instance_collection, InstanceType_Model, &upload );
+	DrawModelInstanceCollection( model_shadows_instance_collection, InstanceType_ModelShadows, &upload );
+	DrawModelInstanceCollection( model_outlines_instance_collection, InstanceType_ModelOutlines, &upload );
+	DrawModelInstanceCollection( model_silhouette_instance_collection, InstanceType_ModelSilhouette, &upload );
+
+	RecordNullGLMappedWrite( upload.cursor );
+
+	TracyCPlot( "Instanced draws", s64( upload.num_draws ) );
+	TracyCPlot( "Instance batches", s64( upload.num_batches ) );
+	TracyCPlot( "Instance buffer utilisation", float( upload.cursor ) / float( INSTANCE_BUFFER_SIZE ) );
+
+	if( upload.num_dropped > 0 && cls.monotonicTime - last_instance_overflow_warning >= 1000 ) {
+		Com_Printf( S_COLOR_YELLOW "Instance buffer is full, dropped %u instances\n", upload.num_dropped );
+		last_instance_overflow_warning = cls.monotonicTime;
+	}
 }
 
-template< typename T, typename F >
-static T SampleAnimationChannel( const Model::AnimationChannel< T > & channel, float t, T def, F lerp ) {
-	if( channel.samples == NULL )
-		return def;
-	if( channel.num_samples == 1 )
-		return channel.samples[ 0 ];
+/*
+ * animation sampling runs in two passes: first find the keyframe pair and
+ * lerp fraction for every channel of every node, writing them out as SoA
+ * arrays, then interpolate 4 nodes at a time with SSE
+ */
 
-	t = Clamp( channel.times[ 0 ], t, channel.times[ channel.num_samples - 1 ] );
+constexpr u32 MAX_ANIMATED_NODES = 256; // Model::num_nodes is a u8
 
-	u32 sample = 0;
-	for( u32 i = 1; i < channel.num_samples; i++ ) {
-		if( channel.times[ i ] >= t ) {
-			sample = i - 1;
-			break;
+template< typename T >
+static bool IsKeyframeBefore( const Model::AnimationChannel< T > & channel, u32 sample, float t ) {
+	return sample + 1 < channel.num_samples && ( sample == 0 || channel.times[ sample ] < t ) && channel.times[ sample + 1 ] >= t;
+}
+
+// returns the sample with times[ sample ] < t <= times[ sample + 1 ]
+template< typename T >
+static u32 FindKeyframe( const Model::AnimationChannel< T > & channel, float t, u16 * cursor ) {
+	if( cursor != NULL ) {
+		if( IsKeyframeBefore( channel, *cursor, t ) )
+			return *cursor;
+		if( IsKeyframeBefore( channel, *cursor + 1, t ) ) {
+			*cursor += 1;
+			return *cursor;
+		}
+	}
+
+	u32 lo = 1;
+	u32 hi = channel.num_samples - 1;
+	while( lo < hi ) {
+		u32 mid = ( lo + hi ) / 2;
+		if( channel.times[ mid ] >= t ) {
+			hi = mid;
+		}
+		else {
+			lo = mid + 1;
 		}
 	}
 
+	u32 sample = lo - 1;
+	if( cursor != NULL && sample <= U16_MAX ) {
+		*cursor = u16( sample );
+	}
+	return sample;
+}
+
+template< typename T >
+static void FindKeyframePair( const Model::AnimationChannel< T > & channel, float t, T def, u16 * cursor, T * from, T * to, float * lerp_frac ) {
+	*lerp_frac = 0.0f;
+
+	if( channel.samples == NULL ) {
+		*from = def;
+		*to = def;
+		return;
+	}
+
+	if( channel.num_samples == 1 ) {
+		*from = channel.samples[ 0 ];
+		*to = channel.samples[ 0 ];
+		return;
+	}
+
+	t = Clamp( channel.times[ 0 ], t, channel.times[ channel.num_samples - 1 ] );
+	u32 sample = FindKeyframe( channel, t, cursor );
+
 	// TODO: cubic
 	if( channel.interpolation == InterpolationMode_Step ) {
-		return channel.samples[ sample ];
+		*from = channel.samples[ sample ];
+		*to = channel.samples[ sample ];
+		return;
 	}
 
-	float lerp_frac = ( t - channel.times[ sample ] ) / ( channel.times[ sample + 1 ] - channel.times[ sample ] );
-	return lerp( channel.samples[ sample ], lerp_frac, channel.samples[ sample + 1 ] );
+	*from = channel.samples[ sample ];
+	*to = channel.samples[ sample + 1 ];
+	*lerp_frac = ( t - channel.times[ sample ] ) / ( channel.times[ sample + 1 ] - channel.times[ sample ] );
+}
+
+struct SoAKeyframes {
+	alignas( 16 ) float rotation_from[ 4 ][ MAX_ANIMATED_NODES ];
+	alignas( 16 ) float rotation_to[ 4 ][ MAX_ANIMATED_NODES ];
+	alignas( 16 ) float rotation_t[ MAX_ANIMATED_NODES ];
+
+	alignas( 16 ) float translation_from[ 3 ][ MAX_ANIMATED_NODES ];
+	alignas( 16 ) float translation_to[ 3 ][ MAX_ANIMATED_NODES ];
+	alignas( 16 ) float translation_t[ MAX_ANIMATED_NODES ];
+
+	alignas( 16 ) float scale_from[ MAX_ANIMATED_NODES ];
+	alignas( 16 ) float scale_to[ MAX_ANIMATED_NODES ];
+	alignas( 16 ) float scale_t[ MAX_ANIMATED_NODES ];
+};
+
+static void GatherKeyframes( SoAKeyframes * soa, u32 i, const Model::Node * node, const Model::NodeAnimation * animation, float t, AnimationCursor * cursor ) {
+	Quaternion rotation_from, rotation_to;
+	FindKeyframePair( animation->rotations, t, node->local_transform.rotation, cursor == NULL ? NULL : &cursor->rotation, &rotation_from, &rotation_to, &soa->rotation_t[ i ] );
+	Vec3 translation_from, translation_to;
+	FindKeyframePair( animation->translations, t, node->local_transform.translation, cursor == NULL ? NULL : &cursor->translation, &translation_from, &translation_to, &soa->translation_t[ i ] );
+	FindKeyframePair( animation->scales, t, node->local_transform.scale, cursor == NULL ? NULL : &cursor->scale, &soa->scale_from[ i ], &soa->scale_to[ i ], &soa->scale_t[ i ] );
+
+	soa->rotation_from[ 0 ][ i ] = rotation_from.x;
+	soa->rotation_from[ 1 ][ i ] = rotation_from.y;
+	soa->rotation_from[ 2 ][ i ] = rotation_from.z;
+	soa->rotation_from[ 3 ][ i ] = rotation_from.w;
+	soa->rotation_to[ 0 ][ i ] = rotation_to.x;
+	soa->rotation_to[ 1 ][ i ] = rotation_to.y;
+	soa->rotation_to[ 2 ][ i ] = rotation_to.z;
+	soa->rotation_to[ 3 ][ i ] = rotation_to.w;
+
+	soa->translation_from[ 0 ][ i ] = translation_from.x;
+	soa->translation_from[ 1 ][ i ] = translation_from.y;
+	soa->translation_from[ 2 ][ i ] = translation_from.z;
+	soa->translation_to[ 0 ][ i ] = translation_to.x;
+	soa->translation_to[ 1 ][ i ] = translation_to.y;
+	soa->translation_to[ 2 ][ i ] = translation_to.z;
+}
+
+static __m128 LerpSSE( __m128 a, __m128 t, __m128 b ) {
+	return _mm_add_ps( _mm_mul_ps( a, _mm_sub_ps( _mm_set1_ps( 1.0f ), t ) ), _mm_mul_ps( b, t ) );
+}
+
+// same as NLerp, 4 quaternions at a time
+static void NLerpSoA( SoAKeyframes * soa, u32 i ) {
+	__m128 ax = _mm_load_ps( &soa->rotation_from[ 0 ][ i ] );
+	__m128 ay = _mm_load_ps( &soa->rotation_from[ 1 ][ i ] );
+	__m128 az = _mm_load_ps( &soa->rotation_from[ 2 ][ i ] );
+	__m128 aw = _mm_load_ps( &soa->rotation_from[ 3 ][ i ] );
+	__m128 bx = _mm_load_ps( &soa->rotation_to[ 0 ][ i ] );
+	__m128 by = _mm_load_ps( &soa->rotation_to[ 1 ][ i ] );
+	__m128 bz = _mm_load_ps( &soa->rotation_to[ 2 ][ i ] );
+	__m128 bw = _mm_load_ps( &soa->rotation_to[ 3 ][ i ] );
+	__m128 t = _mm_load_ps( &soa->rotation_t[ i ] );
+
+	__m128 dot = _mm_add_ps( _mm_add_ps( _mm_mul_ps( ax, bx ), _mm_mul_ps( ay, by ) ), _mm_add_ps( _mm_mul_ps( az, bz ), _mm_mul_ps( aw, bw ) ) );
+	__m128 flip = _mm_and_ps( _mm_cmple_ps( dot, _mm_setzero_ps() ), _mm_set1_ps( -0.0f ) );
+	__m128 rt = _mm_xor_ps( t, flip );
+	__m128 lt = _mm_sub_ps( _mm_set1_ps( 1.0f ), t );
+
+	__m128 x = _mm_add_ps( _mm_mul_ps( ax, lt ), _mm_mul_ps( bx, rt ) );
+	__m128 y = _mm_add_ps( _mm_mul_ps( ay, lt ), _mm_mul_ps( by, rt ) );
+	__m128 z = _mm_add_ps( _mm_mul_ps( az, lt ), _mm_mul_ps( bz, rt ) );
+	__m128 w = _mm_add_ps( _mm_mul_ps( aw, lt ), _mm_mul_ps( bw, rt ) );
+
+	__m128 length_squared = _mm_add_ps( _mm_add_ps( _mm_mul_ps( x, x ), _mm_mul_ps( y, y ) ), _mm_add_ps( _mm_mul_ps( z, z ), _mm_mul_ps( w, w ) ) );
+	__m128 inv_length = _mm_div_ps( _mm_set1_ps( 1.0f ), _mm_sqrt_ps( length_squared ) );
+
+	_mm_store_ps( &soa->rotation_from[ 0 ][ i ], _mm_mul_ps( x, inv_length ) );
+	_mm_store_ps( &soa->rotation_from[ 1 ][ i ], _mm_mul_ps( y, inv_length ) );
+	_mm_store_ps( &soa->rotation_from[ 2 ][ i ], _mm_mul_ps( z, inv_length ) );
+	_mm_store_ps( &soa->rotation_from[ 3 ][ i ], _mm_mul_ps( w, inv_length ) );
 }
 
-// can't use overloaded function as a template parameter
-static Vec3 LerpVec3( Vec3 a, float t, Vec3 b ) { return Lerp( a, t, b ); }
-static float LerpFloat( float a, float t, float b ) { return Lerp( a, t, b ); }
+static void LerpSoA( float * from, const float * to, const float * t, u32 i ) {
+	_mm_store_ps( &from[ i ], LerpSSE( _mm_load_ps( &from[ i ] ), _mm_load_ps( &t[ i ] ), _mm_load_ps( &to[ i ] ) ) );
+}
 
-Span< TRS > SampleAnimation( Allocator * a, const Model * model, float t, u8 animation ) {
+Span< TRS > SampleAnimation( Allocator * a, const Model * model, float t, u8 animation, Span< AnimationCursor > cursors ) {
 	TracyZoneScoped;
 
+	assert( cursors.n == 0 || cursors.n == model->num_nodes );
+
 	Span< TRS > local_poses = ALLOC_SPAN( a, TRS, model->num_nodes );
 
+	SoAKeyframes soa;
 	for( u8 i = 0; i < model->num_nodes; i++ ) {
 		const Model::Node * node = &model->nodes[ i ];
-		local_poses[ i ].rotation = SampleAnimationChannel( node->animations[ animation ].rotations, t, node->local_transform.rotation, NLerp );
-		local_poses[ i ].translation = SampleAnimationChannel( node->animations[ animation ].translations, t, node->local_transform.translation, LerpVec3 );
-		local_poses[ i ].scale = SampleAnimationChannel( node->animations[ animation ].scales, t, node->local_transform.scale, LerpFloat );
+		GatherKeyframes( &soa, i, node, &node->animations[ animation ], t, cursors.n == 0 ? NULL : &cursors[ i ] );
+	}
+
+	// pad out to a multiple of 4 with identity so the last batch doesn't divide by zero
+	u32 num_padded = AlignPow2( u32( model->num_nodes ), u32( 4 ) );
+	for( u32 i = model->num_nodes; i < num_padded; i++ ) {
+		for( int j = 0; j < 4; j++ ) {
+			soa.rotation_from[ j ][ i ] = j == 3 ? 1.0f : 0.0f;
+			soa.rotation_to[ j ][ i ] = j == 3 ? 1.0f : 0.0f;
+		}
+		for( int j = 0; j < 3; j++ ) {
+			soa.translation_from[ j ][ i ] = 0.0f;
+			soa.translation_to[ j ][ i ] = 0.0f;
+		}
+		soa.scale_from[ i ] = 1.0f;
+		soa.scale_to[ i ] = 1.0f;
+		soa.rotation_t[ i ] = 0.0f;
+		soa.translation_t[ i ] = 0.0f;
+		soa.scale_t[ i ] = 0.0f;
+	}
+
+	for( u32 i = 0; i < num_padded; i += 4 ) {
+		NLerpSoA( &soa, i );
+		for( int j = 0; j < 3; j++ ) {
+			LerpSoA( soa.translation_from[ j ], soa.translation_to[ j ], soa.translation_t, i );
+		}
+		LerpSoA( soa.scale_from, soa.scale_to, soa.scale_t, i );
+	}
+
+	for( u8 i = 0; i < model->num_nodes; i++ ) {
+		local_poses[ i ].rotation = Quaternion( soa.rotation_from[ 0 ][ i ], soa.rotation_from[ 1 ][ i ], soa.rotation_from[ 2 ][ i ], soa.rotation_from[ 3 ][ i ] );
+		local_poses[ i ].translation = Vec3( soa.translation_from[ 0 ][ i ], soa.translation_from[ 1 ][ i ], soa.translation_from[ 2 ][ i ] );
+		local_poses[ i ].scale = soa.scale_from[ i ];
 	}
 
 	return local_poses;
@@ -485,31 +845,60 @@ static Mat4 TRSToMat4( const TRS & trs ) {
 	);
 }
 
-MatrixPalettes ComputeMatrixPalettes( Allocator * a, const Model * model, Span< const TRS > local_poses ) {
+static __m128 LoadVec4( const Vec4 & v ) {
+	return _mm_load_ps( &v.x );
+}
+
+static __m128 LinearCombination( const __m128 * cols, const Vec4 & v ) {
+	__m128 xy = _mm_add_ps( _mm_mul_ps( cols[ 0 ], _mm_set1_ps( v.x ) ), _mm_mul_ps( cols[ 1 ], _mm_set1_ps( v.y ) ) );
+	__m128 zw = _mm_add_ps( _mm_mul_ps( cols[ 2 ], _mm_set1_ps( v.z ) ), _mm_mul_ps( cols[ 3 ], _mm_set1_ps( v.w ) ) );
+	return _mm_add_ps( xy, zw );
+}
+
+// Mat4 is column major so each column of the result is a linear combination
+// of lhs's columns, which is 4 broadcasts and 4 madds instead of 16 dot products
+static Mat4 MultiplyMat4SSE( const Mat4 & lhs, const Mat4 & rhs ) {
+	__m128 cols[] = { LoadVec4( lhs.col0 ), LoadVec4( lhs.col1 ), LoadVec4( lhs.col2 ), LoadVec4( lhs.col3 ) };
+
+	Mat4 result;
+	_mm_store_ps( &result.col0.x, LinearCombination( cols, rhs.col0 ) );
+	_mm_store_ps( &result.col1.x, LinearCombination( cols, rhs.col1 ) );
+	_mm_store_ps( &result.col2.x, LinearCombination( cols, rhs.col2 ) );
+	_mm_store_ps( &result.col3.x, LinearCombination( cols, rhs.col3 ) );
+	return result;
+}
+
+void ComputeMatrixPalettes( MatrixPalettes * palettes, const Model * model, Span< const TRS > local_poses ) {
 	TracyZoneScoped;
 
 	assert( local_poses.n == model->num_nodes );
-
-	MatrixPalettes palettes = { };
-	palettes.node_transforms = ALLOC_SPAN( a, Mat4, model->num_nodes );
-	if( model->num_joints != 0 ) {
-		palettes.skinning_matrices = ALLOC_SPAN( a, Mat4, model->num_joints );
-	}
+	assert( palettes->node_transforms.n == model->num_nodes );
+	assert( palettes->skinning_matrices.n == model->num_joints );
 
 	for( u8 i = 0; i < model->num_nodes; i++ ) {
 		u8 parent = model->nodes[ i ].parent;
 		if( parent == U8_MAX ) {
-			palettes.node_transforms[ i ] = TRSToMat4( local_poses[ i ] );
+			palettes->node_transforms[ i ] = TRSToMat4( local_poses[ i ] );
 		}
 		else {
-			palettes.node_transforms[ i ] = palettes.node_transforms[ parent ] * TRSToMat4( local_poses[ i ] );
+			palettes->node_transforms[ i ] = MultiplyMat4SSE( palettes->node_transforms[ parent ], TRSToMat4( local_poses[ i ] ) );
 		}
 	}
 
 	for( u8 i = 0; i < model->num_joints; i++ ) {
 		u8 node_idx = model->skin[ i ].node_idx;
-		palettes.skinning_matrices[ i ] = palettes.node_transforms[ node_idx ] * model->skin[ i ].joint_to_bind;
+		palettes->skinning_matrices[ i ] = MultiplyMat4SSE( palettes->node_transforms[ node_idx ], model->skin[ i ].joint_to_bind );
 	}
+}
+
+MatrixPalettes ComputeMatrixPalettes( Allocator * a, const Model * model, Span< const TRS > local_poses ) {
+	MatrixPalettes palettes = { };
+	palettes.node_transforms = ALLOC_SPAN( a, Mat4, model->num_nodes );
+	if( model->num_joints != 0 ) {
+		palettes.skinning_matrices = ALLOC_SPAN( a, Mat4, model->num_joints );
+	}
+
+	ComputeMatrixPalettes( &palettes, model, local_poses );
 
 	return palettes;
 }
@@ -129,8 +129,10 @@ struct Model {
 	u8 num_animations;
 };
 
+struct StartupTask;
+void DecodeModels( StartupTask * task );
+
 void InitModels();
-void HotloadModels();
 void ShutdownModels();
 
 const Model * FindModel( StringHash name );
@@ -139,7 +141,20 @@ const Model * FindMapModel( StringHash name );
 
 void DeleteModel( Model * model );
 
-bool LoadGLTFModel( Model * model, const char * path );
+// everything that doesn't touch GL, so it can run on the thread pool.
+// geometry holds the quantized vertex streams for each primitive
+struct DecodedGLTFModel {
+	Model model;
+	Span< u8 > geometry;
+	bool cached;
+
+	// filled in by UploadGLTFModel
+	size_t gpu_bytes;
+	size_t unquantized_bytes;
+};
+
+bool DecodeGLTFModel( TempAllocator * temp, DecodedGLTFModel * decoded, const char * path, Span< const u8 > glb );
+void UploadGLTFModel( Model * model, DecodedGLTFModel * decoded, const char * path );
 
 struct Map;
 bool LoadBSPRenderData( const char * filename, Map * map, u64 base_hash, Span< const u8 > data );
@@ -148,7 +163,16 @@ void DeleteBSPRenderData( Map * map );
 void DrawModelPrimitive( const Model * model, const Model::Primitive * primitive, const PipelineState & pipeline );
 void DrawModel( DrawModelConfig config, const Model * model, const Mat4 & transform, const Vec4 & color, MatrixPalettes palettes = MatrixPalettes() );
 
-Span< TRS > SampleAnimation( Allocator * a, const Model * model, float t, u8 animation = 0 );
+// the keyframe each channel sampled last time, so sampling a clip that only
+// moves forward a little each frame doesn't have to search for it again
+struct AnimationCursor {
+	u16 rotation;
+	u16 translation;
+	u16 scale;
+};
+
+Span< TRS > SampleAnimation( Allocator * a, const Model * model, float t, u8 animation = 0, Span< AnimationCursor > cursors = Span< AnimationCursor >() );
 MatrixPalettes ComputeMatrixPalettes( Allocator * a, const Model * model, Span< const TRS > local_poses );
+void ComputeMatrixPalettes( MatrixPalettes * palettes, const Model * model, Span< const TRS > local_poses );
 bool FindNodeByName( const Model * model, u32 name, u8 * idx );
 void MergeLowerUpperPoses( Span< TRS > lower, Span< const TRS > upper, const Model * model, u8 upper_root_joint );
@@ -0,0 +1,575 @@
+#include <ctype.h>
+
+#include "glad/glad.h"
+
+#include "qcommon/base.h"
+#include "qcommon/qcommon.h"
+#include "qcommon/array.h"
+#include "qcommon/string.h"
+#include "client/client.h"
+#include "client/renderer/types.h"
+#include "client/renderer/null_gl.h"
+
+/*
+ * the backend keeps calling the real GL entry points, we just point glad at
+ * functions that log the call and hand back plausible results
+ *
+ * shader reflection is approximate. we scrape sampler/block declarations out
+ * of the GLSL source, which includes ones the real compiler would have culled
+ */
+
+struct NullGLReflection {
+	struct Sampler {
+		char name[ 64 ];
+		GLenum type;
+	};
+
+	Sampler samplers[ ARRAY_COUNT( &Shader::textures ) + ARRAY_COUNT( &Shader::texture_arrays ) ];
+	size_t num_samplers;
+	size_t num_textures;
+	size_t num_texture_arrays;
+
+	char uniform_blocks[ ARRAY_COUNT( &Shader::uniforms ) ][ 64 ];
+	size_t num_uniform_blocks;
+
+	char storage_blocks[ ARRAY_COUNT( &Shader::buffers ) ][ 64 ];
+	size_t num_storage_blocks;
+};
+
+struct NullGLProgram {
+	GLuint id;
+	NullGLReflection reflection;
+};
+
+struct NullGLMapping {
+	GLuint buffer;
+	void * memory;
+};
+
+static NonRAIIDynamicArray< NullGLCommand > command_log;
+static NonRAIIDynamicArray< NullGLProgram > programs; // shaders too
+static NonRAIIDynamicArray< NullGLMapping > mappings;
+static GLuint next_object;
+static u64 next_fence;
+
+static bool recording = false;
+
+static void Record( NullGLCommandType type, const char * function, u64 bytes = 0 ) {
+	NullGLCommand command;
+	command.type = type;
+	command.function = function;
+	command.bytes = bytes;
+	command_log.add( command );
+}
+
+static GLuint NewObject( const char * function ) {
+	Record( NullGLCommand_Resource, function );
+	next_object++;
+	return next_object;
+}
+
+static void NewObjects( const char * function, GLsizei n, GLuint * objects ) {
+	for( GLsizei i = 0; i < n; i++ ) {
+		objects[ i ] = NewObject( function );
+	}
+}
+
+static u64 PixelSize( GLenum format, GLenum type ) {
+	u64 channels = 4;
+	switch( format ) {
+		case GL_RED: channels = 1; break;
+		case GL_RG: channels = 2; break;
+		case GL_RGB: channels = 3; break;
+	}
+
+	u64 channel_size = 1;
+	switch( type ) {
+		case GL_UNSIGNED_SHORT:
+		case GL_HALF_FLOAT:
+			channel_size = 2;
+			break;
+
+		case GL_UNSIGNED_INT:
+		case GL_FLOAT:
+			channel_size = 4;
+			break;
+	}
+
+	return channels * channel_size;
+}
+
+static NullGLProgram * FindProgram( GLuint id ) {
+	for( NullGLProgram & program : programs ) {
+		if( program.id == id ) {
+			return &program;
+		}
+	}
+
+	return NULL;
+}
+
+static void DeleteProgram( GLuint id ) {
+	NullGLProgram * program = FindProgram( id );
+	if( program == NULL )
+		return;
+
+	*program = programs.top();
+	programs.resize( programs.size() - 1 );
+}
+
+static Span< const char > DeclaratorName( Span< const char > token ) {
+	size_t n = 0;
+	while( n < token.n && ( isalnum( u8( token[ n ] ) ) || token[ n ] == '_' ) ) {
+		n++;
+	}
+	return token.slice( 0, n );
+}
+
+static bool AddReflectedName( char ( *names )[ 64 ], size_t capacity, size_t * n, Span< const char > name ) {
+	if( name.n == 0 || name.n >= sizeof( names[ 0 ] ) )
+		return false;
+
+	for( size_t i = 0; i < *n; i++ ) {
+		if( StrEqual( name, names[ i ] ) ) {
+			return false;
+		}
+	}
+
+	if( *n == capacity )
+		return false;
+
+	memcpy( names[ *n ], name.ptr, name.n );
+	names[ *n ][ name.n ] = '\0';
+	*n += 1;
+	return true;
+}
+
+static void AddSampler( NullGLReflection * reflection, Span< const char > name, GLenum type ) {
+	if( name.n == 0 || name.n >= sizeof( reflection->samplers[ 0 ].name ) )
+		return;
+
+	for( size_t i = 0; i < reflection->num_samplers; i++ ) {
+		if( StrEqual( name, reflection->samplers[ i ].name ) ) {
+			return;
+		}
+	}
+
+	// stay within what LinkShader accepts, unused samplers are normally culled by the compiler
+	bool is_array = type == GL_SAMPLER_2D_ARRAY || type == GL_SAMPLER_2D_ARRAY_SHADOW;
+	size_t * count = is_array ? &reflection->num_texture_arrays : &reflection->num_textures;
+	size_t capacity = is_array ? ARRAY_COUNT( &Shader::texture_arrays ) : ARRAY_COUNT( &Shader::textures );
+	if( *count == capacity )
+		return;
+	*count += 1;
+
+	NullGLReflection::Sampler * sampler = &reflection->samplers[ reflection->num_samplers ];
+	memcpy( sampler->name, name.ptr, name.n );
+	sampler->name[ name.n ] = '\0';
+	sampler->type = type;
+	reflection->num_samplers++;
+}
+
+static void ReflectGLSL( NullGLReflection * reflection, Span< const char > src ) {
+	Span< const char > cursor = src;
+
+	while( true ) {
+		Span< const char > token = ParseToken( &cursor, Parse_DontStopOnNewLine );
+		if( token.n == 0 )
+			break;
+
+		if( StrEqual( token, "buffer" ) ) {
+			Span< const char > name = DeclaratorName( ParseToken( &cursor, Parse_DontStopOnNewLine ) );
+			AddReflectedName( reflection->storage_blocks, ARRAY_COUNT( reflection->storage_blocks ), &reflection->num_storage_blocks, name );
+			continue;
+		}
+
+		if( !StrEqual( token, "uniform" ) )
+			continue;
+
+		Span< const char > type = ParseToken( &cursor, Parse_DontStopOnNewLine );
+		if( StrEqual( type, "lowp" ) || StrEqual( type, "mediump" ) || StrEqual( type, "highp" ) ) {
+			type = ParseToken( &cursor, Parse_DontStopOnNewLine );
+		}
+
+		if( StartsWith( type, "sampler" ) ) {
+			GLenum gl_type = GL_SAMPLER_2D;
+			if( StrEqual( type, "sampler2DMS" ) )
+				gl_type = GL_SAMPLER_2D_MULTISAMPLE;
+			else if( StrEqual( type, "sampler2DArray" ) )
+				gl_type = GL_SAMPLER_2D_ARRAY;
+			else if( StrEqual( type, "sampler2DArrayShadow" ) )
+				gl_type = GL_SAMPLER_2D_ARRAY_SHADOW;
+
+			AddSampler( reflection, DeclaratorName( ParseToken( &cursor, Parse_DontStopOnNewLine ) ), gl_type );
+			continue;
+		}
+
+		// uniform blocks look like "uniform u_Name {"
+		Span< const char > name = DeclaratorName( type );
+		bool block = name.n < type.n && type[ name.n ] == '{';
+		if( !block ) {
+			Span< const char > peek = cursor;
+			block = StartsWith( ParseToken( &peek, Parse_DontStopOnNewLine ), "{" );
+		}
+
+		if( block ) {
+			AddReflectedName( reflection->uniform_blocks, ARRAY_COUNT( reflection->uniform_blocks ), &reflection->num_uniform_blocks, name );
+		}
+	}
+}
+
+static void MergeReflection( NullGLReflection * program, const NullGLReflection & shader ) {
+	for( size_t i = 0; i < shader.num_samplers; i++ ) {
+		AddSampler( program, MakeSpan( shader.samplers[ i ].name ), shader.samplers[ i ].type );
+	}
+
+	for( size_t i = 0; i < shader.num_uniform_blocks; i++ ) {
+		AddReflectedName( program->uniform_blocks, ARRAY_COUNT( program->uniform_blocks ), &program->num_uniform_blocks, MakeSpan( shader.uniform_blocks[ i ] ) );
+	}
+
+	for( size_t i = 0; i < shader.num_storage_blocks; i++ ) {
+		AddReflectedName( program->storage_blocks, ARRAY_COUNT( program->storage_blocks ), &program->num_storage_blocks, MakeSpan( shader.storage_blocks[ i ] ) );
+	}
+}
+
+static void CopyGLString( const char * str, GLsizei buf_size, GLsizei * length, GLchar * buf ) {
+	if( buf_size <= 0 )
+		return;
+
+	GLsizei n = Min2( GLsizei( strlen( str ) ), buf_size - 1 );
+	memcpy( buf, str, n );
+	buf[ n ] = '\0';
+	if( length != NULL ) {
+		*length = n;
+	}
+}
+
+static void InstallExtensions() {
+	GLAD_GL_ARB_buffer_storage = 1;
+	GLAD_GL_ARB_clip_control = 1;
+	GLAD_GL_ARB_direct_state_access = 1;
+	GLAD_GL_EXT_direct_state_access = 0; // let DSAHacks forward the EXT entry points to the ARB ones
+	GLAD_GL_EXT_texture_compression_s3tc = 1;
+	GLAD_GL_EXT_texture_filter_anisotropic = 1;
+	GLAD_GL_EXT_texture_sRGB = 1;
+	GLAD_GL_EXT_texture_sRGB_decode = 1;
+	GLAD_GL_NVX_gpu_memory_info = 0;
+}
+
+static void InstallQueries() {
+	glGetIntegerv = []( GLenum pname, GLint * data ) {
+		switch( pname ) {
+			case GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS: *data = 16; break;
+			case GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT: *data = 256; break;
+			case GL_MAX_UNIFORM_BLOCK_SIZE: *data = 64 * 1024; break;
+			default: *data = 0; break;
+		}
+	};
+	glGetFloatv = []( GLenum pname, GLfloat * data ) {
+		*data = pname == GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT ? 16.0f : 0.0f;
+	};
+	glGetInteger64v = []( GLenum pname, GLint64 * data ) { *data = 0; };
+
+	glGenQueries = []( GLsizei n, GLuint * ids ) { NewObjects( "glGenQueries", n, ids ); };
+	glQueryCounter = []( GLuint id, GLenum target ) { };
+	glGetQueryiv = []( GLenum target, GLenum pname, GLint * params ) { *params = pname == GL_QUERY_COUNTER_BITS ? 64 : 0; };
+	glGetQueryObjectiv = []( GLuint id, GLenum pname, GLint * params ) { *params = pname == GL_QUERY_RESULT_AVAILABLE ? GL_TRUE : 0; };
+	glGetQueryObjectui64v = []( GLuint id, GLenum pname, GLuint64 * params ) { *params = 0; };
+
+	glFenceSync = []( GLenum condition, GLbitfield flags ) {
+		Record( NullGLCommand_Resource, "glFenceSync" );
+		next_fence++;
+		return bit_cast< GLsync >( next_fence );
+	};
+	glClientWaitSync = []( GLsync sync, GLbitfield flags, GLuint64 timeout ) -> GLenum { return GL_ALREADY_SIGNALED; };
+	glDeleteSync = []( GLsync sync ) { };
+
+	glObjectLabel = []( GLenum identifier, GLuint name, GLsizei length, const GLchar * label ) { };
+	glPushDebugGroup = []( GLenum source, GLuint id, GLsizei length, const GLchar * message ) { };
+	glPopDebugGroup = []() { };
+	glDebugMessageCallback = []( GLDEBUGPROC callback, const void * user ) { };
+	glDebugMessageControl = []( GLenum source, GLenum type, GLenum severity, GLsizei count, const GLuint * ids, GLboolean enabled ) { };
+}
+
+static void InstallState() {
+	glEnable = []( GLenum cap ) { Record( NullGLCommand_StateChange, "glEnable" ); };
+	glDisable = []( GLenum cap ) { Record( NullGLCommand_StateChange, "glDisable" ); };
+	glBlendFunc = []( GLenum src, GLenum dst ) { Record( NullGLCommand_StateChange, "glBlendFunc" ); };
+	glCullFace = []( GLenum mode ) { Record( NullGLCommand_StateChange, "glCullFace" ); };
+	glDepthFunc = []( GLenum func ) { Record( NullGLCommand_StateChange, "glDepthFunc" ); };
+	glDepthMask = []( GLboolean flag ) { Record( NullGLCommand_StateChange, "glDepthMask" ); };
+	glDepthRange = []( GLdouble n, GLdouble f ) { Record( NullGLCommand_StateChange, "glDepthRange" ); };
+	glPolygonMode = []( GLenum face, GLenum mode ) { Record( NullGLCommand_StateChange, "glPolygonMode" ); };
+	glPolygonOffset = []( GLfloat factor, GLfloat units ) { Record( NullGLCommand_StateChange, "glPolygonOffset" ); };
+	glScissor = []( GLint x, GLint y, GLsizei w, GLsizei h ) { Record( NullGLCommand_StateChange, "glScissor" ); };
+	glViewport = []( GLint x, GLint y, GLsizei w, GLsizei h ) { Record( NullGLCommand_StateChange, "glViewport" ); };
+	glPixelStorei = []( GLenum pname, GLint param ) { Record( NullGLCommand_StateChange, "glPixelStorei" ); };
+	glClearColor = []( GLfloat r, GLfloat g, GLfloat b, GLfloat a ) { Record( NullGLCommand_StateChange, "glClearColor" ); };
+	glClearDepth = []( GLdouble depth ) { Record( NullGLCommand_StateChange, "glClearDepth" ); };
+
+	glUseProgram = []( GLuint program ) { Record( NullGLCommand_StateChange, "glUseProgram" ); };
+	glBindFramebuffer = []( GLenum target, GLuint fbo ) { Record( NullGLCommand_StateChange, "glBindFramebuffer" ); };
+	glBindVertexArray = []( GLuint vao ) { Record( NullGLCommand_StateChange, "glBindVertexArray" ); };
+	glBindBuffer = []( GLenum target, GLuint buffer ) { Record( NullGLCommand_StateChange, "glBindBuffer" ); };
+	glBindBufferBase = []( GLenum target, GLuint index, GLuint buffer ) { Record( NullGLCommand_StateChange, "glBindBufferBase" ); };
+	glBindBufferRange = []( GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size ) { Record( NullGLCommand_StateChange, "glBindBufferRange" ); };
+	glBindTexture = []( GLenum target, GLuint texture ) { Record( NullGLCommand_StateChange, "glBindTexture" ); };
+	glBindTextureUnit = []( GLuint unit, GLuint texture ) { Record( NullGLCommand_StateChange, "glBindTextureUnit" ); };
+	glVertexAttribDivisor = []( GLuint index, GLuint divisor ) { Record( NullGLCommand_StateChange, "glVertexAttribDivisor" ); };
+	glBeginTransformFeedback = []( GLenum primitive ) { Record( NullGLCommand_StateChange, "glBeginTransformFeedback" ); };
+	glEndTransformFeedback = []() { Record( NullGLCommand_StateChange, "glEndTransformFeedback" ); };
+
+	glClear = []( GLbitfield mask ) { Record( NullGLCommand_ClearOrBlit, "glClear" ); };
+	glBlitFramebuffer = []( GLint sx0, GLint sy0, GLint sx1, GLint sy1, GLint dx0, GLint dy0, GLint dx1, GLint dy1, GLbitfield mask, GLenum filter ) {
+		Record( NullGLCommand_ClearOrBlit, "glBlitFramebuffer" );
+	};
+	glBlitNamedFramebuffer = []( GLuint src, GLuint dst, GLint sx0, GLint sy0, GLint sx1, GLint sy1, GLint dx0, GLint dy0, GLint dx1, GLint dy1, GLbitfield mask, GLenum filter ) {
+		Record( NullGLCommand_ClearOrBlit, "glBlitNamedFramebuffer" );
+	};
+
+	glDrawArrays = []( GLenum mode, GLint first, GLsizei count ) { Record( NullGLCommand_Draw, "glDrawArrays" ); };
+	glDrawElements = []( GLenum mode, GLsizei count, GLenum type, const void * indices ) { Record( NullGLCommand_Draw, "glDrawElements" ); };
+	glDrawElementsInstanced = []( GLenum mode, GLsizei count, GLenum type, const void * indices, GLsizei instances ) { Record( NullGLCommand_Draw, "glDrawElementsInstanced" ); };
+	glDrawElementsInstancedBaseInstance = []( GLenum mode, GLsizei count, GLenum type, const void * indices, GLsizei instances, GLuint base_instance ) { Record( NullGLCommand_Draw, "glDrawElementsInstancedBaseInstance" ); };
+	glDispatchCompute = []( GLuint x, GLuint y, GLuint z ) { Record( NullGLCommand_Dispatch, "glDispatchCompute" ); };
+
+	glReadPixels = []( GLint x, GLint y, GLsizei w, GLsizei h, GLenum format, GLenum type, void * pixels ) {
+		memset( pixels, 0, w * h * PixelSize( format, type ) );
+	};
+}
+
+static void InstallBuffers() {
+	glGenBuffers = []( GLsizei n, GLuint * buffers ) { NewObjects( "glGenBuffers", n, buffers ); };
+	glCreateBuffers = []( GLsizei n, GLuint * buffers ) { NewObjects( "glCreateBuffers", n, buffers ); };
+	glDeleteBuffers = []( GLsizei n, const GLuint * buffers ) { Record( NullGLCommand_Resource, "glDeleteBuffers" ); };
+
+	glNamedBufferStorage = []( GLuint buffer, GLsizeiptr size, const void * data, GLbitfield flags ) {
+		Record( data != NULL ? NullGLCommand_Upload : NullGLCommand_Resource, "glNamedBufferStorage", data != NULL ? size : 0 );
+	};
+	glNamedBufferSubData = []( GLuint buffer, GLintptr offset, GLsizeiptr size, const void * data ) {
+		Record( NullGLCommand_Upload, "glNamedBufferSubData", size );
+	};
+	glGetNamedBufferSubData = []( GLuint buffer, GLintptr offset, GLsizeiptr size, void * data ) {
+		memset( data, 0, size );
+	};
+
+	glMapNamedBufferRange = []( GLuint buffer, GLintptr offset, GLsizeiptr length, GLbitfield access ) {
+		NullGLMapping mapping;
+		mapping.buffer = buffer;
+		mapping.memory = ALLOC_SIZE( sys_allocator, length, 16 );
+		mappings.add( mapping );
+		return mapping.memory;
+	};
+	glUnmapNamedBuffer = []( GLuint buffer ) -> GLboolean {
+		for( NullGLMapping & mapping : mappings ) {
+			if( mapping.buffer == buffer ) {
+				FREE( sys_allocator, mapping.memory );
+				mapping = mappings.top();
+				mappings.resize( mappings.size() - 1 );
+				break;
+			}
+		}
+		return GL_TRUE;
+	};
+
+	glCreateVertexArrays = []( GLsizei n, GLuint * vaos ) { NewObjects( "glCreateVertexArrays", n, vaos ); };
+	glGenVertexArrays = []( GLsizei n, GLuint * vaos ) { NewObjects( "glGenVertexArrays", n, vaos ); };
+	glDeleteVertexArrays = []( GLsizei n, const GLuint * vaos ) { Record( NullGLCommand_Resource, "glDeleteVertexArrays" ); };
+	glVertexArrayElementBuffer = []( GLuint vao, GLuint buffer ) { Record( NullGLCommand_Resource, "glVertexArrayElementBuffer" ); };
+	glEnableVertexArrayAttrib = []( GLuint vao, GLuint index ) { Record( NullGLCommand_Resource, "glEnableVertexArrayAttrib" ); };
+	glVertexArrayVertexBuffer = []( GLuint vao, GLuint binding, GLuint buffer, GLintptr offset, GLsizei stride ) { Record( NullGLCommand_Resource, "glVertexArrayVertexBuffer" ); };
+	glVertexArrayAttribFormat = []( GLuint vao, GLuint index, GLint size, GLenum type, GLboolean normalized, GLuint offset ) { Record( NullGLCommand_Resource, "glVertexArrayAttribFormat" ); };
+	glVertexArrayAttribIFormat = []( GLuint vao, GLuint index, GLint size, GLenum type, GLuint offset ) { Record( NullGLCommand_Resource, "glVertexArrayAttribIFormat" ); };
+}
+
+static void InstallTextures() {
+	glGenTextures = []( GLsizei n, GLuint * textures ) { NewObjects( "glGenTextures", n, textures ); };
+	glCreateTextures = []( GLenum target, GLsizei n, GLuint * textures ) { NewObjects( "glCreateTextures", n, textures ); };
+	glDeleteTextures = []( GLsizei n, const GLuint * textures ) { Record( NullGLCommand_Resource, "glDeleteTextures" ); };
+
+	glTextureStorage2D = []( GLuint tex, GLsizei mips, GLenum format, GLsizei w, GLsizei h ) { Record( NullGLCommand_Resource, "glTextureStorage2D" ); };
+	glTextureStorage3D = []( GLuint tex, GLsizei mips, GLenum format, GLsizei w, GLsizei h, GLsizei d ) { Record( NullGLCommand_Resource, "glTextureStorage3D" ); };
+	glTextureStorage2DMultisample = []( GLuint tex, GLsizei samples, GLenum format, GLsizei w, GLsizei h, GLboolean fixed_sample_locations ) {
+		Record( NullGLCommand_Resource, "glTextureStorage2DMultisample" );
+	};
+	glTextureParameterf = []( GLuint tex, GLenum pname, GLfloat param ) { Record( NullGLCommand_Resource, "glTextureParameterf" ); };
+	glTextureParameterfv = []( GLuint tex, GLenum pname, const GLfloat * params ) { Record( NullGLCommand_Resource, "glTextureParameterfv" ); };
+	glTextureParameteri = []( GLuint tex, GLenum pname, GLint param ) { Record( NullGLCommand_Resource, "glTextureParameteri" ); };
+
+	glTextureSubImage2D = []( GLuint tex, GLint mip, GLint x, GLint y, GLsizei w, GLsizei h, GLenum format, GLenum type, const void * data ) {
+		Record( NullGLCommand_Upload, "glTextureSubImage2D", u64( w ) * u64( h ) * PixelSize( format, type ) );
+	};
+	glTextureSubImage3DEXT = []( GLuint tex, GLenum target, GLint mip, GLint x, GLint y, GLint z, GLsizei w, GLsizei h, GLsizei d, GLenum format, GLenum type, const void * data ) {
+		Record( NullGLCommand_Upload, "glTextureSubImage3DEXT", u64( w ) * u64( h ) * u64( d ) * PixelSize( format, type ) );
+	};
+	glCompressedTextureSubImage2D = []( GLuint tex, GLint mip, GLint x, GLint y, GLsizei w, GLsizei h, GLenum format, GLsizei n, const void * data ) {
+		Record( NullGLCommand_Upload, "glCompressedTextureSubImage2D", n );
+	};
+	glCompressedTextureSubImage3D = []( GLuint tex, GLint mip, GLint x, GLint y, GLint z, GLsizei w, GLsizei h, GLsizei d, GLenum format, GLsizei n, const void * data ) {
+		Record( NullGLCommand_Upload, "glCompressedTextureSubImage3D", n );
+	};
+
+	glGenFramebuffers = []( GLsizei n, GLuint * fbos ) { NewObjects( "glGenFramebuffers", n, fbos ); };
+	glCreateFramebuffers = []( GLsizei n, GLuint * fbos ) { NewObjects( "glCreateFramebuffers", n, fbos ); };
+	glDeleteFramebuffers = []( GLsizei n, const GLuint * fbos ) { Record( NullGLCommand_Resource, "glDeleteFramebuffers" ); };
+	glNamedFramebufferTexture = []( GLuint fbo, GLenum attachment, GLuint texture, GLint mip ) { Record( NullGLCommand_Resource, "glNamedFramebufferTexture" ); };
+	glNamedFramebufferTextureLayer = []( GLuint fbo, GLenum attachment, GLuint texture, GLint mip, GLint layer ) { Record( NullGLCommand_Resource, "glNamedFramebufferTextureLayer" ); };
+	glNamedFramebufferDrawBuffers = []( GLuint fbo, GLsizei n, const GLenum * bufs ) { Record( NullGLCommand_Resource, "glNamedFramebufferDrawBuffers" ); };
+	glCheckNamedFramebufferStatus = []( GLuint fbo, GLenum target ) -> GLenum { return GL_FRAMEBUFFER_COMPLETE; };
+}
+
+static void InstallShaders() {
+	glCreateShader = []( GLenum type ) {
+		GLuint id = NewObject( "glCreateShader" );
+		NullGLProgram * shader = programs.add();
+		*shader = { };
+		shader->id = id;
+		return id;
+	};
+	glShaderSource = []( GLuint id, GLsizei count, const GLchar * const * strings, const GLint * lengths ) {
+		Record( NullGLCommand_Resource, "glShaderSource" );
+
+		NullGLProgram * shader = FindProgram( id );
+		if( shader == NULL )
+			return;
+
+		// keep tokens from running across source fragments
+		TempAllocator temp = cls.frame_arena.temp();
+		DynamicString src( &temp );
+		for( GLsizei i = 0; i < count; i++ ) {
+			size_t len = lengths == NULL || lengths[ i ] < 0 ? strlen( strings[ i ] ) : size_t( lengths[ i ] );
+			src.append_raw( strings[ i ], len );
+			src += "\n";
+		}
+
+		ReflectGLSL( &shader->reflection, src.span() );
+	};
+	glCompileShader = []( GLuint id ) { Record( NullGLCommand_Resource, "glCompileShader" ); };
+	glGetShaderiv = []( GLuint id, GLenum pname, GLint * params ) { *params = pname == GL_COMPILE_STATUS ? GL_TRUE : 0; };
+	glGetShaderInfoLog = []( GLuint id, GLsizei buf_size, GLsizei * length, GLchar * log ) { CopyGLString( "", buf_size, length, log ); };
+	glGetShaderSource = []( GLuint id, GLsizei buf_size, GLsizei * length, GLchar * src ) { CopyGLString( "", buf_size, length, src ); };
+	glDeleteShader = []( GLuint id ) {
+		Record( NullGLCommand_Resource, "glDeleteShader" );
+		DeleteProgram( id );
+	};
+
+	glCreateProgram = []() {
+		GLuint id = NewObject( "glCreateProgram" );
+		NullGLProgram * program = programs.add();
+		*program = { };
+		program->id = id;
+		return id;
+	};
+	glAttachShader = []( GLuint program_id, GLuint shader_id ) {
+		Record( NullGLCommand_Resource, "glAttachShader" );
+		NullGLProgram * program = FindProgram( program_id );
+		NullGLProgram * shader = FindProgram( shader_id );
+		if( program != NULL && shader != NULL ) {
+			MergeReflection( &program->reflection, shader->reflection );
+		}
+	};
+	glBindAttribLocation = []( GLuint program, GLuint index, const GLchar * name ) { };
+	glBindFragDataLocation = []( GLuint program, GLuint color, const GLchar * name ) { };
+	glTransformFeedbackVaryings = []( GLuint program, GLsizei count, const GLchar * const * varyings, GLenum mode ) { };
+	glLinkProgram = []( GLuint id ) { Record( NullGLCommand_Resource, "glLinkProgram" ); };
+	glDeleteProgram = []( GLuint id ) {
+		Record( NullGLCommand_Resource, "glDeleteProgram" );
+		DeleteProgram( id );
+	};
+
+	glGetProgramiv = []( GLuint id, GLenum pname, GLint * params ) {
+		const NullGLProgram * program = FindProgram( id );
+		switch( pname ) {
+			case GL_LINK_STATUS: *params = GL_TRUE; break;
+			case GL_ACTIVE_UNIFORMS: *params = program == NULL ? 0 : GLint( program->reflection.num_samplers ); break;
+			default: *params = 0; break;
+		}
+	};
+	glGetProgramInfoLog = []( GLuint id, GLsizei buf_size, GLsizei * length, GLchar * log ) { CopyGLString( "", buf_size, length, log ); };
+	glGetActiveUniform = []( GLuint id, GLuint index, GLsizei buf_size, GLsizei * length, GLint * size, GLenum * type, GLchar * name ) {
+		const NullGLReflection::Sampler & sampler = FindProgram( id )->reflection.samplers[ index ];
+		CopyGLString( sampler.name, buf_size, length, name );
+		*size = 1;
+		*type = sampler.type;
+	};
+	glGetUniformLocation = []( GLuint id, const GLchar * name ) -> GLint { return 0; };
+	glProgramUniform1i = []( GLuint id, GLint location, GLint value ) { Record( NullGLCommand_Resource, "glProgramUniform1i" ); };
+
+	glGetProgramInterfaceiv = []( GLuint id, GLenum iface, GLenum pname, GLint * params ) {
+		const NullGLProgram * program = FindProgram( id );
+		*params = 0;
+		if( program != NULL && pname == GL_ACTIVE_RESOURCES ) {
+			if( iface == GL_UNIFORM_BLOCK )
+				*params = GLint( program->reflection.num_uniform_blocks );
+			else if( iface == GL_SHADER_STORAGE_BLOCK )
+				*params = GLint( program->reflection.num_storage_blocks );
+		}
+	};
+	glGetProgramResourceName = []( GLuint id, GLenum iface, GLuint index, GLsizei buf_size, GLsizei * length, GLchar * name ) {
+		const NullGLReflection & reflection = FindProgram( id )->reflection;
+		const char * resource = iface == GL_UNIFORM_BLOCK ? reflection.uniform_blocks[ index ] : reflection.storage_blocks[ index ];
+		CopyGLString( resource, buf_size, length, name );
+	};
+	glUniformBlockBinding = []( GLuint id, GLuint index, GLuint binding ) { Record( NullGLCommand_Resource, "glUniformBlockBinding" ); };
+	glShaderStorageBlockBinding = []( GLuint id, GLuint index, GLuint binding ) { Record( NullGLCommand_Resource, "glShaderStorageBlockBinding" ); };
+}
+
+void InitNullGL() {
+	TracyZoneScoped;
+
+	command_log.init( sys_allocator );
+	programs.init( sys_allocator );
+	mappings.init( sys_allocator );
+	next_object = 0;
+	next_fence = 0;
+
+	InstallExtensions();
+	InstallQueries();
+	InstallState();
+	InstallBuffers();
+	InstallTextures();
+	InstallShaders();
+
+	recording = true;
+}
+
+void ShutdownNullGL() {
+	for( NullGLMapping mapping : mappings ) {
+		FREE( sys_allocator, mapping.memory );
+	}
+
+	command_log.shutdown();
+	programs.shutdown();
+	mappings.shutdown();
+
+	recording = false;
+}
+
+void RecordNullGLMappedWrite( u64 bytes ) {
+	if( recording ) {
+		Record( NullGLCommand_Upload, "memcpy", bytes );
+	}
+}
+
+Span< const NullGLCommand > NullGLCommandLog() {
+	return command_log.span();
+}
+
+NullGLFrameStats NullGLEndFrame() {
+	NullGLFrameStats stats = { };
+
+	for( const NullGLCommand & command : command_log ) {
+		switch( command.type ) {
+			case NullGLCommand_Draw: stats.draw_calls++; break;
+			case NullGLCommand_Dispatch: stats.dispatches++; break;
+			case NullGLCommand_StateChange: stats.state_changes++; break;
+			case NullGLCommand_ClearOrBlit: stats.clears_and_blits++; break;
+			case NullGLCommand_Upload: stats.uploaded_bytes += command.bytes; break;
+			case NullGLCommand_Resource: break;
+		}
+	}
+
+	command_log.clear();
+
+	return stats;
+}
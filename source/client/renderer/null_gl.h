@@ -0,0 +1,40 @@
+#pragma once
+
+#include "qcommon/types.h"
+
+/*
+ * a GL "driver" that records what the backend asks for instead of talking to
+ * a GPU, so the CPU side of the renderer can be benchmarked headless
+ */
+
+enum NullGLCommandType : u8 {
+	NullGLCommand_Draw,
+	NullGLCommand_Dispatch,
+	NullGLCommand_StateChange,
+	NullGLCommand_Upload,
+	NullGLCommand_ClearOrBlit,
+	NullGLCommand_Resource,
+};
+
+struct NullGLCommand {
+	NullGLCommandType type;
+	const char * function;
+	u64 bytes;
+};
+
+struct NullGLFrameStats {
+	u32 draw_calls;
+	u32 dispatches;
+	u32 state_changes;
+	u32 clears_and_blits;
+	u64 uploaded_bytes;
+};
+
+void InitNullGL();
+void ShutdownNullGL();
+
+// for writes the GL can't see, i.e. memcpys into persistently mapped buffers
+void RecordNullGLMappedWrite( u64 bytes );
+
+Span< const NullGLCommand > NullGLCommandLog();
+NullGLFrameStats NullGLEndFrame();
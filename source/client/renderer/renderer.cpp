@@ -394,12 +394,6 @@ struct SourceLocationData {
 #endif
 
 void RendererBeginFrame( u32 viewport_width, u32 viewport_height ) {
-	HotloadShaders();
-	HotloadMaterials();
-	HotloadModels();
-	HotloadMaps();
-	HotloadVisualEffects();
-
 	ClearMaterialStaticUniforms();
 
 	RenderBackendBeginFrame();
@@ -585,6 +579,9 @@ void SetupShadowCascades() {
 			shadow_projection.col3.y += rounded_offset.y;
 		}
 
+		// no near plane because shadow casters get depth clamped instead of clipped
+		frame_static.shadow_frusta[ i ] = FrustumFromMatrix( shadow_projection * shadow_view, false, true );
+
 		frame_static.shadowmap_view_uniforms[ i ] = UploadViewUniforms( shadow_view, Mat4::Identity(), shadow_projection, Mat4::Identity(), shadow_camera_position, Vec2(), cascade_dist[ i ], 0, frame_static.light_direction );
 
 		Mat4 inv_shadow_view = InvertViewMatrix( shadow_view, shadow_camera_position );
@@ -619,6 +616,7 @@ void RendererSetView( Vec3 position, EulerDegrees3 angles, float vertical_fov )
 	frame_static.position = position;
 	frame_static.vertical_fov = vertical_fov;
 	frame_static.near_plane = near_plane;
+	frame_static.frustum = FrustumFromMatrix( frame_static.P * frame_static.V, true, false );
 
 	frame_static.light_direction = Normalize( Vec3( 1.0f, 2.0f, -3.0f ) );
 	// frame_static.light_direction.x = cosf( float( cls.monotonicTime ) * 0.0001f ) * 2.0f;
@@ -2,6 +2,7 @@
 
 #include "qcommon/types.h"
 #include "client/renderer/backend.h"
+#include "client/renderer/culling.h"
 #include "client/renderer/material.h"
 #include "client/renderer/model.h"
 #include "client/renderer/shader.h"
@@ -51,6 +52,9 @@ struct FrameStatic {
 	float vertical_fov;
 	float near_plane;
 
+	Frustum frustum;
+	Frustum shadow_frusta[ 4 ];
+
 	Framebuffer silhouette_gbuffer;
 	Framebuffer msaa_fb;
 	Framebuffer postprocess_fb;
@@ -3,6 +3,7 @@
 #include "qcommon/array.h"
 #include "client/client.h"
 #include "client/assets.h"
+#include "client/startup.h"
 #include "client/renderer/renderer.h"
 
 Shaders shaders;
@@ -54,60 +55,65 @@ static Span< Span< const char > > BuildShaderSrcs( TempAllocator * temp, const c
 	return srcs.span();
 }
 
-static void LoadShader( Shader * shader, const char * path, const char * defines = NULL, Span< const char * > feedback_varyings = Span< const char * >(), bool particle_vertex_attribs = false ) {
+static void LoadShader( TempAllocator * temp, Shader * shader, const char * path, const char * defines = NULL, Span< const char * > feedback_varyings = Span< const char * >(), bool particle_vertex_attribs = false ) {
 	TracyZoneScoped;
 
-	TempAllocator temp = cls.frame_arena.temp();
-	Span< Span< const char > > srcs = BuildShaderSrcs( &temp, path, defines );
+	Span< Span< const char > > srcs = BuildShaderSrcs( temp, path, defines );
 
 	Shader new_shader;
-	if( !NewShader( &new_shader, srcs, feedback_varyings, particle_vertex_attribs ) )
+	if( !NewShader( temp, &new_shader, srcs, feedback_varyings, particle_vertex_attribs ) )
 		return;
 
 	DeleteShader( *shader );
 	*shader = new_shader;
 }
 
-static void LoadShaders() {
+static void LoadShaders( TempAllocator * temp ) {
 	TracyZoneScoped;
 
-	TempAllocator temp = cls.frame_arena.temp();
+	u64 start_time = Sys_Microseconds();
 
 	// standard
-	LoadShader( &shaders.standard, "glsl/standard.glsl" );
-	LoadShader( &shaders.standard_vertexcolors, "glsl/standard.glsl", "#define VERTEX_COLORS 1\n" );
-	LoadShader( &shaders.standard_skinned, "glsl/standard.glsl", "#define SKINNED 1\n" );
-	LoadShader( &shaders.standard_skinned_vertexcolors, "glsl/standard.glsl", "#define SKINNED 1\n#define VERTEX_COLORS 1\n" );
+	LoadShader( temp, &shaders.standard, "glsl/standard.glsl" );
+	LoadShader( temp, &shaders.standard_vertexcolors, "glsl/standard.glsl", "#define VERTEX_COLORS 1\n" );
+	LoadShader( temp, &shaders.standard_skinned, "glsl/standard.glsl", "#define SKINNED 1\n" );
+	LoadShader( temp, &shaders.standard_skinned_vertexcolors, "glsl/standard.glsl", "#define SKINNED 1\n#define VERTEX_COLORS 1\n" );
 
-	const char * standard_shaded_defines = temp(
+	const char * standard_shaded_defines = ( *temp )(
 		"#define APPLY_DLIGHTS 1\n"
 		"#define SHADED 1\n"
 		"#define TILE_SIZE {}\n"
-		"#define DLIGHT_CUTOFF {}\n", TILE_SIZE, DLIGHT_CUTOFF );
-	LoadShader( &shaders.standard_shaded, "glsl/standard.glsl", standard_shaded_defines );
+		"#define CLUSTER_DEPTH_SLICES {}\n"
+		"#define CLUSTER_FAR_PLANE {}\n"
+		"#define DLIGHT_CUTOFF {}\n", TILE_SIZE, CLUSTER_DEPTH_SLICES, CLUSTER_FAR_PLANE, DLIGHT_CUTOFF );
+	LoadShader( temp, &shaders.standard_shaded, "glsl/standard.glsl", standard_shaded_defines );
 
-	const char * standard_skinned_shaded_defines = temp(
+	const char * standard_skinned_shaded_defines = ( *temp )(
 		"#define SKINNED 1\n"
 		"#define APPLY_DLIGHTS 1\n"
 		"#define SHADED 1\n"
 		"#define TILE_SIZE {}\n"
-		"#define DLIGHT_CUTOFF {}\n", TILE_SIZE, DLIGHT_CUTOFF );
-	LoadShader( &shaders.standard_skinned_shaded, "glsl/standard.glsl", standard_skinned_shaded_defines );
+		"#define CLUSTER_DEPTH_SLICES {}\n"
+		"#define CLUSTER_FAR_PLANE {}\n"
+		"#define DLIGHT_CUTOFF {}\n", TILE_SIZE, CLUSTER_DEPTH_SLICES, CLUSTER_FAR_PLANE, DLIGHT_CUTOFF );
+	LoadShader( temp, &shaders.standard_skinned_shaded, "glsl/standard.glsl", standard_skinned_shaded_defines );
 
 	// standard instanced
-	LoadShader( &shaders.standard_instanced, "glsl/standard.glsl", "#define INSTANCED 1\n" );
-	LoadShader( &shaders.standard_vertexcolors_instanced, "glsl/standard.glsl", "#define VERTEX_COLORS 1\n" );
+	LoadShader( temp, &shaders.standard_instanced, "glsl/standard.glsl", "#define INSTANCED 1\n" );
+	LoadShader( temp, &shaders.standard_vertexcolors_instanced, "glsl/standard.glsl", "#define VERTEX_COLORS 1\n" );
 
-	const char * standard_shaded_instanced_defines = temp(
+	const char * standard_shaded_instanced_defines = ( *temp )(
 		"#define INSTANCED 1\n"
 		"#define APPLY_DLIGHTS 1\n"
 		"#define SHADED 1\n"
 		"#define TILE_SIZE {}\n"
-		"#define DLIGHT_CUTOFF {}\n", TILE_SIZE, DLIGHT_CUTOFF );
-	LoadShader( &shaders.standard_shaded_instanced, "glsl/standard.glsl", standard_shaded_instanced_defines );
+		"#define CLUSTER_DEPTH_SLICES {}\n"
+		"#define CLUSTER_FAR_PLANE {}\n"
+		"#define DLIGHT_CUTOFF {}\n", TILE_SIZE, CLUSTER_DEPTH_SLICES, CLUSTER_FAR_PLANE, DLIGHT_CUTOFF );
+	LoadShader( temp, &shaders.standard_shaded_instanced, "glsl/standard.glsl", standard_shaded_instanced_defines );
 
 	// rest
-	const char * world_defines = temp(
+	const char * world_defines = ( *temp )(
 		"#define APPLY_DRAWFLAT 1\n"
 		"#define APPLY_FOG 1\n"
 		"#define APPLY_DECALS 1\n"
@@ -115,30 +121,32 @@ static void LoadShaders() {
 		"#define APPLY_SHADOWS 1\n"
 		"#define SHADED 1\n"
 		"#define TILE_SIZE {}\n"
-		"#define DLIGHT_CUTOFF {}\n", TILE_SIZE, DLIGHT_CUTOFF );
-	LoadShader( &shaders.world, "glsl/standard.glsl", world_defines );
+		"#define CLUSTER_DEPTH_SLICES {}\n"
+		"#define CLUSTER_FAR_PLANE {}\n"
+		"#define DLIGHT_CUTOFF {}\n", TILE_SIZE, CLUSTER_DEPTH_SLICES, CLUSTER_FAR_PLANE, DLIGHT_CUTOFF );
+	LoadShader( temp, &shaders.world, "glsl/standard.glsl", world_defines );
 
-	LoadShader( &shaders.depth_only, "glsl/depth_only.glsl" );
-	LoadShader( &shaders.depth_only_instanced, "glsl/depth_only.glsl", "#define INSTANCED 1\n" );
-	LoadShader( &shaders.depth_only_skinned, "glsl/depth_only.glsl", "#define SKINNED 1\n" );
+	LoadShader( temp, &shaders.depth_only, "glsl/depth_only.glsl" );
+	LoadShader( temp, &shaders.depth_only_instanced, "glsl/depth_only.glsl", "#define INSTANCED 1\n" );
+	LoadShader( temp, &shaders.depth_only_skinned, "glsl/depth_only.glsl", "#define SKINNED 1\n" );
 
-	LoadShader( &shaders.postprocess_world_gbuffer, "glsl/postprocess_world_gbuffer.glsl" );
-	LoadShader( &shaders.postprocess_world_gbuffer_msaa, "glsl/postprocess_world_gbuffer.glsl", "#define MSAA 1\n" );
+	LoadShader( temp, &shaders.postprocess_world_gbuffer, "glsl/postprocess_world_gbuffer.glsl" );
+	LoadShader( temp, &shaders.postprocess_world_gbuffer_msaa, "glsl/postprocess_world_gbuffer.glsl", "#define MSAA 1\n" );
 
-	LoadShader( &shaders.write_silhouette_gbuffer, "glsl/write_silhouette_gbuffer.glsl" );
-	LoadShader( &shaders.write_silhouette_gbuffer_instanced, "glsl/write_silhouette_gbuffer.glsl", "#define INSTANCED 1\n" );
-	LoadShader( &shaders.write_silhouette_gbuffer_skinned, "glsl/write_silhouette_gbuffer.glsl", "#define SKINNED 1\n" );
-	LoadShader( &shaders.postprocess_silhouette_gbuffer, "glsl/postprocess_silhouette_gbuffer.glsl" );
+	LoadShader( temp, &shaders.write_silhouette_gbuffer, "glsl/write_silhouette_gbuffer.glsl" );
+	LoadShader( temp, &shaders.write_silhouette_gbuffer_instanced, "glsl/write_silhouette_gbuffer.glsl", "#define INSTANCED 1\n" );
+	LoadShader( temp, &shaders.write_silhouette_gbuffer_skinned, "glsl/write_silhouette_gbuffer.glsl", "#define SKINNED 1\n" );
+	LoadShader( temp, &shaders.postprocess_silhouette_gbuffer, "glsl/postprocess_silhouette_gbuffer.glsl" );
 
-	LoadShader( &shaders.outline, "glsl/outline.glsl" );
-	LoadShader( &shaders.outline_instanced, "glsl/outline.glsl", "#define INSTANCED 1\n" );
-	LoadShader( &shaders.outline_skinned, "glsl/outline.glsl", "#define SKINNED 1\n" );
+	LoadShader( temp, &shaders.outline, "glsl/outline.glsl" );
+	LoadShader( temp, &shaders.outline_instanced, "glsl/outline.glsl", "#define INSTANCED 1\n" );
+	LoadShader( temp, &shaders.outline_skinned, "glsl/outline.glsl", "#define SKINNED 1\n" );
 
-	LoadShader( &shaders.scope, "glsl/scope.glsl" );
-	LoadShader( &shaders.skybox, "glsl/skybox.glsl" );
-	LoadShader( &shaders.text, "glsl/text.glsl" );
-	LoadShader( &shaders.blur, "glsl/blur.glsl" );
-	LoadShader( &shaders.postprocess, "glsl/postprocess.glsl" );
+	LoadShader( temp, &shaders.scope, "glsl/scope.glsl" );
+	LoadShader( temp, &shaders.skybox, "glsl/skybox.glsl" );
+	LoadShader( temp, &shaders.text, "glsl/text.glsl" );
+	LoadShader( temp, &shaders.blur, "glsl/blur.glsl" );
+	LoadShader( temp, &shaders.postprocess, "glsl/postprocess.glsl" );
 
 	const char * update_no_feedback[] = {
 		"v_ParticlePosition",
@@ -151,7 +159,7 @@ static void LoadShaders() {
 		"v_ParticleAgeLifetime",
 		"v_ParticleFlags",
 	};
-	LoadShader( &shaders.particle_update, "glsl/particle_update.glsl", NULL, Span< const char *>( update_no_feedback, ARRAY_COUNT( update_no_feedback ) ), true );
+	LoadShader( temp, &shaders.particle_update, "glsl/particle_update.glsl", NULL, Span< const char *>( update_no_feedback, ARRAY_COUNT( update_no_feedback ) ), true );
 
 	const char * update_feedback[] = {
 		"v_ParticlePosition",
@@ -167,31 +175,55 @@ static void LoadShaders() {
 		"v_FeedbackPositionNormal",
 		"v_FeedbackColorParm",
 	};
-	LoadShader( &shaders.particle_update_feedback, "glsl/particle_update.glsl", "#define FEEDBACK 1\n", Span< const char *>( update_feedback, ARRAY_COUNT( update_feedback ) ), true );
+	LoadShader( temp, &shaders.particle_update_feedback, "glsl/particle_update.glsl", "#define FEEDBACK 1\n", Span< const char *>( update_feedback, ARRAY_COUNT( update_feedback ) ), true );
+
+	LoadShader( temp, &shaders.particle, "glsl/particle.glsl", NULL, Span< const char * >(), true );
+	LoadShader( temp, &shaders.particle_model, "glsl/particle.glsl", "#define MODEL 1\n", Span< const char * >(), true );
 
-	LoadShader( &shaders.particle, "glsl/particle.glsl", NULL, Span< const char * >(), true );
-	LoadShader( &shaders.particle_model, "glsl/particle.glsl", "#define MODEL 1\n", Span< const char * >(), true );
+	Com_GGPrint( "Loading shaders took {.2}ms", ( Sys_Microseconds() - start_time ) / 1000.0 );
 }
 
-void InitShaders() {
-	shaders = { };
-	LoadShaders();
+static bool shaders_loaded;
+
+static void HotloadShaders( Span< const char * > paths ) {
+	TempAllocator temp = cls.frame_arena.temp();
+	LoadShaders( &temp );
 }
 
-void HotloadShaders() {
-	bool need_hotload = false;
-	for( const char * path : ModifiedAssetPaths() ) {
-		if( FileExtension( path ) == ".glsl" ) {
-			need_hotload = true;
-			break;
-		}
-	}
+// runs on the loader context so the driver can compile while the rest of
+// startup carries on
+void CompileShaders( StartupTask * task ) {
+	InitProgramBinaryCache();
 
-	if( need_hotload ) {
-		LoadShaders();
+	StartupTaskDo( task, []( TempAllocator * temp, void * data ) {
+		if( !MakeLoaderContextCurrent() )
+			return;
+
+		shaders = { };
+		LoadShaders( temp );
+		shaders_loaded = true;
+
+		ReleaseLoaderContext();
+	} );
+}
+
+void InitShaders() {
+	if( !shaders_loaded ) {
+		InitProgramBinaryCache();
+
+		TempAllocator temp = cls.frame_arena.temp();
+		shaders = { };
+		LoadShaders( &temp );
 	}
+
+	shaders_loaded = false;
+	DestroyLoaderContext();
+
+	SubscribeToAssetChanges( "*.glsl", HotloadShaders );
 }
 
 void ShutdownShaders() {
+	UnsubscribeFromAssetChanges( HotloadShaders );
+
 	DeleteShader( shaders.text );
 }
@@ -49,6 +49,8 @@ struct Shaders {
 
 extern Shaders shaders;
 
+struct StartupTask;
+void CompileShaders( StartupTask * task );
+
 void InitShaders();
-void HotloadShaders();
 void ShutdownShaders();
@@ -8,6 +8,9 @@ struct ImmediateSoundHandle {
 
 extern Cvar * s_device;
 
+struct StartupTask;
+void DecodeSounds( StartupTask * task );
+
 bool S_Init();
 void S_Shutdown();
 
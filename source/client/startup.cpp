@@ -0,0 +1,239 @@
+#include "qcommon/base.h"
+#include "qcommon/qcommon.h"
+#include "qcommon/string.h"
+#include "qcommon/threads.h"
+#include "client/assets.h"
+#include "client/startup.h"
+
+struct StartupTask {
+	StartupTaskConfig config;
+
+	u32 dependencies[ ARRAY_COUNT( &StartupTaskConfig::dependencies ) ];
+	u32 num_dependencies;
+
+	bool kicked;
+	bool finished;
+	u32 jobs_pending;
+
+	u64 kick_time;
+	u64 cpu_done_time;
+	u64 finish_time;
+};
+
+struct StartupJob {
+	StartupTask * task;
+	JobCallback callback;
+	void * data;
+};
+
+static constexpr u32 MAX_STARTUP_TASKS = 32;
+
+static StartupTask tasks[ MAX_STARTUP_TASKS ];
+static u32 num_tasks;
+
+static Mutex * startup_mutex;
+static Semaphore * startup_sem;
+
+void AddStartupTask( const StartupTaskConfig & config ) {
+	assert( num_tasks < ARRAY_COUNT( tasks ) );
+
+	StartupTask * task = &tasks[ num_tasks ];
+	*task = { };
+	task->config = config;
+	num_tasks++;
+}
+
+static void RunStartupJob( TempAllocator * temp, void * data ) {
+	StartupJob * job = ( StartupJob * ) data;
+	StartupTask * task = job->task;
+
+	{
+		TracyZoneScopedN( "Startup job" );
+		TracyZoneText( task->config.name, strlen( task->config.name ) );
+		job->callback( temp, job->data );
+	}
+
+	FREE( sys_allocator, job );
+
+	Lock( startup_mutex );
+	task->jobs_pending--;
+	if( task->jobs_pending == 0 ) {
+		task->cpu_done_time = Sys_Microseconds();
+	}
+	Unlock( startup_mutex );
+
+	Signal( startup_sem );
+}
+
+void StartupTaskDo( StartupTask * task, JobCallback callback, void * data ) {
+	StartupJob * job = ALLOC( sys_allocator, StartupJob );
+	job->task = task;
+	job->callback = callback;
+	job->data = data;
+
+	Lock( startup_mutex );
+	task->jobs_pending++;
+	Unlock( startup_mutex );
+
+	ThreadPoolDo( RunStartupJob, job );
+}
+
+void StartupTaskParallelFor( StartupTask * task, void * datum, size_t n, size_t stride, JobCallback callback ) {
+	for( size_t i = 0; i < n; i++ ) {
+		StartupTaskDo( task, callback, ( ( char * ) datum ) + stride * i );
+	}
+}
+
+static void PrefetchAsset( TempAllocator * temp, void * data ) {
+	AssetBinary( ( const char * ) data );
+}
+
+static void KickStartupTask( StartupTask * task ) {
+	TracyZoneScopedN( "Kick startup task" );
+	TracyZoneText( task->config.name, strlen( task->config.name ) );
+
+	task->kicked = true;
+	task->kick_time = Sys_Microseconds();
+	task->cpu_done_time = task->kick_time;
+
+	// hold a job open so the task can't look finished while we're still kicking
+	Lock( startup_mutex );
+	task->jobs_pending++;
+	Unlock( startup_mutex );
+
+	for( const char * ext : task->config.asset_extensions ) {
+		if( ext == NULL )
+			continue;
+
+		for( const char * path : AssetPaths() ) {
+			if( StrEqual( FileExtension( path ), ext ) ) {
+				StartupTaskDo( task, PrefetchAsset, const_cast< char * >( path ) );
+			}
+		}
+	}
+
+	if( task->config.kick != NULL ) {
+		task->config.kick( task );
+	}
+
+	Lock( startup_mutex );
+	task->jobs_pending--;
+	if( task->jobs_pending == 0 ) {
+		task->cpu_done_time = Sys_Microseconds();
+	}
+	Unlock( startup_mutex );
+}
+
+static bool DependenciesFinished( const StartupTask * task ) {
+	for( u32 i = 0; i < task->num_dependencies; i++ ) {
+		if( !tasks[ task->dependencies[ i ] ].finished ) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void ResolveDependencies() {
+	for( u32 i = 0; i < num_tasks; i++ ) {
+		StartupTask * task = &tasks[ i ];
+		for( const char * dependency : task->config.dependencies ) {
+			if( dependency == NULL )
+				continue;
+
+			bool found = false;
+			for( u32 j = 0; j < num_tasks; j++ ) {
+				if( StrEqual( tasks[ j ].config.name, dependency ) ) {
+					task->dependencies[ task->num_dependencies ] = j;
+					task->num_dependencies++;
+					found = true;
+					break;
+				}
+			}
+
+			if( !found ) {
+				Fatal( "Startup task %s depends on %s, which doesn't exist", task->config.name, dependency );
+			}
+		}
+	}
+}
+
+static void PrintStartupReport( u64 start_time, u64 end_time ) {
+	Com_GGPrint( "Startup took {.2}ms:", ( end_time - start_time ) / 1000.0f );
+
+	for( u32 i = 0; i < num_tasks; i++ ) {
+		const StartupTask * task = &tasks[ i ];
+		float started = ( task->kick_time - start_time ) / 1000.0f;
+		float cpu = ( task->cpu_done_time - task->kick_time ) / 1000.0f;
+		float main_thread = ( task->finish_time - Max2( task->cpu_done_time, task->kick_time ) ) / 1000.0f;
+		float finished = ( task->finish_time - start_time ) / 1000.0f;
+		Com_GGPrint( "    {-16} started at {.2}ms, {.2}ms on the thread pool, {.2}ms on the main thread, done at {.2}ms",
+			task->config.name, started, cpu, main_thread, finished );
+	}
+}
+
+void RunStartupTasks() {
+	TracyZoneScoped;
+
+	u64 start_time = Sys_Microseconds();
+
+	startup_mutex = NewMutex();
+	startup_sem = NewSemaphore();
+
+	ResolveDependencies();
+
+	u32 num_finished = 0;
+	while( num_finished < num_tasks ) {
+		bool progress = false;
+		bool anything_running = false;
+
+		for( u32 i = 0; i < num_tasks; i++ ) {
+			StartupTask * task = &tasks[ i ];
+			if( task->finished )
+				continue;
+
+			if( !task->kicked ) {
+				if( !DependenciesFinished( task ) )
+					continue;
+				KickStartupTask( task );
+				progress = true;
+			}
+
+			Lock( startup_mutex );
+			bool cpu_done = task->jobs_pending == 0;
+			Unlock( startup_mutex );
+
+			if( !cpu_done ) {
+				anything_running = true;
+				continue;
+			}
+
+			if( task->config.finish != NULL ) {
+				TracyZoneScopedN( "Finish startup task" );
+				TracyZoneText( task->config.name, strlen( task->config.name ) );
+				task->config.finish();
+			}
+
+			task->finished = true;
+			task->finish_time = Sys_Microseconds();
+			num_finished++;
+			progress = true;
+		}
+
+		if( progress )
+			continue;
+
+		if( !anything_running ) {
+			Fatal( "Startup tasks have a dependency cycle" );
+		}
+
+		Wait( startup_sem );
+	}
+
+	DeleteSemaphore( startup_sem );
+	DeleteMutex( startup_mutex );
+
+	PrintStartupReport( start_time, Sys_Microseconds() );
+
+	num_tasks = 0;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "qcommon/types.h"
+#include "client/threadpool.h"
+
+struct StartupTask;
+
+// tasks get kicked on the main thread once their dependencies are done, and
+// can queue CPU work on the thread pool with StartupTaskDo. finish runs on
+// the main thread after all of that work is done, so it can talk to GL/AL
+struct StartupTaskConfig {
+	const char * name = NULL;
+	const char * dependencies[ 4 ] = { };
+
+	// assets with these extensions get decompressed on the thread pool
+	// before the task finishes
+	const char * asset_extensions[ 4 ] = { };
+
+	void ( *kick )( StartupTask * task ) = NULL;
+	void ( *finish )() = NULL;
+};
+
+void AddStartupTask( const StartupTaskConfig & config );
+void RunStartupTasks();
+
+void StartupTaskDo( StartupTask * task, JobCallback callback, void * data = NULL );
+void StartupTaskParallelFor( StartupTask * task, void * datum, size_t n, size_t stride, JobCallback callback );
+
+template< typename T >
+void StartupTaskParallelFor( StartupTask * task, Span< T > datum, JobCallback callback ) {
+	StartupTaskParallelFor( task, datum.ptr, datum.n, sizeof( T ), callback );
+}
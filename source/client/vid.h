@@ -25,9 +25,20 @@ bool operator!=( WindowMode lhs, WindowMode rhs );
 
 void VID_Init();
 
+bool IsHeadless();
+
 void CreateWindow( WindowMode mode );
 void DestroyWindow();
 
+// a hidden context that shares objects with the window's, so startup can
+// create GL resources on the thread pool. MakeLoaderContextCurrent returns
+// false if there isn't one, e.g. when running headless. only one thread can
+// use it at a time
+bool MakeLoaderContextCurrent();
+void ReleaseLoaderContext();
+void DestroyLoaderContext();
+
+void PollWindowEvents();
 void GlfwInputFrame();
 void SwapBuffers();
 
@@ -1,5 +1,8 @@
 #include "qcommon/base.h"
 #include "qcommon/qcommon.h"
+#include "qcommon/array.h"
+#include "qcommon/compression.h"
+#include "qcommon/hash.h"
 
 #include "zstd/zstd.h"
 
@@ -34,3 +37,117 @@ bool Decompress( const char * name, Allocator * a, Span< const u8 > compressed,
 
 	return true;
 }
+
+struct DecompressionStream {
+	Allocator * a;
+	char * name;
+	ZSTD_DStream * zstd;
+	NonRAIIDynamicArray< u8 > decompressed;
+	size_t max_size;
+	size_t content_size;
+	u32 checksum;
+	bool frame_done;
+	bool failed;
+};
+
+DecompressionStream * NewDecompressionStream( Allocator * a, const char * name, size_t max_size ) {
+	ZSTD_DStream * zstd = ZSTD_createDStream();
+	if( zstd == NULL ) {
+		Fatal( "ZSTD_createDStream" );
+	}
+
+	DecompressionStream * stream = ALLOC( a, DecompressionStream );
+	stream->a = a;
+	stream->name = CopyString( a, name );
+	stream->zstd = zstd;
+	stream->decompressed.init( a );
+	stream->max_size = max_size;
+	stream->content_size = 0;
+	stream->checksum = Hash32( NULL, 0 );
+	stream->frame_done = false;
+	stream->failed = false;
+
+	return stream;
+}
+
+void DeleteDecompressionStream( DecompressionStream * stream ) {
+	if( stream == NULL )
+		return;
+
+	ZSTD_freeDStream( stream->zstd );
+	stream->decompressed.shutdown();
+	FREE( stream->a, stream->name );
+	FREE( stream->a, stream );
+}
+
+static bool FailDecompressionStream( DecompressionStream * stream, const char * reason ) {
+	Com_Printf( S_COLOR_RED "Can't decompress %s: %s\n", stream->name, reason );
+	stream->failed = true;
+	return false;
+}
+
+bool DecompressStreamChunk( DecompressionStream * stream, Span< const u8 > compressed ) {
+	TracyZoneScoped;
+
+	if( stream->failed )
+		return false;
+
+	if( stream->frame_done ) {
+		return compressed.n == 0 || FailDecompressionStream( stream, "trailing data" );
+	}
+
+	// reserve the whole output up front if the header tells us how big it is
+	if( stream->decompressed.size() == 0 && stream->content_size == 0 ) {
+		unsigned long long content_size = ZSTD_getFrameContentSize( compressed.ptr, compressed.n );
+		if( content_size != ZSTD_CONTENTSIZE_ERROR && content_size != ZSTD_CONTENTSIZE_UNKNOWN ) {
+			if( content_size > stream->max_size ) {
+				return FailDecompressionStream( stream, "too big" );
+			}
+			stream->content_size = content_size;
+		}
+	}
+
+	ZSTD_inBuffer in = { compressed.ptr, compressed.n, 0 };
+	while( true ) {
+		size_t old_size = stream->decompressed.size();
+		size_t out_size = stream->content_size > old_size ? stream->content_size - old_size : ZSTD_DStreamOutSize();
+		stream->decompressed.extend( out_size );
+
+		ZSTD_outBuffer out = { stream->decompressed.ptr() + old_size, out_size, 0 };
+		size_t r = ZSTD_decompressStream( stream->zstd, &out, &in );
+		stream->decompressed.resize( old_size + out.pos );
+		stream->checksum = Hash32( stream->decompressed.ptr() + old_size, out.pos, stream->checksum );
+
+		if( ZSTD_isError( r ) ) {
+			return FailDecompressionStream( stream, ZSTD_getErrorName( r ) );
+		}
+
+		if( stream->decompressed.size() > stream->max_size ) {
+			return FailDecompressionStream( stream, "too big" );
+		}
+
+		if( r == 0 ) {
+			stream->frame_done = true;
+			return in.pos == in.size || FailDecompressionStream( stream, "trailing data" );
+		}
+
+		// a full output buffer means zstd might still be holding on to some data
+		if( in.pos == in.size && out.pos < out.size )
+			break;
+	}
+
+	return true;
+}
+
+bool FinishDecompressionStream( DecompressionStream * stream, Span< const u8 > * decompressed, u32 * checksum ) {
+	if( stream->failed )
+		return false;
+
+	if( !stream->frame_done ) {
+		return FailDecompressionStream( stream, "truncated" );
+	}
+
+	*decompressed = stream->decompressed.span();
+	*checksum = stream->checksum;
+	return true;
+}
@@ -3,3 +3,14 @@
 #include "qcommon/types.h"
 
 bool Decompress( const char * name, Allocator * a, Span< const u8 > compressed, Span< u8 > * decompressed );
+
+// for data that arrives in pieces, e.g. downloads. zstd only verifies frames
+// that were compressed with a checksum, so the stream also keeps a running
+// Hash32 of everything it decompresses for callers to check
+struct DecompressionStream;
+
+DecompressionStream * NewDecompressionStream( Allocator * a, const char * name, size_t max_size );
+void DeleteDecompressionStream( DecompressionStream * stream );
+
+bool DecompressStreamChunk( DecompressionStream * stream, Span< const u8 > compressed );
+bool FinishDecompressionStream( DecompressionStream * stream, Span< const u8 > * decompressed, u32 * checksum );
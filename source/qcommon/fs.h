@@ -25,10 +25,18 @@ bool Seek( FILE * file, size_t cursor );
 size_t FileSize( FILE * file );
 
 bool FileExists( Allocator * temp, const char * path );
+bool CreatePathForFile( Allocator * a, const char * path );
 bool WriteFile( TempAllocator * temp, const char * path, const void * data, size_t len );
 bool MoveFile( Allocator * a, const char * old_path, const char * new_path, MoveFileReplace replace );
 bool RemoveFile( Allocator * a, const char * path );
 
+struct FileMetadata {
+	u64 size;
+	s64 modified_time; // seconds since the unix epoch
+};
+
+bool GetFileMetadata( Allocator * a, const char * path, FileMetadata * metadata );
+
 struct ListDirHandle {
 	char impl[ 64 ];
 };
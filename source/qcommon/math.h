@@ -13,6 +13,7 @@ extern "C" float sqrtf( float );
 extern "C" float cbrtf( float );
 extern "C" float powf( float, float );
 extern "C" float logf( float );
+extern "C" float log2f( float );
 extern "C" float fmodf( float, float );
 extern "C" double fmod( double, double );
 extern "C" float floorf( float );
@@ -19,6 +19,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "server/server.h"
+#include "qcommon/cmodel.h"
 #include "qcommon/version.h"
 
 //============================================================================
@@ -315,7 +316,7 @@ static void SV_Baselines_f( client_t *client ) {
 
 	// send next command
 	if( start == MAX_EDICTS ) {
-		SV_SendServerCommand( client, "precache %i \"%s\"", svs.spawncount, sv.mapname );
+		SV_SendServerCommand( client, "precache %i \"%s\" %u", svs.spawncount, sv.mapname, svs.cms->checksum );
 	} else {
 		SV_SendServerCommand( client, "cmd baselines %i %i", svs.spawncount, start );
 	}
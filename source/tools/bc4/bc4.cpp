@@ -1,10 +1,13 @@
 #include "qcommon/base.h"
+#include "qcommon/array.h"
 #include "qcommon/fs.h"
+#include "qcommon/hash.h"
 #include "qcommon/span2d.h"
 #include "qcommon/string.h"
+#include "qcommon/threads.h"
+#include "client/renderer/bc4.h"
 #include "client/renderer/dds.h"
 
-#include "rgbcx/rgbcx.h"
 #include "stb/stb_image.h"
 #include "stb/stb_image_resize.h"
 
@@ -12,6 +15,12 @@ void ShowErrorMessage( const char * msg, const char * file, int line ) {
 	printf( "%s (%s:%d)\n", msg, file, line );
 }
 
+enum EncodeResult {
+	EncodeResult_Encoded,
+	EncodeResult_UpToDate,
+	EncodeResult_Failed,
+};
+
 static u32 BlockFormatMipLevels( u32 w, u32 h ) {
 	u32 dim = Min2( w, h );
 	u32 levels = 0;
@@ -34,49 +43,88 @@ static u32 MipSize( u32 w, u32 h, u32 level ) {
 	return w * h;
 }
 
-int main( int argc, char ** argv ) {
-	if( argc != 2 ) {
-		printf( "Usage: bc4 <single channel image.png>\n" );
-		return 1;
+static Span< u8 > ReadWholeFile( const char * path ) {
+	FILE * file = OpenFile( sys_allocator, path, "rb" );
+	if( file == NULL )
+		return Span< u8 >();
+	defer { fclose( file ); };
+
+	fseek( file, 0, SEEK_END );
+	size_t size = ftell( file );
+	fseek( file, 0, SEEK_SET );
+
+	Span< u8 > contents = ALLOC_SPAN( sys_allocator, u8, size );
+	if( fread( contents.ptr, 1, size, file ) != size ) {
+		FREE( sys_allocator, contents.ptr );
+		return Span< u8 >();
 	}
 
+	return contents;
+}
+
+// the dds remembers the hash of the image it was made from, so we can skip
+// images that haven't changed since the last run
+static bool UpToDate( const char * dds_path, u64 source_hash ) {
+	FILE * dds = OpenFile( sys_allocator, dds_path, "rb" );
+	if( dds == NULL )
+		return false;
+	defer { fclose( dds ); };
+
+	DDSHeader header;
+	if( fread( &header, sizeof( header ), 1, dds ) != 1 )
+		return false;
+
+	return header.magic == DDSMagic && header.source_hash == source_hash;
+}
+
+static EncodeResult EncodeImage( const char * path, bool force ) {
+	Span< u8 > contents = ReadWholeFile( path );
+	if( contents.ptr == NULL ) {
+		printf( "Can't read %s\n", path );
+		return EncodeResult_Failed;
+	}
+	defer { FREE( sys_allocator, contents.ptr ); };
+
+	DynamicString dds_path( sys_allocator, "{}.dds", path );
+
+	// mix the encoder versions in so encoder changes rebuild everything. the
+	// HQ encoder uses the fast one for flat blocks so it needs both
+	u32 versions[] = { BC4_ENCODER_VERSION, BC4_HQ_ENCODER_VERSION };
+	u64 source_hash = Hash64( contents.ptr, contents.n, Hash64( versions, sizeof( versions ) ) );
+	if( !force && UpToDate( dds_path.c_str(), source_hash ) )
+		return EncodeResult_UpToDate;
+
 	int w, h, comp;
-	u8 * pixels = stbi_load( argv[ 1 ], &w, &h, &comp, 1 );
+	u8 * pixels = stbi_load_from_memory( contents.ptr, contents.n, &w, &h, &comp, 1 );
 	if( pixels == NULL ) {
-		printf( "Can't load image: %s\n", stbi_failure_reason() );
-		return 1;
+		printf( "Can't load %s: %s\n", path, stbi_failure_reason() );
+		return EncodeResult_Failed;
 	}
 	defer { stbi_image_free( pixels ); };
 
-	bool generate_mipmaps = IsPowerOf2( w ) && IsPowerOf2( h );
-	if( !generate_mipmaps ) {
-		printf( "Image isn't pow2 sized so we aren't computing mipmaps: %s\n", argv[ 1 ] );
+	if( comp != 1 ) {
+		printf( "Image must be single channel: %s\n", path );
+		return EncodeResult_Failed;
 	}
 
-	if( comp != 1 ) {
-		printf( "Image must be single channel\n" );
-		return 1;
+	bool generate_mipmaps = IsPowerOf2( w ) && IsPowerOf2( h );
+	if( !generate_mipmaps ) {
+		printf( "Image isn't pow2 sized so we aren't computing mipmaps: %s\n", path );
 	}
 
 	u32 num_levels = generate_mipmaps ? BlockFormatMipLevels( w, h ) : 1;
-	u32 total_size = 0;
+	u32 total_blocks = 0;
 	for( u32 i = 0; i < num_levels; i++ ) {
-		total_size += MipSize( w, h, i );
+		total_blocks += MipSize( w / 4, h / 4, i );
 	}
 
-	constexpr u32 BC4BitsPerPixel = 4;
-	constexpr u32 BC4BlockSize = ( 4 * 4 * BC4BitsPerPixel ) / 8;
-
-	u32 bc4_bytes = ( total_size * BC4BitsPerPixel ) / 8;
-	Span< u8 > bc4 = ALLOC_SPAN( sys_allocator, u8, bc4_bytes );
-	u32 bc4_cursor = 0;
-
+	Span< BC4Block > bc4 = ALLOC_SPAN( sys_allocator, BC4Block, total_blocks );
 	u8 * resized = ALLOC_MANY( sys_allocator, u8, w * h );
 
 	defer { FREE( sys_allocator, bc4.ptr ); };
 	defer { FREE( sys_allocator, resized ); };
 
-	rgbcx::init();
+	Span< BC4Block > cursor = bc4;
 
 	for( u32 i = 0; i < num_levels; i++ ) {
 		u32 mip_w, mip_h;
@@ -90,44 +138,143 @@ int main( int argc, char ** argv ) {
 
 		if( ok == 0 ) {
 			printf( "stb_image_resize died lol\n" );
-			return 1;
+			return EncodeResult_Failed;
 		}
 
 		Span2D< const u8 > mip = Span2D< u8 >( resized, mip_w, mip_h );
-
-		for( u32 row = 0; row < mip_h / 4; row++ ) {
-			for( u32 col = 0; col < mip_w / 4; col++ ) {
-				Span2D< const u8 > src = mip.slice( col * 4, row * 4, 4, 4 );
-				u8 src_block[ 16 ];
-				CopySpan2D( Span2D< u8 >( src_block, 4, 4 ), src );
-
-				Span< u8 > dst = bc4.slice( bc4_cursor, bc4_cursor + BC4BlockSize );
-				rgbcx::encode_bc4( dst.ptr, src_block, 1 );
-				bc4_cursor += BC4BlockSize;
-			}
-		}
+		Span2D< BC4Block > mip_bc4( cursor.ptr, mip_w / 4, mip_h / 4 );
+		EncodeBC4RowsHQ( mip_bc4, mip, 0, mip_bc4.h );
+		cursor += mip_bc4.w * mip_bc4.h;
 	}
 
-	assert( bc4_cursor == bc4.num_bytes() );
+	assert( cursor.n == 0 );
 
 	DDSHeader dds_header = { };
 	dds_header.magic = DDSMagic;
 	dds_header.height = h;
 	dds_header.width = w;
 	dds_header.mipmap_count = num_levels;
+	dds_header.source_hash = source_hash;
 	dds_header.format = DDSTextureFormat_BC4;
 
-	DynamicString dds_path( sys_allocator, "{}.dds", argv[ 1 ] );
-
 	FILE * dds = OpenFile( sys_allocator, dds_path.c_str(), "wb" );
 	if( dds == NULL ) {
 		printf( "Can't open %s for writing\n", dds_path.c_str() );
-		return 1;
+		return EncodeResult_Failed;
 	}
 
 	fwrite( &dds_header, sizeof( dds_header ), 1, dds );
 	fwrite( bc4.ptr, sizeof( bc4[ 0 ] ), bc4.n, dds );
 	fclose( dds );
 
-	return 0;
+	printf( "%s\n", dds_path.c_str() );
+
+	return EncodeResult_Encoded;
+}
+
+static bool IsPNG( const char * path ) {
+	size_t len = strlen( path );
+	return len >= 4 && strcmp( path + len - 4, ".png" ) == 0;
+}
+
+static void FindImagesRecursive( DynamicArray< char * > * images, DynamicString * path ) {
+	ListDirHandle scan = BeginListDir( sys_allocator, path->c_str() );
+
+	const char * name;
+	bool dir;
+	while( ListDirNext( &scan, &name, &dir ) ) {
+		// skip ., .., .git, etc
+		if( name[ 0 ] == '.' )
+			continue;
+
+		size_t old_len = path->length();
+		path->append( "/{}", name );
+		if( dir ) {
+			FindImagesRecursive( images, path );
+		}
+		else if( IsPNG( name ) ) {
+			images->add( CopyString( sys_allocator, path->c_str() ) );
+		}
+		path->truncate( old_len );
+	}
+}
+
+struct EncodeQueue {
+	Mutex * mutex;
+	Span< char * > images;
+	size_t next;
+	bool force;
+	u32 results[ EncodeResult_Failed + 1 ];
+};
+
+static void EncodeWorker( void * data ) {
+	EncodeQueue * queue = ( EncodeQueue * ) data;
+
+	while( true ) {
+		Lock( queue->mutex );
+		if( queue->next == queue->images.n ) {
+			Unlock( queue->mutex );
+			break;
+		}
+		const char * path = queue->images[ queue->next ];
+		queue->next++;
+		Unlock( queue->mutex );
+
+		EncodeResult result = EncodeImage( path, queue->force );
+
+		Lock( queue->mutex );
+		queue->results[ result ]++;
+		Unlock( queue->mutex );
+	}
+}
+
+int main( int argc, char ** argv ) {
+	bool force = false;
+	DynamicArray< char * > images( sys_allocator );
+	defer {
+		for( char * image : images ) {
+			FREE( sys_allocator, image );
+		}
+	};
+
+	for( int i = 1; i < argc; i++ ) {
+		if( strcmp( argv[ i ], "-f" ) == 0 ) {
+			force = true;
+			continue;
+		}
+
+		if( IsPNG( argv[ i ] ) ) {
+			images.add( CopyString( sys_allocator, argv[ i ] ) );
+		}
+		else {
+			DynamicString path( sys_allocator, "{}", argv[ i ] );
+			FindImagesRecursive( &images, &path );
+		}
+	}
+
+	if( images.size() == 0 ) {
+		printf( "Usage: bc4 [-f] <single channel image.png or directory of them>...\n" );
+		printf( "Images that haven't changed since their .dds was written are skipped, -f encodes them anyway\n" );
+		return 1;
+	}
+
+	EncodeQueue queue = { };
+	queue.mutex = NewMutex();
+	queue.images = images.span();
+	queue.force = force;
+	defer { DeleteMutex( queue.mutex ); };
+
+	Thread * threads[ 64 ];
+	u32 num_threads = Min2( Min2( GetCoreCount(), u32( ARRAY_COUNT( threads ) ) ), u32( images.size() ) );
+	for( u32 i = 0; i < num_threads; i++ ) {
+		threads[ i ] = NewThread( EncodeWorker, &queue );
+	}
+	for( u32 i = 0; i < num_threads; i++ ) {
+		JoinThread( threads[ i ] );
+	}
+
+	printf( "%u encoded, %u up to date, %u failed\n",
+		queue.results[ EncodeResult_Encoded ], queue.results[ EncodeResult_UpToDate ], queue.results[ EncodeResult_Failed ] );
+
+	return queue.results[ EncodeResult_Failed ] == 0 ? 0 : 1;
 }
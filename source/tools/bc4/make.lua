@@ -13,6 +13,7 @@ local platform_srcs = OS == "windows" and windows_srcs or linux_srcs
 bin( "bc4", {
 	srcs = {
 		"source/tools/bc4/bc4.cpp",
+		"source/client/renderer/bc4.cpp",
 		"source/qcommon/allocators.cpp",
 		"source/qcommon/base.cpp",
 		"source/qcommon/hash.cpp",
@@ -21,7 +22,6 @@ bin( "bc4", {
 
 	libs = {
 		"ggformat",
-		"rgbcx",
 		"stb_image",
 		"stb_image_resize",
 		"tracy",
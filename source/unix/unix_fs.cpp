@@ -76,6 +76,17 @@ bool RemoveFile( Allocator * a, const char * path ) {
 	return unlink( path ) == 0;
 }
 
+bool GetFileMetadata( Allocator * a, const char * path, FileMetadata * metadata ) {
+	struct stat buf;
+	if( stat( path, &buf ) != 0 )
+		return false;
+
+	metadata->size = buf.st_size;
+	metadata->modified_time = buf.st_mtime;
+
+	return true;
+}
+
 bool CreateDirectory( Allocator * a, const char * path ) {
 	return mkdir( path, 0755 ) == 0 || errno == EEXIST;
 }
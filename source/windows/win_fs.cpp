@@ -106,6 +106,23 @@ bool RemoveFile( Allocator * a, const char * path ) {
 	return DeleteFileW( wide_path ) != 0;
 }
 
+bool GetFileMetadata( Allocator * a, const char * path, FileMetadata * metadata ) {
+	wchar_t * wide_path = UTF8ToWide( a, path );
+	defer { FREE( a, wide_path ); };
+
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if( GetFileAttributesExW( wide_path, GetFileExInfoStandard, &attributes ) == 0 )
+		return false;
+
+	// FILETIMEs count 100ns intervals since 1601
+	u64 modified_time = u64( attributes.ftLastWriteTime.dwHighDateTime ) << 32 | attributes.ftLastWriteTime.dwLowDateTime;
+
+	metadata->size = u64( attributes.nFileSizeHigh ) << 32 | attributes.nFileSizeLow;
+	metadata->modified_time = s64( modified_time / 10000000 ) - 11644473600;
+
+	return true;
+}
+
 #undef CreateDirectory
 bool CreateDirectory( Allocator * a, const char * path ) {
 	wchar_t * wide_path = UTF8ToWide( a, path );